@@ -0,0 +1,201 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Trains a zstd dictionary from a directory of sample files.
+
+    Install the dictionary on the sender and all receivers:
+
+        ./loraftp_dict samples/ telemetry.dict
+        sudo ./loraftp_get --dictionary telemetry.dict
+        sudo ./loraftp_send report.json --dictionary telemetry.dict
+
+    To show what the dictionary is worth, every 8th sample is held out of
+    training, and those are compressed with and without the dictionary the
+    way loraftp_send would.  The number of blocks each file takes to send
+    at the default radio profile is reported.
+*/
+
+#include "loraftp.hpp"
+using namespace lora;
+
+#include "zstd.h" // zstd_lib subproject
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <dirent.h> // opendir
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// Every Nth sample is held out of training to test the dictionary
+static const int kHoldOutInterval = 8;
+
+// Fewer samples than this are all used for training and testing
+static const int kMinHoldOutSamples = 2 * kHoldOutInterval;
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+struct SampleFile
+{
+    std::string Name;
+    std::vector<uint8_t> Data;
+};
+
+// Reads the regular files in a directory.  Returns false on error
+static bool ReadSamples(const char* dir_path, std::vector<SampleFile>& samples)
+{
+    DIR* dir = opendir(dir_path);
+    if (!dir) {
+        spdlog::error("Failed to open directory: {}", dir_path);
+        return false;
+    }
+
+    while (struct dirent* entry = readdir(dir))
+    {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        const std::string path = std::string(dir_path) + "/" + entry->d_name;
+
+        // Skips directories and empty files
+        MappedReadOnlySmallFile mmf;
+        if (!mmf.Read(path.c_str())) {
+            continue;
+        }
+
+        SampleFile sample;
+        sample.Name = entry->d_name;
+        sample.Data.assign(mmf.GetData(), mmf.GetData() + mmf.GetDataBytes());
+        samples.push_back(sample);
+    }
+
+    closedir(dir);
+    return true;
+}
+
+// Blocks loraftp_send takes to send the file: The compressed file name
+// header and data, plus one extra block
+static uint64_t GetSendBlocks(const SampleFile& sample, ZstdDictionary* dictionary)
+{
+    std::vector<uint8_t> data;
+    const size_t name_bytes = std::min<size_t>(sample.Name.size(), 255);
+    data.push_back((uint8_t)name_bytes);
+    data.insert(data.end(), sample.Name.begin(), sample.Name.begin() + name_bytes);
+    data.push_back(0);
+    data.insert(data.end(), sample.Data.begin(), sample.Data.end());
+
+    CompressionTarget target;
+    target.BlockHeaderBytes = kBlockHeaderBytes;
+
+    const CompressionPlan plan = PlanCompression(data.data(), data.size(), data.size(), target, dictionary);
+
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    std::vector<uint8_t> compressed(ZSTD_compressBound(data.size()));
+    size_t bytes = 0;
+    if (cctx && ApplyCompressionPlan(cctx, plan, dictionary)) {
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+        bytes = ZSTD_compress2(cctx, compressed.data(), compressed.size(), data.data(), data.size());
+    }
+    ZSTD_freeCCtx(cctx);
+
+    if (bytes == 0 || ZSTD_isError(bytes)) {
+        spdlog::error("Failed to compress sample: {}", sample.Name);
+        return 0;
+    }
+
+    const int block_bytes = RadioProfile().GetMaxSendBytes() - kBlockHeaderBytes;
+    return (bytes + block_bytes - 1) / block_bytes + 1;
+}
+
+
+//------------------------------------------------------------------------------
+// Entrypoint
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        spdlog::info("Usage: {} <sample directory> <dictionary file> [--size BYTES]", argv[0]);
+        spdlog::info("--size sets the largest dictionary size, default {}", kDefaultDictionaryBytes);
+        return -1;
+    }
+
+    const char* sample_dir = argv[1];
+    const char* dict_path = argv[2];
+
+    size_t dict_bytes = kDefaultDictionaryBytes;
+    for (int i = 3; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "--size") && i + 1 < argc) {
+            dict_bytes = (size_t)atoll(argv[++i]);
+            continue;
+        }
+        spdlog::error("Unknown argument: {}", argv[i]);
+        return -1;
+    }
+
+    std::vector<SampleFile> samples;
+    if (!ReadSamples(sample_dir, samples)) {
+        return -1;
+    }
+
+    const bool hold_out = samples.size() >= (size_t)kMinHoldOutSamples;
+
+    std::vector<std::vector<uint8_t>> training;
+    std::vector<const SampleFile*> testing;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        if (hold_out && i % kHoldOutInterval == 0) {
+            testing.push_back(&samples[i]);
+        } else {
+            training.push_back(samples[i].Data);
+            if (!hold_out) {
+                testing.push_back(&samples[i]);
+            }
+        }
+    }
+
+    spdlog::info("Training a dictionary of up to {} bytes from {} files...", dict_bytes, training.size());
+
+    std::vector<uint8_t> dict;
+    if (!TrainDictionary(training, dict_bytes, dict)) {
+        return -1;
+    }
+
+    auto dictionary = std::make_shared<ZstdDictionary>();
+    if (!dictionary->Set(dict.data(), dict.size())) {
+        spdlog::error("Trained dictionary is invalid");
+        return -1;
+    }
+
+    if (!WriteBufferToFile(dict_path, dict.data(), dict.size())) {
+        spdlog::error("Failed to write dictionary: {}", dict_path);
+        return -1;
+    }
+
+    spdlog::info("Wrote dictionary {} ({} bytes) to {}", dictionary->GetId(), dict.size(), dict_path);
+
+    uint64_t plain_blocks = 0, dict_blocks = 0;
+    for (const SampleFile* sample : testing) {
+        plain_blocks += GetSendBlocks(*sample, nullptr);
+        dict_blocks += GetSendBlocks(*sample, dictionary.get());
+    }
+
+    if (testing.empty() || plain_blocks == 0) {
+        return 0;
+    }
+
+    spdlog::info("{} {} files: {} blocks per file without the dictionary, {} with it ({}% fewer)",
+        testing.size(),
+        hold_out ? "held out" : "training",
+        plain_blocks / (float)testing.size(),
+        dict_blocks / (float)testing.size(),
+        100.f * (1.f - dict_blocks / (float)plain_blocks));
+
+    return 0;
+}
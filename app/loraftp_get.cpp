@@ -10,6 +10,7 @@ using namespace lora;
 
 #include <thread>
 #include <chrono>
+#include <cstring>
 using namespace std;
 
 
@@ -32,30 +33,61 @@ void SignalHandler(int)
 
 int main(int argc, char* argv[])
 {
-    (void)argc;
-    (void)argv;
-
     SetupAsyncDiskLog("getter.log", false/*enable debug logs?*/);
 
     spdlog::info("loraftp_get V{} starting...", kVersion);
 
+    // Files are written to the current directory by default
+    FileReceiverSettings settings;
+    settings.OutputDirectory = ".";
+
+    // Optional list of HATs to merge blocks from
+    std::vector<std::shared_ptr<IRadioLink>> links;
+    for (int i = 1; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "--output") && i + 1 < argc) {
+            settings.OutputDirectory = argv[++i];
+            continue;
+        }
+        if (0 == strcmp(argv[i], "--base-dir") && i + 1 < argc) {
+            settings.BaseDirectory = argv[++i];
+            continue;
+        }
+        if (0 == strcmp(argv[i], "--solve-threads") && i + 1 < argc) {
+            settings.SolveThreads = atoi(argv[++i]);
+            continue;
+        }
+        if (0 == strcmp(argv[i], "--dictionary") && i + 1 < argc) {
+            auto dictionary = std::make_shared<ZstdDictionary>();
+            if (!dictionary->Load(argv[++i])) {
+                return -1;
+            }
+            spdlog::info("Installed dictionary {}", dictionary->GetId());
+            settings.Dictionaries.push_back(dictionary);
+            continue;
+        }
+
+        auto link = OpenWaveshareLink(argv[i], false);
+        if (!link) {
+            spdlog::info("Usage: {} [--output DIR] [--dictionary FILE ...] [--base-dir DIR] [--solve-threads N] [serial_device:m0_pin:m1_pin:channel ...]", argv[0]);
+            return -1;
+        }
+        links.push_back(link);
+    }
+
     FileReceiver receiver;
     ScopedFunction client_scope([&]() {
         receiver.Shutdown();
     });
 
     if (!receiver.Initialize([&](float progress, const char* file_name, const void* file_data, int file_bytes) {
-        if (file_name && file_data) {
-            if (!WriteBufferToFile(file_name, file_data, file_bytes)) {
-                spdlog::error("Failed to write file: {} [{} bytes]", file_name, file_bytes);
-            } else {
-                spdlog::info("Completed file transfer: {} [{} bytes]", file_name, file_bytes);
-            }
+        (void)file_data; // Already written to the output directory
+        if (file_name) {
+            spdlog::info("Completed file transfer: {}/{} [{} bytes]", settings.OutputDirectory, file_name, file_bytes);
             Terminated = true;
         } else {
             spdlog::info("Progress: {}%", progress * 100.f);
         }
-    })) {
+    }, links, settings)) {
         spdlog::error("receiver.Initialize failed");
         return -1;
     }
@@ -68,5 +100,6 @@ int main(int argc, char* argv[])
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
 
+    spdlog::info("Receiver timing: {}", receiver.GetTimingStats().ToString());
     return 0;
 }
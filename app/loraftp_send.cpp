@@ -12,6 +12,8 @@ using namespace lora;
 
 #include <thread>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 using namespace std;
 
 
@@ -39,16 +41,83 @@ int main(int argc, char* argv[])
     spdlog::info("loraftp_send V{} starting...", kVersion);
 
     if (argc < 2) {
-        spdlog::info("Usage: {} <file to send>", argv[0]);
+        spdlog::info("Usage: {} <file to send> [--profile RATE:SIZE] [--loss RATE:SIZE:LOSS ...] [--frame-version 1|2] [--generation-blocks N] [--compression-level N] [--dictionary FILE] [--base FILE] [--solve-threads N] [serial_device:m0_pin:m1_pin:channel ...]", argv[0]);
+        spdlog::info("With several HATs listed, blocks are striped across all of them");
+        spdlog::info("--profile sets the air rate (bps) and packet size (bytes), default {}", RadioProfile().ToString());
+        spdlog::info("--loss passes in loss rates measured by loraftp_get, and the best profile is used");
+        spdlog::info("--frame-version 1 sends to receivers from before version 2 frames");
+        spdlog::info("--generation-blocks splits larger files into generations of N blocks, default {}", kDefaultGenerationBlocks);
+        spdlog::info("--compression-level sets the zstd level, by default it is picked to send the file in the least time");
+        spdlog::info("--dictionary compresses with a dictionary from loraftp_dict, which receivers must also have");
+        spdlog::info("--base sends only the changes from an earlier version of the file that receivers already have");
+        spdlog::info("--solve-threads sets the threads for each Wirehair solve, default 1");
         return -1;
     }
 
     const char* file_name = argv[1];
 
-    MappedReadOnlySmallFile mmf;
-    if (!mmf.Read(file_name)) {
-        spdlog::error("Failed to open file: {}", file_name);
-        return false;
+    FileSenderSettings settings;
+    std::vector<ProfileLoss> measurements;
+
+    std::vector<std::shared_ptr<IRadioLink>> links;
+    for (int i = 2; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "--profile") && i + 1 < argc) {
+            if (!settings.Profile.FromString(argv[++i])) {
+                spdlog::error("Unsupported profile: {}", argv[i]);
+                return -1;
+            }
+            continue;
+        }
+        if (0 == strcmp(argv[i], "--frame-version") && i + 1 < argc) {
+            settings.FrameVersion = atoi(argv[++i]);
+            continue;
+        }
+        if (0 == strcmp(argv[i], "--generation-blocks") && i + 1 < argc) {
+            settings.GenerationBlocks = atoi(argv[++i]);
+            continue;
+        }
+        if (0 == strcmp(argv[i], "--compression-level") && i + 1 < argc) {
+            settings.CompressionLevel = atoi(argv[++i]);
+            continue;
+        }
+        if (0 == strcmp(argv[i], "--dictionary") && i + 1 < argc) {
+            settings.Dictionary = std::make_shared<ZstdDictionary>();
+            if (!settings.Dictionary->Load(argv[++i])) {
+                return -1;
+            }
+            continue;
+        }
+        if (0 == strcmp(argv[i], "--base") && i + 1 < argc) {
+            settings.BaseFile = argv[++i];
+            continue;
+        }
+        if (0 == strcmp(argv[i], "--solve-threads") && i + 1 < argc) {
+            settings.SolveThreads = atoi(argv[++i]);
+            continue;
+        }
+        if (0 == strcmp(argv[i], "--loss") && i + 1 < argc) {
+            const std::string arg = argv[++i];
+            const size_t colon = arg.rfind(':');
+            ProfileLoss measurement;
+            if (colon == std::string::npos || !measurement.Profile.FromString(arg.substr(0, colon))) {
+                spdlog::error("Expected --loss RATE:SIZE:LOSS, got: {}", arg);
+                return -1;
+            }
+            measurement.LossRate = (float)atof(arg.substr(colon + 1).c_str());
+            measurements.push_back(measurement);
+            continue;
+        }
+
+        auto link = OpenWaveshareLink(argv[i], true);
+        if (!link) {
+            return -1;
+        }
+        links.push_back(link);
+    }
+
+    if (!measurements.empty()) {
+        settings.Profile = SelectRadioProfile(measurements, kBlockHeaderBytes);
+        spdlog::info("Selected radio profile {} from {} measurements", settings.Profile.ToString(), measurements.size());
     }
 
     FileSender sender;
@@ -56,7 +125,7 @@ int main(int argc, char* argv[])
         sender.Shutdown();
     });
 
-    if (!sender.Initialize(file_name, mmf.GetData(), mmf.GetDataBytes())) {
+    if (!sender.InitializeFromFile(file_name, links, settings)) {
         spdlog::error("sender.Initialize failed");
         return -1;
     }
@@ -67,5 +136,6 @@ int main(int argc, char* argv[])
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
 
+    spdlog::info("Sender timing: {}", sender.GetTimingStats().ToString());
     return 0;
 }
@@ -0,0 +1,127 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Picks how hard to compress a file before sending it
+
+    Every byte saved is airtime saved, and at LoRa air rates airtime costs
+    far more than CPU time, so the fastest zstd level is rarely the best.
+    The planner compresses a sample of the file at several levels, predicts
+    the compression time and compressed size for the whole file, and picks
+    the settings with the shortest total time until the file is on the air:
+
+        compression time (spread over the sender's cores)
+        + airtime for the compressed blocks (spread over the links)
+
+    Files that do not compress are stored instead.
+*/
+
+#pragma once
+
+#include "radio_link.hpp"
+
+#include <string>
+#include <vector>
+
+struct ZSTD_CCtx_s; // zstd.h
+
+namespace lora {
+
+class ZstdDictionary; // zstd_dictionary.hpp
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// Largest window used with long distance matching.  Receivers decode windows
+// up to this size without setting ZSTD_d_windowLogMax
+static const int kMaxLongWindowLog = 27;
+
+
+//------------------------------------------------------------------------------
+// CompressionPlan
+
+struct CompressionPlan
+{
+    // zstd compression level.  Stored files use the fastest (negative) level,
+    // which leaves data that does not compress in raw zstd blocks
+    int Level = 1;
+    bool Stored = false;
+
+    // zstd worker threads, or 0 to compress on the calling thread
+    int Workers = 0;
+
+    // Window for long distance matching, or 0 to use the level's window
+    int LongWindowLog = 0;
+
+    // Predicted for the whole file
+    uint64_t CompressedBytes = 0;
+    uint64_t CompressUsec = 0;
+    uint64_t AirtimeUsec = 0;
+
+    uint64_t GetTotalUsec() const
+    {
+        return CompressUsec + AirtimeUsec;
+    }
+
+    // For example "level 19, 4 workers, long window 2^27"
+    std::string ToString() const;
+};
+
+// How the compressed file will be sent
+struct CompressionTarget
+{
+    RadioProfile Profile;
+    int FrameVersion = kFrameVersion2;
+
+    // Protocol header in front of each block
+    int BlockHeaderBytes = 0;
+
+    // Blocks are striped across this many radios
+    int LinkCount = 1;
+
+    // Cores available for compression, or 0 for all of them
+    int Cores = 0;
+};
+
+// Smallest zstd window log that covers this many bytes
+int GetWindowLog(uint64_t bytes);
+
+// Part of the file to pass to PlanCompression()
+struct SampleRange
+{
+    uint64_t Offset = 0;
+    uint32_t Bytes = 0;
+};
+
+// Returns the parts of a file of this size to sample, spread evenly through
+// the file.  Small files are sampled whole
+std::vector<SampleRange> GetCompressionSampleRanges(uint64_t file_bytes);
+
+/*
+    Picks the compression settings with the shortest predicted time to send
+    a file of file_bytes.  The sample is the ranges from
+    GetCompressionSampleRanges() placed one after another.
+
+    Taking the sample costs about as much as compressing it once at each
+    level tried.  Higher levels are only tried while their compression time
+    alone is shorter than the best total so far.
+
+    If the file will be compressed with a dictionary, pass it in so the
+    sample is compressed with it too.
+*/
+CompressionPlan PlanCompression(
+    const uint8_t* sample,
+    size_t sample_bytes,
+    uint64_t file_bytes,
+    const CompressionTarget& target,
+    ZstdDictionary* dictionary = nullptr);
+
+// Plan for a fixed level on the calling thread, without a prediction
+CompressionPlan GetFixedCompressionPlan(int level);
+
+// Sets the compression parameters and optional dictionary on a context.
+// Returns false on failure
+bool ApplyCompressionPlan(ZSTD_CCtx_s* cctx, const CompressionPlan& plan, ZstdDictionary* dictionary = nullptr);
+
+
+} // namespace lora
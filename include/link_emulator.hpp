@@ -0,0 +1,233 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    In-process lossy radio channel emulator
+
+    LinkEmulator: Shared radio spectrum that models airtime and loss.
+    EmulatedLink: IRadioLink endpoint attached to a LinkEmulator.
+
+    Frames are sent through the channel as raw bytes and received through the
+    same FrameParser as the hardware, so corruption and truncation exercise
+    the real CRC checks.  Like the HAT, the receiving radio appends an RSSI
+    byte to each frame.
+*/
+
+#pragma once
+
+#include "radio_link.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace lora {
+
+
+//------------------------------------------------------------------------------
+// LinkEmulatorSettings
+
+struct LinkEmulatorSettings
+{
+    // Matches the Waveshare HAT
+    int RadioBufferBytes = 1000;
+
+    // Independent (Bernoulli) frame loss probability
+    float LossRate = 0.f;
+
+    /*
+        Gilbert-Elliott burst loss model, used if GoodToBadRate > 0.
+        Each frame the channel moves between the good and bad states with
+        these probabilities, and frames are lost with the state's loss rate.
+    */
+    float GoodToBadRate = 0.f;
+    float BadToGoodRate = 0.f;
+    float GoodLossRate = 0.f;
+    float BadLossRate = 1.f;
+
+    // Probability of each byte being corrupted
+    float ByteErrorRate = 0.f;
+
+    // Probability of a frame being cut short at a random byte
+    float TruncationRate = 0.f;
+
+    // Number of channels.  Radios only hear others on the same channel.
+    int ChannelCount = 84;
+
+    // Ambient noise reported for each channel, or empty for no scan results
+    std::vector<float> ChannelNoiseDbm;
+
+    // Frames are also lost with probability (noise - NoiseFloorDbm) *
+    // LossPerNoiseDb for the channel they are sent on, limited to 0..1
+    float NoiseFloorDbm = -100.f;
+    float LossPerNoiseDb = 0.f;
+
+    // RSSI the receiving radio appends to each frame, like the HAT does.
+    // Each frame varies uniformly by up to SignalJitterDb either way.
+    int SignalDbm = -70;
+    int SignalJitterDb = 3;
+
+    // Optional frame loss probability for the sender's radio profile,
+    // for example to model a long link that only low air rates cross
+    std::function<float(const RadioProfile& profile)> ProfileLossRate;
+
+    uint32_t Seed = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// LinkEmulatorStats
+
+struct LinkEmulatorStats
+{
+    uint64_t SentFrames = 0;
+    uint64_t LostFrames = 0;
+    uint64_t CorruptedFrames = 0;
+    uint64_t TruncatedFrames = 0;
+
+    // Frames dropped because the sender overran the radio buffer
+    uint64_t OverrunFrames = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// EmulatedLink
+
+class LinkEmulator;
+
+class EmulatedLink : public IRadioLink
+{
+    friend class LinkEmulator;
+
+public:
+    ~EmulatedLink()
+    {
+        Shutdown();
+    }
+
+    void Shutdown() override;
+
+    bool Send(const uint8_t* data, int bytes) override;
+    bool SendFrame(const uint8_t* frame, int frame_bytes) override;
+
+    int GetSendQueueBytes() override
+    {
+        return 0; // No UART between us and the emulated radio
+    }
+
+    bool Receive(const OnFrame& callback, int timeout_msec) override;
+
+    void Interrupt() override;
+
+    RadioProfile GetRadioProfile() const override;
+
+    bool SetRadioProfile(const RadioProfile& profile) override;
+
+    int GetRadioBufferBytes() const override;
+
+    int GetFrameVersion() const override
+    {
+        return FrameVersion;
+    }
+    bool SetFrameVersion(int frame_version) override
+    {
+        if (frame_version != kFrameVersion1 && frame_version != kFrameVersion2) {
+            return false;
+        }
+        FrameVersion = frame_version;
+        return true;
+    }
+
+
+    int GetChannelCount() const override;
+
+    int GetChannel() const override
+    {
+        return Channel;
+    }
+
+    bool SetChannel(int channel) override;
+
+    bool GetChannelNoise(std::vector<float>& noise_dbm) override;
+
+    LinkQuality& GetLinkQuality() override
+    {
+        return Quality;
+    }
+
+protected:
+    std::shared_ptr<LinkEmulator> Emulator;
+
+    std::atomic<int> Channel = ATOMIC_VAR_INIT(0);
+
+    // Protected by Emulator->Lock.  Radios only hear others at the same air rate
+    RadioProfile Profile;
+
+    // Used by Send()
+    int FrameVersion = kFrameVersion2;
+
+    // Modeled time when this radio finishes sending everything queued
+    uint64_t AirBusyUntilUsec = 0;
+
+    struct Delivery
+    {
+        uint64_t DeliverUsec;
+        std::vector<uint8_t> Bytes;
+    };
+
+    std::mutex Lock;
+    std::condition_variable Condition;
+    std::deque<Delivery> Inbox;
+    bool Interrupted = false;
+
+    FrameParser Parser;
+    LinkQuality Quality;
+
+    void Deliver(uint64_t deliver_usec, std::vector<uint8_t>&& bytes);
+};
+
+
+//------------------------------------------------------------------------------
+// LinkEmulator
+
+class LinkEmulator : public std::enable_shared_from_this<LinkEmulator>
+{
+    friend class EmulatedLink;
+
+public:
+    void Initialize(const LinkEmulatorSettings& settings);
+
+    // Returns a new radio tuned to the given channel, or nullptr on failure
+    std::shared_ptr<EmulatedLink> CreateLink(int channel = 0);
+
+    LinkEmulatorStats GetStats();
+
+    const LinkEmulatorSettings& GetSettings() const
+    {
+        return Settings;
+    }
+
+protected:
+    LinkEmulatorSettings Settings;
+
+    std::mutex Lock;
+    std::vector<std::weak_ptr<EmulatedLink>> Links;
+    std::mt19937 Prng;
+    bool BadState = false;
+    LinkEmulatorStats Stats;
+
+    // Applies impairments and delivers the frame to every other link
+    void Transmit(EmulatedLink* sender, uint64_t deliver_usec, const uint8_t* frame, int frame_bytes);
+
+    // Returns true with the given probability
+    bool Chance(float probability);
+
+    // Probability of losing a frame to the noise on the channel
+    float GetNoiseLossRate(int channel) const;
+};
+
+
+} // namespace lora
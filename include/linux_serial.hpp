@@ -4,6 +4,7 @@
     Serial port library for Linux
 
     RawSerialPort: Binary interface to serial connected devices.
+    SerialReactor: Blocks until a serial port is readable, or until woken.
 */
 
 #pragma once
@@ -35,8 +36,18 @@ public:
     bool Initialize(const char* port_file, int baudrate);
     void Shutdown();
 
+    // Discards all unsent and unread data
     void Flush();
 
+    // Blocks until all queued data has been sent.
+    // Returns true for success and false for failure.
+    bool Drain();
+
+    // Changes the baudrate without closing the port.
+    // Queued data is sent at the old baudrate first.
+    // Returns true for success and false for failure.
+    bool SetBaudrate(int baudrate);
+
     // Returns number of bytes in send queue
     int GetSendQueueBytes();
 
@@ -51,9 +62,49 @@ public:
     // Returns -1 on error.
     int Read(void* data, int bytes);
 
+    // Returns the file descriptor, or -1 if the port is not open.
+    int GetFd() const
+    {
+        return fd;
+    }
+
 protected:
     int fd = -1;
 };
 
 
+//------------------------------------------------------------------------------
+// SerialReactor
+
+/*
+    Instead of polling GetAvailable() on a timer, this waits in poll() on the
+    serial port and on an eventfd.  The eventfd lets another thread wake up the
+    waiting thread immediately, for example during shutdown.
+*/
+class SerialReactor
+{
+public:
+    ~SerialReactor()
+    {
+        Shutdown();
+    }
+
+    // Returns true for success and false for failure.
+    bool Initialize();
+    void Shutdown();
+
+    // Blocks until the port has data to read, Wake() is called,
+    // or timeout_msec elapses.
+    // Returns 1 if data is available, 0 on timeout or wake.
+    // Returns -1 on error.
+    int Wait(const RawSerialPort& port, int timeout_msec);
+
+    // Wakes up a thread blocked in Wait().  Safe to call from any thread.
+    void Wake();
+
+protected:
+    int WakeFd = -1;
+};
+
+
 } // namespace lora
@@ -3,30 +3,155 @@
 #pragma once
 
 #include "waveshare.hpp"
+#include "compression_planner.hpp"
+#include "zstd_dictionary.hpp"
 #include "Counter.h"
 
 #include "wirehair.h" // wirehair subproject
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <vector>
 
+struct ZSTD_CCtx_s; // zstd.h
+struct ZSTD_DCtx_s;
+
 namespace lora {
 
 
 //------------------------------------------------------------------------------
 // Constants
 
-// Block size for error correction code
-static const int kFileBlockBytes = kPacketMaxBytes - 1; // 1 byte for block id
+// Version 1 block frames are [block id(1)] [block data], and the file size
+// and hash are sent in separate info frames
+static const int kBlockV1HeaderBytes = 1;
+
+/*
+    Version 2 block frames describe themselves:
+
+        [block id(2)] [session(1)] [block count(2)] [block data]
+
+    The block id is the Wirehair block id, which wraps at 16 bits, so a
+    receiver never has to guess the high bits after losing many frames.
+    Each FileSender picks a new 7-bit session id, so receivers notice a new
+    file right away.  With the block count and the frame size a receiver
+    that tunes in late can set up the decoder from the first block it hears.
+
+    Instead of the file hash, the compressed data carries the zstd content
+    checksum.  The block size for the error correction code is the radio
+    profile's GetMaxSendBytes() less this header.
+*/
+static const int kBlockHeaderBytes = 2 + 1 + 2;
+
+/*
+    Files too large for one Wirehair codec are split into generations that
+    are each block count blocks long.  The high bit of the session byte is
+    set, and the header is followed by:
+
+        [generation(2)] [generation count(2)]
+*/
+static const int kGenerationHeaderBytes = 2 + 2;
+static const uint8_t kSessionGenerationFlag = 0x80;
+
+/*
+    Senders encode runs of this many consecutive block ids from one
+    generation at a time.  The generations take turns run by run, and with
+    several links each link sends every Nth run.  Receivers need it to count
+    lost frames.  Divides 65536, so runs never cross a block id wrap.
+*/
+static const unsigned kBlockRunLength = 8;
+
+// Wirehair is most efficient at around 1000 blocks and fails above 64000
+static const int kDefaultGenerationBlocks = 1000;
+static const int kMaxGenerationBlocks = 64000;
+
+// FileSenderSettings::CompressionLevel that lets PlanCompression() decide
+static const int kAutoCompressionLevel = 0;
+
+/*
+    Delta files start with a zstd skippable frame that names the base file,
+    an earlier version of the file that receivers already have:
+
+        [magic(4)] [frame bytes(4)] [base bytes(8)] [base hash(4)]
+        [base name bytes(1)] [base name]
+
+    The zstd frame after it is compressed with the base file as a prefix
+    (patch-from), so only the changes take airtime.  The base hash is the
+    FastCrc32() of the base file.  Receivers from before delta files read
+    the content size of the skippable frame as zero and drop the file.
+*/
+static const uint32_t kDeltaFrameMagic = 0x184D2A5D; // ZSTD_MAGIC_SKIPPABLE_START + 13
+static const int kDeltaFrameHeaderBytes = 4 + 4 + 8 + 4 + 1;
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+/*
+    Opens a Waveshare HAT described by "serial_device:m0_pin:m1_pin:channel",
+    for example "/dev/ttyAMA1:5:6:43", for use by a FileSender (sender = true)
+    or a FileReceiver.  Returns nullptr on failure.
+*/
+std::shared_ptr<IRadioLink> OpenWaveshareLink(const std::string& spec, bool sender);
 
 
 //------------------------------------------------------------------------------
 // FileReceiver
 
 // Progress from 0..1 based on how much data is received.
-// The receive is complete when file_name and file_data are not null.
+// The receive is complete when file_name is not null.  file_data is null if
+// the file was written to FileReceiverSettings::OutputDirectory.
 using OnReceiveProgress = std::function<void(float progress, const char* file_name, const void* file_data, int file_bytes)>;
 
+struct FileReceiverSettings
+{
+    /*
+        If not empty, received files are decompressed straight to a file in
+        this directory, so the receiver does not hold the file in memory.
+        The file only appears once it is complete and validated.
+    */
+    std::string OutputDirectory;
+
+    // Dictionaries senders may compress with.  Files compressed with a
+    // dictionary that is not here are dropped
+    std::vector<std::shared_ptr<ZstdDictionary>> Dictionaries;
+
+    /*
+        Where to find the base files named by delta files.  If empty, this
+        is OutputDirectory, so a new version of a file received there
+        replaces the version it was a delta from.  Delta files whose base
+        file is missing or different are dropped.
+    */
+    std::string BaseDirectory;
+
+    // Threads for each Wirehair solve.  Extra threads have not yet been
+    // measured to help on the Pi, so the default is one
+    int SolveThreads = 1;
+};
+
+struct ReceiverTimingStats
+{
+    // Time the radio thread spends on each received frame.  It does not
+    // read the UART meanwhile, so long stalls overflow the kernel buffer
+    TimingHistogram RadioStall;
+
+    // Time each received block waits for the decode thread
+    TimingHistogram DecodeQueueWait;
+
+    // Time each wirehair_decode() call takes on the decode thread.  The
+    // call for the last block a generation needs includes the matrix solve
+    TimingHistogram Decode;
+
+    // Time the decode thread takes to recover and decompress the generations
+    // that a solve made ready
+    TimingHistogram Recover;
+
+    // One line summary for the log
+    std::string ToString() const;
+};
+
 class FileReceiver
 {
 public:
@@ -34,7 +159,18 @@ public:
     {
         Shutdown();
     }
-    bool Initialize(OnReceiveProgress on_recv);
+
+    // If link is null, the Waveshare HAT is used
+    bool Initialize(
+        OnReceiveProgress on_recv,
+        std::shared_ptr<IRadioLink> link = nullptr);
+
+    // Receives blocks from several links into one decoder, for example one
+    // HAT per channel.  Use with a FileSender striping across the same links.
+    bool Initialize(
+        OnReceiveProgress on_recv,
+        const std::vector<std::shared_ptr<IRadioLink>>& links,
+        const FileReceiverSettings& settings = FileReceiverSettings());
     void Shutdown();
 
     bool IsTerminated() const
@@ -42,41 +178,379 @@ public:
         return Terminated;
     }
 
+    // Radio and decode thread timing since Initialize()
+    ReceiverTimingStats GetTimingStats();
+
 protected:
     OnReceiveProgress OnRecv;
+    FileReceiverSettings Settings;
+
+    struct ReceiveLink
+    {
+        std::shared_ptr<IRadioLink> Uplink;
+        std::shared_ptr<std::thread> Thread;
+
+        // Each link carries its own stream of block ids
+        Counter32 NextBlockId = 0;
+
+        // Channel and profile the link started with, where the sender
+        // announces its data channel and profile
+        int RendezvousChannel = 0;
+        RadioProfile RendezvousProfile;
+
+        // Data channel and profile announced during the last Receive(),
+        // or -1 for none
+        int AnnouncedChannel = -1;
+        RadioProfile AnnouncedProfile;
+
+        // Loss measured with each profile this link has used
+        std::vector<ProfileLoss> Measurements;
+
+        // Time of the last frame received by this link
+        uint64_t LastFrameUsec = 0;
+
+        // Time of the last link quality report
+        uint64_t LastStatsUsec = 0;
+    };
+    std::vector<ReceiveLink> Links;
+
+    // Held by the link threads while they update the state below
+    std::mutex Lock;
 
     bool TransferComplete = false;
     uint32_t FileBytes = 0;
     uint32_t DecompressedBytes = 0;
     uint32_t FileHash = 0;
-    Counter32 NextBlockId = 0;
+    uint32_t BlockBytes = 0;
+
+    // Frame version of the file info
+    int FileFrameVersion = 0;
+
+    // FileBytes is split evenly between the generations
+    uint32_t GenerationCount = 0;
+    uint32_t GenerationBytes = 0;
 
     uint32_t TotalBlockCount = 0;
     uint32_t FileBlockCount = 0;
 
-    Waveshare Uplink;
-    WirehairCodec Decoder = nullptr;
+    uint64_t LastReceiveUsec = 0;
+
+    // Set by the decode thread for generations it has all the blocks for
+    std::vector<uint8_t> DecodedGenerations;
 
     std::atomic<bool> Terminated = ATOMIC_VAR_INIT(false);
-    std::shared_ptr<std::thread> Thread;
 
-    // Blocks buffered up before we receive the file length and hash
+    // Version 1 blocks buffered up before we receive the file length, hash and
+    // block size.  Each is [link index] [frame version] [truncated block id(2)] [block data]
     std::vector<std::vector<uint8_t>> BufferedBlocks;
 
+    // Incremented each time the link threads start or reset a transfer
+    uint32_t TransferId = 0;
+
+    /*
+        Version 2 file the decode thread could not use, such as a delta from
+        a base file we do not have, or -1 for none.  The sender repeats the
+        file until it is stopped, so blocks of this session and file size
+        are dropped as they arrive instead of being decoded again.
+    */
+    int RejectedSession = -1;
+    uint32_t RejectedFileBytes = 0;
+
+    // What the decode thread needs to know about the file
+    struct StreamInfo
+    {
+        uint32_t TransferId = 0;
+        int FrameVersion = 0;
+        int Session = -1;
+        uint32_t GenerationCount = 0;
+        uint32_t GenerationBytes = 0;
+        uint32_t BlockBytes = 0;
+        uint32_t DecompressedBytes = 0;
+        uint32_t FileHash = 0;
+    };
+
+    // Block handed from a link thread to the decode thread
+    struct DecodeJob
+    {
+        StreamInfo Info;
+        unsigned Generation = 0;
+        uint32_t BlockId = 0;
+
+        // Empty to tell the decode thread the transfer was reset
+        std::vector<uint8_t> Block;
+
+        uint64_t QueuedUsec = 0;
+    };
+
+    /*
+        The decode thread owns the Wirehair decoders.  Solving a generation,
+        recovering it and decompressing it take far longer than a frame, so
+        the link threads only queue the blocks they receive, and keep reading
+        their radios and receiving the next transfer meanwhile.
+    */
+    std::shared_ptr<std::thread> DecodeThread;
+    std::mutex DecodeLock;
+    std::condition_variable DecodeCondition;
+    std::deque<DecodeJob> DecodeQueue;
+
+    std::mutex StatsLock;
+    ReceiverTimingStats TimingStats;
+
+    // The state below is only used by the decode thread
+
+    // Transfer being decoded, with one decoder per generation.  Each is
+    // created by the first block of its generation and freed once the
+    // generation is recovered
+    StreamInfo Stream;
+    std::vector<WirehairCodec> Decoders;
+    std::vector<uint8_t> SolvedGenerations;
+    bool StreamFailed = false;
+
+    // Set when the file failed in a way that receiving it again would not
+    // fix, such as a missing base file or dictionary
+    bool StreamRejected = false;
+
+    /*
+        Generations are recovered one at a time into GenerationData and
+        decompressed in order as soon as the ones before them are done.
+        After the file name header, the data goes to OutputFile, or to
+        DecompressedData if there is no output directory.
+    */
+    uint32_t NextGeneration = 0;
+    std::vector<uint8_t> GenerationData;
+    ZSTD_DCtx_s* Decompressor = nullptr;
+    std::vector<uint8_t> DecompressorOutput;
+    bool FrameComplete = false;
+
+    // Decompressed size from the file info or zstd frame
+    uint64_t ExpectedBytes = 0;
+    uint64_t DecompressedOffset = 0;
+
+    // Running hash of the decompressed data, for version 1
+    uint32_t DecompressedHash = 0;
+
+    // [file name bytes(1)] [file name] [0] until all of it is received
+    std::vector<uint8_t> FileHeader;
+    int FileHeaderBytes = 0;
+
     std::string Filename;
-    std::vector<uint8_t> FileData;
+    AtomicFileWriter OutputFile;
     std::vector<uint8_t> DecompressedData;
 
-    void Loop();
-    void OnFileInfo(uint32_t file_bytes, uint32_t hash, uint32_t next_block_id, uint32_t decompressed_bytes);
-    void OnBlock(uint8_t truncated_id, const void* data, int bytes);
-    bool InitDecoder(uint32_t file_bytes);
+    // Session of the version 2 sender, or -1 before the first block
+    int Session = -1;
+
+    // Base file of a delta file, mapped while it is decompressed
+    MappedReadOnlySmallFile BaseFile;
+
+    void Loop(int link_index);
+
+    // Version 1 info frame
+    void OnFileInfo(int link_index, uint32_t file_bytes, uint32_t hash, uint32_t next_block_id, uint32_t decompressed_bytes, uint32_t block_bytes);
+
+    // Version 2 block frame: Reads the header and passes the block to OnBlock()
+    void OnBlockFrame(int link_index, const uint8_t* data, int bytes);
+
+    // The block id is 8 bits for version 1 and 16 bits for version 2
+    void OnBlock(int link_index, int frame_version, unsigned generation, uint16_t truncated_id, const void* data, int bytes);
+
+    // Starts a new transfer for a new file and queues the buffered blocks.
+    // Version 2 senders do not provide the hash or decompressed size
+    void StartFile(int frame_version, uint32_t file_bytes, uint32_t block_bytes, uint32_t generation_count = 1, uint32_t hash = 0, uint32_t decompressed_bytes = 0);
+
+    // Forgets the file being received
+    void ResetTransfer();
+
+    // Starts a new transfer id.  The decode thread finishes the blocks
+    // queued before this and then drops any file it has not finished
+    void NewTransferId();
+
+    // Hands a block to the decode thread
+    void QueueBlock(unsigned generation, uint32_t block_id, const void* data, int bytes);
+
+    // Adds the file info for the current transfer and queues the job
+    void QueueDecodeJob(DecodeJob& job);
+
+    void DecodeLoop();
+    void OnDecodeJob(const DecodeJob& job);
+
+    // Feeds a block to its decoder, and streams out the generations it
+    // completes.  Returns false on failure
+    bool DecodeBlock(const DecodeJob& job);
+
+    // Sets up the decode thread state for a new transfer
+    void StartStream(const StreamInfo& info);
+    void FreeDecoders();
+
+    // Recovers and decompresses the generations that are ready, in order,
+    // and finishes the file after the last one.  Returns false on failure
+    bool StreamGenerations();
+
+    // Opens the base file if data starts with a delta frame, and sets
+    // frame_offset to the zstd frame after it.  Returns false if the base
+    // file is missing or different
+    bool OpenBaseFile(const uint8_t* data, size_t bytes, size_t& frame_offset);
+
+    // Returns false on failure
+    bool Decompress(const uint8_t* data, size_t bytes);
+    bool OnDecompressed(const uint8_t* data, size_t bytes);
+
+    // Validates the file and passes it to OnRecv.  Returns false on failure
+    bool FinishFile();
+
+    // Follows the sender to the announced channel and profile, or goes
+    // back to the rendezvous channel if the sender went quiet.
+    // Returns false on failure
+    bool UpdateTuning(int link_index);
+
+    // Logs link quality and the best profile measured so far
+    void ReportLinkQuality(int link_index);
 };
 
 
 //------------------------------------------------------------------------------
 // FileSender
 
+struct FileSenderSettings
+{
+    /*
+        Move each link from the channel it starts on (the rendezvous channel)
+        to the quietest channel found by its ambient noise scan.  The data
+        channel is announced on the rendezvous channel every few seconds,
+        and receivers follow it.
+    */
+    bool AutoChannel = true;
+
+    /*
+        Air rate and packet size to send with.  Links start with the
+        default profile, and if this is different it is announced along
+        with the data channel.  See SelectRadioProfile().
+    */
+    RadioProfile Profile;
+
+    /*
+        Set to kFrameVersion1 to send to receivers from before version 2.
+        Version 1 frames carry less data, and the file info goes out in
+        separate frames every 32 blocks.
+    */
+    int FrameVersion = kFrameVersion2;
+
+    /*
+        Version 2 files longer than this many blocks are split into
+        generations, each with its own Wirehair codec.  Runs of blocks take
+        turns between the generations, and receivers decode each one
+        separately.  Smaller generations solve faster but add 4 bytes to each block header.
+    */
+    int GenerationBlocks = kDefaultGenerationBlocks;
+
+    /*
+        zstd compression level.  By default the level, worker threads and
+        long distance matching are picked by PlanCompression() to send the
+        file in the least total time for the profile and number of links.
+    */
+    int CompressionLevel = kAutoCompressionLevel;
+
+    // Dictionary to compress with, which receivers must have installed.
+    // Helps most with small files like those it was trained on
+    std::shared_ptr<ZstdDictionary> Dictionary;
+
+    /*
+        If set, send a delta from this earlier version of the file, which
+        receivers already have under its file name.  For small edits to
+        large files this takes a tiny fraction of the airtime.  Receivers
+        without the base file drop the delta.
+    */
+    std::string BaseFile;
+
+    // Threads for each Wirehair encoder solve, as in FileReceiverSettings
+    int SolveThreads = 1;
+};
+
+// FileSender timing, summed over the links
+struct SenderTimingStats
+{
+    // Time each wirehair_encode_batch() call takes on the encode-ahead
+    // threads, per block
+    TimingHistogram Encode;
+
+    // Time between block frames handed to the radio.  Pacing sets the
+    // usual gap, and longer ones mean the radio ran out of data
+    TimingHistogram TransmitGap;
+
+    // Times a link was ready to send before its next block was encoded
+    uint64_t Underruns = 0;
+
+    // One line summary for the log
+    std::string ToString() const;
+};
+
+/*
+    Lock-free queue of block frames ready to send, with one writer and one
+    reader.  The writer encodes each block in place and writes the link
+    frame around it, CRC included.  The reader hands the slot straight to
+    IRadioLink::SendFrame(), so the only copy left is the serial write.
+*/
+class FrameRing
+{
+public:
+    // Power of two.  About two seconds of frames at the fastest air rate
+    static const unsigned kSlotCount = 64;
+    static_assert(kSlotCount % kBlockRunLength == 0, "Runs must not wrap");
+
+    struct Slot
+    {
+        // Link frame holding the block header and data
+        uint8_t Frame[kFrameV1HeaderBytes + kPacketMaxBytes];
+        int FrameBytes = 0;
+
+        // Block id before wrapping, for version 1 info frames
+        uint32_t BlockId = 0;
+
+        // EncoderState::Epoch of the encoder that produced the block
+        uint32_t Epoch = 0;
+    };
+
+    // Writer: Returns the first of count free slots in a row, or nullptr if
+    // the ring does not have that many free.  Every call must use the same
+    // count, which divides kSlotCount, so the slots never wrap
+    Slot* GetWriteSlots(unsigned count)
+    {
+        const unsigned write_index = WriteIndex.load(std::memory_order_relaxed);
+        if (write_index - ReadIndex.load(std::memory_order_acquire) > kSlotCount - count) {
+            return nullptr;
+        }
+        return &Slots[write_index % kSlotCount];
+    }
+
+    // Writer: Hands the slots from GetWriteSlots() to the reader
+    void Push(unsigned count)
+    {
+        WriteIndex.store(WriteIndex.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    // Reader: Returns the oldest frame, or nullptr if the ring is empty
+    Slot* GetReadSlot()
+    {
+        const unsigned read_index = ReadIndex.load(std::memory_order_relaxed);
+        if (read_index == WriteIndex.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &Slots[read_index % kSlotCount];
+    }
+
+    // Reader: Returns the slot from GetReadSlot() to the writer
+    void Pop()
+    {
+        ReadIndex.store(ReadIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+protected:
+    Slot Slots[kSlotCount];
+
+    std::atomic<unsigned> WriteIndex = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned> ReadIndex = ATOMIC_VAR_INIT(0);
+};
+
 class FileSender
 {
 public:
@@ -84,29 +558,180 @@ public:
     {
         Shutdown();
     }
-    bool Initialize(const char* file_name, const uint8_t* file_data, int file_bytes);
+
+    // If link is null, the Waveshare HAT is used
+    bool Initialize(
+        const char* file_name,
+        const uint8_t* file_data,
+        int file_bytes,
+        std::shared_ptr<IRadioLink> link = nullptr);
+
+    /*
+        Sends on several links at once, for example one HAT per channel.
+        Each link has its own thread and sends every Nth block id, so a
+        receiver listening to any subset of the links gets useful blocks.
+    */
+    bool Initialize(
+        const char* file_name,
+        const uint8_t* file_data,
+        int file_bytes,
+        const std::vector<std::shared_ptr<IRadioLink>>& links,
+        const FileSenderSettings& settings = FileSenderSettings());
+
+    // Reads the file from disk a piece at a time while compressing it,
+    // so only the compressed file is held in memory
+    bool InitializeFromFile(
+        const char* file_path,
+        const std::vector<std::shared_ptr<IRadioLink>>& links,
+        const FileSenderSettings& settings = FileSenderSettings());
     void Shutdown();
 
+    /*
+        Switches all links to a new radio profile while sending.
+        If the packet size changes, the file is encoded again with a new
+        block size and receivers start over.
+        Returns false if the profile is invalid or encoding fails.
+    */
+    bool SetRadioProfile(const RadioProfile& profile);
+
     bool IsTerminated() const
     {
         return Terminated;
     }
 
+    // Safe to call from any thread
+    SenderTimingStats GetTimingStats();
+
 protected:
-    Waveshare Uplink;
-    WirehairCodec Encoder = nullptr;
+    FileSenderSettings Settings;
+
+    struct SendLink
+    {
+        std::shared_ptr<IRadioLink> Uplink;
+        TransmitPacer Pacer;
+        std::shared_ptr<std::thread> Thread;
+
+        // Blocks are encoded ahead of the link by EncodeLoop(), so encoding
+        // never holds up the radio
+        std::shared_ptr<FrameRing> Ring;
+        std::shared_ptr<std::thread> EncodeThread;
+
+        int RendezvousChannel = 0;
+        int DataChannel = 0;
+        RadioProfile RendezvousProfile;
+        RadioProfile DataProfile;
+        uint64_t LastAnnounceUsec = 0;
+    };
+    std::vector<SendLink> Links;
+
+    // Held while links pick their data channels
+    std::mutex ChannelLock;
+
+    // Error correction encoders for one packet size
+    struct EncoderState
+    {
+        // One codec per generation
+        std::vector<WirehairCodec> Codecs;
+
+        int HeaderBytes = 0;
+        int BlockBytes = 0;
+
+        // Compressed file size including padding
+        uint32_t FileBytes = 0;
+
+        // Number of blocks in each generation, sent in version 2 block headers
+        uint16_t BlockCount = 0;
+
+        // Changes with each new encoder, so frames encoded ahead by the old
+        // one can be told apart
+        uint32_t Epoch = 0;
+
+        ~EncoderState()
+        {
+            for (WirehairCodec codec : Codecs) {
+                wirehair_free(codec);
+            }
+        }
+    };
+
+    // Held while changing the profile and encoder
+    std::mutex ProfileLock;
+    RadioProfile Profile;
+
+    // wirehair_encode() only reads the encoder, so the link threads share it.
+    // Each thread holds a reference to the one it uses, so it can be replaced
+    std::shared_ptr<EncoderState> Encoder;
+    uint32_t EncoderEpoch = 0;
 
     std::atomic<bool> Terminated = ATOMIC_VAR_INIT(false);
-    std::shared_ptr<std::thread> Thread;
+
+    std::mutex StatsLock;
+    SenderTimingStats TimingStats;
 
     std::string Filename;
     uint32_t FileHash = 0;
 
+    // Version 2 session id, without kSessionGenerationFlag
+    uint8_t Session = 0;
+
     std::vector<uint8_t> CompressedFile;
     size_t CompressedFileBytes = 0;
     uint32_t DecompressedBytes = 0;
 
-    void Loop();
+    // Used while compressing the file
+    ZSTD_CCtx_s* Compressor = nullptr;
+    CompressionPlan Plan;
+
+    // Base file of a delta, mapped while compressing
+    MappedReadOnlySmallFile BaseFile;
+
+    /*
+        Checks the settings, plans the compression from the sample taken at
+        GetCompressionSampleRanges(), and starts compressing the file name
+        header into CompressedFile.  CompressData() then compresses the file a
+        piece at a time, and StartSending() finishes compressing and starts
+        the links.  Each returns false on failure.
+    */
+    bool BeginFile(
+        const char* file_path,
+        uint64_t file_bytes,
+        const std::vector<uint8_t>& sample,
+        size_t link_count,
+        const FileSenderSettings& settings);
+    bool CompressData(const uint8_t* data, size_t bytes);
+
+    // Maps the base file and writes the delta frame to CompressedFile.
+    // Leaves BaseFile closed to send the whole file instead if the window
+    // would be too large.  Returns false on failure
+    bool OpenBaseFile();
+    bool StartSending(const std::vector<std::shared_ptr<IRadioLink>>& links);
+
+    void Loop(int link_index);
+
+    // Encodes the link's blocks into its FrameRing until terminated
+    void EncodeLoop(int link_index);
+
+    // Waits until the radio has room for the frame and then sends it.
+    // Returns false on failure or if terminated.
+    bool PacedSend(SendLink& link, const uint8_t* data, int bytes);
+
+    // PacedSend() for a frame written by FrameParser
+    bool PacedSendFrame(SendLink& link, const uint8_t* frame, int frame_bytes);
+
+    // Returns the quietest channel not used by another link
+    int PickDataChannel(int link_index);
+
+    // Visits the rendezvous channel to announce the data channel and profile.
+    // Returns false on failure or if terminated.
+    bool AnnounceDataChannel(SendLink& link);
+
+    // Waits for frames in the radio buffer to go out before changing channel
+    // and profile.  Returns false on failure or if terminated.
+    bool RetuneWhenIdle(SendLink& link, int channel, const RadioProfile& profile);
+
+    // Splits the file into generations for the packet size.
+    // Returns nullptr on failure
+    std::shared_ptr<EncoderState> CreateEncoder(int send_bytes);
 };
 
 
@@ -0,0 +1,529 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Radio link layer shared by the radio backends
+
+    RadioProfile: Air data rate and packet size, and how to choose them.
+    FrameParser: Finds frames in a received byte stream.
+    TransmitPacer: Paces sends to keep the radio busy without overrunning it.
+    LinkQuality: Rolling receive statistics for placing antennas.
+    IRadioLink: Interface to a radio that sends and receives frames.
+*/
+
+#pragma once
+
+#include "tools.hpp"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lora {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// Frame format versions.  Receivers accept both, and senders use version 2
+// unless they need to reach receivers from before it existed
+static const int kFrameVersion1 = 1;
+static const int kFrameVersion2 = 2;
+
+// Air data rates the radio supports in bits per second, slowest first
+static const int kAirRatesBps[] = {
+    300, 1200, 2400, 4800, 9600, 19200, 38400, 62500
+};
+static const int kAirRateCount = 8;
+
+// Packet sizes the radio supports in bytes, smallest first
+static const int kPacketSizes[] = {
+    32, 64, 128, 240
+};
+static const int kPacketSizeCount = 4;
+
+/*
+    Bytes added to each Send() by version 1 framing:
+
+        [length(1)] [header check(1)] [CRC24 of data(3)] [data...]
+
+    The header check byte is a hash of the other header bytes.  It lets the
+    parser reject noise before running the CRC over a whole packet.
+*/
+static const int kFrameV1HeaderBytes = 1 + 1 + 3;
+
+/*
+    Bytes added to each Send() by version 2 framing:
+
+        [sync(1)] [length(1)] [header check(1)] [data...] [CRC16 of length, check and data(2)]
+
+    The sync byte is never a valid version 1 length, so the parser can tell
+    the versions apart.  The header check byte is a hash of the length and
+    the first data byte, which is the session id in block frames.  Like the
+    version 1 header check, it rejects noise before the parser waits for a
+    whole packet to arrive.
+*/
+static const int kFrameHeaderBytes = 1 + 1 + 1 + 2;
+static const uint8_t kFrameSyncByte = 0xf5;
+
+// Offset of the data in a version 2 frame
+static const int kFrameDataOffset = 1 + 1 + 1;
+
+// Maximum Send() size, with the largest packet size
+// HACK: We add a header to fix truncation problem with this HAT
+static const int kPacketMaxBytes = 240 - kFrameHeaderBytes;
+
+// Estimated time the radio spends on preamble, sync and header for each packet
+static const int kAirPacketOverheadUsec = 2000;
+
+// RSSI passed to OnFrame when the radio did not measure it
+static const int kUnknownRssiDbm = 0;
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+// Bytes added to each Send() by the given frame version
+inline int GetFrameHeaderBytes(int frame_version)
+{
+    return frame_version == kFrameVersion1 ? kFrameV1HeaderBytes : kFrameHeaderBytes;
+}
+
+// Offset of the Send() data in a frame of the given version
+inline int GetFrameDataOffset(int frame_version)
+{
+    return frame_version == kFrameVersion1 ? kFrameV1HeaderBytes : kFrameDataOffset;
+}
+
+// Estimated time on air for a Send() of the given number of bytes
+inline uint64_t GetAirtimeUsec(int bytes, int air_rate_bps, int frame_version = kFrameVersion2)
+{
+    const uint64_t air_bits = (GetFrameHeaderBytes(frame_version) + bytes) * 8;
+    return air_bits * 1000000 / air_rate_bps + kAirPacketOverheadUsec;
+}
+
+// The radio reports RSSI as a byte holding dBm + 256
+inline int RssiByteToDbm(uint8_t rssi)
+{
+    return (int)rssi - 256;
+}
+
+
+//------------------------------------------------------------------------------
+// RadioProfile
+
+/*
+    Air data rate and packet size used by a radio.
+
+    Lower air rates reach further and smaller packets are less likely to be
+    hit by noise, but both carry less data per second.  Radios only hear
+    each other if they use the same air rate.
+*/
+struct RadioProfile
+{
+    int AirRateBps = 62500;
+
+    // Each Send() goes out in one packet of up to this many bytes
+    int PacketBytes = 240;
+
+    // Largest Send() that fits in one packet
+    int GetMaxSendBytes(int frame_version = kFrameVersion2) const
+    {
+        return PacketBytes - GetFrameHeaderBytes(frame_version);
+    }
+
+    // Index into kAirRatesBps, or -1 if not supported
+    int GetAirRateIndex() const;
+
+    // Index into kPacketSizes, or -1 if not supported
+    int GetPacketSizeIndex() const;
+
+    bool IsValid() const
+    {
+        return GetAirRateIndex() >= 0 && GetPacketSizeIndex() >= 0;
+    }
+
+    bool operator==(const RadioProfile& other) const
+    {
+        return AirRateBps == other.AirRateBps && PacketBytes == other.PacketBytes;
+    }
+    bool operator!=(const RadioProfile& other) const
+    {
+        return !(*this == other);
+    }
+
+    // For example "62500:240", the format read by FromString()
+    std::string ToString() const;
+
+    // Parses "air_rate_bps:packet_bytes".  Returns false if invalid
+    bool FromString(const std::string& text);
+};
+
+// Frame loss rate measured by a receiver using a profile
+struct ProfileLoss
+{
+    RadioProfile Profile;
+    float LossRate = 0.f;
+};
+
+/*
+    Estimated goodput in bytes per second: The data carried by each packet,
+    less overhead_bytes of protocol header, times the chance it arrives.
+*/
+float EstimateGoodputBps(const RadioProfile& profile, float loss_rate, int overhead_bytes);
+
+/*
+    Picks the profile with the best estimated goodput, so a slower air rate
+    wins when it gets enough more frames through.
+
+    Loss at the other packet sizes for a measured air rate is predicted by
+    assuming frames are lost at a constant rate per unit of airtime:
+    delivery = (1 - measured loss) ^ (airtime / measured airtime).
+    Air rates without a measurement are not picked, because there is no
+    way to predict how far they reach.
+
+    Returns the default profile if there are no measurements.
+*/
+RadioProfile SelectRadioProfile(const std::vector<ProfileLoss>& measurements, int overhead_bytes);
+
+
+//------------------------------------------------------------------------------
+// FrameParser
+
+// Callback for each packet received.
+// The data points into the receive ring and is only valid during the call.
+// rssi_dbm is the received signal strength, or kUnknownRssiDbm.
+// frame_version is the format the frame was sent with.
+using OnFrame = std::function<void(const uint8_t* data, int bytes, int rssi_dbm, int frame_version)>;
+
+/*
+    Finds frames written by WriteFrame() in the received byte stream.
+    Both frame versions are found, even when mixed in one stream.
+
+    Received bytes are written straight into a mirrored ring buffer, and frames
+    are handed to the callback in place, so nothing is copied or moved even if
+    a frame wraps around the end of the ring.  Because the ring is much larger
+    than a frame, a buffer full of noise is always consumed and cannot stall.
+
+    If the radio appends an RSSI byte to each packet it receives, the byte
+    after each frame is passed to the callback as the RSSI.  That byte is
+    parsed again as a possible frame start, so if the radio put two frames
+    in one packet the second frame is still found.
+*/
+class FrameParser
+{
+public:
+    // Returns false on failure
+    bool Initialize(bool rssi_trailer = false);
+
+    // Discard all buffered data
+    void Reset()
+    {
+        ReadOffset = WriteOffset = ScanOffset = 0;
+        LastFrameVersion = 0;
+    }
+
+    // Returns the number of bytes that can be written at GetWritePtr()
+    int GetWriteSpace() const
+    {
+        return (int)(Ring.Size - (WriteOffset - ReadOffset));
+    }
+    uint8_t* GetWritePtr()
+    {
+        return Ring.Data + (WriteOffset & Ring.Mask);
+    }
+
+    // Call after writing bytes at GetWritePtr()
+    void OnWrite(int bytes)
+    {
+        WriteOffset += bytes;
+    }
+
+    // Returns the number of bytes buffered and not parsed yet
+    int GetBufferedBytes() const
+    {
+        return (int)(WriteOffset - ReadOffset);
+    }
+
+    // Calls callback for each complete frame in the buffer.
+    // Returns the number of frames that had a valid header but failed the CRC
+    int Parse(const OnFrame& callback);
+
+    // Returns the expected version 1 header check byte for the given length and CRC24
+    static uint8_t GetHeaderCheck(uint8_t length, uint32_t crc24)
+    {
+        const uint32_t word = length | (crc24 << 8);
+        return static_cast<uint8_t>( (word * UINT32_C(0x9E3779B1)) >> 24 );
+    }
+
+    // Returns the expected version 2 header check byte for the given length
+    // and first data byte
+    static uint8_t GetHeaderCheckV2(uint8_t length, uint8_t first_byte)
+    {
+        const uint32_t word = kFrameSyncByte | ((uint32_t)length << 8) | ((uint32_t)first_byte << 16);
+        return static_cast<uint8_t>( (word * UINT32_C(0x9E3779B1)) >> 24 );
+    }
+
+    // Writes the header and data for a Send() of the given bytes into frame.
+    // Returns the number of bytes written: GetFrameHeaderBytes() + bytes
+    static int WriteFrame(const uint8_t* data, int bytes, uint8_t* frame, int frame_version = kFrameVersion2);
+
+    // Like WriteFrame(), for data that is already in place at
+    // frame + GetFrameDataOffset().  Writes only the header and trailer.
+    static int SealFrame(uint8_t* frame, int bytes, int frame_version = kFrameVersion2);
+
+protected:
+    // Size of receive ring, rounded up to the page size
+    static const int kRingBytes = 4096;
+
+    MirroredRingBuffer Ring;
+
+    // Each frame is followed by an RSSI byte
+    bool RssiTrailer = false;
+
+    // Free-running offsets into the ring
+    uint32_t ReadOffset = 0;
+    uint32_t WriteOffset = 0;
+
+    // When Parse() stops at a header waiting for the rest of its packet, the
+    // data from there up to here has been parsed already
+    uint32_t ScanOffset = 0;
+
+    // Version of the last frame found, or 0 for none
+    int LastFrameVersion = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// TransmitPacer
+
+/*
+    Keeps the radio transmit buffer full without overrunning it.
+
+    The kernel send queue (TIOCOUTQ) tells us how much data has not reached
+    the radio yet, and the airtime model tells us how much data is still
+    waiting to go out over the air.  The difference is what is sitting in the
+    radio's buffer.
+*/
+class TransmitPacer
+{
+public:
+    void Reset(int air_rate_bps, int buffer_bytes);
+
+    // Returns the number of microseconds to wait before writing a frame of
+    // the given size to the radio, or 0 if it can be written right now.
+    uint64_t GetDelayUsec(uint64_t now_usec, int frame_bytes, int send_queue_bytes) const;
+
+    // Record that a frame was written
+    void OnSend(uint64_t now_usec, uint64_t airtime_usec);
+
+    // Returns the time until everything sent so far is on the air
+    uint64_t GetBusyUsec(uint64_t now_usec) const
+    {
+        return AirBusyUntilUsec > now_usec ? AirBusyUntilUsec - now_usec : 0;
+    }
+
+protected:
+    int AirRateBps = 1;
+    int BufferBytes = 0;
+
+    // Modeled time when all data written so far has been sent over the air
+    uint64_t AirBusyUntilUsec = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// LinkQuality
+
+// RSSI histogram: kRssiBinCount bins of kRssiBinDb starting at kRssiHistogramMinDbm.
+// Readings outside the range go in the first or last bin.
+static const int kRssiHistogramMinDbm = -130;
+static const int kRssiBinDb = 10;
+static const int kRssiBinCount = 10;
+
+struct LinkQualityStats
+{
+    // Frames that passed the CRC check
+    uint64_t Frames = 0;
+
+    // Frames that had a valid header but failed the CRC check
+    uint64_t CrcFailures = 0;
+
+    // Frames with sequence numbers, and the frames missing from gaps between them
+    uint64_t SequencedFrames = 0;
+    uint64_t LostFrames = 0;
+
+    // Frames with an RSSI reading
+    uint64_t RssiFrames = 0;
+    int64_t RssiSumDbm = 0;
+    int RssiMinDbm = 0;
+    int RssiMaxDbm = 0;
+    uint64_t RssiHistogram[kRssiBinCount] = {};
+
+    void Add(const LinkQualityStats& other);
+
+    float GetCrcFailureRate() const
+    {
+        const uint64_t total = Frames + CrcFailures;
+        return total > 0 ? CrcFailures / (float)total : 0.f;
+    }
+
+    float GetLossRate() const
+    {
+        const uint64_t total = SequencedFrames + LostFrames;
+        return total > 0 ? LostFrames / (float)total : 0.f;
+    }
+
+    float GetAverageRssiDbm() const
+    {
+        return RssiFrames > 0 ? RssiSumDbm / (float)RssiFrames : 0.f;
+    }
+
+    // One line summary for the log
+    std::string ToString() const;
+};
+
+/*
+    Rolling receive statistics for one radio.
+
+    Counts are kept for the current window and the one before it, so the
+    stats cover the last one to two windows and old conditions age out.
+
+    Loss is estimated from gaps in the sequence numbers of received frames.
+    Several radios may share a stream of sequence numbers, so the step
+    between consecutive frames is learned as the smallest step seen.
+*/
+class LinkQuality
+{
+public:
+    void Reset();
+
+    // Called by the radio for each frame received
+    void OnFrame(int rssi_dbm);
+
+    void OnCrcFailures(int count);
+
+    // Called by the protocol with the sequence number of a received frame.
+    // The sender sends runs of run_length sequence numbers in a row, and may
+    // skip whole runs that it sends on other links
+    void OnSequence(uint32_t sequence, uint32_t run_length = 1);
+
+    // Safe to call from any thread
+    LinkQualityStats GetStats();
+
+protected:
+    // Length of each window
+    static const uint64_t kWindowUsec = 10 * 1000 * 1000;
+
+    // Larger forward steps in runs restart the sequence instead of counting
+    // as loss
+    static const uint32_t kMaxSequenceStep = 256;
+
+    std::mutex Lock;
+
+    uint64_t WindowStartUsec = 0;
+    LinkQualityStats Current, Previous;
+
+    bool SequenceValid = false;
+    uint32_t LastRun = 0, LastRunOffset = 0;
+
+    // Smallest step between runs seen since the sequence started
+    uint32_t RunStep = 0;
+
+    // Starts a new window if the current one is over.  Lock must be held
+    void RollWindow();
+};
+
+
+//------------------------------------------------------------------------------
+// IRadioLink
+
+/*
+    Interface to a radio that sends and receives frames.
+
+    Implemented by the Waveshare HAT driver, and by LinkEmulator so that the
+    file transfer protocol can be tested without radio hardware.
+*/
+class IRadioLink
+{
+public:
+    virtual ~IRadioLink() = default;
+
+    virtual void Shutdown() = 0;
+
+    // Send up to GetMaxSendBytes() at a time.
+    // Returns false if the link is broken.
+    virtual bool Send(const uint8_t* data, int bytes) = 0;
+
+    // Sends a frame written by FrameParser::WriteFrame() or SealFrame() for
+    // GetFrameVersion() as-is, without copying it.
+    // Returns false if the link is broken.
+    virtual bool SendFrame(const uint8_t* frame, int frame_bytes) = 0;
+
+    // Returns number of bytes written that have not reached the radio yet.
+    // Returns -1 on error.
+    virtual int GetSendQueueBytes() = 0;
+
+    // Calls callback for each packet received.
+    // If timeout_msec > 0 and no data is waiting, this first blocks until
+    // data arrives, Interrupt() is called, or the timeout.
+    // Returns false if the link is broken.
+    virtual bool Receive(const OnFrame& callback, int timeout_msec) = 0;
+
+    // Wakes up a thread blocked in Receive().  Safe to call from any thread.
+    virtual void Interrupt() = 0;
+
+    virtual RadioProfile GetRadioProfile() const = 0;
+
+    // Changes the air rate and packet size.
+    // Must not be called from a Receive() callback.
+    // Returns false on failure.
+    virtual bool SetRadioProfile(const RadioProfile& profile) = 0;
+
+    // Frame format written by Send().  Receive() accepts all versions
+    virtual int GetFrameVersion() const = 0;
+
+    // Returns false if the version is not supported
+    virtual bool SetFrameVersion(int frame_version) = 0;
+
+    // Air data rate in bits per second
+    int GetAirDataRateBps() const
+    {
+        return GetRadioProfile().AirRateBps;
+    }
+
+    // Largest Send() that fits in one packet
+    int GetMaxSendBytes() const
+    {
+        return GetRadioProfile().GetMaxSendBytes(GetFrameVersion());
+    }
+
+    // Number of bytes the radio can buffer while transmitting
+    virtual int GetRadioBufferBytes() const = 0;
+
+    // Number of channels the radio can tune to
+    virtual int GetChannelCount() const = 0;
+
+    virtual int GetChannel() const = 0;
+
+    // Tunes the radio to channel 0..GetChannelCount()-1.
+    // Data received but not yet parsed is dropped.
+    // Must not be called from a Receive() callback.
+    // Returns false on failure.
+    virtual bool SetChannel(int channel) = 0;
+
+    // Fills noise_dbm with the ambient noise of each channel from the last
+    // scan.  Returns false if there are no scan results.
+    virtual bool GetChannelNoise(std::vector<float>& noise_dbm) = 0;
+
+    // Receive statistics, updated by Receive()
+    virtual LinkQuality& GetLinkQuality() = 0;
+
+    // Estimated time on air for a Send() of the given number of bytes
+    uint64_t GetAirtimeUsec(int bytes) const
+    {
+        return lora::GetAirtimeUsec(bytes, GetAirDataRateBps(), GetFrameVersion());
+    }
+};
+
+
+} // namespace lora
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <functional>
 #include <memory>
+#include <string>
 #include <thread>
 #include <system_error>
 
@@ -25,8 +26,16 @@ static const int kVersion = 100; // 1.0.0
 uint64_t GetTimeUsec();
 uint64_t GetTimeMsec();
 
-// Data needs to be aligned to 8 byte address in memory
-uint32_t FastCrc32(const void* data, int bytes);
+// CRC32C of the data.  Gives the same result on every platform.
+// Uses SSE4.2 or ARMv8 CRC instructions when the CPU supports them.
+// To continue a CRC over more data, pass the previous result as crc.
+uint32_t FastCrc32(const void* data, size_t bytes, uint32_t crc = 0);
+
+// Portable slice-by-8 version of FastCrc32() for testing
+uint32_t FastCrc32Portable(const void* data, size_t bytes, uint32_t crc = 0);
+
+// Returns the name of the implementation used by FastCrc32()
+const char* GetFastCrc32Name();
 
 /// Calls the provided (lambda) function at the end of the current scope
 class ScopedFunction
@@ -59,6 +68,10 @@ inline void JoinThread(std::shared_ptr<std::thread>& th)
     }
 }
 
+/// Lowers the scheduling priority of the calling thread, so that threads
+/// reading the radio run first on a single core.  Threads it starts inherit it
+void SetCurrentThreadBackground();
+
 
 //------------------------------------------------------------------------------
 // Byte Order
@@ -332,6 +345,30 @@ struct MappedReadOnlySmallFile
 };
 
 
+//------------------------------------------------------------------------------
+// MirroredRingBuffer
+
+/// Ring buffer that is mapped twice back-to-back in virtual memory.
+/// Any span of up to Size bytes starting inside the ring is contiguous,
+/// so data that wraps around the end can be read and written in place.
+struct MirroredRingBuffer
+{
+    uint8_t* Data = nullptr;
+    uint32_t Size = 0; // Power of two and a multiple of the page size
+    uint32_t Mask = 0;
+
+    /// Allocates at least min_bytes.  Returns false on error
+    bool Allocate(uint32_t min_bytes);
+
+    void Free();
+
+    ~MirroredRingBuffer()
+    {
+        Free();
+    }
+};
+
+
 //------------------------------------------------------------------------------
 // File Helpers
 
@@ -339,6 +376,85 @@ struct MappedReadOnlySmallFile
 bool WriteBufferToFile(const char* path, const void* data, uint64_t bytes);
 
 
+//------------------------------------------------------------------------------
+// AtomicFileWriter
+
+/*
+    Writes a file front to back without holding it in memory.
+
+    The data goes to an unnamed temporary file in the same directory, which
+    replaces the file at the path only when Commit() succeeds.  If the
+    writer is aborted or the process dies, nothing appears at the path.
+*/
+class AtomicFileWriter
+{
+public:
+    ~AtomicFileWriter()
+    {
+        Abort();
+    }
+
+    // Reserves expected_bytes on disk up front, if not zero.
+    // Returns false on error
+    bool Open(const std::string& path, uint64_t expected_bytes = 0);
+
+    // Returns false on error
+    bool Write(const void* data, size_t bytes);
+
+    // Flushes the data and moves it to the path.  Returns false on error
+    bool Commit();
+
+    // Discards the data written so far
+    void Abort();
+
+    uint64_t GetWrittenBytes() const
+    {
+        return WrittenBytes;
+    }
+
+protected:
+    int File = -1;
+    std::string Path;
+
+    // Named temporary file, used if the file system has no unnamed ones
+    std::string TempPath;
+
+    uint64_t WrittenBytes = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// TimingHistogram
+
+// Bin 0 counts zero usec, and bin i counts 2^(i-1) to 2^i - 1 usec.
+// Longer times go in the last bin
+static const int kTimingBinCount = 26;
+
+// Distribution of a duration, such as the time each call takes
+struct TimingHistogram
+{
+    uint64_t Count = 0;
+    uint64_t TotalUsec = 0;
+    uint64_t MaxUsec = 0;
+    uint64_t Bins[kTimingBinCount] = {};
+
+    void Add(uint64_t usec);
+    void Add(const TimingHistogram& other);
+
+    float GetAverageUsec() const
+    {
+        return Count > 0 ? TotalUsec / (float)Count : 0.f;
+    }
+
+    // Time that this fraction of the samples took no longer than, from
+    // 0 to 1.  Read from the bins, so it is within a factor of two
+    uint64_t GetPercentileUsec(float fraction) const;
+
+    // One line summary for the log
+    std::string ToString() const;
+};
+
+
 //------------------------------------------------------------------------------
 // Logging
 
@@ -2,36 +2,86 @@
 
 #pragma once
 
-#include "tools.hpp"
+#include "radio_link.hpp"
 #include "linux_serial.hpp"
 
+#include <string>
+
 namespace lora {
 
 
 //------------------------------------------------------------------------------
 // Constants
 
-// Maximum Send() size
-// HACK: We add a header to fix truncation problem with this HAT
-static const int kPacketMaxBytes = 235;
+// The HAT buffers this many bytes from the UART while it transmits
+static const int kHatBufferBytes = 1000;
 
 // Number of channels
 static const int kChannelCount = 84;
 
-static const int kCheckedChannelCount = 4;
-static const int kCheckedChannels[kCheckedChannelCount] = {
-    16, 32, 48, 64
-};
+// Ambient RSSI reads per channel during ScanAmbientRssi() in Initialize()
+static const int kScanRetries = 3;
 
 // Monitor address can receive but not transmit.
 // Other addresses can transmit but not receive.
 static const uint16_t kMonitorAddress = UINT16_C(0xffff);
 
+// Number of HAT configuration registers written by Initialize()
+static const int kRegisterCount = 9;
+
+// Channel register offset
+static const int kRegChannel = 5;
+
+// Ambient RSSI scan done by Initialize()
+enum class RssiScan
+{
+    // Do not scan
+    Skip,
+
+    // Use results saved on disk by a recent scan, or scan if they are stale
+    Cached,
+
+    // Always scan
+    Always
+};
+
+
+//------------------------------------------------------------------------------
+// WaveshareDevice
+
+// Serial port and GPIO pins for one HAT.
+// Defaults match a single HAT plugged into the Raspberry Pi header.
+struct WaveshareDevice
+{
+    std::string SerialDevice = "/dev/ttyS0";
+
+    // Mode select pins (BCM numbering)
+    int M0Pin = 22;
+    int M1Pin = 27;
+};
+
+
+//------------------------------------------------------------------------------
+// ModeSwitchStats
+
+// Latency of switching the HAT between config and transmit modes
+struct ModeSwitchStats
+{
+    // Time from leaving transmit mode until the HAT answers in config mode
+    TimingHistogram EnterConfig;
+
+    // Time from leaving config mode until the HAT can send and receive
+    TimingHistogram EnterTransmit;
+
+    // Whole config change: Enter config mode, write registers, and leave
+    TimingHistogram ConfigSession;
+};
+
 
 //------------------------------------------------------------------------------
 // Waveshare HAT API
 
-class Waveshare
+class Waveshare : public IRadioLink
 {
 public:
     ~Waveshare()
@@ -42,64 +92,165 @@ public:
     /*
         Channel = Initial channel to configure 0...kChannelCount-1
         LBT = Listen Before Transmit (adds ~2 seconds of latency).
+
+        If the HAT registers already hold this configuration, for example
+        after the app restarts, they are not written again.
     */
     bool Initialize(
         int channel, // Initial channel
         uint16_t transmit_addr, // Address to use when transmitting
-        bool lbt = false);
-    void Shutdown();
+        bool lbt = false,
+        RssiScan rssi_scan = RssiScan::Cached,
+        const WaveshareDevice& device = WaveshareDevice());
+    void Shutdown() override;
 
     // Read and ignore data until we stop receiving input.
     // This might be helpful to resynchronize with the input stream.
     void DrainReceiveBuffer();
 
+    int GetChannelCount() const override
+    {
+        return kChannelCount;
+    }
+
+    int GetChannel() const override
+    {
+        return Registers[kRegChannel];
+    }
+
     // 0..83
-    bool SetChannel(int channel, bool enable_ambient_rssi = false);
+    bool SetChannel(int channel) override
+    {
+        return SetChannel(channel, false);
+    }
+    bool SetChannel(int channel, bool enable_ambient_rssi);
+
+    // Returns the results of ScanAmbientRssi()
+    bool GetChannelNoise(std::vector<float>& noise_dbm) override;
+
+    LinkQuality& GetLinkQuality() override
+    {
+        return Quality;
+    }
 
-    // Send up to 240 bytes at a time
-    bool Send(const uint8_t* data, int bytes);
+    // Send up to GetMaxSendBytes() at a time
+    bool Send(const uint8_t* data, int bytes) override;
+    bool SendFrame(const uint8_t* frame, int frame_bytes) override;
 
-    int GetSendQueueBytes()
+    int GetSendQueueBytes() override
     {
         return Serial.GetSendQueueBytes();
     }
 
-    // Calls callback for each packet received.
+    // Calls callback for each packet received, with the RSSI the HAT measured.
+    // If timeout_msec > 0 and no data is waiting, this first blocks until
+    // the serial port is readable, Interrupt() is called, or the timeout.
     // Returns false if pipe breaks.
-    bool Receive(std::function<void(const uint8_t* data, int bytes)> callback);
+    bool Receive(
+        const OnFrame& callback,
+        int timeout_msec = 0) override;
+
+    // Wakes up a thread blocked in Receive().  Safe to call from any thread.
+    void Interrupt() override
+    {
+        Reactor.Wake();
+    }
+
+    // Initialize() sets the default RadioProfile
+    RadioProfile GetRadioProfile() const override;
+    bool SetRadioProfile(const RadioProfile& profile) override;
+
+    int GetRadioBufferBytes() const override
+    {
+        return kHatBufferBytes;
+    }
+
+    int GetFrameVersion() const override
+    {
+        return FrameVersion;
+    }
+    bool SetFrameVersion(int frame_version) override
+    {
+        if (frame_version != kFrameVersion1 && frame_version != kFrameVersion2) {
+            return false;
+        }
+        FrameVersion = frame_version;
+        return true;
+    }
 
     // Scan all channels and read ambient RSSI.
     // After this you must call SetChannel() again because it changes the channel
-    bool ScanAmbientRssi(int retries = 10);
+    bool ScanAmbientRssi(int retries = kScanRetries);
+
+    const ModeSwitchStats& GetModeSwitchStats() const
+    {
+        return SwitchStats;
+    }
 
-    // Updated by ScanAmbientRssi()
-    // Note only the ones in kCheckedChannels are actually updated.
-    uint8_t ChannelRssiRaw[kChannelCount]; // units: dBm * 2
+    // Updated by ScanAmbientRssi(), or loaded from the cache by Initialize()
+    bool ChannelRssiValid = false;
+    uint8_t ChannelRssiRaw[kChannelCount]; // units: dBm + 256
     float ChannelRssi[kChannelCount]; // dBm
 
 protected:
+    WaveshareDevice Device;
+    bool GpioInitialized = false;
     RawSerialPort Serial;
+    SerialReactor Reactor;
     bool InConfigMode = false;
     int Baudrate = 9600;
     uint16_t TransmitAddress = kMonitorAddress;
-    uint16_t CurrentAddress = kMonitorAddress;
+
+    // Used by Send()
+    int FrameVersion = kFrameVersion2;
+
+    /*
+        Register values we want, and the values last written to the HAT.
+        Changes are staged in Registers and then CommitConfig() writes all
+        the registers that differ in one config mode session.
+    */
+    uint8_t Registers[kRegisterCount];
+    uint8_t HatRegisters[kRegisterCount];
+    bool HatRegistersValid = false;
+
+    ModeSwitchStats SwitchStats;
+
+    // Models when the frames written by Send() are all on the air, so that
+    // EnterConfigMode() knows how long the HAT takes to empty its buffer
+    TransmitPacer AirModel;
 
     // Receive() data goes here
-    static const int kRecvBufferBytes = 240;
-    uint8_t RecvBuffer[kRecvBufferBytes];
-    //uint64_t RecvStartUsec = 0; // Used to avoid blocking short messages
-    int RecvOffsetBytes = 0;
+    FrameParser Parser;
+
+    // Updated by Receive()
+    LinkQuality Quality;
 
+    // The serial port stays open, and only the baudrate changes
     bool EnterConfigMode();
     bool EnterTransmitMode();
 
+    // Waits busy_usec for the HAT to send what it has buffered, then reads a
+    // register until the HAT answers, showing it is in config mode
+    bool WaitForConfigMode(int timeout_msec, uint64_t busy_usec);
+
+    // Writes staged register changes and returns to transmit mode
+    bool CommitConfig();
+
     bool SetAddress(uint16_t addr);
 
     bool WriteConfig(int offset, const uint8_t* data, int bytes);
+    bool ReadConfig(int offset, uint8_t* data, int bytes);
+
+    // Cache of ScanAmbientRssi() results on disk, one file per serial device.
+    // Returns false if there is no recent scan.
+    std::string GetRssiCachePath() const;
+    bool LoadRssiCache();
+    void SaveRssiCache();
 
     bool ReadAmbientRssi(uint8_t& rssi);
 
-    bool WaitForResponse(int minbytes);
+    // Returns false if fewer than minbytes are available after timeout_msec
+    bool WaitForResponse(int minbytes, int timeout_msec = 5000);
 
     bool FillRecvBuffer();
 };
@@ -0,0 +1,96 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Shared zstd dictionaries for small files
+
+    Small files compress poorly on their own, because zstd has nothing to
+    match against until it has seen some of the file.  A dictionary trained
+    on files like them gives it that history up front.  The sender and every
+    receiver install the same dictionary file.
+
+    Each zstd frame records the id of the dictionary it was compressed with,
+    so receivers pick the right one from those installed.
+*/
+
+#pragma once
+
+#include "tools.hpp"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ZSTD_CDict_s; // zstd.h
+struct ZSTD_DDict_s;
+
+namespace lora {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// Size of the dictionaries built by TrainDictionary() unless specified
+static const size_t kDefaultDictionaryBytes = 32 * 1024;
+
+
+//------------------------------------------------------------------------------
+// ZstdDictionary
+
+class ZstdDictionary
+{
+public:
+    ~ZstdDictionary();
+
+    // Reads a dictionary written by TrainDictionary().  Returns false on error
+    bool Load(const char* path);
+
+    // Sets the dictionary from memory.  Returns false if it is not a trained
+    // zstd dictionary, which is the only kind with an id
+    bool Set(const uint8_t* data, size_t bytes);
+
+    // Id recorded in frames compressed with this dictionary
+    unsigned GetId() const
+    {
+        return Id;
+    }
+
+    const std::vector<uint8_t>& GetData() const
+    {
+        return Data;
+    }
+
+    // Digested for compression at a zstd level, created on first use.
+    // Returns nullptr on error
+    ZSTD_CDict_s* GetCDict(int level);
+
+    // Digested for decompression
+    ZSTD_DDict_s* GetDDict() const
+    {
+        return DDict;
+    }
+
+protected:
+    std::vector<uint8_t> Data;
+    unsigned Id = 0;
+
+    std::mutex Lock;
+    std::map<int, ZSTD_CDict_s*> CDicts;
+
+    ZSTD_DDict_s* DDict = nullptr;
+
+    void Free();
+};
+
+/*
+    Trains a dictionary of up to dict_bytes from sample files.  zstd suggests
+    the samples add up to about 100 times the dictionary size, and training
+    fails if there are too few of them.  Returns false on failure
+*/
+bool TrainDictionary(
+    const std::vector<std::vector<uint8_t>>& samples,
+    size_t dict_bytes,
+    std::vector<uint8_t>& dict);
+
+
+} // namespace lora
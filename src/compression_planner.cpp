@@ -0,0 +1,295 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+#include "compression_planner.hpp"
+#include "zstd_dictionary.hpp"
+
+#define ZSTD_STATIC_LINKING_ONLY // ZSTD_getCParams
+#include "zstd.h" // zstd_lib subproject
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+namespace lora {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// The sample is this many pieces of this size.  Spreading it through the
+// file keeps a header or a run of padding from deciding the plan
+static const int kSampleSlices = 8;
+static const uint32_t kSampleSliceBytes = 32 * 1024;
+
+// Levels tried, in order of increasing compression time.  Levels above 19
+// need windows larger than receivers accept by default
+static const int kPlanLevels[] = {
+    1, 3, 6, 9, 12, 15, 19
+};
+
+// Data that level 1 cannot shrink below this ratio is stored
+static const float kIncompressibleRatio = 0.98f;
+
+// zstd runs smaller files on one thread, and splits larger ones into jobs
+// of about this size at the fast levels
+static const uint64_t kMinWorkerBytes = 1024 * 1024;
+static const uint64_t kWorkerJobBytes = 4 * 1024 * 1024;
+
+/*
+    Long distance matching is used on files larger than the level's window,
+    if it costs less extra compression time than this share of the airtime.
+
+    The sample is too small to show matches far apart, so this assumes long
+    matches save at least this share of the compressed size.  Long distance
+    matching runs on one thread: zstd workers only see their own job, which
+    loses the long matches, and each job needs a buffer as large as the window.
+*/
+static const float kLongModeMinSavings = 0.01f;
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+static uint64_t EstimateAirtimeUsec(uint64_t compressed_bytes, const CompressionTarget& target)
+{
+    const int send_bytes = target.Profile.GetMaxSendBytes(target.FrameVersion);
+    const int block_bytes = send_bytes - target.BlockHeaderBytes;
+    if (block_bytes <= 0) {
+        return 0;
+    }
+
+    const uint64_t blocks = (compressed_bytes + block_bytes - 1) / block_bytes;
+    const uint64_t packet_usec = GetAirtimeUsec(send_bytes, target.Profile.AirRateBps, target.FrameVersion);
+    return blocks * packet_usec / std::max(target.LinkCount, 1);
+}
+
+
+//------------------------------------------------------------------------------
+// CompressionPlan
+
+int GetWindowLog(uint64_t bytes)
+{
+    int log = ZSTD_WINDOWLOG_MIN;
+    while (log < 63 && ((uint64_t)1 << log) < bytes) {
+        ++log;
+    }
+    return log;
+}
+
+std::string CompressionPlan::ToString() const
+{
+    std::ostringstream oss;
+    if (Stored) {
+        oss << "stored";
+    } else {
+        oss << "level " << Level;
+    }
+    if (Workers > 0) {
+        oss << ", " << Workers << " workers";
+    }
+    if (LongWindowLog > 0) {
+        oss << ", long window 2^" << LongWindowLog;
+    }
+    return oss.str();
+}
+
+std::vector<SampleRange> GetCompressionSampleRanges(uint64_t file_bytes)
+{
+    std::vector<SampleRange> ranges;
+
+    if (file_bytes <= (uint64_t)kSampleSlices * kSampleSliceBytes) {
+        if (file_bytes > 0) {
+            SampleRange range;
+            range.Bytes = (uint32_t)file_bytes;
+            ranges.push_back(range);
+        }
+        return ranges;
+    }
+
+    const uint64_t stride = (file_bytes - kSampleSliceBytes) / (kSampleSlices - 1);
+    for (int i = 0; i < kSampleSlices; ++i) {
+        SampleRange range;
+        range.Offset = stride * i;
+        range.Bytes = kSampleSliceBytes;
+        ranges.push_back(range);
+    }
+    return ranges;
+}
+
+CompressionPlan GetFixedCompressionPlan(int level)
+{
+    CompressionPlan plan;
+    plan.Level = level;
+    return plan;
+}
+
+CompressionPlan PlanCompression(
+    const uint8_t* sample,
+    size_t sample_bytes,
+    uint64_t file_bytes,
+    const CompressionTarget& target,
+    ZstdDictionary* dictionary)
+{
+    CompressionPlan best = GetFixedCompressionPlan(1);
+    if (sample_bytes == 0) {
+        return best;
+    }
+
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    if (!cctx) {
+        spdlog::error("ZSTD_createCCtx failed");
+        return best;
+    }
+    std::vector<uint8_t> compressed(ZSTD_compressBound(sample_bytes));
+
+    int cores = target.Cores;
+    if (cores <= 0) {
+        cores = std::max((int)std::thread::hardware_concurrency(), 1);
+    }
+    const int workers = (cores > 1 && file_bytes > kMinWorkerBytes) ? cores : 0;
+    const uint64_t parallel = std::max<uint64_t>(std::min<uint64_t>(cores, file_bytes / kWorkerJobBytes), 1);
+
+    const double scale = file_bytes / (double)sample_bytes;
+
+    // Compresses the sample and predicts the result for the whole file.
+    // Returns false on failure
+    auto evaluate = [&](int level, CompressionPlan& plan) -> bool {
+        // The sender digests the dictionary once, so that is not timed
+        ZSTD_CDict* cdict = nullptr;
+        if (dictionary) {
+            cdict = dictionary->GetCDict(level);
+            if (!cdict) {
+                return false;
+            }
+        }
+
+        const uint64_t t0 = GetTimeUsec();
+        size_t bytes;
+        if (cdict) {
+            bytes = ZSTD_compress_usingCDict(
+                cctx,
+                compressed.data(), compressed.size(),
+                sample, sample_bytes,
+                cdict);
+        } else {
+            bytes = ZSTD_compressCCtx(
+                cctx,
+                compressed.data(), compressed.size(),
+                sample, sample_bytes,
+                level);
+        }
+        const uint64_t t1 = GetTimeUsec();
+
+        if (ZSTD_isError(bytes)) {
+            spdlog::error("ZSTD_compressCCtx failed: {} level={}", ZSTD_getErrorName(bytes), level);
+            return false;
+        }
+
+        plan.Level = level;
+        plan.CompressedBytes = (uint64_t)(bytes * scale);
+        plan.CompressUsec = (uint64_t)((t1 - t0) * scale);
+        plan.AirtimeUsec = EstimateAirtimeUsec(plan.CompressedBytes, target);
+        return true;
+    };
+
+    CompressionPlan stored;
+    stored.Stored = true;
+    if (!evaluate(ZSTD_minCLevel(), stored)) {
+        ZSTD_freeCCtx(cctx);
+        return best;
+    }
+    best = stored;
+
+    CompressionPlan plan;
+    plan.Workers = workers;
+    for (int level : kPlanLevels)
+    {
+        // Compression time only grows with level, so stop once it alone
+        // takes longer than the best plan so far
+        if (plan.CompressUsec >= best.GetTotalUsec()) {
+            break;
+        }
+
+        if (!evaluate(level, plan)) {
+            break;
+        }
+        plan.CompressUsec /= parallel;
+
+        if (level == kPlanLevels[0] && plan.CompressedBytes >= file_bytes * kIncompressibleRatio) {
+            break;
+        }
+
+        if (plan.GetTotalUsec() < best.GetTotalUsec()) {
+            best = plan;
+        }
+    }
+
+    ZSTD_freeCCtx(cctx);
+
+    if (best.Stored) {
+        return best;
+    }
+
+    const int window_log = (int)ZSTD_getCParams(best.Level, file_bytes, 0).windowLog;
+    if (window_log < kMaxLongWindowLog && file_bytes > ((uint64_t)1 << window_log))
+    {
+        const uint64_t single_usec = best.CompressUsec * (best.Workers > 0 ? parallel : 1);
+        const uint64_t extra_usec = single_usec - best.CompressUsec;
+
+        if (extra_usec < best.AirtimeUsec * kLongModeMinSavings) {
+            best.LongWindowLog = std::min(GetWindowLog(file_bytes), kMaxLongWindowLog);
+            best.Workers = 0;
+            best.CompressUsec = single_usec;
+        }
+    }
+
+    return best;
+}
+
+bool ApplyCompressionPlan(ZSTD_CCtx_s* cctx, const CompressionPlan& plan, ZstdDictionary* dictionary)
+{
+    const int level = plan.Stored ? ZSTD_minCLevel() : plan.Level;
+
+    size_t result = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    if (ZSTD_isError(result)) {
+        spdlog::error("ZSTD_c_compressionLevel failed: {} level={}", ZSTD_getErrorName(result), level);
+        return false;
+    }
+
+    // The dictionary id goes in the frame header for receivers
+    if (dictionary) {
+        ZSTD_CDict* cdict = dictionary->GetCDict(level);
+        if (!cdict) {
+            return false;
+        }
+        result = ZSTD_CCtx_refCDict(cctx, cdict);
+        if (ZSTD_isError(result)) {
+            spdlog::error("ZSTD_CCtx_refCDict failed: {}", ZSTD_getErrorName(result));
+            return false;
+        }
+    }
+
+    if (plan.Workers > 0) {
+        result = ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, plan.Workers);
+        if (ZSTD_isError(result)) {
+            // zstd was built without ZSTD_MULTITHREAD: Compress on this thread
+            spdlog::warn("ZSTD_c_nbWorkers failed: {}", ZSTD_getErrorName(result));
+        }
+    }
+
+    if (plan.LongWindowLog > 0) {
+        result = ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1);
+        if (!ZSTD_isError(result)) {
+            result = ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, plan.LongWindowLog);
+        }
+        if (ZSTD_isError(result)) {
+            spdlog::error("Long distance matching failed: {} window_log={}", ZSTD_getErrorName(result), plan.LongWindowLog);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+} // namespace lora
@@ -0,0 +1,337 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+#include "link_emulator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+using namespace std;
+
+namespace lora {
+
+
+//------------------------------------------------------------------------------
+// EmulatedLink
+
+void EmulatedLink::Shutdown()
+{
+    Interrupt();
+}
+
+bool EmulatedLink::Send(const uint8_t* data, int bytes)
+{
+    if (bytes <= 0 || bytes > GetMaxSendBytes()) {
+        spdlog::error("EmulatedLink::Send: invalid bytes={}", bytes);
+        return false;
+    }
+
+    uint8_t frame[kFrameV1HeaderBytes + kPacketMaxBytes];
+    const int frame_bytes = FrameParser::WriteFrame(data, bytes, frame, FrameVersion);
+
+    return SendFrame(frame, frame_bytes);
+}
+
+bool EmulatedLink::SendFrame(const uint8_t* frame, int frame_bytes)
+{
+    const int bytes = frame_bytes - GetFrameHeaderBytes(FrameVersion);
+    if (bytes <= 0 || bytes > GetMaxSendBytes()) {
+        spdlog::error("EmulatedLink::SendFrame: invalid frame_bytes={}", frame_bytes);
+        return false;
+    }
+
+    const uint64_t now_usec = GetTimeUsec();
+    if (AirBusyUntilUsec < now_usec) {
+        AirBusyUntilUsec = now_usec;
+    }
+
+    // Bytes still waiting in the radio buffer
+    const uint64_t buffered_bytes = (AirBusyUntilUsec - now_usec) * GetAirDataRateBps() / 8 / 1000000;
+    if (buffered_bytes + frame_bytes > (uint64_t)GetRadioBufferBytes()) {
+        std::lock_guard<std::mutex> locker(Emulator->Lock);
+        ++Emulator->Stats.OverrunFrames;
+        return true; // Radio silently drops it
+    }
+
+    AirBusyUntilUsec += GetAirtimeUsec(bytes);
+
+    Emulator->Transmit(this, AirBusyUntilUsec, frame, frame_bytes);
+    return true;
+}
+
+void EmulatedLink::Deliver(uint64_t deliver_usec, std::vector<uint8_t>&& bytes)
+{
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+
+        // Keep the inbox sorted by delivery time
+        auto it = Inbox.end();
+        while (it != Inbox.begin() && (it - 1)->DeliverUsec > deliver_usec) {
+            --it;
+        }
+        Inbox.insert(it, Delivery{ deliver_usec, std::move(bytes) });
+    }
+    Condition.notify_all();
+}
+
+bool EmulatedLink::Receive(const OnFrame& callback, int timeout_msec)
+{
+    std::vector<Delivery> ready;
+    {
+        std::unique_lock<std::mutex> locker(Lock);
+
+        const uint64_t deadline_usec = GetTimeUsec() + (uint64_t)timeout_msec * 1000;
+
+        for (;;)
+        {
+            const uint64_t now_usec = GetTimeUsec();
+            while (!Inbox.empty() && Inbox.front().DeliverUsec <= now_usec) {
+                ready.push_back(std::move(Inbox.front()));
+                Inbox.pop_front();
+            }
+            if (!ready.empty() || Interrupted || now_usec >= deadline_usec) {
+                break;
+            }
+
+            uint64_t wake_usec = deadline_usec;
+            if (!Inbox.empty() && Inbox.front().DeliverUsec < wake_usec) {
+                wake_usec = Inbox.front().DeliverUsec;
+            }
+            Condition.wait_for(locker, std::chrono::microseconds(wake_usec - now_usec));
+        }
+
+        Interrupted = false;
+    }
+
+    for (auto& delivery : ready)
+    {
+        int bytes = (int)delivery.Bytes.size();
+        if (bytes > Parser.GetWriteSpace()) {
+            bytes = Parser.GetWriteSpace();
+        }
+        memcpy(Parser.GetWritePtr(), delivery.Bytes.data(), bytes);
+        Parser.OnWrite(bytes);
+
+        const int crc_failures = Parser.Parse([&](const uint8_t* data, int frame_bytes, int rssi_dbm, int frame_version) {
+            Quality.OnFrame(rssi_dbm);
+            callback(data, frame_bytes, rssi_dbm, frame_version);
+        });
+        Quality.OnCrcFailures(crc_failures);
+    }
+
+    return true;
+}
+
+void EmulatedLink::Interrupt()
+{
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        Interrupted = true;
+    }
+    Condition.notify_all();
+}
+
+RadioProfile EmulatedLink::GetRadioProfile() const
+{
+    std::lock_guard<std::mutex> locker(Emulator->Lock);
+    return Profile;
+}
+
+bool EmulatedLink::SetRadioProfile(const RadioProfile& profile)
+{
+    if (!profile.IsValid()) {
+        spdlog::error("EmulatedLink::SetRadioProfile: Unsupported profile {}", profile.ToString());
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(Emulator->Lock);
+        Profile = profile;
+    }
+
+    // Frames in flight at the old air rate are not heard
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        Inbox.clear();
+    }
+    Parser.Reset();
+
+    return true;
+}
+
+int EmulatedLink::GetRadioBufferBytes() const
+{
+    return Emulator->Settings.RadioBufferBytes;
+}
+
+int EmulatedLink::GetChannelCount() const
+{
+    return Emulator->Settings.ChannelCount;
+}
+
+bool EmulatedLink::SetChannel(int channel)
+{
+    if (channel < 0 || channel >= GetChannelCount()) {
+        spdlog::error("EmulatedLink::SetChannel: invalid channel={}", channel);
+        return false;
+    }
+
+    Channel = channel;
+
+    // Frames in flight on the old channel are not heard
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        Inbox.clear();
+    }
+    Parser.Reset();
+
+    return true;
+}
+
+bool EmulatedLink::GetChannelNoise(std::vector<float>& noise_dbm)
+{
+    if (Emulator->Settings.ChannelNoiseDbm.empty()) {
+        return false;
+    }
+    noise_dbm = Emulator->Settings.ChannelNoiseDbm;
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// LinkEmulator
+
+void LinkEmulator::Initialize(const LinkEmulatorSettings& settings)
+{
+    std::lock_guard<std::mutex> locker(Lock);
+
+    Settings = settings;
+    Prng.seed(settings.Seed);
+    BadState = false;
+    Stats = LinkEmulatorStats();
+    Links.clear();
+}
+
+std::shared_ptr<EmulatedLink> LinkEmulator::CreateLink(int channel)
+{
+    auto link = std::make_shared<EmulatedLink>();
+    link->Emulator = shared_from_this();
+    link->Channel = channel;
+
+    link->Quality.Reset();
+
+    if (!link->Parser.Initialize(true)) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> locker(Lock);
+    Links.push_back(link);
+    return link;
+}
+
+LinkEmulatorStats LinkEmulator::GetStats()
+{
+    std::lock_guard<std::mutex> locker(Lock);
+    return Stats;
+}
+
+bool LinkEmulator::Chance(float probability)
+{
+    if (probability <= 0.f) {
+        return false;
+    }
+    return std::uniform_real_distribution<float>(0.f, 1.f)(Prng) < probability;
+}
+
+float LinkEmulator::GetNoiseLossRate(int channel) const
+{
+    if (channel >= (int)Settings.ChannelNoiseDbm.size()) {
+        return 0.f;
+    }
+    const float loss = (Settings.ChannelNoiseDbm[channel] - Settings.NoiseFloorDbm) * Settings.LossPerNoiseDb;
+    return std::min(std::max(loss, 0.f), 1.f);
+}
+
+void LinkEmulator::Transmit(EmulatedLink* sender, uint64_t deliver_usec, const uint8_t* frame, int frame_bytes)
+{
+    std::vector<std::shared_ptr<EmulatedLink>> receivers;
+    std::vector<uint8_t> bytes(frame, frame + frame_bytes);
+
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+
+        ++Stats.SentFrames;
+
+        const int channel = sender->GetChannel();
+
+        bool lost = Chance(Settings.LossRate) || Chance(GetNoiseLossRate(channel));
+
+        if (Settings.ProfileLossRate && Chance(Settings.ProfileLossRate(sender->Profile))) {
+            lost = true;
+        }
+
+        if (Settings.GoodToBadRate > 0.f)
+        {
+            if (BadState) {
+                BadState = !Chance(Settings.BadToGoodRate);
+            } else {
+                BadState = Chance(Settings.GoodToBadRate);
+            }
+            if (Chance(BadState ? Settings.BadLossRate : Settings.GoodLossRate)) {
+                lost = true;
+            }
+        }
+
+        if (lost) {
+            ++Stats.LostFrames;
+            return;
+        }
+
+        if (Settings.ByteErrorRate > 0.f)
+        {
+            bool corrupted = false;
+            for (auto& b : bytes) {
+                if (Chance(Settings.ByteErrorRate)) {
+                    b ^= (uint8_t)(1 + Prng() % 255);
+                    corrupted = true;
+                }
+            }
+            if (corrupted) {
+                ++Stats.CorruptedFrames;
+            }
+        }
+
+        if (Chance(Settings.TruncationRate)) {
+            bytes.resize(Prng() % bytes.size());
+            ++Stats.TruncatedFrames;
+        }
+
+        int rssi_dbm = Settings.SignalDbm;
+        if (Settings.SignalJitterDb > 0) {
+            rssi_dbm += (int)(Prng() % (2 * Settings.SignalJitterDb + 1)) - Settings.SignalJitterDb;
+        }
+        bytes.push_back((uint8_t)(rssi_dbm + 256));
+
+        for (auto& weak : Links) {
+            auto link = weak.lock();
+            if (link && link.get() != sender && link->GetChannel() == channel &&
+                link->Profile.AirRateBps == sender->Profile.AirRateBps)
+            {
+                receivers.push_back(link);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < receivers.size(); ++i)
+    {
+        std::vector<uint8_t> copy;
+        if (i + 1 < receivers.size()) {
+            copy = bytes;
+        } else {
+            copy = std::move(bytes);
+        }
+        receivers[i]->Deliver(deliver_usec, std::move(copy));
+    }
+}
+
+
+} // namespace lora
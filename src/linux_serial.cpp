@@ -5,6 +5,8 @@
 #include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -72,7 +74,7 @@ bool RawSerialPort::Initialize(const char* port_file, int baudrate)
     fd = open(port_file, O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK);
     if (fd < 0) {
         spdlog::error("Unable to open serial port: {}", port_file);
-        return -1;
+        return false;
     }
 
     fcntl(fd, F_SETFL, O_RDWR);
@@ -131,6 +133,40 @@ void RawSerialPort::Flush()
     }
 }
 
+bool RawSerialPort::Drain()
+{
+    if (tcdrain(fd) != 0) {
+        spdlog::error("tcdrain failed: errno={}", errno);
+        return false;
+    }
+    return true;
+}
+
+bool RawSerialPort::SetBaudrate(int baudrate)
+{
+    int baud = BaudrateToBaud(baudrate);
+    if (baud < 0) {
+        spdlog::error("Invalid baudrate: {}", baudrate);
+        return false;
+    }
+
+    struct termios options;
+    if (tcgetattr(fd, &options) != 0) {
+        spdlog::error("tcgetattr failed: errno={}", errno);
+        return false;
+    }
+
+    cfsetispeed(&options, baud);
+    cfsetospeed(&options, baud);
+
+    if (tcsetattr(fd, TCSADRAIN, &options) != 0) {
+        spdlog::error("tcsetattr failed: errno={}", errno);
+        return false;
+    }
+
+    return true;
+}
+
 int RawSerialPort::GetSendQueueBytes()
 {
     int result = 0;
@@ -182,4 +218,76 @@ int RawSerialPort::Read(void* data, int bytes)
 }
 
 
+//------------------------------------------------------------------------------
+// SerialReactor
+
+bool SerialReactor::Initialize()
+{
+    Shutdown();
+
+    WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (WakeFd < 0) {
+        spdlog::error("eventfd failed: errno={}", errno);
+        return false;
+    }
+
+    return true;
+}
+
+void SerialReactor::Shutdown()
+{
+    if (WakeFd != -1) {
+        close(WakeFd);
+        WakeFd = -1;
+    }
+}
+
+int SerialReactor::Wait(const RawSerialPort& port, int timeout_msec)
+{
+    struct pollfd fds[2];
+    fds[0].fd = port.GetFd();
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = WakeFd;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+
+    int r = poll(fds, 2, timeout_msec);
+    if (r < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        spdlog::error("poll failed: errno={}", errno);
+        return -1;
+    }
+
+    if (fds[1].revents & POLLIN) {
+        // Clear the wake event so the next Wait() will block again
+        uint64_t value = 0;
+        if (read(WakeFd, &value, sizeof(value)) < 0) {
+            // Another thread may have already cleared it
+        }
+    }
+
+    if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+        spdlog::error("serial port poll error: revents={}", fds[0].revents);
+        return -1;
+    }
+
+    return (fds[0].revents & POLLIN) ? 1 : 0;
+}
+
+void SerialReactor::Wake()
+{
+    if (WakeFd == -1) {
+        return;
+    }
+
+    const uint64_t value = 1;
+    if (write(WakeFd, &value, sizeof(value)) < 0) {
+        spdlog::warn("SerialReactor::Wake: write failed: errno={}", errno);
+    }
+}
+
+
 } // namespace lora
@@ -5,7 +5,12 @@
 #include "zstd.h" // zstd_lib subproject
 
 #include <cstring>
+#include <cstdlib>
 #include <cassert>
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <random>
 #include <sstream>
 using namespace std;
 
@@ -21,24 +26,154 @@ static const int kRendezvousChannel = 42;
 
 static const uint16_t kSenderAddr = 1;
 
-static const int kZstdCompressLevel = 1;
+/*
+    Size of periodic version 1 info sync message:
+    [file bytes(4)] [file hash(4)] [next block id(4)] [decompressed bytes(4)] [block bytes(2)]
+*/
+static const int kInfoBytes = 4 + 4 + 4 + 4 + 2;
 
-// We need size + crc + offset header on each frame, eating into the 240 max.
-// We add one byte for block id to the block data.
-static const int kBlockBytes = kPacketMaxBytes - 1;
+// Longest time to block waiting for radio data before checking timeouts
+static const int kReceiveWaitMsec = 100;
 
-// Size of periodic info sync message
-static const int kInfoBytes = 4 + 4 + 4 + 4;
+// Longest time to sleep waiting for the HAT to have room, to check for shutdown
+static const int kMaxPaceWaitUsec = 100 * 1000;
+
+// Interval between goodput reports from the sender and link quality reports
+// from the receiver
+static const uint64_t kStatsIntervalUsec = 10 * 1000 * 1000;
+
+// Time to sleep when a FrameRing is full or empty.  Much shorter than the
+// airtime of a frame, so the encode-ahead thread keeps up
+static const int kFrameRingWaitUsec = 1000;
+
+// Decode thread wakes up this often to check for shutdown
+static const int kDecodeWaitMsec = 100;
+
+/*
+    Size of data channel announcement:
+    [file hash(4)] [channel(1)] [air rate index(1)] [packet size index(1)]
+*/
+static const int kAnnounceBytes = 4 + 1 + 1 + 1;
+
+// Sender returns to the rendezvous channel this often to announce the data
+// channel and profile
+static const uint64_t kAnnounceIntervalUsec = 5 * 1000 * 1000;
+
+// Announcements sent on each visit to the rendezvous channel, in case some are lost
+static const int kAnnounceRepeat = 3;
+
+// Receivers return to the rendezvous channel after this long without frames
+static const uint64_t kDataChannelTimeoutUsec = 3 * 1000 * 1000;
+
+// Only leave the rendezvous channel for one at least this much quieter
+static const float kMinChannelGainDb = 3.f;
+
+// Frames needed to record a loss measurement for a profile
+static const uint64_t kMinMeasuredFrames = 32;
+
+// FileSender::InitializeFromFile() maps and compresses this much of the file at a time
+static const uint32_t kReadChunkBytes = 4 * 1024 * 1024;
+
+/*
+    zstd level for delta files, unless FileSenderSettings::CompressionLevel
+    is set.  The planner's sample cannot see matches in the base file, so
+    it would predict far more airtime than a delta takes.  Level 9 finds
+    about 20% more matches than level 3 in a grown log for little CPU time,
+    and level 19 takes seconds to save a block or two.
+*/
+static const int kDeltaCompressionLevel = 9;
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+static int GetBlockHeaderBytes(int frame_version)
+{
+    return frame_version == kFrameVersion1 ? kBlockV1HeaderBytes : kBlockHeaderBytes;
+}
+
+// Sequence number of a block in the order senders send them: Runs of
+// kBlockRunLength block ids that take turns between the generations
+static uint32_t GetBlockSequence(uint32_t block_id, unsigned generation, unsigned generation_count)
+{
+    const uint32_t run = block_id / kBlockRunLength;
+    return (run * generation_count + generation) * kBlockRunLength + block_id % kBlockRunLength;
+}
+
+std::shared_ptr<IRadioLink> OpenWaveshareLink(const std::string& spec, bool sender)
+{
+    // Split from the right so the device path may contain ':'
+    std::string fields[4];
+    std::string rest = spec;
+    for (int i = 3; i > 0; --i) {
+        const size_t colon = rest.find_last_of(':');
+        if (colon == std::string::npos) {
+            spdlog::error("Expected serial_device:m0_pin:m1_pin:channel but got: {}", spec);
+            return nullptr;
+        }
+        fields[i] = rest.substr(colon + 1);
+        rest = rest.substr(0, colon);
+    }
+    fields[0] = rest;
+
+    WaveshareDevice device;
+    device.SerialDevice = fields[0];
+    device.M0Pin = atoi(fields[1].c_str());
+    device.M1Pin = atoi(fields[2].c_str());
+    const int channel = atoi(fields[3].c_str());
+
+    if (channel < 0 || channel >= kChannelCount) {
+        spdlog::error("Invalid channel: {}", spec);
+        return nullptr;
+    }
+
+    // Only the sender uses the ambient noise scan, to pick a data channel
+    auto waveshare = std::make_shared<Waveshare>();
+    if (!waveshare->Initialize(
+        channel,
+        sender ? kSenderAddr : kMonitorAddress,
+        false,
+        sender ? RssiScan::Cached : RssiScan::Skip,
+        device))
+    {
+        spdlog::error("Waveshare.Initialize failed: {}", spec);
+        return nullptr;
+    }
+
+    return waveshare;
+}
 
 
 //------------------------------------------------------------------------------
 // FileReceiver
 
-bool FileReceiver::Initialize(OnReceiveProgress on_recv)
+bool FileReceiver::Initialize(
+    OnReceiveProgress on_recv,
+    std::shared_ptr<IRadioLink> link)
+{
+    std::vector<std::shared_ptr<IRadioLink>> links;
+    if (link) {
+        links.push_back(link);
+    }
+    return Initialize(on_recv, links);
+}
+
+bool FileReceiver::Initialize(
+    OnReceiveProgress on_recv,
+    const std::vector<std::shared_ptr<IRadioLink>>& links,
+    const FileReceiverSettings& settings)
 {
     Shutdown();
 
     OnRecv = on_recv;
+    Settings = settings;
+
+    Decompressor = ZSTD_createDCtx();
+    if (!Decompressor) {
+        spdlog::error("ZSTD_createDCtx failed");
+        return false;
+    }
+    DecompressorOutput.resize(ZSTD_DStreamOutSize());
 
     WirehairResult wr = wirehair_init();
     if (wr != Wirehair_Success) {
@@ -46,70 +181,239 @@ bool FileReceiver::Initialize(OnReceiveProgress on_recv)
         return false;
     }
 
-    if (!Uplink.Initialize(kRendezvousChannel, kMonitorAddress)) {
-        spdlog::error("Uplink.Initialize failed");
-        return false;
+    if (links.empty()) {
+        auto waveshare = std::make_shared<Waveshare>();
+        if (!waveshare->Initialize(kRendezvousChannel, kMonitorAddress, false, RssiScan::Skip)) {
+            spdlog::error("Uplink.Initialize failed");
+            return false;
+        }
+        Links.resize(1);
+        Links[0].Uplink = waveshare;
+    } else {
+        Links.resize(links.size());
+        for (size_t i = 0; i < links.size(); ++i) {
+            Links[i].Uplink = links[i];
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(StatsLock);
+        TimingStats = ReceiverTimingStats();
     }
 
     Terminated = false;
-    Thread = std::make_shared<std::thread>(&FileReceiver::Loop, this);
+    LastReceiveUsec = 0;
+    DecodeThread = std::make_shared<std::thread>(&FileReceiver::DecodeLoop, this);
+    for (int i = 0; i < (int)Links.size(); ++i) {
+        Links[i].Thread = std::make_shared<std::thread>(&FileReceiver::Loop, this, i);
+    }
     return true;
 }
 
 void FileReceiver::Shutdown()
 {
-    Uplink.Shutdown();
+    Terminated = true;
+    for (auto& link : Links) {
+        link.Uplink->Interrupt();
+    }
+    for (auto& link : Links) {
+        JoinThread(link.Thread);
+    }
 
-    wirehair_free(Decoder);
-    Decoder = nullptr;
-}
+    for (auto& link : Links) {
+        link.Uplink->Shutdown();
+    }
+    Links.clear();
 
-bool FileReceiver::InitDecoder(uint32_t file_bytes)
-{
-    Decoder = wirehair_decoder_create(Decoder, file_bytes, kFileBlockBytes);
-    if (!Decoder) {
-        spdlog::error("wirehair_decoder_create failed");
-        return false;
+    {
+        std::lock_guard<std::mutex> locker(DecodeLock);
+        DecodeCondition.notify_all();
     }
-    return true;
+    JoinThread(DecodeThread);
+
+    DecodeQueue.clear();
+    FreeDecoders();
+
+    ZSTD_freeDCtx(Decompressor);
+    Decompressor = nullptr;
+
+    OutputFile.Abort();
+    BaseFile.Close();
 }
 
-void FileReceiver::OnFileInfo(uint32_t file_bytes, uint32_t hash, uint32_t next_block_id, uint32_t decompressed_bytes)
+void FileReceiver::OnFileInfo(int link_index, uint32_t file_bytes, uint32_t hash, uint32_t next_block_id, uint32_t decompressed_bytes, uint32_t block_bytes)
 {
-    if (file_bytes <= 0 || decompressed_bytes < 2) {
+    if (file_bytes <= 0 || decompressed_bytes < 2 || block_bytes <= 0 || block_bytes >= kPacketMaxBytes) {
         spdlog::warn("Ignored invalid file info");
         return;
     }
 
-    NextBlockId = next_block_id;
+    Links[link_index].NextBlockId = next_block_id;
 
-    // If file changed mid-transmit:
-    if (FileBytes != file_bytes || FileHash != hash || DecompressedBytes != decompressed_bytes)
+    // If file or block size changed mid-transmit:
+    if (FileFrameVersion != kFrameVersion1 || FileBytes != file_bytes || FileHash != hash || DecompressedBytes != decompressed_bytes || BlockBytes != block_bytes)
     {
-        TransferComplete = false;
+        // The sender runs the links in lockstep, so this is a good starting
+        // point for links that have not sent file info yet
+        for (auto& link : Links) {
+            link.NextBlockId = next_block_id;
+        }
 
-        spdlog::info("Detected new file transfer starting [{} bytes]", file_bytes);
+        StartFile(kFrameVersion1, file_bytes, block_bytes, 1, hash, decompressed_bytes);
+    }
+}
+
+void FileReceiver::OnBlockFrame(int link_index, const uint8_t* data, int bytes)
+{
+    const uint16_t block_id = ReadU16_LE(data);
+    const int session = data[2] & ~kSessionGenerationFlag;
+    const uint16_t block_count = ReadU16_LE(data + 3);
+
+    int header_bytes = kBlockHeaderBytes;
+    unsigned generation = 0;
+    uint32_t generation_count = 1;
+    if (data[2] & kSessionGenerationFlag)
+    {
+        header_bytes += kGenerationHeaderBytes;
+        if (bytes <= header_bytes) {
+            spdlog::warn("Ignoring truncated block: {} bytes", bytes);
+            return;
+        }
+        generation = ReadU16_LE(data + 5);
+        generation_count = ReadU16_LE(data + 7);
+    }
+    const int block_bytes = bytes - header_bytes;
 
-        if (InitDecoder(file_bytes)) {
-            FileBytes = file_bytes;
-            FileHash = hash;
-            DecompressedBytes = decompressed_bytes;
+    if (session != Session)
+    {
+        if (Session >= 0) {
+            spdlog::info("Detected new sender session");
         }
+        ResetTransfer();
+        Session = session;
+    }
+
+    if (block_count < 2 || generation >= generation_count) {
+        spdlog::warn("Ignored block with invalid block count {} or generation {}/{}", block_count, generation, generation_count);
+        return;
+    }
 
-        TotalBlockCount = (FileBytes + kFileBlockBytes - 1) / kFileBlockBytes;
-        FileBlockCount = 0;
+    const uint64_t file_bytes = (uint64_t)generation_count * block_count * block_bytes;
+    if (file_bytes > UINT32_MAX) {
+        spdlog::warn("Ignored block for {} byte file", file_bytes);
+        return;
+    }
 
-        OnRecv(0.f, nullptr, nullptr, 0);
+    // Drop files the decode thread could not use before they are decoded again
+    if (session == RejectedSession && file_bytes == RejectedFileBytes) {
+        Links[link_index].Uplink->GetLinkQuality().OnSequence(GetBlockSequence(block_id, generation, generation_count), kBlockRunLength);
+        return;
+    }
 
-        for (auto& block : BufferedBlocks) {
-            OnBlock(block[0], block.data() + 1, kFileBlockBytes);
+    // The sender changes block size with the packet size
+    if (FileFrameVersion != kFrameVersion2 || FileBytes != file_bytes ||
+        BlockBytes != (uint32_t)block_bytes || GenerationCount != generation_count)
+    {
+        StartFile(kFrameVersion2, (uint32_t)file_bytes, block_bytes, generation_count);
+        if (FileBytes == 0) {
+            return; // Try again with the next block
         }
+    }
+
+    OnBlock(link_index, kFrameVersion2, generation, block_id, data + header_bytes, block_bytes);
+}
+
+void FileReceiver::StartFile(int frame_version, uint32_t file_bytes, uint32_t block_bytes, uint32_t generation_count, uint32_t hash, uint32_t decompressed_bytes)
+{
+    TransferComplete = false;
+
+    spdlog::info("Detected new file transfer starting [{} bytes in {} byte blocks, {} generations]", file_bytes, block_bytes, generation_count);
+
+    const uint32_t generation_bytes = file_bytes / generation_count;
+
+    FileFrameVersion = frame_version;
+    FileBytes = file_bytes;
+    FileHash = hash;
+    DecompressedBytes = decompressed_bytes;
+    BlockBytes = block_bytes;
+
+    GenerationCount = generation_count;
+    GenerationBytes = generation_bytes;
+    DecodedGenerations.assign(generation_count, 0);
+
+    TotalBlockCount = generation_count * ((GenerationBytes + BlockBytes - 1) / BlockBytes);
+    FileBlockCount = 0;
+
+    NewTransferId();
+
+    OnRecv(0.f, nullptr, nullptr, 0);
+
+    // Only version 1 blocks are buffered, and they have one generation
+    for (auto& block : BufferedBlocks) {
+        OnBlock(block[0], block[1], 0, ReadU16_LE(block.data() + 2), block.data() + 4, (int)block.size() - 4);
+    }
+
+    BufferedBlocks.clear();
+}
+
+void FileReceiver::ResetTransfer()
+{
+    // Let the decode thread finish a file that was fully received
+    const bool drop_file = !TransferComplete;
+
+    FileFrameVersion = 0;
+    FileBytes = 0;
+    FileHash = 0;
+    BlockBytes = 0;
+    GenerationCount = 0;
+    GenerationBytes = 0;
+    TransferComplete = false;
+    Session = -1;
+    for (auto& link : Links) {
+        link.NextBlockId = 0;
+    }
+    BufferedBlocks.clear();
 
-        BufferedBlocks.clear();
+    if (drop_file) {
+        NewTransferId();
     }
 }
 
-void FileReceiver::OnBlock(uint8_t truncated_id, const void* data, int bytes)
+void FileReceiver::NewTransferId()
+{
+    ++TransferId;
+
+    DecodeJob job;
+    QueueDecodeJob(job);
+}
+
+void FileReceiver::QueueBlock(unsigned generation, uint32_t block_id, const void* data, int bytes)
+{
+    DecodeJob job;
+    job.Generation = generation;
+    job.BlockId = block_id;
+    job.Block.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + bytes);
+    QueueDecodeJob(job);
+}
+
+void FileReceiver::QueueDecodeJob(DecodeJob& job)
+{
+    job.Info.TransferId = TransferId;
+    job.Info.FrameVersion = FileFrameVersion;
+    job.Info.Session = Session;
+    job.Info.GenerationCount = GenerationCount;
+    job.Info.GenerationBytes = GenerationBytes;
+    job.Info.BlockBytes = BlockBytes;
+    job.Info.DecompressedBytes = DecompressedBytes;
+    job.Info.FileHash = FileHash;
+    job.QueuedUsec = GetTimeUsec();
+
+    std::lock_guard<std::mutex> locker(DecodeLock);
+    DecodeQueue.push_back(std::move(job));
+    DecodeCondition.notify_all();
+}
+
+void FileReceiver::OnBlock(int link_index, int frame_version, unsigned generation, uint16_t truncated_id, const void* data, int bytes)
 {
     if (TransferComplete) {
         return; // Ignore more data
@@ -120,293 +424,1643 @@ void FileReceiver::OnBlock(uint8_t truncated_id, const void* data, int bytes)
     {
         spdlog::debug("Buffering a block");
 
-        std::vector<uint8_t> temp(1 + bytes);
-        temp[0] = truncated_id;
-        memcpy(temp.data() + 1, data, bytes);
+        std::vector<uint8_t> temp(4 + bytes);
+        temp[0] = (uint8_t)link_index;
+        temp[1] = (uint8_t)frame_version;
+        WriteU16_LE(temp.data() + 2, truncated_id);
+        memcpy(temp.data() + 4, data, bytes);
 
         BufferedBlocks.push_back(temp);
         return;
     }
 
-    NextBlockId = Counter32::ExpandFromTruncated(NextBlockId, Counter8(truncated_id));
+    if ((uint32_t)bytes != BlockBytes) {
+        spdlog::debug("Ignoring {} byte block: Expected {} bytes", bytes, BlockBytes);
+        return;
+    }
 
-    WirehairResult r = wirehair_decode(Decoder, NextBlockId.ToUnsigned(), data, bytes);
-    if (r == Wirehair_NeedMore)
+    uint32_t block_id = truncated_id;
+    if (frame_version == kFrameVersion1)
     {
-        ++FileBlockCount;
-        const float progress = FileBlockCount / (float)TotalBlockCount;
-        OnRecv(progress, nullptr, nullptr, 0);
-        return;
+        Counter32& next_block_id = Links[link_index].NextBlockId;
+        next_block_id = Counter32::ExpandFromTruncated(next_block_id, Counter8((uint8_t)truncated_id));
+        block_id = next_block_id.ToUnsigned();
     }
 
-    // Point of no return for this file
-    TransferComplete = true;
+    Links[link_index].Uplink->GetLinkQuality().OnSequence(GetBlockSequence(block_id, generation, GenerationCount), kBlockRunLength);
 
-    if (r != Wirehair_Success) {
-        spdlog::error("wirehair_decode failed: {}", wirehair_result_string(r));
-        FileBytes = 0;
-        return;
+    if (DecodedGenerations[generation]) {
+        return; // Generation already decoded
     }
 
-    spdlog::info("File transfer complete!  Recovering...");
+    // The decode thread runs wirehair_decode(), including the solve
+    QueueBlock(generation, block_id, data, bytes);
 
-    uint64_t t0 = GetTimeUsec();
+    ++FileBlockCount;
+    const float progress = FileBlockCount / (float)TotalBlockCount;
+    OnRecv(progress < 1.f ? progress : 0.99f, nullptr, nullptr, 0);
+}
 
-    FileData.resize(FileBytes);
-    r = wirehair_recover(Decoder, FileData.data(), FileData.size());
-    if (r != Wirehair_Success) {
-        spdlog::error("wirehair_recover failed: {}", wirehair_result_string(r));
-        FileBytes = 0;
-        return;
-    }
+void FileReceiver::DecodeLoop()
+{
+    spdlog::debug("FileReceiver::DecodeLoop() started");
 
-    uint64_t t1 = GetTimeUsec();
+    // Solving and decompressing yield to the link threads on a single core
+    SetCurrentThreadBackground();
 
-    spdlog::debug("Recovery complete in {} msec.  Decompressing...", (t1 - t0) / 1000.f);
+    while (!Terminated)
+    {
+        DecodeJob job;
+        {
+            std::unique_lock<std::mutex> locker(DecodeLock);
+            DecodeCondition.wait_for(locker, std::chrono::milliseconds(kDecodeWaitMsec), [this]() {
+                return Terminated || !DecodeQueue.empty();
+            });
+            if (Terminated || DecodeQueue.empty()) {
+                continue;
+            }
+            job = std::move(DecodeQueue.front());
+            DecodeQueue.pop_front();
+        }
 
-    // FIXME: We add one extra kBlockBytes to work-around an issue with Wirehair, where it does not
-    // accept input smaller than 2 blocks long.
-    FileData.resize(FileData.size() - kBlockBytes);
-
-    DecompressedData.resize(DecompressedBytes);
-    size_t decompress_result = ZSTD_decompress(
-        DecompressedData.data(), DecompressedBytes,
-        FileData.data(), FileData.size());
-    if (decompress_result != DecompressedBytes) {
-        spdlog::error("ZSTD_decompress failed: {}", ZSTD_getErrorName(decompress_result));
-        FileBytes = 0;
-        return;
+        OnDecodeJob(job);
     }
 
-    uint64_t t2 = GetTimeUsec();
+    spdlog::debug("FileReceiver::DecodeLoop() stopped");
+}
 
-    spdlog::debug("Decompression complete in {} msec.  Validating...", (t2 - t1) / 1000.f);
+void FileReceiver::OnDecodeJob(const DecodeJob& job)
+{
+    if (job.Info.TransferId != Stream.TransferId) {
+        StartStream(job.Info);
+    }
 
-    const uint32_t hash = FastCrc32(DecompressedData.data(), DecompressedData.size());
-    if (hash != FileHash) {
-        spdlog::error("File hash did not match");
-        FileBytes = 0;
+    // If the transfer was reset, or the file failed:
+    if (job.Block.empty() || StreamFailed) {
         return;
     }
 
-    uint64_t t3 = GetTimeUsec();
-
-    spdlog::debug("Validation complete in {} msec", (t3 - t2) / 1000.f);
-
-    const int file_name_bytes = DecompressedData[0];
-    const int header_bytes = 1 + file_name_bytes + 1;
-    if (header_bytes > (int)DecompressedBytes) {
-        spdlog::error("Malformed decompressed data");
-        FileBytes = 0;
-        return;
+    {
+        std::lock_guard<std::mutex> locker(StatsLock);
+        TimingStats.DecodeQueueWait.Add(GetTimeUsec() - job.QueuedUsec);
     }
 
-    // Enforce null-terminated string
-    DecompressedData[1 + file_name_bytes] = '\0';
+    if (!DecodeBlock(job))
+    {
+        StreamFailed = true;
+        OutputFile.Abort();
+        FreeDecoders();
 
-    const char* file_name = (const char*)&DecompressedData[1];
+        std::lock_guard<std::mutex> locker(Lock);
 
-    const uint8_t* file_data = DecompressedData.data() + header_bytes;
-    const int file_bytes = DecompressedBytes - header_bytes;
+        // Stop receiving a file that would fail again, until the sender
+        // starts a new session or sends another size
+        if (StreamRejected && Stream.FrameVersion == kFrameVersion2)
+        {
+            spdlog::info("Ignoring the rest of this file");
+            RejectedSession = Stream.Session;
+            RejectedFileBytes = Stream.GenerationCount * Stream.GenerationBytes;
+        }
 
-    OnRecv(1.f, file_name, file_data, file_bytes);
+        // Receive the file again if the link threads are still on it
+        if (Stream.TransferId == TransferId) {
+            TransferComplete = true;
+            FileBytes = 0;
+        }
+    }
 }
 
-void FileReceiver::Loop()
+bool FileReceiver::DecodeBlock(const DecodeJob& job)
 {
-    spdlog::debug("FileReceiver::Loop started");
+    const unsigned generation = job.Generation;
+    if (generation >= Stream.GenerationCount || SolvedGenerations[generation]) {
+        return true; // Generation already decoded
+    }
 
-    uint64_t LastReceiveUsec = 0;
+    const uint64_t t0 = GetTimeUsec();
 
-    while (!Terminated)
+    /*
+        Wirehair sends the data itself as the first blocks, so block 0 starts
+        the file.  If it holds a whole delta frame, check the base file now
+        rather than after collecting and solving the first generation.
+    */
+    if (generation == 0 && job.BlockId == 0 && job.Block.size() >= (size_t)kDeltaFrameHeaderBytes &&
+        ReadU32_LE(job.Block.data()) == kDeltaFrameMagic &&
+        8 + (uint64_t)ReadU32_LE(job.Block.data() + 4) <= job.Block.size())
     {
-        if (!Uplink.Receive([&](const uint8_t* data, int bytes)
-        {
-            /*
-                To decode the file we need to know its total length ahead of time.
-                Otherwise we just need a truncated 8-bit block identifier on each block.
+        size_t frame_offset = 0;
+        if (!OpenBaseFile(job.Block.data(), job.Block.size(), frame_offset)) {
+            StreamRejected = true;
+            return false;
+        }
 
-                Occasionally the sender will send the length and file hash and full
-                32-bit block identifier.
-                We can buffer up data for a while until this is received.
-            */
+        // Opened again once the generation is recovered
+        BaseFile.Close();
+    }
 
-            if (bytes == kInfoBytes) {
-                OnFileInfo(ReadU32_LE(data), ReadU32_LE(data + 4), ReadU32_LE(data + 8), ReadU32_LE(data + 12));
-            } else if (bytes == kPacketMaxBytes) {
-                OnBlock(data[0], data + 1, bytes - 1);
-            } else {
-                spdlog::warn("Ignoring bogon: {} bytes", bytes);
-            }
+    WirehairCodec& decoder = Decoders[generation];
+    if (!decoder)
+    {
+        // The final block of a generation runs the solve
+        const unsigned solve_threads = (unsigned)std::max(Settings.SolveThreads, 1);
 
-            LastReceiveUsec = GetTimeUsec();
-        })) {
-            spdlog::error("Receive loop failed");
-            break;
+        decoder = wirehair_decoder_create_threads(nullptr, Stream.GenerationBytes, Stream.BlockBytes, solve_threads);
+        if (!decoder) {
+            spdlog::error("wirehair_decoder_create_threads failed");
+            return false;
         }
+    }
 
-        const int64_t dt = GetTimeUsec() - LastReceiveUsec;
-        const int64_t timeout_usec = 20 * 1000 * 1000;
-        if (dt > timeout_usec)
+    const WirehairResult r = wirehair_decode(decoder, job.BlockId, job.Block.data(), (uint32_t)job.Block.size());
+
+    const uint64_t t1 = GetTimeUsec();
+    {
+        std::lock_guard<std::mutex> locker(StatsLock);
+        TimingStats.Decode.Add(t1 - t0);
+    }
+
+    if (r == Wirehair_NeedMore) {
+        return true;
+    }
+    if (r != Wirehair_Success) {
+        spdlog::error("wirehair_decode failed for generation {}: {}", generation, wirehair_result_string(r));
+        return false;
+    }
+
+    SolvedGenerations[generation] = 1;
+
+    // Tell the link threads to stop queueing blocks for the generation
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        if (Stream.TransferId == TransferId && generation < DecodedGenerations.size())
         {
-            if (FileBytes != 0)
-            {
-                spdlog::info("Timeout while receiving file from sender.  Resetting and waiting for next file...");
-                FileBytes = 0;
-                FileHash = 0;
-                NextBlockId = 0;
-                BufferedBlocks.clear();
+            DecodedGenerations[generation] = 1;
+
+            if (std::find(DecodedGenerations.begin(), DecodedGenerations.end(), 0) == DecodedGenerations.end()) {
+                // Point of no return for this file
+                TransferComplete = true;
             }
         }
-
-        usleep(4000);
     }
 
-    spdlog::debug("FileReceiver::Loop stopped");
-}
+    const bool streamed = StreamGenerations();
 
+    std::lock_guard<std::mutex> locker(StatsLock);
+    TimingStats.Recover.Add(GetTimeUsec() - t1);
+    return streamed;
+}
 
-//------------------------------------------------------------------------------
-// FileSender
+void FileReceiver::StartStream(const StreamInfo& info)
+{
+    // Drop the file that was being decoded, if it was not finished
+    FreeDecoders();
+    OutputFile.Abort();
+    BaseFile.Close();
+
+    Stream = info;
+    StreamFailed = false;
+    StreamRejected = false;
+    Decoders.assign(info.GenerationCount, nullptr);
+    SolvedGenerations.assign(info.GenerationCount, 0);
+
+    NextGeneration = 0;
+    GenerationData.resize(info.GenerationBytes);
+    ZSTD_DCtx_reset(Decompressor, ZSTD_reset_session_only);
+    FrameComplete = false;
+    ExpectedBytes = 0;
+    DecompressedOffset = 0;
+    DecompressedHash = 0;
+    FileHeader.clear();
+    FileHeaderBytes = 0;
+    DecompressedData.clear();
+}
 
-bool FileSender::Initialize(const char* filepath, const uint8_t* file_data, int file_bytes)
+void FileReceiver::FreeDecoders()
 {
-    const char* last_slash0 = strrchr(filepath, '/');
-    const char* last_slash1 = strrchr(filepath, '\\');
-    const char* last_slash = last_slash0;
-    if (last_slash < last_slash1) {
-        last_slash = last_slash1;
-    }
-    if (last_slash) {
-        Filename = last_slash + 1;
-    } else {
-        Filename = filepath;
+    for (WirehairCodec& decoder : Decoders) {
+        wirehair_free(decoder);
+        decoder = nullptr;
     }
+}
 
-    if (Filename.empty()) {
-        spdlog::error("File name is empty");
-        return false;
+bool FileReceiver::StreamGenerations()
+{
+    while (NextGeneration < Stream.GenerationCount && SolvedGenerations[NextGeneration])
+    {
+        WirehairCodec& decoder = Decoders[NextGeneration];
+
+        const uint64_t t0 = GetTimeUsec();
+
+        WirehairResult r = wirehair_recover(decoder, GenerationData.data(), Stream.GenerationBytes);
+
+        wirehair_free(decoder);
+        decoder = nullptr;
+
+        if (r != Wirehair_Success) {
+            spdlog::error("wirehair_recover failed for generation {}: {}", NextGeneration, wirehair_result_string(r));
+            return false;
+        }
+
+        const uint64_t t1 = GetTimeUsec();
+
+        // Delta frame at the start of the file
+        size_t frame_offset = 0;
+
+        if (NextGeneration == 0)
+        {
+            if (!OpenBaseFile(GenerationData.data(), Stream.GenerationBytes, frame_offset)) {
+                StreamRejected = true;
+                return false;
+            }
+            const uint8_t* frame = GenerationData.data() + frame_offset;
+            const size_t frame_bytes = Stream.GenerationBytes - frame_offset;
+
+            // Version 2 senders leave it to the size zstd records in the frame
+            ExpectedBytes = Stream.DecompressedBytes;
+            if (Stream.FrameVersion == kFrameVersion2) {
+                ExpectedBytes = ZSTD_getFrameContentSize(frame, frame_bytes);
+            }
+            if (ExpectedBytes < 2 || ExpectedBytes >= ZSTD_CONTENTSIZE_ERROR || ExpectedBytes > UINT32_MAX) {
+                spdlog::error("Invalid decompressed size");
+                return false;
+            }
+
+            // Frames compressed with a dictionary name it by id
+            const unsigned dict_id = ZSTD_getDictID_fromFrame(frame, frame_bytes);
+            ZSTD_DDict* ddict = nullptr;
+            if (dict_id != 0 && !BaseFile.GetData())
+            {
+                for (const auto& dictionary : Settings.Dictionaries) {
+                    if (dictionary->GetId() == dict_id) {
+                        ddict = dictionary->GetDDict();
+                        break;
+                    }
+                }
+                if (!ddict) {
+                    spdlog::error("File was compressed with dictionary {}, which is not installed", dict_id);
+                    StreamRejected = true;
+                    return false;
+                }
+            }
+            ZSTD_DCtx_refDDict(Decompressor, ddict);
+
+            // The base file takes the place of a dictionary
+            if (BaseFile.GetData()) {
+                ZSTD_DCtx_refPrefix(Decompressor, BaseFile.GetData(), BaseFile.GetDataBytes());
+            }
+        }
+
+        // FIXME: The sender adds at least one extra block to work-around an issue with Wirehair,
+        // where it does not accept input smaller than 2 blocks long.  Zstd finds where the data ends
+        if (!FrameComplete && !Decompress(GenerationData.data() + frame_offset, Stream.GenerationBytes - frame_offset)) {
+            return false;
+        }
+
+        spdlog::debug("Generation {} recovered in {} msec and decompressed in {} msec",
+            NextGeneration, (t1 - t0) / 1000.f, (GetTimeUsec() - t1) / 1000.f);
+
+        ++NextGeneration;
     }
-    if (Filename.size() > 255) {
-        spdlog::error("File name too long: ", Filename);
-        return false;
+
+    if (NextGeneration < Stream.GenerationCount) {
+        return true;
     }
 
-    DecompressedBytes = 1 + Filename.size() + 1 + file_bytes;
-    std::vector<uint8_t> temp(DecompressedBytes);
+    BaseFile.Close();
 
-    temp[0] = (uint8_t)Filename.size();
-    memcpy(temp.data() + 1, Filename.data(), Filename.size());
-    temp[1 + Filename.size()] = '\0';
-    memcpy(temp.data() + 1 + Filename.size() + 1, file_data, file_bytes);
+    spdlog::info("File transfer complete!  Validating...");
 
-    FileHash = FastCrc32(temp.data(), temp.size());
+    return FinishFile();
+}
 
-    const size_t file_bound = ZSTD_compressBound(temp.size());
-    CompressedFile.resize(file_bound + kBlockBytes);
+bool FileReceiver::OpenBaseFile(const uint8_t* data, size_t bytes, size_t& frame_offset)
+{
+    BaseFile.Close();
+    frame_offset = 0;
 
-    CompressedFileBytes = ZSTD_compress(
-        CompressedFile.data(), file_bound,
-        temp.data(), temp.size(), kZstdCompressLevel);
+    const uint8_t* frame = data;
+    if (bytes < (size_t)kDeltaFrameHeaderBytes || ReadU32_LE(frame) != kDeltaFrameMagic) {
+        return true; // Not a delta
+    }
 
-    if (ZSTD_isError(CompressedFileBytes)) {
-        spdlog::error("Zstd failed: {} file_bytes={}", ZSTD_getErrorName(CompressedFileBytes), file_bytes);
+    const uint64_t frame_bytes = 8 + (uint64_t)ReadU32_LE(frame + 4);
+    const uint64_t base_bytes = ReadU64_LE(frame + 8);
+    const uint32_t base_hash = ReadU32_LE(frame + 16);
+    const int name_bytes = frame[20];
+    if (frame_bytes != (uint64_t)kDeltaFrameHeaderBytes + name_bytes || frame_bytes > bytes) {
+        spdlog::error("Malformed delta frame");
         return false;
     }
 
-    WirehairResult wr = wirehair_init();
-    if (wr != Wirehair_Success) {
-        spdlog::error("wirehair_init failed: {}", wirehair_result_string(wr));
+    const std::string base_name((const char*)frame + 21, name_bytes);
+    if (base_name.empty() || base_name == "." || base_name == ".." ||
+        base_name.find('/') != std::string::npos || base_name.find('\0') != std::string::npos)
+    {
+        spdlog::error("Invalid base file name: {}", base_name);
         return false;
     }
 
-    // FIXME: We add one extra kBlockBytes to work-around an issue with Wirehair, where it does not
-    // accept input smaller than 2 blocks long.
-    CompressedFileBytes += kBlockBytes;
-
-    Encoder = wirehair_encoder_create(Encoder, CompressedFile.data(), CompressedFileBytes, kBlockBytes);
-    if (!Encoder) {
-        spdlog::error("wirehair_encoder_create failed: File size may be too large.");
+    const std::string& dir = Settings.BaseDirectory.empty() ? Settings.OutputDirectory : Settings.BaseDirectory;
+    if (dir.empty()) {
+        spdlog::warn("Dropping delta from {}: No base directory", base_name);
         return false;
     }
 
-    spdlog::info("Compressed {} to {} bytes.  Starting LoRa uplink...", filepath, CompressedFileBytes);
-
-    if (!Uplink.Initialize(kRendezvousChannel, kSenderAddr)) {
-        spdlog::error("Uplink.Initialize failed");
+    const std::string path = dir + "/" + base_name;
+    if (!BaseFile.Read(path.c_str())) {
+        spdlog::warn("Dropping delta from {}: We do not have the base file", path);
+        return false;
+    }
+    if (BaseFile.GetDataBytes() != base_bytes || FastCrc32(BaseFile.GetData(), BaseFile.GetDataBytes()) != base_hash) {
+        spdlog::warn("Dropping delta from {}: Our base file is a different version", path);
+        BaseFile.Close();
         return false;
     }
 
-    spdlog::info("Transmitting...");
+    spdlog::info("Receiving a delta from {} ({} bytes)", path, base_bytes);
 
-    Terminated = false;
-    Thread = std::make_shared<std::thread>(&FileSender::Loop, this);
+    frame_offset = (size_t)frame_bytes;
     return true;
 }
 
-void FileSender::Shutdown()
+bool FileReceiver::Decompress(const uint8_t* data, size_t bytes)
 {
-    Terminated = true;
-    JoinThread(Thread);
+    ZSTD_inBuffer input = { data, bytes, 0 };
 
-    Uplink.Shutdown();
+    while (!FrameComplete)
+    {
+        ZSTD_outBuffer output = { DecompressorOutput.data(), DecompressorOutput.size(), 0 };
 
-    wirehair_free(Encoder);
-    Encoder = nullptr;
-}
+        const size_t result = ZSTD_decompressStream(Decompressor, &output, &input);
+        if (ZSTD_isError(result)) {
+            spdlog::error("ZSTD_decompressStream failed: {}", ZSTD_getErrorName(result));
+            return false;
+        }
 
-void FileSender::Loop()
-{
-    spdlog::debug("FileSender::Loop started");
+        if (!OnDecompressed(DecompressorOutput.data(), output.pos)) {
+            return false;
+        }
 
-    const int send_interval_usec = 100 * 1000;
+        // Anything after the end of the frame is padding
+        FrameComplete = (result == 0);
 
-    ScopedFunction term_scope([&]() {
-        // All function exit conditions flag terminated
-        Terminated = true;
-    });
+        // Stop when the input is used up and zstd has nothing left to flush
+        if (input.pos >= input.size && output.pos < output.size) {
+            break;
+        }
+    }
 
-    unsigned block_id = 0;
+    return true;
+}
 
-    while (!Terminated)
-    {
-        if (block_id % 32 == 0) {
-            uint8_t info[kInfoBytes];
+bool FileReceiver::OnDecompressed(const uint8_t* data, size_t bytes)
+{
+    if (DecompressedOffset + bytes > ExpectedBytes) {
+        spdlog::error("Decompressed data is larger than {} bytes", ExpectedBytes);
+        return false;
+    }
+    DecompressedOffset += bytes;
+
+    if (Stream.FrameVersion == kFrameVersion1) {
+        DecompressedHash = FastCrc32(data, bytes, DecompressedHash);
+    }
+
+    // Without an output directory the header stays in DecompressedData
+    if (Settings.OutputDirectory.empty())
+    {
+        if (DecompressedData.empty()) {
+            DecompressedData.reserve((size_t)ExpectedBytes);
+        }
+        DecompressedData.insert(DecompressedData.end(), data, data + bytes);
+    }
+
+    // Read the file name header: [file name bytes(1)] [file name] [0]
+    while (bytes > 0 && (FileHeaderBytes == 0 || (int)FileHeader.size() < FileHeaderBytes))
+    {
+        FileHeader.push_back(*data++);
+        --bytes;
+
+        if (FileHeader.size() == 1) {
+            FileHeaderBytes = 1 + FileHeader[0] + 1;
+            if ((uint64_t)FileHeaderBytes > ExpectedBytes) {
+                spdlog::error("Malformed decompressed data");
+                return false;
+            }
+        }
+
+        if ((int)FileHeader.size() == FileHeaderBytes)
+        {
+            // Enforce null-terminated string
+            FileHeader[FileHeaderBytes - 1] = '\0';
+            Filename = (const char*)&FileHeader[1];
+
+            if (!Settings.OutputDirectory.empty())
+            {
+                // Only write inside the output directory
+                if (Filename.empty() || Filename == "." || Filename == ".." || Filename.find('/') != std::string::npos) {
+                    spdlog::error("Invalid file name: {}", Filename);
+                    return false;
+                }
+
+                const std::string path = Settings.OutputDirectory + "/" + Filename;
+                if (!OutputFile.Open(path, ExpectedBytes - FileHeaderBytes)) {
+                    spdlog::error("Failed to create file: {}", path);
+                    return false;
+                }
+            }
+        }
+    }
+
+    if (bytes > 0 && !Settings.OutputDirectory.empty() && !OutputFile.Write(data, bytes)) {
+        spdlog::error("Failed to write file: {}", Filename);
+        return false;
+    }
+
+    return true;
+}
+
+bool FileReceiver::FinishFile()
+{
+    if (!FrameComplete || DecompressedOffset != ExpectedBytes || FileHeaderBytes == 0) {
+        spdlog::error("Decompressed data is incomplete: {} of {} bytes", DecompressedOffset, ExpectedBytes);
+        return false;
+    }
+
+    // Version 2 files were validated by the zstd content checksum
+    if (Stream.FrameVersion == kFrameVersion1 && DecompressedHash != Stream.FileHash) {
+        spdlog::error("File hash did not match");
+        return false;
+    }
+
+    const int file_bytes = (int)(ExpectedBytes - FileHeaderBytes);
+
+    const uint8_t* file_data = nullptr;
+    if (Settings.OutputDirectory.empty()) {
+        file_data = DecompressedData.data() + FileHeaderBytes;
+    } else if (!OutputFile.Commit()) {
+        spdlog::error("Failed to save file: {}", Filename);
+        return false;
+    }
+
+    // Callbacks come from the link threads too
+    std::lock_guard<std::mutex> locker(Lock);
+    OnRecv(1.f, Filename.c_str(), file_data, file_bytes);
+    return true;
+}
+
+bool FileReceiver::UpdateTuning(int link_index)
+{
+    ReceiveLink& link = Links[link_index];
+    IRadioLink* uplink = link.Uplink.get();
+
+    const int channel = uplink->GetChannel();
+    const RadioProfile profile = uplink->GetRadioProfile();
+
+    int next_channel = channel;
+    RadioProfile next_profile = profile;
+
+    if (link.AnnouncedChannel >= 0)
+    {
+        next_channel = link.AnnouncedChannel;
+        next_profile = link.AnnouncedProfile;
+        link.AnnouncedChannel = -1;
+
+        if (next_channel != channel || next_profile != profile) {
+            spdlog::info("Link {}: Following sender to channel {} with radio profile {}",
+                link_index, next_channel, next_profile.ToString());
+        }
+    }
+    else if ((channel != link.RendezvousChannel || profile != link.RendezvousProfile) &&
+        GetTimeUsec() - link.LastFrameUsec > kDataChannelTimeoutUsec)
+    {
+        next_channel = link.RendezvousChannel;
+        next_profile = link.RendezvousProfile;
+
+        spdlog::info("Link {}: Lost sender on channel {}.  Returning to rendezvous channel {}",
+            link_index, channel, link.RendezvousChannel);
+    }
+
+    if (next_channel != channel)
+    {
+        if (!uplink->SetChannel(next_channel)) {
+            spdlog::error("SetChannel failed");
+            return false;
+        }
+        link.LastFrameUsec = GetTimeUsec();
+    }
+
+    if (next_profile != profile)
+    {
+        if (!uplink->SetRadioProfile(next_profile)) {
+            spdlog::error("SetRadioProfile failed");
+            return false;
+        }
+        link.LastFrameUsec = GetTimeUsec();
+
+        // Measure the new profile from scratch
+        uplink->GetLinkQuality().Reset();
+    }
+
+    return true;
+}
+
+void FileReceiver::ReportLinkQuality(int link_index)
+{
+    ReceiveLink& link = Links[link_index];
+    IRadioLink* uplink = link.Uplink.get();
+
+    const RadioProfile profile = uplink->GetRadioProfile();
+    const LinkQualityStats stats = uplink->GetLinkQuality().GetStats();
+
+    spdlog::info("Link {}: Channel {} profile {}: {}",
+        link_index, uplink->GetChannel(), profile.ToString(), stats.ToString());
+
+    if (stats.SequencedFrames < kMinMeasuredFrames) {
+        return;
+    }
+
+    ProfileLoss measurement;
+    measurement.Profile = profile;
+    measurement.LossRate = stats.GetLossRate();
+
+    bool found = false;
+    for (auto& existing : link.Measurements) {
+        if (existing.Profile == profile) {
+            existing = measurement;
+            found = true;
+        }
+    }
+    if (!found) {
+        link.Measurements.push_back(measurement);
+    }
+
+    const RadioProfile best = SelectRadioProfile(link.Measurements, kBlockHeaderBytes);
+
+    // Printed in the form loraftp_send accepts, so the sender can use it
+    spdlog::info("Link {}: Measured --loss {}:{} ({} bytes/sec goodput).  Best profile for measured loss: {}",
+        link_index,
+        profile.ToString(),
+        measurement.LossRate,
+        (int)EstimateGoodputBps(profile, measurement.LossRate, kBlockHeaderBytes),
+        best.ToString());
+}
+
+void FileReceiver::Loop(int link_index)
+{
+    spdlog::debug("FileReceiver::Loop({}) started", link_index);
+
+    ReceiveLink& link = Links[link_index];
+    IRadioLink* uplink = link.Uplink.get();
+
+    link.RendezvousChannel = uplink->GetChannel();
+    link.RendezvousProfile = uplink->GetRadioProfile();
+    link.LastFrameUsec = link.LastStatsUsec = GetTimeUsec();
+
+    while (!Terminated)
+    {
+        if (!uplink->Receive([&](const uint8_t* data, int bytes, int rssi_dbm, int frame_version)
+        {
+            (void)rssi_dbm; // Collected by the uplink's LinkQuality
+
+            /*
+                To decode the file we need to know its total length ahead of time.
+                Otherwise we just need a truncated 8-bit block identifier on each block.
+
+                Occasionally the sender will send the length and file hash and full
+                32-bit block identifier.
+                We can buffer up data for a while until this is received.
+            */
+
+            const uint64_t t0 = GetTimeUsec();
+            ScopedFunction stall_scope([&]() {
+                std::lock_guard<std::mutex> stats_locker(StatsLock);
+                TimingStats.RadioStall.Add(GetTimeUsec() - t0);
+            });
+
+            std::lock_guard<std::mutex> locker(Lock);
+
+            if (frame_version == kFrameVersion1 && bytes == kInfoBytes) {
+                OnFileInfo(link_index, ReadU32_LE(data), ReadU32_LE(data + 4), ReadU32_LE(data + 8), ReadU32_LE(data + 12), ReadU16_LE(data + 16));
+            } else if (bytes == kAnnounceBytes) {
+                // Cannot change channel inside Receive()
+                if (data[4] < uplink->GetChannelCount() && data[5] < kAirRateCount && data[6] < kPacketSizeCount) {
+                    link.AnnouncedChannel = data[4];
+                    link.AnnouncedProfile.AirRateBps = kAirRatesBps[data[5]];
+                    link.AnnouncedProfile.PacketBytes = kPacketSizes[data[6]];
+                }
+            } else if (frame_version == kFrameVersion1 && bytes > kBlockV1HeaderBytes) {
+                OnBlock(link_index, kFrameVersion1, 0, data[0], data + kBlockV1HeaderBytes, bytes - kBlockV1HeaderBytes);
+            } else if (frame_version == kFrameVersion2 && bytes > kBlockHeaderBytes) {
+                OnBlockFrame(link_index, data, bytes);
+            } else {
+                spdlog::warn("Ignoring bogon: {} bytes", bytes);
+            }
+
+            LastReceiveUsec = link.LastFrameUsec = GetTimeUsec();
+        }, kReceiveWaitMsec)) {
+            spdlog::error("Receive loop failed");
+            break;
+        }
+
+        if (!UpdateTuning(link_index)) {
+            break;
+        }
+
+        if (GetTimeUsec() - link.LastStatsUsec >= kStatsIntervalUsec) {
+            link.LastStatsUsec = GetTimeUsec();
+            ReportLinkQuality(link_index);
+            if (link_index == 0) {
+                spdlog::info("Receiver timing: {}", GetTimingStats().ToString());
+            }
+        }
+
+        std::lock_guard<std::mutex> locker(Lock);
+
+        const int64_t dt = GetTimeUsec() - LastReceiveUsec;
+        const int64_t timeout_usec = 20 * 1000 * 1000;
+        if (dt > timeout_usec)
+        {
+            if (FileBytes != 0)
+            {
+                spdlog::info("Timeout while receiving file from sender.  Resetting and waiting for next file...");
+                ResetTransfer();
+            }
+        }
+    }
+
+    spdlog::debug("FileReceiver::Loop({}) stopped", link_index);
+}
+
+ReceiverTimingStats FileReceiver::GetTimingStats()
+{
+    std::lock_guard<std::mutex> locker(StatsLock);
+    return TimingStats;
+}
+
+std::string ReceiverTimingStats::ToString() const
+{
+    std::ostringstream oss;
+    oss << "radio stall: " << RadioStall.ToString()
+        << ", decode queue wait: " << DecodeQueueWait.ToString()
+        << ", decode: " << Decode.ToString()
+        << ", recover: " << Recover.ToString();
+    return oss.str();
+}
+
+
+//------------------------------------------------------------------------------
+// FileSender
+
+bool FileSender::Initialize(
+    const char* filepath,
+    const uint8_t* file_data,
+    int file_bytes,
+    std::shared_ptr<IRadioLink> link)
+{
+    std::vector<std::shared_ptr<IRadioLink>> links;
+    if (link) {
+        links.push_back(link);
+    }
+    return Initialize(filepath, file_data, file_bytes, links);
+}
+
+bool FileSender::Initialize(
+    const char* filepath,
+    const uint8_t* file_data,
+    int file_bytes,
+    const std::vector<std::shared_ptr<IRadioLink>>& links,
+    const FileSenderSettings& settings)
+{
+    std::vector<uint8_t> sample;
+    for (const SampleRange& range : GetCompressionSampleRanges(file_bytes)) {
+        sample.insert(sample.end(), file_data + range.Offset, file_data + range.Offset + range.Bytes);
+    }
+
+    if (!BeginFile(filepath, file_bytes, sample, links.size(), settings)) {
+        return false;
+    }
+    if (!CompressData(file_data, file_bytes)) {
+        return false;
+    }
+    return StartSending(links);
+}
+
+bool FileSender::InitializeFromFile(
+    const char* file_path,
+    const std::vector<std::shared_ptr<IRadioLink>>& links,
+    const FileSenderSettings& settings)
+{
+    MappedFile file;
+    if (!file.OpenRead(file_path, true/*read ahead*/)) {
+        spdlog::error("Failed to open file: {}", file_path);
+        return false;
+    }
+
+    std::vector<uint8_t> sample;
+    for (const SampleRange& range : GetCompressionSampleRanges(file.Length))
+    {
+        MappedView view;
+        if (!view.Open(&file) || !view.MapView(range.Offset, range.Bytes)) {
+            spdlog::error("Failed to map {} bytes at offset {} of file: {}", range.Bytes, range.Offset, file_path);
+            return false;
+        }
+        sample.insert(sample.end(), view.Data, view.Data + range.Bytes);
+    }
+
+    if (!BeginFile(file_path, file.Length, sample, links.size(), settings)) {
+        return false;
+    }
+
+    // Map one piece of the file at a time, so pages already compressed can
+    // be dropped from memory
+    for (uint64_t offset = 0; offset < file.Length; offset += kReadChunkBytes)
+    {
+        const uint32_t bytes = (uint32_t)std::min<uint64_t>(kReadChunkBytes, file.Length - offset);
+
+        MappedView view;
+        if (!view.Open(&file) || !view.MapView(offset, bytes)) {
+            spdlog::error("Failed to map {} bytes at offset {} of file: {}", bytes, offset, file_path);
+            return false;
+        }
+        if (!CompressData(view.Data, bytes)) {
+            return false;
+        }
+    }
+
+    return StartSending(links);
+}
+
+// Runs the compressor until it has used all of the input, or with end = true
+// until the frame is complete.  Output is added to the end of compressed,
+// which grows a chunk at a time inside its reserved capacity
+static bool StreamCompress(
+    ZSTD_CCtx* cctx,
+    const void* data,
+    size_t bytes,
+    bool end,
+    std::vector<uint8_t>& compressed,
+    size_t& compressed_bytes)
+{
+    ZSTD_inBuffer input = { data, bytes, 0 };
+
+    for (;;)
+    {
+        if (compressed.size() - compressed_bytes < ZSTD_CStreamOutSize())
+        {
+            // Growing past the capacity would move the buffer
+            const size_t size = std::min(compressed_bytes + ZSTD_CStreamOutSize(), compressed.capacity());
+            if (size <= compressed_bytes) {
+                spdlog::error("Compressed data does not fit in {} bytes", compressed.capacity());
+                return false;
+            }
+            compressed.resize(size);
+        }
+
+        ZSTD_outBuffer output = { compressed.data() + compressed_bytes, compressed.size() - compressed_bytes, 0 };
+
+        const size_t remaining = ZSTD_compressStream2(cctx, &output, &input, end ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(remaining)) {
+            spdlog::error("ZSTD_compressStream2 failed: {}", ZSTD_getErrorName(remaining));
+            return false;
+        }
+
+        compressed_bytes += output.pos;
+
+        if (end ? (remaining == 0) : (input.pos >= input.size)) {
+            return true;
+        }
+    }
+}
+
+bool FileSender::BeginFile(
+    const char* filepath,
+    uint64_t file_bytes,
+    const std::vector<uint8_t>& sample,
+    size_t link_count,
+    const FileSenderSettings& settings)
+{
+    Shutdown();
+
+    Settings = settings;
+
+    if (Settings.FrameVersion != kFrameVersion1 && Settings.FrameVersion != kFrameVersion2) {
+        spdlog::error("Unsupported frame version: {}", Settings.FrameVersion);
+        return false;
+    }
+    if (Settings.GenerationBlocks < 2 || Settings.GenerationBlocks > kMaxGenerationBlocks) {
+        spdlog::error("Unsupported generation size: {} blocks", Settings.GenerationBlocks);
+        return false;
+    }
+
+    const char* last_slash0 = strrchr(filepath, '/');
+    const char* last_slash1 = strrchr(filepath, '\\');
+    const char* last_slash = last_slash0;
+    if (last_slash < last_slash1) {
+        last_slash = last_slash1;
+    }
+    if (last_slash) {
+        Filename = last_slash + 1;
+    } else {
+        Filename = filepath;
+    }
+
+    if (Filename.empty()) {
+        spdlog::error("File name is empty");
+        return false;
+    }
+    if (Filename.size() > 255) {
+        spdlog::error("File name too long: ", Filename);
+        return false;
+    }
+
+    const uint64_t decompressed_bytes = 1 + Filename.size() + 1 + file_bytes;
+    if (decompressed_bytes > UINT32_MAX) {
+        spdlog::error("File too large: {} bytes", file_bytes);
+        return false;
+    }
+    DecompressedBytes = (uint32_t)decompressed_bytes;
+
+    uint8_t header[1 + 255 + 1];
+    const int header_bytes = 1 + (int)Filename.size() + 1;
+    header[0] = (uint8_t)Filename.size();
+    memcpy(header + 1, Filename.data(), Filename.size());
+    header[1 + Filename.size()] = '\0';
+
+    FileHash = FastCrc32(header, header_bytes);
+
+    // Receivers start over when the session changes
+    Session = (uint8_t)(std::random_device()() & ~kSessionGenerationFlag);
+
+    /*
+        Reserve the most the file can compress to, plus the padding that
+        StartSending() adds.  StreamCompress() and StartSending() only grow
+        the buffer inside this reservation, so it is never moved.  The
+        reservation is address space: Pages only take memory once written.
+        On a 32-bit system a large file may not fit in the address space.
+    */
+    const uint64_t frame_bound = kDeltaFrameHeaderBytes + 255 + (uint64_t)ZSTD_compressBound(DecompressedBytes);
+    const uint64_t reserve_bytes = frame_bound + frame_bound / Settings.GenerationBlocks + (std::max<size_t>(link_count, 1) + 2) * kPacketMaxBytes;
+    CompressedFile = std::vector<uint8_t>();
+    CompressedFileBytes = 0;
+    if (reserve_bytes > SIZE_MAX / 2) {
+        spdlog::error("File too large for this system: {} bytes", file_bytes);
+        return false;
+    }
+    try {
+        CompressedFile.reserve((size_t)reserve_bytes);
+    } catch (std::bad_alloc& /*err*/) {
+        spdlog::error("Not enough memory to compress file: {} bytes", file_bytes);
+        return false;
+    }
+
+    if (!Settings.BaseFile.empty() && !OpenBaseFile()) {
+        return false;
+    }
+
+    Compressor = ZSTD_createCCtx();
+    if (!Compressor) {
+        spdlog::error("ZSTD_createCCtx failed");
+        return false;
+    }
+
+    if (BaseFile.GetData())
+    {
+        // Patch-from: The window covers the base file and the new file, so
+        // long distance matching finds the unchanged parts anywhere in the base
+        Plan = GetFixedCompressionPlan(Settings.CompressionLevel != kAutoCompressionLevel ? Settings.CompressionLevel : kDeltaCompressionLevel);
+        Plan.LongWindowLog = GetWindowLog((uint64_t)BaseFile.GetDataBytes() + DecompressedBytes);
+
+        spdlog::info("Compressing with {} against base file {} ({} bytes)", Plan.ToString(), Settings.BaseFile, BaseFile.GetDataBytes());
+    }
+    else if (Settings.CompressionLevel == kAutoCompressionLevel)
+    {
+        CompressionTarget target;
+        target.Profile = Settings.Profile;
+        target.FrameVersion = Settings.FrameVersion;
+        target.BlockHeaderBytes = (Settings.FrameVersion == kFrameVersion1) ? kBlockV1HeaderBytes : kBlockHeaderBytes;
+        target.LinkCount = (int)std::max<size_t>(link_count, 1);
+
+        Plan = PlanCompression(sample.data(), sample.size(), file_bytes, target, Settings.Dictionary.get());
+
+        spdlog::info("Compressing with {}: Predicted {} bytes, {} msec to compress and {} seconds of airtime",
+            Plan.ToString(), Plan.CompressedBytes, Plan.CompressUsec / 1000.f, Plan.AirtimeUsec / 1000000.f);
+    }
+    else
+    {
+        Plan = GetFixedCompressionPlan(Settings.CompressionLevel);
+
+        spdlog::info("Compressing with {}", Plan.ToString());
+    }
+
+    // The base file takes the place of a dictionary
+    if (BaseFile.GetData())
+    {
+        if (!ApplyCompressionPlan(Compressor, Plan)) {
+            return false;
+        }
+
+        const size_t result = ZSTD_CCtx_refPrefix(Compressor, BaseFile.GetData(), BaseFile.GetDataBytes());
+        if (ZSTD_isError(result)) {
+            spdlog::error("ZSTD_CCtx_refPrefix failed: {}", ZSTD_getErrorName(result));
+            return false;
+        }
+    }
+    else
+    {
+        if (!ApplyCompressionPlan(Compressor, Plan, Settings.Dictionary.get())) {
+            return false;
+        }
+        if (Settings.Dictionary) {
+            spdlog::info("Compressing with dictionary {}", Settings.Dictionary->GetId());
+        }
+    }
+
+    // The content checksum validates the file for version 2 receivers, and
+    // the pledged size is recorded in the frame for them
+    ZSTD_CCtx_setParameter(Compressor, ZSTD_c_checksumFlag, 1);
+    ZSTD_CCtx_setPledgedSrcSize(Compressor, DecompressedBytes);
+
+    return StreamCompress(Compressor, header, header_bytes, false, CompressedFile, CompressedFileBytes);
+}
+
+bool FileSender::OpenBaseFile()
+{
+    if (!BaseFile.Read(Settings.BaseFile.c_str())) {
+        spdlog::error("Failed to open base file: {}", Settings.BaseFile);
+        return false;
+    }
+
+    const uint64_t window_bytes = (uint64_t)BaseFile.GetDataBytes() + DecompressedBytes;
+    if (window_bytes > ((uint64_t)1 << kMaxLongWindowLog)) {
+        spdlog::warn("Base file and new file are {} bytes together, more than receivers can decode as a delta.  Sending the whole file",
+            window_bytes);
+        BaseFile.Close();
+        return true;
+    }
+
+    // Receivers look for the base file by name
+    const char* base_name = strrchr(Settings.BaseFile.c_str(), '/');
+    base_name = base_name ? base_name + 1 : Settings.BaseFile.c_str();
+    const size_t name_bytes = strlen(base_name);
+    if (name_bytes == 0 || name_bytes > 255) {
+        spdlog::error("Unsupported base file name: {}", Settings.BaseFile);
+        return false;
+    }
+
+    const uint32_t frame_bytes = kDeltaFrameHeaderBytes + (uint32_t)name_bytes;
+    CompressedFile.resize(frame_bytes);
+
+    uint8_t* frame = CompressedFile.data();
+    WriteU32_LE(frame, kDeltaFrameMagic);
+    WriteU32_LE(frame + 4, frame_bytes - 8);
+    WriteU64_LE(frame + 8, BaseFile.GetDataBytes());
+    WriteU32_LE(frame + 16, FastCrc32(BaseFile.GetData(), BaseFile.GetDataBytes()));
+    frame[20] = (uint8_t)name_bytes;
+    memcpy(frame + 21, base_name, name_bytes);
+
+    CompressedFileBytes = frame_bytes;
+    return true;
+}
+
+bool FileSender::CompressData(const uint8_t* data, size_t bytes)
+{
+    FileHash = FastCrc32(data, bytes, FileHash);
+
+    return StreamCompress(Compressor, data, bytes, false, CompressedFile, CompressedFileBytes);
+}
+
+bool FileSender::StartSending(const std::vector<std::shared_ptr<IRadioLink>>& links)
+{
+    const bool compressed = StreamCompress(Compressor, nullptr, 0, true, CompressedFile, CompressedFileBytes);
+
+    ZSTD_freeCCtx(Compressor);
+    Compressor = nullptr;
+    BaseFile.Close();
+
+    if (!compressed) {
+        return false;
+    }
 
-            WriteU32_LE(info, (uint32_t)CompressedFileBytes);
+    WirehairResult wr = wirehair_init();
+    if (wr != Wirehair_Success) {
+        spdlog::error("wirehair_init failed: {}", wirehair_result_string(wr));
+        return false;
+    }
+
+    spdlog::info("Compressed {} to {} bytes.  Starting LoRa uplink...", Filename, CompressedFileBytes);
+
+    if (links.empty()) {
+        auto waveshare = std::make_shared<Waveshare>();
+        if (!waveshare->Initialize(kRendezvousChannel, kSenderAddr)) {
+            spdlog::error("Uplink.Initialize failed");
+            return false;
+        }
+        Links.resize(1);
+        Links[0].Uplink = waveshare;
+    } else {
+        Links.resize(links.size());
+        for (size_t i = 0; i < links.size(); ++i) {
+            Links[i].Uplink = links[i];
+        }
+    }
+
+    for (auto& link : Links) {
+        if (!link.Uplink->SetFrameVersion(Settings.FrameVersion)) {
+            spdlog::error("Uplink.SetFrameVersion failed");
+            return false;
+        }
+        link.RendezvousChannel = link.DataChannel = link.Uplink->GetChannel();
+        link.RendezvousProfile = link.DataProfile = link.Uplink->GetRadioProfile();
+        link.LastAnnounceUsec = 0;
+    }
+
+    /*
+        Room for the padding added by CreateEncoder(): One extra block, and
+        up to one block per generation to make the generations the same size.
+        There are fewer than CompressedFileBytes / GenerationBlocks / block
+        bytes + link count + 2 generations, so this covers any block size.
+
+        BeginFile() reserved room for this, so the buffer is not moved.  The
+        encoders read from CompressedFile, so it is not resized again.
+    */
+    CompressedFile.resize(CompressedFileBytes + CompressedFileBytes / Settings.GenerationBlocks + (Links.size() + 2) * kPacketMaxBytes);
+
+    // Padding after the compressed data must be zeros
+    memset(CompressedFile.data() + CompressedFileBytes, 0, CompressedFile.size() - CompressedFileBytes);
+
+    // The generation count depends on the number of links
+    Encoder.reset();
+    if (!SetRadioProfile(Settings.Profile)) {
+        return false;
+    }
+
+    spdlog::info("Transmitting on {} links...", Links.size());
+
+    {
+        std::lock_guard<std::mutex> locker(StatsLock);
+        TimingStats = SenderTimingStats();
+    }
+
+    Terminated = false;
+    for (int i = 0; i < (int)Links.size(); ++i) {
+        Links[i].Ring = std::make_shared<FrameRing>();
+        Links[i].EncodeThread = std::make_shared<std::thread>(&FileSender::EncodeLoop, this, i);
+        Links[i].Thread = std::make_shared<std::thread>(&FileSender::Loop, this, i);
+    }
+    return true;
+}
+
+void FileSender::Shutdown()
+{
+    Terminated = true;
+    for (auto& link : Links) {
+        JoinThread(link.Thread);
+        JoinThread(link.EncodeThread);
+    }
+
+    for (auto& link : Links) {
+        link.Uplink->Shutdown();
+    }
+    Links.clear();
+
+    ZSTD_freeCCtx(Compressor);
+    Compressor = nullptr;
+    BaseFile.Close();
+
+    std::lock_guard<std::mutex> locker(ProfileLock);
+    Encoder.reset();
+}
+
+static unsigned GreatestCommonDivisor(unsigned a, unsigned b)
+{
+    while (b != 0) {
+        const unsigned r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+std::shared_ptr<FileSender::EncoderState> FileSender::CreateEncoder(int send_bytes)
+{
+    auto encoder = std::make_shared<EncoderState>();
+
+    encoder->HeaderBytes = GetBlockHeaderBytes(Settings.FrameVersion);
+    encoder->BlockBytes = send_bytes - encoder->HeaderBytes;
+
+    // FIXME: We add one extra block to work-around an issue with Wirehair, where it does not
+    // accept input smaller than 2 blocks long.
+    uint32_t block_count = (uint32_t)(CompressedFileBytes + encoder->BlockBytes - 1) / encoder->BlockBytes + 1;
+    uint32_t generation_count = 1;
+
+    if (Settings.FrameVersion == kFrameVersion1) {
+        encoder->FileBytes = (uint32_t)CompressedFileBytes + encoder->BlockBytes;
+    }
+    else
+    {
+        if (block_count > (uint32_t)Settings.GenerationBlocks)
+        {
+            encoder->HeaderBytes += kGenerationHeaderBytes;
+            encoder->BlockBytes = send_bytes - encoder->HeaderBytes;
+
+            const uint32_t total_blocks = (uint32_t)(CompressedFileBytes + encoder->BlockBytes - 1) / encoder->BlockBytes + 1;
+            generation_count = (total_blocks + Settings.GenerationBlocks - 1) / Settings.GenerationBlocks;
+
+            // Link i sends block runs i, i + N, i + 2N... and generation =
+            // run % generation count, so each link carries every generation
+            // only if the counts have no common factor
+            while (GreatestCommonDivisor(generation_count, (unsigned)Links.size()) != 1) {
+                ++generation_count;
+            }
+
+            // Block headers only have room for one block count, so pad
+            // every generation to the same size
+            block_count = (total_blocks + generation_count - 1) / generation_count;
+        }
+
+        if (block_count < 2 || block_count > kMaxGenerationBlocks || generation_count > UINT16_MAX) {
+            spdlog::error("Cannot split file into generations: {} generations of {} blocks", generation_count, block_count);
+            return nullptr;
+        }
+
+        encoder->FileBytes = generation_count * block_count * encoder->BlockBytes;
+        encoder->BlockCount = (uint16_t)block_count;
+    }
+
+    if (encoder->FileBytes > CompressedFile.size()) {
+        spdlog::error("Not enough room for padding: {} > {} bytes", encoder->FileBytes, CompressedFile.size());
+        return nullptr;
+    }
+
+    const uint32_t generation_bytes = encoder->FileBytes / generation_count;
+
+    const unsigned solve_threads = (unsigned)std::max(Settings.SolveThreads, 1);
+
+    const uint64_t t0 = GetTimeUsec();
+
+    for (uint32_t i = 0; i < generation_count; ++i)
+    {
+        WirehairCodec codec = wirehair_encoder_create_threads(
+            nullptr,
+            CompressedFile.data() + i * (size_t)generation_bytes,
+            generation_bytes,
+            encoder->BlockBytes,
+            solve_threads);
+        if (!codec) {
+            spdlog::error("wirehair_encoder_create_threads failed: File size may be too large.");
+            return nullptr;
+        }
+        encoder->Codecs.push_back(codec);
+    }
+
+    spdlog::info("Encoded {} generations of {} blocks in {} msec",
+        generation_count, block_count, (GetTimeUsec() - t0) / 1000.f);
+
+    encoder->Epoch = ++EncoderEpoch;
+    return encoder;
+}
+
+bool FileSender::SetRadioProfile(const RadioProfile& profile)
+{
+    if (!profile.IsValid()) {
+        spdlog::error("FileSender::SetRadioProfile: Unsupported profile {}", profile.ToString());
+        return false;
+    }
+
+    const int send_bytes = profile.GetMaxSendBytes(Settings.FrameVersion);
+
+    std::lock_guard<std::mutex> locker(ProfileLock);
+
+    if (!Encoder || Encoder->HeaderBytes + Encoder->BlockBytes != send_bytes)
+    {
+        auto encoder = CreateEncoder(send_bytes);
+        if (!encoder) {
+            return false;
+        }
+        Encoder = encoder;
+    }
+
+    Profile = profile;
+
+    spdlog::info("Sending with radio profile {} ({} byte blocks)", profile.ToString(), Encoder->BlockBytes);
+    return true;
+}
+
+bool FileSender::PacedSend(SendLink& link, const uint8_t* data, int bytes)
+{
+    uint8_t frame[kFrameV1HeaderBytes + kPacketMaxBytes];
+    const int frame_bytes = FrameParser::WriteFrame(data, bytes, frame, Settings.FrameVersion);
+
+    return PacedSendFrame(link, frame, frame_bytes);
+}
+
+bool FileSender::PacedSendFrame(SendLink& link, const uint8_t* frame, int frame_bytes)
+{
+    for (;;)
+    {
+        if (Terminated) {
+            return false;
+        }
+
+        const int send_queue_bytes = link.Uplink->GetSendQueueBytes();
+        if (send_queue_bytes < 0) {
+            spdlog::error("GetSendQueueBytes failed");
+            return false;
+        }
+
+        uint64_t delay_usec = link.Pacer.GetDelayUsec(GetTimeUsec(), frame_bytes, send_queue_bytes);
+        if (delay_usec == 0) {
+            break;
+        }
+        if (delay_usec > kMaxPaceWaitUsec) {
+            delay_usec = kMaxPaceWaitUsec;
+        }
+
+        usleep((useconds_t)delay_usec);
+    }
+
+    if (!link.Uplink->SendFrame(frame, frame_bytes)) {
+        spdlog::error("Uplink.SendFrame failed");
+        return false;
+    }
+
+    const int bytes = frame_bytes - GetFrameHeaderBytes(Settings.FrameVersion);
+    link.Pacer.OnSend(GetTimeUsec(), link.Uplink->GetAirtimeUsec(bytes));
+    return true;
+}
+
+int FileSender::PickDataChannel(int link_index)
+{
+    SendLink& link = Links[link_index];
+
+    std::vector<float> noise_dbm;
+    if (!link.Uplink->GetChannelNoise(noise_dbm) || noise_dbm.empty()) {
+        spdlog::info("Link {}: No ambient noise scan.  Staying on channel {}", link_index, link.RendezvousChannel);
+        return link.RendezvousChannel;
+    }
+
+    std::lock_guard<std::mutex> locker(ChannelLock);
+
+    const int channel_count = (int)noise_dbm.size();
+    float rendezvous_dbm = 0.f;
+    float best_dbm = std::numeric_limits<float>::max();
+    if (link.RendezvousChannel < channel_count) {
+        rendezvous_dbm = noise_dbm[link.RendezvousChannel];
+        best_dbm = rendezvous_dbm - kMinChannelGainDb;
+    }
+
+    int best_channel = link.RendezvousChannel;
+    for (int channel = 0; channel < channel_count; ++channel)
+    {
+        bool used = false;
+        for (int i = 0; i < (int)Links.size(); ++i) {
+            if (i != link_index &&
+                (Links[i].RendezvousChannel == channel || Links[i].DataChannel == channel))
+            {
+                used = true;
+            }
+        }
+
+        if (!used && noise_dbm[channel] < best_dbm) {
+            best_dbm = noise_dbm[channel];
+            best_channel = channel;
+        }
+    }
+
+    if (best_channel == link.RendezvousChannel) {
+        spdlog::info("Link {}: Rendezvous channel {} is quiet enough", link_index, best_channel);
+    } else {
+        spdlog::info("Link {}: Moving to channel {} ({} dBm noise vs {} dBm on rendezvous channel {})",
+            link_index, best_channel, best_dbm, rendezvous_dbm, link.RendezvousChannel);
+    }
+
+    link.DataChannel = best_channel;
+    return best_channel;
+}
+
+bool FileSender::RetuneWhenIdle(SendLink& link, int channel, const RadioProfile& profile)
+{
+    const bool change_channel = link.Uplink->GetChannel() != channel;
+    const bool change_profile = link.Uplink->GetRadioProfile() != profile;
+    if (!change_channel && !change_profile) {
+        return true;
+    }
+
+    for (;;)
+    {
+        if (Terminated) {
+            return false;
+        }
+
+        uint64_t delay_usec = link.Pacer.GetBusyUsec(GetTimeUsec());
+        if (delay_usec == 0) {
+            break;
+        }
+        if (delay_usec > kMaxPaceWaitUsec) {
+            delay_usec = kMaxPaceWaitUsec;
+        }
+
+        usleep((useconds_t)delay_usec);
+    }
+
+    if (change_channel && !link.Uplink->SetChannel(channel)) {
+        spdlog::error("Uplink.SetChannel failed: channel={}", channel);
+        return false;
+    }
+
+    if (change_profile)
+    {
+        if (!link.Uplink->SetRadioProfile(profile)) {
+            spdlog::error("Uplink.SetRadioProfile failed: profile={}", profile.ToString());
+            return false;
+        }
+
+        link.Pacer.Reset(profile.AirRateBps, link.Uplink->GetRadioBufferBytes());
+    }
+
+    return true;
+}
+
+bool FileSender::AnnounceDataChannel(SendLink& link)
+{
+    uint8_t announce[kAnnounceBytes];
+    WriteU32_LE(announce, FileHash);
+    announce[4] = (uint8_t)link.DataChannel;
+    announce[5] = (uint8_t)link.DataProfile.GetAirRateIndex();
+    announce[6] = (uint8_t)link.DataProfile.GetPacketSizeIndex();
+
+    if (!RetuneWhenIdle(link, link.RendezvousChannel, link.RendezvousProfile)) {
+        return false;
+    }
+
+    for (int i = 0; i < kAnnounceRepeat; ++i) {
+        if (!PacedSend(link, announce, kAnnounceBytes)) {
+            return false;
+        }
+    }
+
+    if (!RetuneWhenIdle(link, link.DataChannel, link.DataProfile)) {
+        return false;
+    }
+
+    link.LastAnnounceUsec = GetTimeUsec();
+    return true;
+}
+
+void FileSender::Loop(int link_index)
+{
+    spdlog::debug("FileSender::Loop({}) started", link_index);
+
+    ScopedFunction term_scope([&]() {
+        // All function exit conditions flag terminated
+        Terminated = true;
+    });
+
+    SendLink& link = Links[link_index];
+    link.Pacer.Reset(link.Uplink->GetAirDataRateBps(), link.Uplink->GetRadioBufferBytes());
+
+    if (Settings.AutoChannel) {
+        PickDataChannel(link_index);
+    }
+
+    unsigned block_count = 0;
+
+    uint64_t stats_start_usec = GetTimeUsec();
+    unsigned stats_start_block_count = 0;
+
+    // Time the last block frame was handed to the radio, or 0 after
+    // sending something else
+    uint64_t last_send_usec = 0;
+    bool underrun = false;
+
+    std::shared_ptr<EncoderState> encoder;
+    RadioProfile profile = link.DataProfile;
+    bool retune = true;
+
+    while (!Terminated)
+    {
+        {
+            std::lock_guard<std::mutex> locker(ProfileLock);
+
+            if (encoder != Encoder)
+            {
+                // New block size: EncodeLoop() starts the block ids over
+                encoder = Encoder;
+                retune = true;
+            }
+            if (profile != Profile) {
+                profile = Profile;
+                retune = true;
+            }
+        }
+
+        if (retune)
+        {
+            if (!RetuneWhenIdle(link, link.DataChannel, profile)) {
+                break;
+            }
+            link.DataProfile = profile;
+
+            // Announce the change right away and send file info with the first block
+            link.LastAnnounceUsec = 0;
+            block_count = 0;
+            stats_start_usec = GetTimeUsec();
+            stats_start_block_count = 0;
+            last_send_usec = 0;
+            retune = false;
+        }
+
+        if ((link.DataChannel != link.RendezvousChannel || link.DataProfile != link.RendezvousProfile) &&
+            GetTimeUsec() - link.LastAnnounceUsec >= kAnnounceIntervalUsec)
+        {
+            if (!AnnounceDataChannel(link)) {
+                break;
+            }
+            last_send_usec = 0;
+        }
+
+        FrameRing::Slot* slot = link.Ring->GetReadSlot();
+        if (!slot) {
+            // Count each frame the link waits for once
+            if (!underrun) {
+                underrun = true;
+                std::lock_guard<std::mutex> locker(StatsLock);
+                ++TimingStats.Underruns;
+            }
+            usleep(kFrameRingWaitUsec);
+            continue;
+        }
+        underrun = false;
+
+        // Drop frames encoded ahead by the previous encoder
+        if (slot->Epoch != encoder->Epoch) {
+            link.Ring->Pop();
+            continue;
+        }
+
+        if (Settings.FrameVersion == kFrameVersion1 && block_count % 32 == 0) {
+            uint8_t info[kInfoBytes];
+
+            WriteU32_LE(info, encoder->FileBytes);
             WriteU32_LE(info + 4, FileHash);
-            WriteU32_LE(info + 8, block_id);
+            WriteU32_LE(info + 8, slot->BlockId);
             WriteU32_LE(info + 12, DecompressedBytes);
+            WriteU16_LE(info + 16, (uint16_t)encoder->BlockBytes);
 
-            if (!Uplink.Send(info, kInfoBytes)) {
-                spdlog::error("Uplink.Send failed");
+            if (!PacedSend(link, info, kInfoBytes)) {
                 break;
             }
+            last_send_usec = 0;
+        }
+
+        if (!PacedSendFrame(link, slot->Frame, slot->FrameBytes)) {
+            break;
+        }
+        link.Ring->Pop();
+
+        ++block_count;
+
+        const uint64_t now_usec = GetTimeUsec();
+        if (last_send_usec != 0) {
+            std::lock_guard<std::mutex> locker(StatsLock);
+            TimingStats.TransmitGap.Add(now_usec - last_send_usec);
+        }
+        last_send_usec = now_usec;
+
+        const uint64_t stats_usec = now_usec - stats_start_usec;
+        if (stats_usec >= kStatsIntervalUsec) {
+            const unsigned blocks = block_count - stats_start_block_count;
+            const float blocks_per_sec = blocks * 1000000.f / stats_usec;
+            spdlog::info("Link {}: Sending {} blocks/sec ({} bytes/sec goodput)",
+                link_index, blocks_per_sec, blocks_per_sec * encoder->BlockBytes);
+            if (link_index == 0) {
+                spdlog::info("Sender timing: {}", GetTimingStats().ToString());
+            }
+
+            stats_start_usec = now_usec;
+            stats_start_block_count = block_count;
+        }
+    }
+
+    spdlog::debug("FileSender::Loop({}) ended", link_index);
+}
+
+void FileSender::EncodeLoop(int link_index)
+{
+    spdlog::debug("FileSender::EncodeLoop({}) started", link_index);
+
+    ScopedFunction term_scope([&]() {
+        // All function exit conditions flag terminated
+        Terminated = true;
+    });
+
+    FrameRing& ring = *Links[link_index].Ring;
+
+    // Each link sends every Nth run of blocks so the links never repeat a
+    // block.  See kBlockRunLength
+    const unsigned sequence_stride = (unsigned)Links.size();
+    unsigned sequence = link_index;
+
+    const int data_offset = GetFrameDataOffset(Settings.FrameVersion);
+
+    std::shared_ptr<EncoderState> encoder;
+
+    while (!Terminated)
+    {
+        {
+            std::lock_guard<std::mutex> locker(ProfileLock);
+
+            if (encoder != Encoder)
+            {
+                // New block size: Start the block ids over for the new encoder
+                encoder = Encoder;
+                sequence = link_index;
+            }
+        }
+
+        FrameRing::Slot* slots = ring.GetWriteSlots(kBlockRunLength);
+        if (!slots) {
+            usleep(kFrameRingWaitUsec);
+            continue;
+        }
+
+        // Runs take turns between the generations
+        const unsigned generation_count = (unsigned)encoder->Codecs.size();
+        const unsigned generation = sequence % generation_count;
+        const unsigned first_id = sequence / generation_count * kBlockRunLength;
 
-            usleep(send_interval_usec);
+        // Version 2 block ids wrap at 16 bits.  Runs never cross the wrap
+        uint32_t first_encode_id = first_id;
+        if (Settings.FrameVersion != kFrameVersion1) {
+            first_encode_id = (uint16_t)first_id;
         }
 
-        uint8_t block[kPacketMaxBytes] = {};
-        uint32_t block_bytes = 0;
+        const int header_bytes = encoder->HeaderBytes;
 
-        WirehairResult wr = wirehair_encode(Encoder, block_id, block + 1, (uint32_t)kBlockBytes, &block_bytes);
+        const uint64_t t0 = GetTimeUsec();
+
+        // Blocks go straight into the slots.  Short last blocks are padded
+        // to full size
+        WirehairResult wr = wirehair_encode_batch(
+            encoder->Codecs[generation],
+            first_encode_id,
+            kBlockRunLength,
+            slots[0].Frame + data_offset + header_bytes,
+            sizeof(FrameRing::Slot));
         if (wr != Wirehair_Success) {
-            spdlog::error("wirehair_encode failed: {}", wirehair_result_string(wr));
+            spdlog::error("wirehair_encode_batch failed: {}", wirehair_result_string(wr));
             return;
         }
 
-        block[0] = (uint8_t)block_id;
-        if (!Uplink.Send(block, kPacketMaxBytes)) {
-            spdlog::error("Uplink.Send failed");
-            break;
+        const uint64_t t1 = GetTimeUsec();
+
+        for (unsigned i = 0; i < kBlockRunLength; ++i)
+        {
+            FrameRing::Slot* slot = slots + i;
+            const uint32_t block_id = first_id + i;
+            uint8_t* block = slot->Frame + data_offset;
+
+            if (Settings.FrameVersion == kFrameVersion1) {
+                block[0] = (uint8_t)block_id;
+            } else {
+                WriteU16_LE(block, (uint16_t)block_id);
+                block[2] = Session;
+                WriteU16_LE(block + 3, encoder->BlockCount);
+                if (generation_count > 1) {
+                    block[2] |= kSessionGenerationFlag;
+                    WriteU16_LE(block + 5, (uint16_t)generation);
+                    WriteU16_LE(block + 7, (uint16_t)generation_count);
+                }
+            }
+
+            slot->FrameBytes = FrameParser::SealFrame(slot->Frame, header_bytes + encoder->BlockBytes, Settings.FrameVersion);
+            slot->BlockId = block_id;
+            slot->Epoch = encoder->Epoch;
         }
+        ring.Push(kBlockRunLength);
 
-        usleep(send_interval_usec);
+        sequence += sequence_stride;
 
-        ++block_id;
+        std::lock_guard<std::mutex> locker(StatsLock);
+        TimingStats.Encode.Add((t1 - t0) / kBlockRunLength);
     }
 
-    spdlog::debug("FileSender::Loop ended");
+    spdlog::debug("FileSender::EncodeLoop({}) ended", link_index);
+}
+
+SenderTimingStats FileSender::GetTimingStats()
+{
+    std::lock_guard<std::mutex> locker(StatsLock);
+    return TimingStats;
+}
+
+std::string SenderTimingStats::ToString() const
+{
+    std::ostringstream oss;
+    oss << "underruns = " << Underruns
+        << ", encode: " << Encode.ToString()
+        << ", transmit gap: " << TransmitGap.ToString();
+    return oss.str();
 }
 
 
@@ -0,0 +1,533 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+#include "radio_link.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace lora {
+
+
+//------------------------------------------------------------------------------
+// RadioProfile
+
+int RadioProfile::GetAirRateIndex() const
+{
+    for (int i = 0; i < kAirRateCount; ++i) {
+        if (kAirRatesBps[i] == AirRateBps) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int RadioProfile::GetPacketSizeIndex() const
+{
+    for (int i = 0; i < kPacketSizeCount; ++i) {
+        if (kPacketSizes[i] == PacketBytes) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+std::string RadioProfile::ToString() const
+{
+    std::ostringstream oss;
+    oss << AirRateBps << ":" << PacketBytes;
+    return oss.str();
+}
+
+bool RadioProfile::FromString(const std::string& text)
+{
+    const size_t colon = text.find(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+
+    RadioProfile profile;
+    profile.AirRateBps = atoi(text.substr(0, colon).c_str());
+    profile.PacketBytes = atoi(text.substr(colon + 1).c_str());
+    if (!profile.IsValid()) {
+        return false;
+    }
+
+    *this = profile;
+    return true;
+}
+
+float EstimateGoodputBps(const RadioProfile& profile, float loss_rate, int overhead_bytes)
+{
+    const int data_bytes = profile.GetMaxSendBytes() - overhead_bytes;
+    if (data_bytes <= 0) {
+        return 0.f;
+    }
+
+    const uint64_t airtime_usec = GetAirtimeUsec(profile.GetMaxSendBytes(), profile.AirRateBps);
+    return data_bytes * 1000000.f / airtime_usec * (1.f - loss_rate);
+}
+
+RadioProfile SelectRadioProfile(const std::vector<ProfileLoss>& measurements, int overhead_bytes)
+{
+    RadioProfile best;
+    float best_goodput = -1.f;
+
+    for (int rate_index = 0; rate_index < kAirRateCount; ++rate_index)
+    {
+        for (int size_index = 0; size_index < kPacketSizeCount; ++size_index)
+        {
+            RadioProfile profile;
+            profile.AirRateBps = kAirRatesBps[rate_index];
+            profile.PacketBytes = kPacketSizes[size_index];
+
+            const uint64_t airtime_usec = GetAirtimeUsec(profile.GetMaxSendBytes(), profile.AirRateBps);
+
+            // Predict from the measurement at this air rate with the closest packet size
+            const ProfileLoss* closest = nullptr;
+            for (const auto& measurement : measurements) {
+                if (measurement.Profile.AirRateBps != profile.AirRateBps) {
+                    continue;
+                }
+                if (!closest || std::abs(measurement.Profile.PacketBytes - profile.PacketBytes) <
+                    std::abs(closest->Profile.PacketBytes - profile.PacketBytes))
+                {
+                    closest = &measurement;
+                }
+            }
+            if (!closest) {
+                continue;
+            }
+
+            const uint64_t measured_usec = GetAirtimeUsec(closest->Profile.GetMaxSendBytes(), profile.AirRateBps);
+            const float delivery = std::pow(1.f - closest->LossRate, airtime_usec / (float)measured_usec);
+
+            const float goodput = EstimateGoodputBps(profile, 1.f - delivery, overhead_bytes);
+            if (goodput > best_goodput) {
+                best_goodput = goodput;
+                best = profile;
+            }
+        }
+    }
+
+    return best;
+}
+
+
+//------------------------------------------------------------------------------
+// FrameParser
+
+bool FrameParser::Initialize(bool rssi_trailer)
+{
+    Reset();
+
+    RssiTrailer = rssi_trailer;
+
+    if (!Ring.Allocate(kRingBytes)) {
+        spdlog::error("Failed to allocate receive ring");
+        return false;
+    }
+
+    return true;
+}
+
+int FrameParser::WriteFrame(const uint8_t* data, int bytes, uint8_t* frame, int frame_version)
+{
+    memcpy(frame + GetFrameDataOffset(frame_version), data, bytes);
+    return SealFrame(frame, bytes, frame_version);
+}
+
+int FrameParser::SealFrame(uint8_t* frame, int bytes, int frame_version)
+{
+    if (frame_version == kFrameVersion1)
+    {
+        const uint32_t crc24 = FastCrc32(frame + kFrameV1HeaderBytes, bytes) & 0xffffff;
+        frame[0] = static_cast<uint8_t>( bytes );
+        frame[1] = GetHeaderCheck(frame[0], crc24);
+        WriteU24_LE(frame + 2, crc24);
+        return kFrameV1HeaderBytes + bytes;
+    }
+
+    frame[0] = kFrameSyncByte;
+    frame[1] = static_cast<uint8_t>( bytes );
+    frame[2] = GetHeaderCheckV2(frame[1], frame[kFrameDataOffset]);
+    const uint16_t crc16 = static_cast<uint16_t>( FastCrc32(frame + 1, 2 + bytes) );
+    WriteU16_LE(frame + kFrameDataOffset + bytes, crc16);
+    return kFrameHeaderBytes + bytes;
+}
+
+int FrameParser::Parse(const OnFrame& callback)
+{
+    // Ring is mirrored so all reads from here up to Ring.Size bytes are contiguous
+    const uint8_t* buffer = Ring.Data + (ReadOffset & Ring.Mask);
+    const int buffer_bytes = GetBufferedBytes();
+    const int trailer_bytes = RssiTrailer ? 1 : 0;
+    int crc_failures = 0;
+
+    /*
+        Offset of the first header that passed its check but is waiting for
+        the rest of its packet, or -1 for none.  Parsing goes on past it, so
+        that noise which passed the check or a frame that was cut short does
+        not hold back the frames after it.  A complete frame found after it
+        shows it was not a frame.
+    */
+    int pending_offset = -1;
+
+    // Offset of the first header after that one that is also waiting
+    int rescan_offset = -1;
+
+    // Data already parsed after a header that was pending last time
+    const int scanned_bytes = (int)(ScanOffset - ReadOffset);
+
+    int start_offset;
+    for (start_offset = 0; start_offset + 1 < buffer_bytes; ++start_offset)
+    {
+        // A version 2 sender only sends version 2 frames, so behind its
+        // waiting header only sync bytes can start a frame.  memchr() skips
+        // the data of the waiting frame fast
+        if (pending_offset >= 0 && LastFrameVersion == kFrameVersion2 && buffer[pending_offset] == kFrameSyncByte)
+        {
+            const uint8_t* sync = static_cast<const uint8_t*>( memchr(buffer + start_offset, kFrameSyncByte, buffer_bytes - 1 - start_offset) );
+            if (!sync) {
+                start_offset = buffer_bytes - 1;
+                break;
+            }
+            start_offset = static_cast<int>( sync - buffer );
+        }
+
+        const uint8_t* header = buffer + start_offset;
+        const int available_bytes = buffer_bytes - start_offset;
+
+        const uint8_t* packet;
+        int packet_bytes;
+        int frame_version;
+
+        if (header[0] == kFrameSyncByte)
+        {
+            packet_bytes = header[1];
+            if (packet_bytes <= 0 || packet_bytes > kPacketMaxBytes) {
+                // Not the start of a packet
+                continue;
+            }
+
+            if (available_bytes < 4) {
+                // Not enough data arrived yet
+                break;
+            }
+
+            // Cheap check that rejects all but 1/256 of noise before the CRC
+            if (header[2] != GetHeaderCheckV2(header[1], header[3])) {
+                // Not the start of a packet
+                continue;
+            }
+
+            if (available_bytes < kFrameHeaderBytes + packet_bytes + trailer_bytes) {
+                // Not enough data arrived yet
+                if (pending_offset < 0) {
+                    pending_offset = start_offset;
+                    if (start_offset == 0 && scanned_bytes > 1) {
+                        start_offset = scanned_bytes - 1;
+                    }
+                } else if (rescan_offset < 0) {
+                    rescan_offset = start_offset;
+                }
+                continue;
+            }
+
+            packet = header + 3;
+
+            const uint16_t crc = static_cast<uint16_t>( FastCrc32(header + 1, 2 + packet_bytes) );
+            if (ReadU16_LE(packet + packet_bytes) != crc) {
+                // Not the start of a packet, or a corrupted one.
+                // Data after a pending header is parsed again next time
+                if (pending_offset < 0) {
+                    ++crc_failures;
+                }
+                continue;
+            }
+
+            frame_version = kFrameVersion2;
+        }
+        else
+        {
+            packet_bytes = header[0];
+            if (packet_bytes <= 0 || packet_bytes > kPacketMaxBytes) {
+                // Not the start of a packet
+                continue;
+            }
+
+            if (available_bytes < kFrameV1HeaderBytes) {
+                // Not enough data arrived yet
+                break;
+            }
+
+            // Cheap check that rejects all but 1/256 of noise before the CRC
+            const uint32_t expected_crc = ReadU24_LE(header + 2);
+            if (header[1] != GetHeaderCheck(header[0], expected_crc)) {
+                // Not the start of a packet
+                continue;
+            }
+
+            if (available_bytes < kFrameV1HeaderBytes + packet_bytes + trailer_bytes) {
+                // Not enough data arrived yet
+                if (pending_offset < 0) {
+                    pending_offset = start_offset;
+                    if (start_offset == 0 && scanned_bytes > 1) {
+                        start_offset = scanned_bytes - 1;
+                    }
+                } else if (rescan_offset < 0) {
+                    rescan_offset = start_offset;
+                }
+                continue;
+            }
+
+            packet = header + kFrameV1HeaderBytes;
+
+            const uint32_t crc = FastCrc32(packet, packet_bytes) & 0xffffff;
+            if (expected_crc != crc) {
+                // Not the start of a packet, or a corrupted one.
+                // Data after a pending header is parsed again next time
+                if (pending_offset < 0) {
+                    ++crc_failures;
+                }
+                continue;
+            }
+
+            frame_version = kFrameVersion1;
+        }
+
+        const int frame_bytes = GetFrameHeaderBytes(frame_version) + packet_bytes;
+
+        int rssi_dbm = kUnknownRssiDbm;
+        if (RssiTrailer) {
+            rssi_dbm = RssiByteToDbm(header[frame_bytes]);
+        }
+
+        callback(packet, packet_bytes, rssi_dbm, frame_version);
+        LastFrameVersion = frame_version;
+
+        // A pending header before this frame was noise or a cut short frame
+        pending_offset = -1;
+
+        // Skip ahead to next potential start point, which may be the RSSI byte
+        start_offset += frame_bytes - 1;
+    }
+
+    // Release parsed data, up to the pending header if there is one
+    if (pending_offset >= 0)
+    {
+        ReadOffset += pending_offset;
+        ScanOffset = ReadOffset + (rescan_offset >= 0 ? rescan_offset : start_offset) - pending_offset;
+    }
+    else
+    {
+        ReadOffset += start_offset;
+        ScanOffset = ReadOffset;
+    }
+
+    return crc_failures;
+}
+
+
+//------------------------------------------------------------------------------
+// TransmitPacer
+
+void TransmitPacer::Reset(int air_rate_bps, int buffer_bytes)
+{
+    AirRateBps = air_rate_bps;
+    BufferBytes = buffer_bytes;
+    AirBusyUntilUsec = 0;
+}
+
+uint64_t TransmitPacer::GetDelayUsec(uint64_t now_usec, int frame_bytes, int send_queue_bytes) const
+{
+    if (AirBusyUntilUsec <= now_usec) {
+        return 0; // Radio is idle
+    }
+
+    // Bytes written that have not been sent over the air yet
+    const uint64_t inflight_bytes = (AirBusyUntilUsec - now_usec) * AirRateBps / 8 / 1000000;
+
+    // Bytes still in the kernel have not reached the radio
+    const int64_t radio_bytes = (int64_t)inflight_bytes - send_queue_bytes;
+
+    const int64_t excess_bytes = radio_bytes + frame_bytes - BufferBytes;
+    if (excess_bytes <= 0) {
+        return 0;
+    }
+
+    // Wait for the excess to drain over the air
+    return (uint64_t)excess_bytes * 8 * 1000000 / AirRateBps;
+}
+
+void TransmitPacer::OnSend(uint64_t now_usec, uint64_t airtime_usec)
+{
+    if (AirBusyUntilUsec < now_usec) {
+        AirBusyUntilUsec = now_usec;
+    }
+    AirBusyUntilUsec += airtime_usec;
+}
+
+
+//------------------------------------------------------------------------------
+// LinkQuality
+
+void LinkQualityStats::Add(const LinkQualityStats& other)
+{
+    if (other.RssiFrames > 0)
+    {
+        if (RssiFrames == 0 || RssiMinDbm > other.RssiMinDbm) {
+            RssiMinDbm = other.RssiMinDbm;
+        }
+        if (RssiFrames == 0 || RssiMaxDbm < other.RssiMaxDbm) {
+            RssiMaxDbm = other.RssiMaxDbm;
+        }
+    }
+
+    Frames += other.Frames;
+    CrcFailures += other.CrcFailures;
+    SequencedFrames += other.SequencedFrames;
+    LostFrames += other.LostFrames;
+    RssiFrames += other.RssiFrames;
+    RssiSumDbm += other.RssiSumDbm;
+    for (int i = 0; i < kRssiBinCount; ++i) {
+        RssiHistogram[i] += other.RssiHistogram[i];
+    }
+}
+
+std::string LinkQualityStats::ToString() const
+{
+    std::ostringstream oss;
+    oss << "frames = " << Frames
+        << ", CRC failures = " << GetCrcFailureRate() * 100.f << "%"
+        << ", loss = " << GetLossRate() * 100.f << "%";
+
+    if (RssiFrames > 0)
+    {
+        oss << ", RSSI avg = " << GetAverageRssiDbm()
+            << " min = " << RssiMinDbm
+            << " max = " << RssiMaxDbm << " dBm, histogram:";
+
+        for (int i = 0; i < kRssiBinCount; ++i) {
+            if (RssiHistogram[i] > 0) {
+                oss << " " << kRssiHistogramMinDbm + i * kRssiBinDb << "=" << RssiHistogram[i];
+            }
+        }
+    }
+
+    return oss.str();
+}
+
+void LinkQuality::Reset()
+{
+    std::lock_guard<std::mutex> locker(Lock);
+
+    WindowStartUsec = GetTimeUsec();
+    Current = LinkQualityStats();
+    Previous = LinkQualityStats();
+    SequenceValid = false;
+    RunStep = 0;
+}
+
+void LinkQuality::RollWindow()
+{
+    const uint64_t now_usec = GetTimeUsec();
+    if (now_usec - WindowStartUsec < kWindowUsec) {
+        return;
+    }
+
+    // If a whole window passed with no calls, the previous window is stale too
+    if (now_usec - WindowStartUsec < kWindowUsec * 2) {
+        Previous = Current;
+    } else {
+        Previous = LinkQualityStats();
+    }
+    Current = LinkQualityStats();
+    WindowStartUsec = now_usec;
+}
+
+void LinkQuality::OnFrame(int rssi_dbm)
+{
+    std::lock_guard<std::mutex> locker(Lock);
+    RollWindow();
+
+    ++Current.Frames;
+
+    if (rssi_dbm == kUnknownRssiDbm) {
+        return;
+    }
+
+    if (Current.RssiFrames == 0 || Current.RssiMinDbm > rssi_dbm) {
+        Current.RssiMinDbm = rssi_dbm;
+    }
+    if (Current.RssiFrames == 0 || Current.RssiMaxDbm < rssi_dbm) {
+        Current.RssiMaxDbm = rssi_dbm;
+    }
+    ++Current.RssiFrames;
+    Current.RssiSumDbm += rssi_dbm;
+
+    int bin = (rssi_dbm - kRssiHistogramMinDbm) / kRssiBinDb;
+    if (bin < 0) {
+        bin = 0;
+    } else if (bin >= kRssiBinCount) {
+        bin = kRssiBinCount - 1;
+    }
+    ++Current.RssiHistogram[bin];
+}
+
+void LinkQuality::OnCrcFailures(int count)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> locker(Lock);
+    RollWindow();
+
+    Current.CrcFailures += count;
+}
+
+void LinkQuality::OnSequence(uint32_t sequence, uint32_t run_length)
+{
+    std::lock_guard<std::mutex> locker(Lock);
+    RollWindow();
+
+    const uint32_t run = sequence / run_length;
+    const uint32_t run_offset = sequence % run_length;
+    const uint32_t step = run - LastRun;
+
+    if (!SequenceValid || step > kMaxSequenceStep || (step == 0 && run_offset <= LastRunOffset)) {
+        // First frame, a repeat, or the sender started over
+        RunStep = 0;
+    }
+    else if (step == 0) {
+        Current.LostFrames += run_offset - LastRunOffset - 1;
+    }
+    else
+    {
+        if (RunStep == 0 || RunStep > step) {
+            RunStep = step;
+        }
+        // Rest of the last run, runs skipped, and the start of this run
+        Current.LostFrames += (run_length - 1 - LastRunOffset) + (step / RunStep - 1) * run_length + run_offset;
+    }
+
+    ++Current.SequencedFrames;
+    LastRun = run;
+    LastRunOffset = run_offset;
+    SequenceValid = true;
+}
+
+LinkQualityStats LinkQuality::GetStats()
+{
+    std::lock_guard<std::mutex> locker(Lock);
+    RollWindow();
+
+    LinkQualityStats stats = Previous;
+    stats.Add(Current);
+    return stats;
+}
+
+
+} // namespace lora
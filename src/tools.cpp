@@ -23,10 +23,8 @@
     #include <sys/time.h>
 #endif
 
-#include <arm_acle.h>
-#include <arm_neon.h>
-
 #include <string.h>
+#include <sstream>
 
 #include <spdlog/async.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
@@ -99,10 +97,34 @@
 # include <errno.h>
 #endif
 
+
+//------------------------------------------------------------------------------
+// CRC32C Instruction Set Check
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+# define LORA_CRC32C_X86
+# include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32) || \
+    (defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 10 && \
+     (defined(__aarch64__) || (defined(__ARM_ARCH) && __ARM_ARCH >= 6)))
+// GCC 10 and newer declare the CRC intrinsics whatever -march says, so the
+// kernel is compiled for ARMv8 CRC below and picked at runtime
+# define LORA_CRC32C_ARM
+# include <arm_acle.h>
+# if defined(CAT_OS_LINUX)
+#  include <sys/auxv.h>
+#  include <asm/hwcap.h>
+# endif
+#endif
+
 #if defined(CAT_OS_WINDOWS)
 # include <windows.h>
 #elif defined(CAT_OS_LINUX) || defined(CAT_OS_AIX) || defined(CAT_OS_SOLARIS) || defined(CAT_OS_IRIX)
 # include <unistd.h>
+# include <sys/resource.h> // setpriority
+# if defined(CAT_OS_LINUX)
+#  include <sys/syscall.h> // SYS_gettid
+# endif
 #elif defined(CAT_OS_OSX) || defined(CAT_OS_BSD)
 # include <sys/sysctl.h>
 # include <unistd.h>
@@ -166,73 +188,324 @@ uint64_t GetTimeMsec()
     return GetTimeUsec() / 1000;
 }
 
-#if __ARM_ARCH >= 8
+// Nice value for SetCurrentThreadBackground()
+static const int kBackgroundNice = 10;
 
-uint32_t FastCrc32(const void* vdata, int bytes)
+void SetCurrentThreadBackground()
 {
-    const uint8_t* data = reinterpret_cast<const uint8_t*>( vdata );
+#if defined(CAT_OS_WINDOWS)
+    ::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(CAT_OS_LINUX)
+    // Linux keeps a nice value for each thread
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), kBackgroundNice);
+#endif
+}
 
-    uint32_t crc = UINT32_C(0xffffffff);
+//------------------------------------------------------------------------------
+// CRC32C
 
-    while (bytes >= 8) {
-        crc = __crc32cd(crc, ReadU64_LE(data));
-        data += 8;
-        bytes -= 8;
+/*
+    CRC32C (Castagnoli polynomial) is used on every platform so that a sender
+    and receiver on different architectures agree.
+
+    Where the CPU has CRC32C instructions (SSE4.2 or ARMv8 CRC), large inputs
+    are split into three lanes that are processed in an interleaved loop to
+    hide the instruction latency.  The lane results are combined by shifting
+    each CRC forward over the zero bytes of the lanes after it, using tables.
+
+    Otherwise a portable slice-by-8 table implementation is used.
+
+    The implementation is selected at runtime.
+*/
+
+// Reflected polynomial
+static const uint32_t kCrc32cPoly = UINT32_C(0x82F63B78);
+
+// Lane sizes for interleaved hardware CRC
+static const unsigned kCrc32cLongBytes = 8192;
+static const unsigned kCrc32cShortBytes = 256;
+
+typedef uint32_t (*Crc32cFunc)(uint32_t state, const uint8_t* data, size_t bytes);
+
+struct Crc32cTables
+{
+    // Slice-by-8 tables
+    uint32_t Slice[8][256];
+
+    // Tables that shift a CRC state forward over a lane of zero bytes
+    uint32_t LongShift[4][256];
+    uint32_t ShortShift[4][256];
+
+    Crc32cFunc Func = nullptr;
+    const char* Name = nullptr;
+
+    Crc32cTables();
+};
+
+static uint32_t Crc32cPortable(uint32_t state, const uint8_t* data, size_t bytes);
+#if defined(LORA_CRC32C_X86) || defined(LORA_CRC32C_ARM)
+static uint32_t Crc32cHardware(uint32_t state, const uint8_t* data, size_t bytes);
+#endif
+
+// Built on first use, so FastCrc32() works from static initializers in other
+// translation units too
+static const Crc32cTables& GetCrc32cTables()
+{
+    static const Crc32cTables tables;
+    return tables;
+}
+
+#if defined(LORA_CRC32C_X86) || defined(LORA_CRC32C_ARM)
+
+// Multiply a and b modulo the polynomial (reflected bit order)
+static uint32_t Crc32cMultModP(uint32_t a, uint32_t b)
+{
+    uint32_t m = UINT32_C(1) << 31, p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ kCrc32cPoly : b >> 1;
     }
+    return p;
+}
 
-    if (bytes & 4) {
-        crc = __crc32cw(crc, ReadU32_LE(data));
-        data += 4;
+// Returns x^(8*bytes) modulo the polynomial
+static uint32_t Crc32cZerosOperator(uint64_t bytes)
+{
+    uint32_t result = UINT32_C(1) << 31; // x^0
+    uint32_t square = UINT32_C(1) << 30; // x^1
+
+    // Square up to x^8 for each byte
+    for (int i = 0; i < 3; ++i) {
+        square = Crc32cMultModP(square, square);
     }
 
-    if (bytes & 2) {
-        crc = __crc32ch(crc, ReadU16_LE(data));
-        data += 2;
+    while (bytes) {
+        if (bytes & 1) {
+            result = Crc32cMultModP(square, result);
+        }
+        square = Crc32cMultModP(square, square);
+        bytes >>= 1;
     }
 
-    if (bytes & 1) {
-        crc = __crc32cb(crc, *data);
+    return result;
+}
+
+static inline uint32_t Crc32cShift(const uint32_t table[4][256], uint32_t state)
+{
+    return table[0][state & 0xff] ^ table[1][(state >> 8) & 0xff] ^
+           table[2][(state >> 16) & 0xff] ^ table[3][state >> 24];
+}
+
+static void Crc32cMakeShiftTable(uint32_t table[4][256], uint64_t bytes)
+{
+    const uint32_t op = Crc32cZerosOperator(bytes);
+
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            table[j][i] = Crc32cMultModP(op, i << (8 * j));
+        }
     }
+}
 
-    return ~crc;
+static bool Crc32cHardwareSupported()
+{
+#if defined(LORA_CRC32C_X86)
+    return __builtin_cpu_supports("sse4.2") != 0;
+#elif defined(LORA_CRC32C_ARM)
+# if defined(CAT_OS_LINUX) && defined(__aarch64__) && defined(HWCAP_CRC32)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+# elif defined(CAT_OS_LINUX) && defined(HWCAP2_CRC32)
+    return (getauxval(AT_HWCAP2) & HWCAP2_CRC32) != 0;
+# elif defined(__ARM_FEATURE_CRC32)
+    return true; // Compiler was told the CPU supports it
+# else
+    return false;
+# endif
+#endif
 }
 
-#else // Fallback when processor cannot do it for us:
+#endif // LORA_CRC32C_X86 || LORA_CRC32C_ARM
 
-static const uint32_t CRC32_LUT[256] = {
-    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 
-    0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7, 0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5, 
-    0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172, 0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59, 
-    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423, 0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924, 0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 
-    0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433, 0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01, 
-    0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950, 0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65, 
-    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0, 0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 
-    0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f, 0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad, 
-    0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1, 
-    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 
-    0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b, 0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79, 
-    0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236, 0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d, 
-    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 
-    0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777, 0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45, 
-    0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc, 0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9, 
-    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d, 
-};
+Crc32cTables::Crc32cTables()
+{
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; ++j) {
+            crc = (crc & 1) ? (crc >> 1) ^ kCrc32cPoly : crc >> 1;
+        }
+        Slice[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int j = 1; j < 8; ++j) {
+            Slice[j][i] = (Slice[j - 1][i] >> 8) ^ Slice[0][Slice[j - 1][i] & 0xff];
+        }
+    }
+
+    Func = Crc32cPortable;
+    Name = "Portable slice-by-8";
+
+#if defined(LORA_CRC32C_X86) || defined(LORA_CRC32C_ARM)
+    if (Crc32cHardwareSupported()) {
+        Crc32cMakeShiftTable(LongShift, kCrc32cLongBytes);
+        Crc32cMakeShiftTable(ShortShift, kCrc32cShortBytes);
 
-uint32_t FastCrc32(const void* vdata, int bytes)
+        Func = Crc32cHardware;
+# if defined(LORA_CRC32C_X86)
+        Name = "SSE4.2 crc32 x3";
+# else
+        Name = "ARMv8 crc32c x3";
+# endif
+    }
+#endif
+}
+
+static uint32_t Crc32cPortable(uint32_t state, const uint8_t* data, size_t bytes)
 {
-    const uint8_t* data = reinterpret_cast<const uint8_t*>( vdata );
+    const uint32_t (*table)[256] = GetCrc32cTables().Slice;
 
-    uint32_t crc = UINT32_C(0xffffffff);
+    while (bytes >= 8) {
+        const uint64_t word = ReadU64_LE(data) ^ state;
+        state = table[7][word & 0xff] ^ table[6][(word >> 8) & 0xff] ^
+                table[5][(word >> 16) & 0xff] ^ table[4][(word >> 24) & 0xff] ^
+                table[3][(word >> 32) & 0xff] ^ table[2][(word >> 40) & 0xff] ^
+                table[1][(word >> 48) & 0xff] ^ table[0][word >> 56];
+        data += 8;
+        bytes -= 8;
+    }
 
-    for (int i = 0; i < bytes; ++i) {
-        crc = (crc >> 8) ^ CRC32_LUT[static_cast<uint8_t>(crc ^ data[i])];
+    while (bytes > 0) {
+        state = (state >> 8) ^ table[0][(state ^ *data) & 0xff];
+        ++data;
+        --bytes;
     }
 
-    return ~crc;
+    return state;
+}
+
+#if defined(LORA_CRC32C_X86)
+
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+
+static inline uint32_t HwCrc32c8(uint32_t state, uint8_t value)
+{
+    return _mm_crc32_u8(state, value);
 }
 
+static inline uint32_t HwCrc32c64(uint32_t state, uint64_t value)
+{
+    return static_cast<uint32_t>( _mm_crc32_u64(state, value) );
+}
+
+#elif defined(LORA_CRC32C_ARM)
+
+#pragma GCC push_options
+#if defined(__aarch64__)
+#pragma GCC target("+crc")
+#elif defined(__ARM_FP)
+#pragma GCC target("arch=armv8-a+crc+simd")
+#else
+#pragma GCC target("arch=armv8-a+crc")
 #endif
 
+static inline uint32_t HwCrc32c8(uint32_t state, uint8_t value)
+{
+    return __crc32cb(state, value);
+}
+
+static inline uint32_t HwCrc32c64(uint32_t state, uint64_t value)
+{
+    return __crc32cd(state, value);
+}
+
+#endif
+
+#if defined(LORA_CRC32C_X86) || defined(LORA_CRC32C_ARM)
+
+// Process three lanes of lane_bytes each, interleaved
+static inline uint32_t Crc32cLanes(
+    uint32_t state,
+    const uint8_t* data,
+    unsigned lane_bytes,
+    const uint32_t shift[4][256])
+{
+    uint32_t crc0 = state, crc1 = 0, crc2 = 0;
+
+    const uint8_t* end = data + lane_bytes;
+    do {
+        crc0 = HwCrc32c64(crc0, ReadU64_LE(data));
+        crc1 = HwCrc32c64(crc1, ReadU64_LE(data + lane_bytes));
+        crc2 = HwCrc32c64(crc2, ReadU64_LE(data + lane_bytes * 2));
+        data += 8;
+    } while (data < end);
+
+    state = Crc32cShift(shift, crc0) ^ crc1;
+    return Crc32cShift(shift, state) ^ crc2;
+}
+
+static uint32_t Crc32cHardware(uint32_t state, const uint8_t* data, size_t bytes)
+{
+    const Crc32cTables& tables = GetCrc32cTables();
+
+    // Align to 8 bytes
+    while (bytes > 0 && (reinterpret_cast<uintptr_t>( data ) & 7) != 0) {
+        state = HwCrc32c8(state, *data);
+        ++data;
+        --bytes;
+    }
+
+    while (bytes >= kCrc32cLongBytes * 3) {
+        state = Crc32cLanes(state, data, kCrc32cLongBytes, tables.LongShift);
+        data += kCrc32cLongBytes * 3;
+        bytes -= kCrc32cLongBytes * 3;
+    }
+
+    while (bytes >= kCrc32cShortBytes * 3) {
+        state = Crc32cLanes(state, data, kCrc32cShortBytes, tables.ShortShift);
+        data += kCrc32cShortBytes * 3;
+        bytes -= kCrc32cShortBytes * 3;
+    }
+
+    while (bytes >= 8) {
+        state = HwCrc32c64(state, ReadU64_LE(data));
+        data += 8;
+        bytes -= 8;
+    }
+
+    while (bytes > 0) {
+        state = HwCrc32c8(state, *data);
+        ++data;
+        --bytes;
+    }
+
+    return state;
+}
+
+#pragma GCC pop_options
+
+#endif // LORA_CRC32C_X86 || LORA_CRC32C_ARM
+
+uint32_t FastCrc32(const void* data, size_t bytes, uint32_t crc)
+{
+    return ~GetCrc32cTables().Func(~crc, reinterpret_cast<const uint8_t*>( data ), bytes);
+}
+
+uint32_t FastCrc32Portable(const void* data, size_t bytes, uint32_t crc)
+{
+    return ~Crc32cPortable(~crc, reinterpret_cast<const uint8_t*>( data ), bytes);
+}
+
+const char* GetFastCrc32Name()
+{
+    return GetCrc32cTables().Name;
+}
+
 
 //------------------------------------------------------------------------------
 // MappedFile
@@ -319,6 +592,11 @@ bool MappedFile::OpenRead(
         fcntl(File, F_RDAHEAD, 1);
     }
 #endif
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (read_ahead) {
+        posix_fadvise(File, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
 
     (void)no_cache;
 #ifdef F_NOCACHE
@@ -619,6 +897,67 @@ void MappedReadOnlySmallFile::Close()
 }
 
 
+//------------------------------------------------------------------------------
+// MirroredRingBuffer
+
+bool MirroredRingBuffer::Allocate(uint32_t min_bytes)
+{
+    Free();
+
+    uint32_t size = GetAllocationGranularity();
+    while (size < min_bytes) {
+        size *= 2;
+    }
+
+#if defined(CAT_OS_LINUX)
+    int fd = memfd_create("ring", MFD_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ScopedFunction fd_scope([fd]() {
+        close(fd);
+    });
+
+    if (0 != ftruncate(fd, size)) {
+        return false;
+    }
+
+    // Reserve address space for both copies
+    void* base = mmap(nullptr, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    uint8_t* data = reinterpret_cast<uint8_t*>( base );
+    void* lo = mmap(data, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    void* hi = mmap(data + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    if (lo == MAP_FAILED || hi == MAP_FAILED) {
+        munmap(base, size * 2);
+        return false;
+    }
+
+    Data = data;
+    Size = size;
+    Mask = size - 1;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void MirroredRingBuffer::Free()
+{
+#if defined(CAT_OS_LINUX)
+    if (Data) {
+        munmap(Data, Size * 2);
+    }
+#endif
+    Data = nullptr;
+    Size = 0;
+    Mask = 0;
+}
+
+
 //------------------------------------------------------------------------------
 // File Helpers
 
@@ -647,6 +986,216 @@ bool WriteBufferToFile(const char* path, const void* data, uint64_t bytes)
 }
 
 
+//------------------------------------------------------------------------------
+// AtomicFileWriter
+
+bool AtomicFileWriter::Open(const std::string& path, uint64_t expected_bytes)
+{
+    Abort();
+
+    Path = path;
+    WrittenBytes = 0;
+
+#if defined(CAT_OS_LINUX)
+    const size_t last_slash = path.rfind('/');
+    const std::string dir = (last_slash == std::string::npos) ? "." : path.substr(0, last_slash + 1);
+
+#if defined(O_TMPFILE)
+    File = open(dir.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, (mode_t)0666);
+#endif
+    if (File < 0)
+    {
+        // Some file systems cannot hold unnamed files
+        TempPath = path + ".XXXXXX";
+        File = mkostemp(&TempPath[0], O_CLOEXEC);
+        if (File < 0) {
+            TempPath.clear();
+            return false;
+        }
+    }
+
+    if (expected_bytes > 0) {
+        // Not all file systems support this, so it is only a hint
+        posix_fallocate(File, 0, (off_t)expected_bytes);
+    }
+
+    return true;
+#else
+    (void)expected_bytes;
+    return false;
+#endif
+}
+
+bool AtomicFileWriter::Write(const void* data, size_t bytes)
+{
+#if defined(CAT_OS_LINUX)
+    const uint8_t* next = reinterpret_cast<const uint8_t*>( data );
+    while (bytes > 0)
+    {
+        const ssize_t written = write(File, next, bytes);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        next += written;
+        bytes -= (size_t)written;
+        WrittenBytes += (uint64_t)written;
+    }
+    return true;
+#else
+    (void)data;
+    (void)bytes;
+    return false;
+#endif
+}
+
+bool AtomicFileWriter::Commit()
+{
+#if defined(CAT_OS_LINUX)
+    if (File < 0) {
+        return false;
+    }
+
+    // Drop space reserved past the end
+    if (0 != ftruncate(File, (off_t)WrittenBytes) || 0 != fsync(File)) {
+        Abort();
+        return false;
+    }
+
+    if (TempPath.empty())
+    {
+        // Give the unnamed file a temporary name, then rename it over the path
+        const std::string fd_path = "/proc/self/fd/" + std::to_string(File);
+        TempPath = Path + ".XXXXXX";
+        const int temp = mkostemp(&TempPath[0], O_CLOEXEC);
+        if (temp < 0) {
+            TempPath.clear();
+            Abort();
+            return false;
+        }
+        close(temp);
+        unlink(TempPath.c_str());
+
+        if (0 != linkat(AT_FDCWD, fd_path.c_str(), AT_FDCWD, TempPath.c_str(), AT_SYMLINK_FOLLOW)) {
+            TempPath.clear();
+            Abort();
+            return false;
+        }
+    }
+
+    if (0 != rename(TempPath.c_str(), Path.c_str())) {
+        Abort();
+        return false;
+    }
+
+    TempPath.clear();
+    close(File);
+    File = -1;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AtomicFileWriter::Abort()
+{
+#if defined(CAT_OS_LINUX)
+    if (File >= 0) {
+        close(File);
+        File = -1;
+    }
+    if (!TempPath.empty()) {
+        unlink(TempPath.c_str());
+        TempPath.clear();
+    }
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+// TimingHistogram
+
+void TimingHistogram::Add(uint64_t usec)
+{
+    int bin = 0;
+    while (bin < kTimingBinCount - 1 && (usec >> bin) != 0) {
+        ++bin;
+    }
+
+    ++Count;
+    TotalUsec += usec;
+    if (MaxUsec < usec) {
+        MaxUsec = usec;
+    }
+    ++Bins[bin];
+}
+
+void TimingHistogram::Add(const TimingHistogram& other)
+{
+    Count += other.Count;
+    TotalUsec += other.TotalUsec;
+    if (MaxUsec < other.MaxUsec) {
+        MaxUsec = other.MaxUsec;
+    }
+    for (int i = 0; i < kTimingBinCount; ++i) {
+        Bins[i] += other.Bins[i];
+    }
+}
+
+uint64_t TimingHistogram::GetPercentileUsec(float fraction) const
+{
+    if (Count == 0) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(fraction * Count + 0.5f);
+    if (target < 1) {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < kTimingBinCount - 1; ++i)
+    {
+        seen += Bins[i];
+        if (seen >= target) {
+            const uint64_t bin_max_usec = ((uint64_t)1 << i) - 1;
+            return bin_max_usec < MaxUsec ? bin_max_usec : MaxUsec;
+        }
+    }
+
+    return MaxUsec;
+}
+
+std::string TimingHistogram::ToString() const
+{
+    std::ostringstream oss;
+    oss << "n = " << Count;
+
+    if (Count > 0)
+    {
+        oss << ", avg = " << GetAverageUsec()
+            << " p50 = " << GetPercentileUsec(0.5f)
+            << " p90 = " << GetPercentileUsec(0.9f)
+            << " p99 = " << GetPercentileUsec(0.99f)
+            << " max = " << MaxUsec << " usec, histogram:";
+
+        // Each bin is listed by the time it is below
+        for (int i = 0; i < kTimingBinCount - 1; ++i) {
+            if (Bins[i] > 0) {
+                oss << " <" << ((uint64_t)1 << i) << "=" << Bins[i];
+            }
+        }
+        if (Bins[kTimingBinCount - 1] > 0) {
+            oss << " >=" << ((uint64_t)1 << (kTimingBinCount - 2)) << "=" << Bins[kTimingBinCount - 1];
+        }
+    }
+
+    return oss.str();
+}
+
+
 //------------------------------------------------------------------------------
 // Logging
 
@@ -6,8 +6,10 @@
 
 #include <thread>
 #include <chrono>
+#include <mutex>
 #include <unistd.h>
 #include <cstring>
+#include <ctime>
 using namespace std;
 
 namespace lora {
@@ -16,12 +18,41 @@ namespace lora {
 //------------------------------------------------------------------------------
 // Constants
 
-static const char* kSerialDevice = "/dev/ttyS0";
-
-static const int kModeSwitchWaitUsec = 100 * 1000; // 100 msec
-
-static const uint8_t kM0 = 22;
-static const uint8_t kM1 = 27;
+// The HAT always uses 9600 baud in config mode
+static const int kConfigBaudrate = 9600;
+
+// Baudrate for transmit mode set by Initialize()
+static const int kTransmitBaudrate = 115200;
+
+// Time allowed for the HAT to boot and answer in config mode on startup
+static const int kBootTimeoutMsec = 2000;
+
+// Time allowed for the HAT to answer in config mode after a mode switch,
+// on top of the airtime for data still in its buffer
+static const int kModeSwitchTimeoutMsec = 1000;
+
+/*
+    The HAT only switches modes once its buffer is on the air, and a probe
+    written before it switches is sent on the air as a packet.  So after
+    raising M1 we wait for the modeled airtime of the buffered data, plus
+    this long for the switch itself, before the first probe.
+*/
+static const int kModeSwitchMinUsec = 20 * 1000; // 20 msec
+
+/*
+    Time to wait for an answer to a config mode probe before writing another.
+    The answer takes a few milliseconds, so this only repeats probes that the
+    HAT missed, rather than queueing more of them while it is still busy.
+*/
+static const int kReadyProbeMsec = 100;
+
+/*
+    The HAT gives no response in transmit mode that we could poll for without
+    putting a packet on the air, so we wait this long for it to apply the new
+    settings after lowering M1.  The HAT is idle at this point, since it only
+    entered config mode after its buffer was sent.
+*/
+static const int kTransmitModeWaitUsec = 20 * 1000; // 20 msec
 
 // FIXME: Pick these
 static const uint8_t kNetId = 0x00;
@@ -29,20 +60,105 @@ static const uint8_t kNetId = 0x00;
 static const uint8_t kKeyHi = 0x00;
 static const uint8_t kKeyLo = 0x00;
 
+// Register offsets
+static const int kRegAddressHi = 0;
+static const int kRegAddressLo = 1;
+static const int kRegAirRate = 3;
+static const int kRegOptions = 4;
+
+// kRegAirRate low bits select the air rate: Index into kAirRatesBps
+static const uint8_t kAirRateMask = 0x07;
+
+// kRegOptions high bits select the packet size: 240, 128, 64, 32 bytes
+static const int kPacketSizeShift = 6;
+static const uint8_t kPacketSizeMask = 0xc0;
+
+// kRegOptions bit to enable ambient noise RSSI
+static const uint8_t kAmbientRssiEnable = 0x20;
+
+// Ambient RSSI scan results are kept here between runs,
+// followed by the serial device name and ".cache"
+static const char* kRssiCachePrefix = "/var/tmp/loraftp_rssi_";
+
+// Scan again if the cached results are older than this
+static const int64_t kRssiCacheTtlSec = 60 * 60; // 1 hour
+
+// Cache file: [magic(4)] [unix time(8)] [ChannelRssiRaw(kChannelCount)]
+static const uint32_t kRssiCacheMagic = UINT32_C(0x49535352); // "RSSI"
+static const int kRssiCacheBytes = 4 + 8 + kChannelCount;
+
+
+//------------------------------------------------------------------------------
+// GPIO
+
+/*
+    pigpio is initialized once for the whole process, but each HAT has its own
+    Waveshare object, so we count the users and only terminate after the last.
+*/
+static std::mutex m_GpioLock;
+static int m_GpioUsers = 0;
+
+static bool AcquireGpio()
+{
+    std::lock_guard<std::mutex> locker(m_GpioLock);
+
+    if (m_GpioUsers == 0 && gpioInitialise() < 0) {
+        spdlog::error("pigpio::gpioInitialise failed");
+        return false;
+    }
+
+    ++m_GpioUsers;
+    return true;
+}
+
+static void ReleaseGpio()
+{
+    std::lock_guard<std::mutex> locker(m_GpioLock);
+
+    if (--m_GpioUsers == 0) {
+        gpioTerminate();
+    }
+}
+
 
 //------------------------------------------------------------------------------
 // Waveshare HAT API
 
-bool Waveshare::Initialize(int channel, uint16_t transmit_addr, bool lbt)
+bool Waveshare::Initialize(
+    int channel,
+    uint16_t transmit_addr,
+    bool lbt,
+    RssiScan rssi_scan,
+    const WaveshareDevice& device)
 {
     Shutdown();
 
+    Device = device;
+
     memset(ChannelRssi, 0, sizeof(ChannelRssi));
     memset(ChannelRssiRaw, 0, sizeof(ChannelRssiRaw));
+    ChannelRssiValid = false;
     InConfigMode = false;
-    Baudrate = 9600;
-    RecvOffsetBytes = 0;
-    CurrentAddress = TransmitAddress = transmit_addr;
+    HatRegistersValid = false;
+    SwitchStats = ModeSwitchStats();
+    AirModel.Reset(RadioProfile().AirRateBps, kHatBufferBytes);
+    Baudrate = kConfigBaudrate;
+    TransmitAddress = transmit_addr;
+
+    const uint64_t t0 = GetTimeUsec();
+
+    Quality.Reset();
+
+    // The HAT appends an RSSI byte to each packet it receives
+    if (!Parser.Initialize(true)) {
+        spdlog::error("Parser.Initialize failed");
+        return false;
+    }
+
+    if (!Reactor.Initialize()) {
+        spdlog::error("Reactor.Initialize failed");
+        return false;
+    }
 
     spdlog::debug("Entering config mode...");
 
@@ -55,29 +171,35 @@ bool Waveshare::Initialize(int channel, uint16_t transmit_addr, bool lbt)
         while pigpio is installed by default.
     */
 
-    if (gpioInitialise() < 0) {
-        spdlog::error("pigpio::gpioInitialise failed");
+    if (!AcquireGpio()) {
         return false;
     }
+    GpioInitialized = true;
 
-    gpioSetMode(kM0, PI_OUTPUT);
-    gpioSetMode(kM1, PI_OUTPUT);
-    gpioWrite(kM0, 0);
-    gpioWrite(kM1, 0);
+    gpioSetMode(Device.M0Pin, PI_OUTPUT);
+    gpioSetMode(Device.M1Pin, PI_OUTPUT);
+    gpioWrite(Device.M0Pin, 0);
+    gpioWrite(Device.M1Pin, 1);
+    InConfigMode = true;
 
-    // Wait longer on startup because it takes a bit to boot on first mode switch
-    usleep(1000 * 1000);
+    // The port stays open from here on, even across mode switches
+    if (!Serial.Initialize(Device.SerialDevice.c_str(), kConfigBaudrate)) {
+        spdlog::error("Failed to open serial port: {}", Device.SerialDevice);
+        return false;
+    }
 
-    if (!EnterConfigMode()) {
-        spdlog::error("EnterConfigMode failed");
+    // Allow longer on startup because it takes a bit to boot
+    if (!WaitForConfigMode(kBootTimeoutMsec, 0)) {
+        spdlog::error("WaitForConfigMode failed");
         return false;
     }
 
     spdlog::debug("Configuring Waveshare HAT...");
 
     // Documentation here: https://www.waveshare.com/wiki/SX1262_915M_LoRa_HAT
-    const int config_bytes = 9;
-    const uint8_t config[config_bytes] = {
+    const RadioProfile profile;
+
+    const uint8_t config[kRegisterCount] = {
         /*
             Node address or 0xffff for monitor mode
         */
@@ -92,18 +214,18 @@ bool Waveshare::Initialize(int channel, uint16_t transmit_addr, bool lbt)
             111 00 111
             ^^^-------- Baudrate = 115200 (for transmit mode)
                 ^^----- 8N1 (no parity bit)
-                   ^^^- Airspeed = 62.5 Kilobits/second
+                   ^^^- Airspeed: 111 = 62.5 Kilobits/second ... 000 = 0.3
         */
-        0xe7,
+        (uint8_t)(0xe0 | profile.GetAirRateIndex()),
 
         /*
             00 0 000 00
-            ^^---------- 240 bytes per packet
+            ^^---------- Packet size: 00 = 240, 01 = 128, 10 = 64, 11 = 32 bytes
                ^-------- Enable ambient noise
                  ^^^---- Reserved (0)
                      ^^- 22 dBm transmit power
         */
-        0,
+        (uint8_t)((kPacketSizeCount - 1 - profile.GetPacketSizeIndex()) << kPacketSizeShift),
 
         /*
             Channel control (CH) 0-83. 84 channels in total
@@ -114,7 +236,7 @@ bool Waveshare::Initialize(int channel, uint16_t transmit_addr, bool lbt)
         (uint8_t)channel,
 
         /*
-            0 0 0 L 0 011
+            1 0 0 L 0 011
             ^------------- Enable RSSI on receive
               ^----------- Transparent transmitting
                 ^--------- Relay disabled
@@ -122,26 +244,43 @@ bool Waveshare::Initialize(int channel, uint16_t transmit_addr, bool lbt)
                     ^----- WOR transmit mode
                       ^^^- WOR period = 2000 msec
         */
-        (uint8_t)(0x03 | (lbt ? 0x10 : 0)),
+        (uint8_t)(0x83 | (lbt ? 0x10 : 0)),
 
         kKeyHi, kKeyLo
     };
 
-    if (!WriteConfig(0, config, config_bytes)) {
-        spdlog::error("WriteConfig failed");
-        return false;
-    }
+    memcpy(Registers, config, kRegisterCount);
 
-    Baudrate = 115200;
+    // Takes effect when we leave config mode
+    Baudrate = kTransmitBaudrate;
+
+    // CommitConfig() only writes registers that differ from the HAT.
+    // Note the key registers are write-only and read back as 0.
+    if (ReadConfig(0, HatRegisters, kRegisterCount)) {
+        HatRegistersValid = true;
+    } else {
+        spdlog::warn("ReadConfig failed: Writing whole config");
+    }
 
-    if (!ScanAmbientRssi()) {
-        spdlog::error("ScanAmbientRssi failed");
+    if (!CommitConfig()) {
+        spdlog::error("CommitConfig failed");
         return false;
     }
 
-    for (int i = 0; i < kCheckedChannelCount; ++i) {
-        const int channel = kCheckedChannels[i];
-        spdlog::debug("Channel {} ambient noise RSSI: {} dBm", channel, ChannelRssi[channel]);
+    if (rssi_scan != RssiScan::Skip)
+    {
+        if (rssi_scan == RssiScan::Always || !LoadRssiCache())
+        {
+            if (!ScanAmbientRssi()) {
+                spdlog::error("ScanAmbientRssi failed");
+                return false;
+            }
+            SaveRssiCache();
+        }
+
+        for (int i = 0; i < kChannelCount; ++i) {
+            spdlog::debug("Channel {} ambient noise RSSI: {} dBm", i, ChannelRssi[i]);
+        }
     }
 
     // Configure back to initial channel without ambient RSSI measurement enabled
@@ -150,14 +289,21 @@ bool Waveshare::Initialize(int channel, uint16_t transmit_addr, bool lbt)
         return false;
     }
 
-    spdlog::debug("LoRa radio ready");
+    spdlog::info("LoRa radio ready in {} msec ({} config sessions)",
+        (GetTimeUsec() - t0) / 1000.f,
+        SwitchStats.ConfigSession.Count);
     return true;
 }
 
 void Waveshare::Shutdown()
 {
     Serial.Shutdown();
-    gpioTerminate();
+    Reactor.Shutdown();
+
+    if (GpioInitialized) {
+        ReleaseGpio();
+        GpioInitialized = false;
+    }
 }
 
 bool Waveshare::EnterConfigMode()
@@ -166,26 +312,38 @@ bool Waveshare::EnterConfigMode()
         return true;
     }
 
-    spdlog::debug("Closing serial port...");
+    spdlog::debug("Entering config mode...");
 
-    Serial.Flush();
-    Serial.Shutdown();
+    const uint64_t t0 = GetTimeUsec();
 
-    spdlog::debug("Entering config mode...");
+    // Let queued frames reach the HAT before it stops taking data
+    if (!Serial.Drain()) {
+        spdlog::error("EnterConfigMode: Serial.Drain failed");
+        return false;
+    }
 
-    gpioWrite(kM1, 1);
+    // Everything written is in the HAT now, and goes on the air before the
+    // HAT switches modes
+    const uint64_t busy_usec = AirModel.GetBusyUsec(GetTimeUsec());
 
-    usleep(kModeSwitchWaitUsec);
+    gpioWrite(Device.M1Pin, 1);
+    InConfigMode = true;
 
-    spdlog::debug("Opening serial port...");
+    if (!Serial.SetBaudrate(kConfigBaudrate)) {
+        spdlog::error("EnterConfigMode: Serial.SetBaudrate failed");
+        return false;
+    }
 
-    if (!Serial.Initialize(kSerialDevice, 9600)) {
-        spdlog::error("Failed to open serial port: {}", kSerialDevice);
+    const int timeout_msec = kModeSwitchTimeoutMsec + (int)(busy_usec / 1000);
+    if (!WaitForConfigMode(timeout_msec, busy_usec)) {
+        spdlog::error("EnterConfigMode: WaitForConfigMode failed");
         return false;
     }
 
-    spdlog::debug("Now in config mode");
-    InConfigMode = true;
+    const uint64_t t1 = GetTimeUsec();
+    SwitchStats.EnterConfig.Add(t1 - t0);
+
+    spdlog::debug("Now in config mode after {} msec", (t1 - t0) / 1000.f);
     return true;
 }
 
@@ -195,64 +353,129 @@ bool Waveshare::EnterTransmitMode()
         return true;
     }
 
-    spdlog::debug("Closing serial port...");
-
-    Serial.Flush();
-    Serial.Shutdown();
-
     spdlog::debug("Entering transmit mode...");
 
-    gpioWrite(kM1, 0);
-
-    usleep(kModeSwitchWaitUsec);
+    const uint64_t t0 = GetTimeUsec();
 
-    spdlog::debug("Opening serial port...");
+    gpioWrite(Device.M1Pin, 0);
+    InConfigMode = false;
 
-    if (!Serial.Initialize(kSerialDevice, Baudrate)) {
-        spdlog::error("Failed to open serial port: {} baudrate={}", kSerialDevice, Baudrate);
+    if (!Serial.SetBaudrate(Baudrate)) {
+        spdlog::error("EnterTransmitMode: Serial.SetBaudrate failed: baudrate={}", Baudrate);
         return false;
     }
 
-    spdlog::debug("Now in transmit mode");
-    InConfigMode = false;
+    usleep(kTransmitModeWaitUsec);
+
+    // Discard anything received during the switch
+    Serial.Flush();
+    Parser.Reset();
+
+    const uint64_t t1 = GetTimeUsec();
+    SwitchStats.EnterTransmit.Add(t1 - t0);
+
+    spdlog::debug("Now in transmit mode after {} msec", (t1 - t0) / 1000.f);
     return true;
 }
 
-bool Waveshare::SetAddress(uint16_t addr)
+bool Waveshare::WaitForConfigMode(int timeout_msec, uint64_t busy_usec)
 {
-    if (CurrentAddress == addr) {
-        return true;
+    // Read one register: The HAT only answers this in config mode
+    const uint8_t probe[3] = {
+        0xc1, 0x00, 0x01
+    };
+
+    const uint64_t t0 = GetTimeMsec();
+
+    usleep((useconds_t)(busy_usec + kModeSwitchMinUsec));
+
+    for (;;)
+    {
+        Serial.Flush();
+
+        if (!Serial.Write(probe, 3)) {
+            spdlog::error("WaitForConfigMode: Serial.Write failed");
+            return false;
+        }
+
+        if (WaitForResponse(4, kReadyProbeMsec))
+        {
+            uint8_t readback[4];
+            const int r = Serial.Read(readback, 4);
+            if (r == 4 && 0 == memcmp(readback, probe, 3)) {
+                return true;
+            }
+        }
+
+        const int64_t dt = GetTimeMsec() - t0;
+        if (dt > timeout_msec) {
+            spdlog::error("WaitForConfigMode: Timeout after {} msec avail={}", dt, Serial.GetAvailable());
+            return false;
+        }
+    }
+}
+
+bool Waveshare::CommitConfig()
+{
+    int first = 0, last = kRegisterCount - 1;
+
+    if (HatRegistersValid)
+    {
+        while (first < kRegisterCount && Registers[first] == HatRegisters[first]) {
+            ++first;
+        }
+        if (first >= kRegisterCount) {
+            return EnterTransmitMode(); // Nothing changed
+        }
+        while (Registers[last] == HatRegisters[last]) {
+            --last;
+        }
     }
 
+    const uint64_t t0 = GetTimeUsec();
+
     if (!EnterConfigMode()) {
-        spdlog::error("SetAddress: EnterConfigMode failed");
+        spdlog::error("CommitConfig: EnterConfigMode failed");
         return false;
     }
-    
-    spdlog::debug("Configuring address {}...", addr);
 
-    uint8_t config[2] = {
-        (uint8_t)(addr >> 8), (uint8_t)addr
-    };
+    spdlog::debug("Writing registers {}..{}...", first, last);
 
-    if (!WriteConfig(0, config, 2)) {
-        spdlog::error("SetAddress: WriteConfig failed");
+    if (!WriteConfig(first, Registers + first, last - first + 1)) {
+        spdlog::error("CommitConfig: WriteConfig failed");
+        HatRegistersValid = false;
         return false;
     }
 
+    memcpy(HatRegisters, Registers, kRegisterCount);
+    HatRegistersValid = true;
+
     if (!EnterTransmitMode()) {
-        spdlog::error("SetAddress: EnterTransmitMode failed");
+        spdlog::error("CommitConfig: EnterTransmitMode failed");
+        return false;
+    }
+
+    SwitchStats.ConfigSession.Add(GetTimeUsec() - t0);
+    return true;
+}
+
+bool Waveshare::SetAddress(uint16_t addr)
+{
+    Registers[kRegAddressHi] = (uint8_t)(addr >> 8);
+    Registers[kRegAddressLo] = (uint8_t)addr;
+
+    if (!CommitConfig()) {
+        spdlog::error("SetAddress: CommitConfig failed");
         return false;
     }
 
-    CurrentAddress = addr;
     return true;
 }
 
 void Waveshare::DrainReceiveBuffer()
 {
     // Receive state must be reset if we drain the buffer
-    RecvOffsetBytes = 0;
+    Parser.Reset();
 
     int available_bytes = Serial.GetAvailable();
 
@@ -276,25 +499,46 @@ void Waveshare::DrainReceiveBuffer()
 
 bool Waveshare::SetChannel(int channel, bool enable_ambient_rssi)
 {
-    if (!EnterConfigMode()) {
-        spdlog::error("SetChannel: EnterConfigMode failed");
+    spdlog::debug("Configuring channel {}...", channel);
+
+    Registers[kRegOptions] &= ~kAmbientRssiEnable;
+    if (enable_ambient_rssi) {
+        Registers[kRegOptions] |= kAmbientRssiEnable;
+    }
+    Registers[kRegChannel] = (uint8_t)channel;
+
+    if (!CommitConfig()) {
+        spdlog::error("SetChannel: CommitConfig failed");
         return false;
     }
-    
-    spdlog::debug("Configuring channel {}...", channel);
 
-    uint8_t config[2] = {
-        (uint8_t)(enable_ambient_rssi ? 0x20 : 0),
-        (uint8_t)channel
-    };
+    return true;
+}
 
-    if (!WriteConfig(4, config, 2)) {
-        spdlog::error("SetChannel: WriteConfig failed");
+RadioProfile Waveshare::GetRadioProfile() const
+{
+    RadioProfile profile;
+    profile.AirRateBps = kAirRatesBps[Registers[kRegAirRate] & kAirRateMask];
+    profile.PacketBytes = kPacketSizes[kPacketSizeCount - 1 - (Registers[kRegOptions] >> kPacketSizeShift)];
+    return profile;
+}
+
+bool Waveshare::SetRadioProfile(const RadioProfile& profile)
+{
+    if (!profile.IsValid()) {
+        spdlog::error("SetRadioProfile: Unsupported profile {}", profile.ToString());
         return false;
     }
 
-    if (!EnterTransmitMode()) {
-        spdlog::error("SetChannel: EnterTransmitMode failed");
+    spdlog::debug("Configuring radio profile {}...", profile.ToString());
+
+    Registers[kRegAirRate] &= ~kAirRateMask;
+    Registers[kRegAirRate] |= (uint8_t)profile.GetAirRateIndex();
+    Registers[kRegOptions] &= ~kPacketSizeMask;
+    Registers[kRegOptions] |= (uint8_t)((kPacketSizeCount - 1 - profile.GetPacketSizeIndex()) << kPacketSizeShift);
+
+    if (!CommitConfig()) {
+        spdlog::error("SetRadioProfile: CommitConfig failed");
         return false;
     }
 
@@ -305,10 +549,10 @@ bool Waveshare::ScanAmbientRssi(int retries)
 {
     spdlog::debug("*** Detecting ambient RSSI:");
 
-    for (int i = 0; i < kCheckedChannelCount; ++i)
-    {
-        const int channel = kCheckedChannels[i];
+    ChannelRssiValid = false;
 
+    for (int channel = 0; channel < kChannelCount; ++channel)
+    {
         spdlog::debug("Setting channel {}...", channel);
         if (!SetChannel(channel, true)) {
             spdlog::error("ScanAmbientRssi: SetChannel failed");
@@ -329,11 +573,21 @@ bool Waveshare::ScanAmbientRssi(int retries)
             }
         }
 
-        const float dbm = largest_rssi * 0.5f;
-        ChannelRssi[channel] = dbm;
+        ChannelRssi[channel] = (float)RssiByteToDbm(largest_rssi);
         ChannelRssiRaw[channel] = largest_rssi;
     }
 
+    ChannelRssiValid = true;
+    return true;
+}
+
+bool Waveshare::GetChannelNoise(std::vector<float>& noise_dbm)
+{
+    if (!ChannelRssiValid) {
+        return false;
+    }
+
+    noise_dbm.assign(ChannelRssi, ChannelRssi + kChannelCount);
     return true;
 }
 
@@ -405,57 +659,174 @@ bool Waveshare::WriteConfig(int offset, const uint8_t* data, int bytes)
     return true;
 }
 
-bool Waveshare::WaitForResponse(int minbytes)
+bool Waveshare::ReadConfig(int offset, uint8_t* data, int bytes)
+{
+    if (bytes <= 0 || bytes >= 240) {
+        spdlog::error("ReadConfig: invalid config len={}", bytes);
+        return false;
+    }
+
+    const uint8_t command[3] = {
+        0xc1, (uint8_t)offset, (uint8_t)bytes
+    };
+
+    if (!Serial.Write(command, 3)) {
+        spdlog::error("ReadConfig: Serial.Write failed");
+        return false;
+    }
+
+    if (!WaitForResponse(3 + bytes)) {
+        spdlog::warn("ReadConfig: WaitForResponse timeout");
+    }
+
+    uint8_t readback[256];
+    int r = Serial.Read(readback, 3 + bytes);
+    if (r != 3 + bytes) {
+        spdlog::error("ReadConfig: Serial.Read failed: r={} bytes={}", r, bytes);
+        return false;
+    }
+
+    if (0 != memcmp(readback, command, 3)) {
+        spdlog::error("ReadConfig: Unexpected response header");
+        return false;
+    }
+
+    memcpy(data, readback + 3, bytes);
+    return true;
+}
+
+std::string Waveshare::GetRssiCachePath() const
 {
-    uint64_t t0 = GetTimeMsec();
+    std::string name = Device.SerialDevice;
+    const size_t last_slash = name.find_last_of('/');
+    if (last_slash != std::string::npos) {
+        name = name.substr(last_slash + 1);
+    }
+    return kRssiCachePrefix + name + ".cache";
+}
 
-    while (Serial.GetAvailable() < minbytes)
+bool Waveshare::LoadRssiCache()
+{
+    const std::string path = GetRssiCachePath();
+
+    MappedReadOnlySmallFile mmf;
+    if (!mmf.Read(path.c_str())) {
+        return false;
+    }
+    if (mmf.GetDataBytes() != kRssiCacheBytes) {
+        spdlog::warn("Ignoring RSSI cache with wrong size: {}", path);
+        return false;
+    }
+
+    const uint8_t* data = mmf.GetData();
+    if (ReadU32_LE(data) != kRssiCacheMagic) {
+        spdlog::warn("Ignoring RSSI cache with wrong magic: {}", path);
+        return false;
+    }
+
+    const int64_t age_sec = (int64_t)time(nullptr) - (int64_t)ReadU64_LE(data + 4);
+    if (age_sec < 0 || age_sec > kRssiCacheTtlSec) {
+        spdlog::debug("RSSI cache is stale: age={} sec", age_sec);
+        return false;
+    }
+
+    for (int i = 0; i < kChannelCount; ++i) {
+        ChannelRssiRaw[i] = data[4 + 8 + i];
+        ChannelRssi[i] = (float)RssiByteToDbm(ChannelRssiRaw[i]);
+    }
+    ChannelRssiValid = true;
+
+    spdlog::debug("Loaded RSSI scan from {} sec ago", age_sec);
+    return true;
+}
+
+void Waveshare::SaveRssiCache()
+{
+    uint8_t data[kRssiCacheBytes];
+    WriteU32_LE(data, kRssiCacheMagic);
+    WriteU64_LE(data + 4, (uint64_t)time(nullptr));
+    memcpy(data + 4 + 8, ChannelRssiRaw, kChannelCount);
+
+    const std::string path = GetRssiCachePath();
+    if (!WriteBufferToFile(path.c_str(), data, kRssiCacheBytes)) {
+        spdlog::warn("Failed to write RSSI cache: {}", path);
+    }
+}
+
+bool Waveshare::WaitForResponse(int minbytes, int timeout_msec)
+{
+    const uint64_t t0 = GetTimeMsec();
+
+    for (;;)
     {
-        uint64_t t1 = GetTimeMsec();
-        int64_t dt = t1 - t0;
+        const int available = Serial.GetAvailable();
+        if (available < 0) {
+            return false;
+        }
+        if (available >= minbytes) {
+            return true;
+        }
 
-        if (dt > 5000) {
-            spdlog::error("Timeout waiting for config result avail={}", Serial.GetAvailable());
+        const int64_t remaining_msec = timeout_msec - (int64_t)(GetTimeMsec() - t0);
+        if (remaining_msec <= 0) {
             return false;
         }
 
-        // Avoid hard spins while waiting
-        usleep(10000);
+        if (available > 0) {
+            // The port stays readable, so sleep about as long as the rest
+            // of the response takes to arrive rather than spinning in poll()
+            const int baudrate = InConfigMode ? kConfigBaudrate : Baudrate;
+            usleep((useconds_t)((minbytes - available) * 10 * 1000000LL / baudrate));
+        } else if (Reactor.Wait(Serial, (int)remaining_msec) < 0) {
+            return false;
+        }
     }
-
-    return true;
 }
 
 bool Waveshare::Send(const uint8_t* data, int bytes)
 {
-    if (bytes > kPacketMaxBytes) {
-        spdlog::error("FIXME: Send() parameter too large! bytes={}", bytes);
+    if (bytes > GetMaxSendBytes()) {
+        spdlog::error("Send: Too large for packet size {}: bytes={}", GetRadioProfile().PacketBytes, bytes);
+        return false;
+    }
+
+    uint8_t frame[kFrameV1HeaderBytes + kPacketMaxBytes];
+    const int frame_bytes = FrameParser::WriteFrame(data, bytes, frame, FrameVersion);
+
+    return SendFrame(frame, frame_bytes);
+}
+
+bool Waveshare::SendFrame(const uint8_t* frame, int frame_bytes)
+{
+    const int bytes = frame_bytes - GetFrameHeaderBytes(FrameVersion);
+    if (bytes <= 0 || bytes > GetMaxSendBytes()) {
+        spdlog::error("SendFrame: Invalid size for packet size {}: frame_bytes={}", GetRadioProfile().PacketBytes, frame_bytes);
         return false;
     }
 
     if (!SetAddress(TransmitAddress)) {
-        spdlog::error("Send: SetAddress failed");
+        spdlog::error("SendFrame: SetAddress failed");
         return false;
     }
 
-    uint8_t frame[240];
-    frame[0] = static_cast<uint8_t>( bytes );
-    WriteU32_LE(frame + 1, FastCrc32(data, bytes));
-    memcpy(frame + 1 + 4, data, bytes);
+    if (!Serial.Write(frame, frame_bytes)) {
+        return false;
+    }
 
-    return Serial.Write(frame, 1 + 4 + bytes);
+    AirModel.OnSend(GetTimeUsec(), GetAirtimeUsec(bytes));
+    return true;
 }
 
 bool Waveshare::FillRecvBuffer()
 {
-    const int remaining_buffer_bytes = kRecvBufferBytes - RecvOffsetBytes;
+    const int remaining_buffer_bytes = Parser.GetWriteSpace();
     if (remaining_buffer_bytes <= 0) {
         return true;
     }
 
     const int available = Serial.GetAvailable();
     if (available < 0) {
-        RecvOffsetBytes = 0;
+        Parser.Reset();
         return false;
     }
     if (available == 0) {
@@ -467,63 +838,42 @@ bool Waveshare::FillRecvBuffer()
         read_bytes = remaining_buffer_bytes;
     }
 
-    int r = Serial.Read(RecvBuffer + RecvOffsetBytes, read_bytes);
+    int r = Serial.Read(Parser.GetWritePtr(), read_bytes);
     if (r != read_bytes) {
-        RecvOffsetBytes = 0;
+        Parser.Reset();
         return false;
     }
 
-    RecvOffsetBytes += read_bytes;
+    Parser.OnWrite(read_bytes);
     return true;
 }
 
-bool Waveshare::Receive(std::function<void(const uint8_t* data, int bytes)> callback)
+bool Waveshare::Receive(
+    const OnFrame& callback,
+    int timeout_msec)
 {
     if (!SetAddress(kMonitorAddress)) {
         spdlog::error("Send: SetAddress failed");
         return false;
     }
 
-    if (!FillRecvBuffer()) {
-        return false;
-    }
-
-    const int buffer_bytes = RecvOffsetBytes;
-
-    int start_offset;
-    for (start_offset = 0; start_offset + 5 < buffer_bytes; ++start_offset)
-    {
-        const int packet_bytes = RecvBuffer[start_offset];
-        if (packet_bytes <= 0 || packet_bytes > kPacketMaxBytes) {
-            // Not the start of a packet
-            continue;
-        }
-
-        const int available_bytes = buffer_bytes - start_offset;
-        if (available_bytes < 5 + packet_bytes) {
-            // Not enough data arrived yet
-            break;
-        }
-
-        const uint32_t expected_crc = ReadU32_LE(RecvBuffer + start_offset + 1);
-        const uint32_t crc = FastCrc32(RecvBuffer + start_offset + 5, packet_bytes);
-        if (expected_crc != crc) {
-            // Not the start of a packet
-            continue;
+    // Sleep in the kernel until there is something new to parse
+    if (timeout_msec > 0 && Serial.GetAvailable() == 0) {
+        if (Reactor.Wait(Serial, timeout_msec) < 0) {
+            return false;
         }
-
-        callback(RecvBuffer + start_offset + 5, packet_bytes);
-
-        // Skip ahead to next potential start point
-        start_offset += 4 + packet_bytes;
     }
 
-    // If we need to eliminate data from the start:
-    if (start_offset > 0) {
-        RecvOffsetBytes = buffer_bytes - start_offset;
-        memmove(RecvBuffer, RecvBuffer + start_offset, RecvOffsetBytes);
+    if (!FillRecvBuffer()) {
+        return false;
     }
 
+    const int crc_failures = Parser.Parse([&](const uint8_t* data, int bytes, int rssi_dbm, int frame_version) {
+        Quality.OnFrame(rssi_dbm);
+        callback(data, bytes, rssi_dbm, frame_version);
+    });
+    Quality.OnCrcFailures(crc_failures);
+
     return true;
 }
 
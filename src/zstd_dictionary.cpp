@@ -0,0 +1,118 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+#include "zstd_dictionary.hpp"
+
+#include "zstd.h" // zstd_lib subproject
+#include "dictBuilder/zdict.h"
+
+namespace lora {
+
+
+//------------------------------------------------------------------------------
+// ZstdDictionary
+
+ZstdDictionary::~ZstdDictionary()
+{
+    Free();
+}
+
+void ZstdDictionary::Free()
+{
+    std::lock_guard<std::mutex> locker(Lock);
+
+    for (auto& level_cdict : CDicts) {
+        ZSTD_freeCDict(level_cdict.second);
+    }
+    CDicts.clear();
+
+    ZSTD_freeDDict(DDict);
+    DDict = nullptr;
+
+    Data.clear();
+    Id = 0;
+}
+
+bool ZstdDictionary::Load(const char* path)
+{
+    MappedReadOnlySmallFile mmf;
+    if (!mmf.Read(path)) {
+        spdlog::error("Failed to open dictionary: {}", path);
+        return false;
+    }
+    if (!Set(mmf.GetData(), mmf.GetDataBytes())) {
+        spdlog::error("Not a zstd dictionary: {}", path);
+        return false;
+    }
+    return true;
+}
+
+bool ZstdDictionary::Set(const uint8_t* data, size_t bytes)
+{
+    Free();
+
+    const unsigned id = ZDICT_getDictID(data, bytes);
+    if (id == 0) {
+        return false;
+    }
+
+    DDict = ZSTD_createDDict(data, bytes);
+    if (!DDict) {
+        spdlog::error("ZSTD_createDDict failed");
+        return false;
+    }
+
+    Data.assign(data, data + bytes);
+    Id = id;
+    return true;
+}
+
+ZSTD_CDict_s* ZstdDictionary::GetCDict(int level)
+{
+    std::lock_guard<std::mutex> locker(Lock);
+
+    auto it = CDicts.find(level);
+    if (it != CDicts.end()) {
+        return it->second;
+    }
+
+    ZSTD_CDict* cdict = ZSTD_createCDict(Data.data(), Data.size(), level);
+    if (!cdict) {
+        spdlog::error("ZSTD_createCDict failed: level={}", level);
+        return nullptr;
+    }
+
+    CDicts[level] = cdict;
+    return cdict;
+}
+
+bool TrainDictionary(
+    const std::vector<std::vector<uint8_t>>& samples,
+    size_t dict_bytes,
+    std::vector<uint8_t>& dict)
+{
+    std::vector<uint8_t> buffer;
+    std::vector<size_t> sizes;
+    for (const auto& sample : samples) {
+        buffer.insert(buffer.end(), sample.begin(), sample.end());
+        sizes.push_back(sample.size());
+    }
+
+    dict.resize(dict_bytes);
+
+    const size_t result = ZDICT_trainFromBuffer(
+        dict.data(), dict.size(),
+        buffer.data(), sizes.data(), (unsigned)sizes.size());
+
+    if (ZDICT_isError(result)) {
+        spdlog::error("ZDICT_trainFromBuffer failed: {} samples={} bytes={}",
+            ZDICT_getErrorName(result), samples.size(), buffer.size());
+        dict.clear();
+        return false;
+    }
+
+    dict.resize(result);
+    return true;
+}
+
+
+} // namespace lora
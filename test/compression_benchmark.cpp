@@ -0,0 +1,350 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Compares the compression picked by PlanCompression() against level 1.
+
+        ./compression_benchmark [file ...]
+
+    Each corpus is compressed both ways, as FileSender does, and the total
+    time to send it is the compression time plus the airtime for the
+    compressed blocks at the default radio profile on one link.  The
+    planner's predictions are shown next to the measured results.
+
+    The generated corpora are telemetry logs, JSON config files, random data
+    that does not compress, and firmware images: a set of similar images
+    more than a zstd window apart, where long distance matching helps.
+    Files given on the command line are also run.
+
+    The delta cases send a new version of a file that the receiver already
+    has an earlier version of: A firmware image with a few bytes patched,
+    and a telemetry log with new lines appended.  The delta is compressed
+    at several levels with the earlier version as the zstd prefix, as
+    FileSender does for FileSenderSettings::BaseFile.
+*/
+
+#include "loraftp.hpp"
+using namespace lora;
+
+#include "zstd.h" // zstd_lib subproject
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+//------------------------------------------------------------------------------
+// Corpora
+
+struct Corpus
+{
+    std::string Name;
+    std::vector<uint8_t> Data;
+};
+
+static void AppendText(std::vector<uint8_t>& data, const char* text, int bytes)
+{
+    data.insert(data.end(), text, text + bytes);
+}
+
+static Corpus MakeTelemetry(size_t bytes)
+{
+    Corpus corpus;
+    corpus.Name = "Telemetry log";
+
+    std::mt19937 prng((uint32_t)bytes);
+    char line[128];
+    while (corpus.Data.size() < bytes) {
+        const int line_bytes = snprintf(line, sizeof(line),
+            "t=%u sensor=%u temp=%u.%u rssi=-%u status=ok\n",
+            (unsigned)(corpus.Data.size() / 64),
+            (unsigned)(prng() % 16),
+            (unsigned)(prng() % 40),
+            (unsigned)(prng() % 10),
+            (unsigned)(prng() % 120));
+        AppendText(corpus.Data, line, line_bytes);
+    }
+    corpus.Data.resize(bytes);
+    return corpus;
+}
+
+static Corpus MakeConfig(size_t bytes)
+{
+    Corpus corpus;
+    corpus.Name = "JSON config";
+
+    std::mt19937 prng((uint32_t)bytes + 1);
+    char entry[256];
+    AppendText(corpus.Data, "{\n  \"nodes\": [\n", 15);
+    while (corpus.Data.size() < bytes) {
+        const int entry_bytes = snprintf(entry, sizeof(entry),
+            "    { \"id\": %u, \"name\": \"node-%04u\", \"channel\": %u, \"air_rate\": %u, "
+            "\"enabled\": %s, \"gain_db\": %u, \"location\": [%u.%04u, -%u.%04u] },\n",
+            (unsigned)(corpus.Data.size() / 128),
+            (unsigned)(prng() % 10000),
+            (unsigned)(prng() % 84),
+            (unsigned)(prng() % 2 ? 62500 : 2400),
+            prng() % 4 ? "true" : "false",
+            (unsigned)(prng() % 30),
+            (unsigned)(prng() % 90), (unsigned)(prng() % 10000),
+            (unsigned)(prng() % 180), (unsigned)(prng() % 10000));
+        AppendText(corpus.Data, entry, entry_bytes);
+    }
+    corpus.Data.resize(bytes);
+    return corpus;
+}
+
+static Corpus MakeRandom(size_t bytes)
+{
+    Corpus corpus;
+    corpus.Name = "Random";
+
+    std::mt19937 prng((uint32_t)bytes + 2);
+    corpus.Data.resize(bytes);
+    for (auto& x : corpus.Data) {
+        x = (uint8_t)prng();
+    }
+    return corpus;
+}
+
+// Images of 8 MB each, which differ in a few places.  Each is mostly
+// small random values, so it compresses about 2:1 on its own
+static Corpus MakeFirmware(size_t bytes)
+{
+    Corpus corpus;
+    corpus.Name = "Firmware images";
+
+    const size_t image_bytes = 8 * 1024 * 1024;
+    std::mt19937 prng(3);
+    std::vector<uint8_t> image(image_bytes);
+    for (auto& x : image) {
+        x = (uint8_t)(prng() % 16);
+    }
+
+    while (corpus.Data.size() < bytes) {
+        for (int i = 0; i < 64; ++i) {
+            image[prng() % image_bytes] = (uint8_t)prng();
+        }
+        corpus.Data.insert(corpus.Data.end(), image.begin(), image.end());
+    }
+    corpus.Data.resize(bytes);
+    return corpus;
+}
+
+static bool ReadCorpus(const char* path, Corpus& corpus)
+{
+    MappedReadOnlySmallFile mmf;
+    if (!mmf.Read(path)) {
+        spdlog::error("Failed to open file: {}", path);
+        return false;
+    }
+    corpus.Name = path;
+    corpus.Data.assign(mmf.GetData(), mmf.GetData() + mmf.GetDataBytes());
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmark
+
+static uint64_t GetCorpusAirtimeUsec(uint64_t compressed_bytes, const CompressionTarget& target)
+{
+    const int send_bytes = target.Profile.GetMaxSendBytes(target.FrameVersion);
+    const int block_bytes = send_bytes - target.BlockHeaderBytes;
+    const uint64_t blocks = (compressed_bytes + block_bytes - 1) / block_bytes;
+    return blocks * GetAirtimeUsec(send_bytes, target.Profile.AirRateBps, target.FrameVersion);
+}
+
+// Compresses the corpus with the plan and logs the result.
+// Returns false on failure
+static bool RunPlan(const char* name, const Corpus& corpus, const CompressionPlan& plan, const CompressionTarget& target, uint64_t plan_usec)
+{
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    if (!cctx) {
+        spdlog::error("ZSTD_createCCtx failed");
+        return false;
+    }
+    std::vector<uint8_t> compressed(ZSTD_compressBound(corpus.Data.size()));
+
+    const uint64_t t0 = GetTimeUsec();
+
+    size_t bytes = 0;
+    if (ApplyCompressionPlan(cctx, plan)) {
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+        bytes = ZSTD_compress2(
+            cctx,
+            compressed.data(), compressed.size(),
+            corpus.Data.data(), corpus.Data.size());
+    }
+
+    const uint64_t t1 = GetTimeUsec();
+
+    ZSTD_freeCCtx(cctx);
+
+    if (bytes == 0 || ZSTD_isError(bytes)) {
+        spdlog::error("{} / {}: Compression failed", corpus.Name, name);
+        return false;
+    }
+
+    const uint64_t compress_usec = t1 - t0 + plan_usec;
+    const uint64_t airtime_usec = GetCorpusAirtimeUsec(bytes, target);
+
+    spdlog::info("    {:<8} {:<36} {:>11} bytes ({:.3f}), {:>10.1f} msec to compress, {:>10.1f} sec airtime, {:>10.1f} sec total",
+        name,
+        plan.ToString(),
+        bytes,
+        bytes / (float)corpus.Data.size(),
+        compress_usec / 1000.f,
+        airtime_usec / 1000000.f,
+        (compress_usec + airtime_usec) / 1000000.f);
+    return true;
+}
+
+static bool RunCorpus(const Corpus& corpus)
+{
+    CompressionTarget target;
+    target.BlockHeaderBytes = kBlockHeaderBytes;
+
+    spdlog::info("{}: {} bytes", corpus.Name, corpus.Data.size());
+
+    if (!RunPlan("Level 1", corpus, GetFixedCompressionPlan(1), target, 0)) {
+        return false;
+    }
+
+    // Sample the corpus the way FileSender does
+    const uint64_t t0 = GetTimeUsec();
+    std::vector<uint8_t> sample;
+    for (const SampleRange& range : GetCompressionSampleRanges(corpus.Data.size())) {
+        const uint8_t* data = corpus.Data.data() + range.Offset;
+        sample.insert(sample.end(), data, data + range.Bytes);
+    }
+    const CompressionPlan plan = PlanCompression(sample.data(), sample.size(), corpus.Data.size(), target);
+    const uint64_t t1 = GetTimeUsec();
+
+    spdlog::info("    Planned in {} msec: Predicted {} bytes, {} msec to compress, {} sec airtime",
+        (t1 - t0) / 1000.f,
+        plan.CompressedBytes,
+        plan.CompressUsec / 1000.f,
+        plan.AirtimeUsec / 1000000.f);
+
+    // Planning time is counted as compression time
+    return RunPlan("Planned", corpus, plan, target, t1 - t0);
+}
+
+// Levels to compare delta compression at
+static const int kDeltaLevels[] = {
+    1, 3, 9, 19
+};
+
+static bool RunDelta(const char* name, const std::vector<uint8_t>& base, const Corpus& corpus)
+{
+    CompressionTarget target;
+    target.BlockHeaderBytes = kBlockHeaderBytes;
+
+    spdlog::info("{}: {} bytes from a {} byte earlier version", name, corpus.Data.size(), base.size());
+
+    // Whole file, for comparison
+    std::vector<uint8_t> sample;
+    for (const SampleRange& range : GetCompressionSampleRanges(corpus.Data.size())) {
+        const uint8_t* data = corpus.Data.data() + range.Offset;
+        sample.insert(sample.end(), data, data + range.Bytes);
+    }
+    const CompressionPlan plan = PlanCompression(sample.data(), sample.size(), corpus.Data.size(), target);
+    if (!RunPlan("Whole", corpus, plan, target, 0)) {
+        return false;
+    }
+
+    for (int level : kDeltaLevels)
+    {
+        CompressionPlan delta = GetFixedCompressionPlan(level);
+        delta.LongWindowLog = GetWindowLog(base.size() + corpus.Data.size());
+
+        ZSTD_CCtx* cctx = ZSTD_createCCtx();
+        std::vector<uint8_t> compressed(ZSTD_compressBound(corpus.Data.size()));
+
+        const uint64_t t0 = GetTimeUsec();
+
+        size_t bytes = 0;
+        if (cctx && ApplyCompressionPlan(cctx, delta)) {
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+            ZSTD_CCtx_refPrefix(cctx, base.data(), base.size());
+            bytes = ZSTD_compress2(
+                cctx,
+                compressed.data(), compressed.size(),
+                corpus.Data.data(), corpus.Data.size());
+        }
+
+        const uint64_t t1 = GetTimeUsec();
+
+        ZSTD_freeCCtx(cctx);
+
+        if (bytes == 0 || ZSTD_isError(bytes)) {
+            spdlog::error("{}: Delta compression failed", name);
+            return false;
+        }
+
+        const uint64_t airtime_usec = GetCorpusAirtimeUsec(bytes, target);
+
+        spdlog::info("    {:<8} {:<36} {:>11} bytes ({:.5f}), {:>10.1f} msec to compress, {:>10.1f} sec airtime, {:>10.1f} sec total",
+            "Delta",
+            delta.ToString(),
+            bytes,
+            bytes / (float)corpus.Data.size(),
+            (t1 - t0) / 1000.f,
+            airtime_usec / 1000000.f,
+            (t1 - t0 + airtime_usec) / 1000000.f);
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Entrypoint
+
+int main(int argc, char* argv[])
+{
+    bool success = true;
+
+    for (size_t bytes : { 4 * 1000, 1000 * 1000, 32 * 1000 * 1000 }) {
+        for (const Corpus& corpus : { MakeTelemetry(bytes), MakeConfig(bytes), MakeRandom(bytes) }) {
+            if (!RunCorpus(corpus)) {
+                success = false;
+            }
+        }
+    }
+
+    if (!RunCorpus(MakeFirmware(48 * 1024 * 1024))) {
+        success = false;
+    }
+
+    {
+        const Corpus firmware = MakeFirmware(8 * 1024 * 1024);
+        Corpus patched = firmware;
+        std::mt19937 prng(4);
+        for (int i = 0; i < 16; ++i) {
+            patched.Data[prng() % patched.Data.size()] = (uint8_t)prng();
+        }
+        if (!RunDelta("Patched firmware image", firmware.Data, patched)) {
+            success = false;
+        }
+
+        const Corpus log = MakeTelemetry(4 * 1000 * 1000);
+        Corpus grown = log;
+        const Corpus lines = MakeTelemetry(20 * 1000);
+        grown.Data.insert(grown.Data.end(), lines.Data.begin(), lines.Data.end());
+        if (!RunDelta("Telemetry log with new lines", log.Data, grown)) {
+            success = false;
+        }
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        Corpus corpus;
+        if (!ReadCorpus(argv[i], corpus) || !RunCorpus(corpus)) {
+            success = false;
+        }
+    }
+
+    return success ? 0 : -1;
+}
@@ -0,0 +1,129 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Checks FastCrc32() against the portable implementation and measures
+    its speed from frame-sized inputs up to whole files.
+
+        ./crc_benchmark
+*/
+
+#include "tools.hpp"
+using namespace lora;
+
+#include <cstring>
+#include <vector>
+#include <random>
+using namespace std;
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const size_t kSizes[] = {
+    5, 16, 64, 235, 1000, 4096, 65536, 1000000, 16000000
+};
+
+// Bytes to process for each timing measurement
+static const uint64_t kTargetBytes = 256000000;
+
+
+//------------------------------------------------------------------------------
+// Self-Test
+
+static bool SelfTest()
+{
+    // Standard check value for CRC32C
+    const char* check = "123456789";
+    if (FastCrc32(check, 9) != UINT32_C(0xE3069283) ||
+        FastCrc32Portable(check, 9) != UINT32_C(0xE3069283))
+    {
+        spdlog::error("CRC32C check value mismatch");
+        return false;
+    }
+
+    std::mt19937 prng(0);
+    std::vector<uint8_t> data(200000);
+    for (auto& x : data) {
+        x = (uint8_t)prng();
+    }
+
+    for (int i = 0; i < 2000; ++i)
+    {
+        const size_t offset = prng() % 16;
+        const size_t bytes = prng() % (data.size() - offset);
+
+        const uint32_t expected = FastCrc32Portable(data.data() + offset, bytes);
+        if (FastCrc32(data.data() + offset, bytes) != expected) {
+            spdlog::error("Mismatch: offset={} bytes={}", offset, bytes);
+            return false;
+        }
+
+        // Continuing a CRC must match the CRC of the whole
+        const size_t split = bytes ? prng() % bytes : 0;
+        const uint32_t first = FastCrc32(data.data() + offset, split);
+        if (FastCrc32(data.data() + offset + split, bytes - split, first) != expected) {
+            spdlog::error("Continuation mismatch: offset={} bytes={} split={}", offset, bytes, split);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmark
+
+typedef uint32_t (*CrcFunc)(const void* data, size_t bytes, uint32_t crc);
+
+static float MeasureGBps(CrcFunc func, const uint8_t* data, size_t bytes)
+{
+    uint64_t iterations = kTargetBytes / bytes;
+    if (iterations < 4) {
+        iterations = 4;
+    }
+
+    uint32_t crc = 0;
+    const uint64_t t0 = GetTimeUsec();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        crc = func(data, bytes, crc);
+    }
+    const uint64_t t1 = GetTimeUsec();
+
+    // Keep the result alive
+    if (crc == 0x12345678) {
+        spdlog::info("(unlikely)");
+    }
+
+    return bytes * iterations / 1000.f / (float)(t1 - t0 > 0 ? t1 - t0 : 1);
+}
+
+
+//------------------------------------------------------------------------------
+// Entrypoint
+
+int main()
+{
+    spdlog::info("FastCrc32 implementation: {}", GetFastCrc32Name());
+
+    if (!SelfTest()) {
+        return -1;
+    }
+    spdlog::info("Self-test passed");
+
+    std::vector<uint8_t> data(kSizes[sizeof(kSizes) / sizeof(kSizes[0]) - 1]);
+    std::mt19937 prng(1);
+    for (auto& x : data) {
+        x = (uint8_t)prng();
+    }
+
+    for (size_t bytes : kSizes)
+    {
+        const float fast = MeasureGBps(FastCrc32, data.data(), bytes);
+        const float portable = MeasureGBps(FastCrc32Portable, data.data(), bytes);
+
+        spdlog::info("{} bytes: FastCrc32 = {} GB/s, portable = {} GB/s", bytes, fast, portable);
+    }
+
+    return 0;
+}
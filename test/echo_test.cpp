@@ -97,9 +97,9 @@ int main(int argc, char* argv[])
         }
         else
         {
-            if (!waveshare.Receive([&](const uint8_t* data, int bytes) {
+            if (!waveshare.Receive([&](const uint8_t* data, int bytes, int rssi_dbm, int frame_version) {
                 std::ostringstream oss;
-                oss << "Got bytes:";
+                oss << "Got version " << frame_version << " frame (RSSI " << rssi_dbm << " dBm):";
                 for (int i = 0; i < bytes; ++i) {
                     oss << " " << (int)data[i];
                 }
@@ -0,0 +1,239 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Checks the GF(256) bulk memory operations for each instruction set the
+    CPU supports against byte-at-a-time gf256_mul(), then measures their
+    speed from small blocks up to 64 KB.
+
+        ./gf256_benchmark
+
+    The instruction set is forced with gf256_set_isa(), so one machine shows
+    what each code path is worth.  Wirehair spends most of its time in
+    gf256_muladd_mem() and gf256_add_mem().
+*/
+
+#include "loraftp.hpp"
+using namespace lora;
+
+#include "gf256.h" // wirehair subproject
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const int kSizes[] = {
+    64, 256, 1024, 4096, 16384, 65536
+};
+
+// Bytes to process for each timing measurement
+static const uint64_t kTargetBytes = 128000000;
+
+// Each measurement is the fastest of this many runs
+static const int kTrials = 3;
+
+// Self-test covers every length up to this, to exercise each tail path
+static const int kMaxTestBytes = 300;
+
+
+//------------------------------------------------------------------------------
+// Operations
+
+enum Operation
+{
+    Op_MulAdd,
+    Op_Mul,
+    Op_Add,
+    Op_Add2,
+
+    Op_Count
+};
+
+static const char* kOperationNames[Op_Count] = {
+    "gf256_muladd_mem",
+    "gf256_mul_mem",
+    "gf256_add_mem",
+    "gf256_add2_mem"
+};
+
+static void RunOperation(Operation op, uint8_t* z, const uint8_t* x, const uint8_t* w, uint8_t y, int bytes)
+{
+    switch (op)
+    {
+    case Op_MulAdd: gf256_muladd_mem(z, y, x, bytes); break;
+    case Op_Mul:    gf256_mul_mem(z, x, y, bytes); break;
+    case Op_Add:    gf256_add_mem(z, x, bytes); break;
+    case Op_Add2:   gf256_add2_mem(z, x, w, bytes); break;
+    default: break;
+    }
+}
+
+// Byte-at-a-time version of RunOperation()
+static void RunReference(Operation op, uint8_t* z, const uint8_t* x, const uint8_t* w, uint8_t y, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        switch (op)
+        {
+        case Op_MulAdd: z[i] ^= gf256_mul(x[i], y); break;
+        case Op_Mul:    z[i] = gf256_mul(x[i], y); break;
+        case Op_Add:    z[i] ^= x[i]; break;
+        case Op_Add2:   z[i] ^= x[i] ^ w[i]; break;
+        default: break;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Self-Test
+
+static bool SelfTest(int isa)
+{
+    std::mt19937 prng(isa);
+
+    // Room to offset each buffer so that unaligned pointers are tested
+    const int buffer_bytes = kMaxTestBytes + 64;
+    std::vector<uint8_t> x(buffer_bytes), w(buffer_bytes), z(buffer_bytes), expected(buffer_bytes);
+    for (auto& b : x) {
+        b = (uint8_t)prng();
+    }
+    for (auto& b : w) {
+        b = (uint8_t)prng();
+    }
+
+    const uint8_t test_y[] = { 0, 1, 2, 0x53, 0x8e, 0xff };
+
+    for (int op = 0; op < Op_Count; ++op) {
+        for (uint8_t y : test_y) {
+            for (int bytes = 0; bytes <= kMaxTestBytes; ++bytes)
+            {
+                const int offset = (int)(prng() % 64);
+
+                for (int i = 0; i < buffer_bytes; ++i) {
+                    z[i] = expected[i] = (uint8_t)prng();
+                }
+
+                RunOperation((Operation)op, z.data() + offset, x.data() + offset / 2, w.data() + offset / 4, y, bytes);
+                RunReference((Operation)op, expected.data() + offset, x.data() + offset / 2, w.data() + offset / 4, y, bytes);
+
+                if (z != expected) {
+                    spdlog::error("{} mismatch: isa={} y={} bytes={} offset={}",
+                        kOperationNames[op], gf256_isa_name(isa), y, bytes, offset);
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmark
+
+static float MeasureGBps(Operation op, uint8_t* z, const uint8_t* x, const uint8_t* w, int bytes)
+{
+    uint64_t iterations = kTargetBytes / bytes;
+    if (iterations < 4) {
+        iterations = 4;
+    }
+
+    uint64_t best_usec = ~(uint64_t)0;
+
+    for (int trial = 0; trial < kTrials; ++trial)
+    {
+        const uint64_t t0 = GetTimeUsec();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            RunOperation(op, z, x, w, (uint8_t)(i | 2), bytes);
+        }
+        const uint64_t t1 = GetTimeUsec();
+
+        best_usec = std::min(best_usec, t1 - t0 > 0 ? t1 - t0 : 1);
+    }
+
+    return bytes * iterations / 1000.f / (float)best_usec;
+}
+
+
+//------------------------------------------------------------------------------
+// Entrypoint
+
+int main()
+{
+    if (gf256_init() != 0) {
+        spdlog::error("gf256_init failed");
+        return -1;
+    }
+
+    const int best_isa = gf256_get_isa();
+    spdlog::info("gf256 picked {} for this CPU", gf256_isa_name(best_isa));
+
+    // Instruction sets this CPU can run, slowest first
+    std::vector<int> isas;
+    for (int isa = GF256_ISA_SCALAR; isa <= best_isa; ++isa) {
+        if (gf256_set_isa(isa) == isa) {
+            isas.push_back(isa);
+        }
+    }
+
+    bool success = true;
+    for (int isa : isas)
+    {
+        gf256_set_isa(isa);
+        if (!SelfTest(isa)) {
+            success = false;
+        }
+    }
+    if (!success) {
+        gf256_set_isa(best_isa);
+        return -1;
+    }
+    spdlog::info("Self-test passed for {} instruction sets", isas.size());
+
+    const int max_bytes = kSizes[sizeof(kSizes) / sizeof(kSizes[0]) - 1];
+    std::vector<uint8_t> x(max_bytes), w(max_bytes), z(max_bytes);
+    std::mt19937 prng(1);
+    for (int i = 0; i < max_bytes; ++i) {
+        x[i] = (uint8_t)prng();
+        w[i] = (uint8_t)prng();
+        z[i] = (uint8_t)prng();
+    }
+
+    for (int op = 0; op < Op_Count; ++op)
+    {
+        spdlog::info("{}:", kOperationNames[op]);
+
+        for (int bytes : kSizes)
+        {
+            std::string line;
+            float scalar_gbps = 0.f;
+
+            for (int isa : isas)
+            {
+                gf256_set_isa(isa);
+                const float gbps = MeasureGBps((Operation)op, z.data(), x.data(), w.data(), bytes);
+                if (isa == GF256_ISA_SCALAR) {
+                    scalar_gbps = gbps;
+                }
+
+                char entry[64];
+                snprintf(entry, sizeof(entry), "  %s = %.2f GB/s (%.1fx)",
+                    gf256_isa_name(isa), gbps, scalar_gbps > 0.f ? gbps / scalar_gbps : 0.f);
+                line += entry;
+            }
+
+            spdlog::info("    {:>5} bytes:{}", bytes, line);
+        }
+    }
+
+    gf256_set_isa(best_isa);
+    return 0;
+}
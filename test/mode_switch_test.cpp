@@ -0,0 +1,73 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Measures how long the Waveshare HAT takes to change channel and address.
+
+    Run it on a Pi with the HAT attached:
+
+        sudo ./mode_switch_test
+
+    Each change is one config mode session: Switch into config mode, write
+    the changed registers, and switch back to transmit mode.
+*/
+
+#include "waveshare.hpp"
+using namespace lora;
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const int kTrials = 50;
+
+static const int kChannelA = 10;
+static const int kChannelB = 11;
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+static void LogStats(const char* name, const TimingHistogram& stats)
+{
+    spdlog::info("{}: {}", name, stats.ToString());
+}
+
+
+//------------------------------------------------------------------------------
+// Entrypoint
+
+int main()
+{
+    Waveshare waveshare;
+
+    uint64_t t0 = GetTimeUsec();
+
+    if (!waveshare.Initialize(kChannelA, kMonitorAddress)) {
+        spdlog::error("Failed to initialize");
+        return -1;
+    }
+
+    uint64_t t1 = GetTimeUsec();
+
+    spdlog::info("Initialize: {} msec", (t1 - t0) / 1000.f);
+
+    TimingHistogram channel_stats;
+    for (int i = 0; i < kTrials; ++i)
+    {
+        t0 = GetTimeUsec();
+        if (!waveshare.SetChannel(i % 2 == 0 ? kChannelB : kChannelA)) {
+            spdlog::error("SetChannel failed");
+            return -1;
+        }
+        channel_stats.Add(GetTimeUsec() - t0);
+    }
+
+    LogStats("SetChannel", channel_stats);
+
+    const ModeSwitchStats& stats = waveshare.GetModeSwitchStats();
+    LogStats("Enter config mode", stats.EnterConfig);
+    LogStats("Enter transmit mode", stats.EnterTransmit);
+    LogStats("Config session", stats.ConfigSession);
+
+    return 0;
+}
@@ -0,0 +1,327 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Measures receive frame parser throughput on a noisy byte stream.
+
+    By default a stream of frames mixed with random line noise is generated.
+    A byte stream recorded from the HAT UART can be used instead:
+
+        cat /dev/ttyS0 > capture.bin
+        ./parser_benchmark capture.bin
+
+    The stream is fed to the parser in small chunks like UART reads.
+    Generated streams with 0%, 10% and 50% garbage are also run through the
+    old fixed 240 byte memmove buffer parser, which has no header check and
+    runs a CRC32 at every plausible length byte, for comparison.
+    Generated streams are run with both frame versions.
+
+    Streams of the smallest 32 byte packets, with 10% garbage and with every
+    tenth frame cut short, check how quickly frames are delivered.  Noise
+    that looks like a frame header, or a frame cut short, can make the
+    parser wait for a packet's worth of data and hold back the frames after
+    it.  A frame is counted as late if the parser only delivers it after a
+    later chunk, rather than right after the chunk that completed it.
+*/
+
+#include "waveshare.hpp"
+using namespace lora;
+
+#include <cstring>
+#include <vector>
+#include <random>
+using namespace std;
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const int kStreamFrames = 20000;
+
+// Bytes delivered per simulated UART read
+static const int kChunkBytes = 64;
+
+// Largest payload that fits a 240 byte packet with any of the framings
+static const int kStreamPacketBytes = 240 - kFrameV1HeaderBytes;
+
+// Payload of the smallest packet size with any of the framings
+static const int kSmallPacketBytes = 32 - kFrameV1HeaderBytes;
+
+// Every this many frames is cut short, for the truncated stream
+static const int kTruncateInterval = 10;
+
+
+//------------------------------------------------------------------------------
+// LegacyParser
+
+// The parser from before FrameParser, kept here for comparison
+struct LegacyParser
+{
+    static const int kRecvBufferBytes = 240;
+    uint8_t RecvBuffer[kRecvBufferBytes];
+    int RecvOffsetBytes = 0;
+
+    // Returns the number of bytes accepted
+    int Write(const uint8_t* data, int bytes)
+    {
+        const int space = kRecvBufferBytes - RecvOffsetBytes;
+        if (bytes > space) {
+            bytes = space;
+        }
+        memcpy(RecvBuffer + RecvOffsetBytes, data, bytes);
+        RecvOffsetBytes += bytes;
+        return bytes;
+    }
+
+    void Parse(const OnFrame& callback)
+    {
+        const int buffer_bytes = RecvOffsetBytes;
+
+        int start_offset;
+        for (start_offset = 0; start_offset + 5 < buffer_bytes; ++start_offset)
+        {
+            const int packet_bytes = RecvBuffer[start_offset];
+            if (packet_bytes <= 0 || packet_bytes > kPacketMaxBytes) {
+                continue;
+            }
+            const int available_bytes = buffer_bytes - start_offset;
+            if (available_bytes < 5 + packet_bytes) {
+                break;
+            }
+            const uint32_t expected_crc = ReadU32_LE(RecvBuffer + start_offset + 1);
+            const uint32_t crc = FastCrc32(RecvBuffer + start_offset + 5, packet_bytes);
+            if (expected_crc != crc) {
+                continue;
+            }
+            callback(RecvBuffer + start_offset + 5, packet_bytes, kUnknownRssiDbm, 0);
+            start_offset += 4 + packet_bytes;
+        }
+
+        if (start_offset > 0) {
+            RecvOffsetBytes = buffer_bytes - start_offset;
+            memmove(RecvBuffer, RecvBuffer + start_offset, RecvOffsetBytes);
+        }
+    }
+};
+
+
+//------------------------------------------------------------------------------
+// Stream Generator
+
+// Legacy framing: [length(1)] [CRC32 of data(4)] [data...]
+static int WriteLegacyFrame(const uint8_t* data, int bytes, uint8_t* frame)
+{
+    frame[0] = static_cast<uint8_t>( bytes );
+    WriteU32_LE(frame + 1, FastCrc32(data, bytes));
+    memcpy(frame + 5, data, bytes);
+    return 5 + bytes;
+}
+
+// Generates frames with garbage_fraction of the stream bytes being noise.
+// The same seed produces the same data and noise for all framings.
+// frame_version 0 selects the legacy framing.  With truncate, every tenth
+// frame is cut short and not counted.  frame_ends receives the stream
+// offset just past each counted frame
+static std::vector<uint8_t> GenerateStream(
+    float garbage_fraction,
+    int frame_version,
+    int& frame_count,
+    int packet_bytes = kStreamPacketBytes,
+    std::vector<size_t>* frame_ends = nullptr,
+    bool truncate = false)
+{
+    std::mt19937 prng((unsigned)(garbage_fraction * 1000));
+    std::vector<uint8_t> stream;
+
+    frame_count = 0;
+    if (frame_ends) {
+        frame_ends->clear();
+    }
+    uint8_t data[kStreamPacketBytes];
+    uint8_t frame[240];
+
+    for (int i = 0; i < kStreamFrames; ++i)
+    {
+        for (int j = 0; j < packet_bytes; ++j) {
+            data[j] = (uint8_t)prng();
+        }
+        int frame_bytes;
+        if (frame_version == 0) {
+            frame_bytes = WriteLegacyFrame(data, packet_bytes, frame);
+        } else {
+            frame_bytes = FrameParser::WriteFrame(data, packet_bytes, frame, frame_version);
+        }
+        if (truncate && i % kTruncateInterval == kTruncateInterval - 1) {
+            // Lose the end of the frame, as if the UART dropped it
+            stream.insert(stream.end(), frame, frame + 1 + prng() % (frame_bytes - 1));
+        } else {
+            stream.insert(stream.end(), frame, frame + frame_bytes);
+            ++frame_count;
+            if (frame_ends) {
+                frame_ends->push_back(stream.size());
+            }
+        }
+
+        if (garbage_fraction > 0.f) {
+            const int noise_bytes = (int)(frame_bytes * garbage_fraction / (1.f - garbage_fraction));
+            for (int j = 0; j < noise_bytes; ++j) {
+                stream.push_back((uint8_t)prng());
+            }
+        }
+    }
+
+    return stream;
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+static void ReportResult(const char* name, const std::vector<uint8_t>& stream, uint64_t usec, int found, int expected, int stalls)
+{
+    const float mbps = stream.size() / (float)(usec > 0 ? usec : 1);
+    spdlog::info("  {}: {} MB/s, found {} of {} frames, {} stalls", name, mbps, found, expected, stalls);
+}
+
+static void RunLegacy(const std::vector<uint8_t>& stream, int expected)
+{
+    LegacyParser parser;
+    int found = 0, stalls = 0;
+    auto callback = [&](const uint8_t*, int, int, int) { ++found; };
+
+    const uint64_t t0 = GetTimeUsec();
+
+    size_t offset = 0;
+    while (offset < stream.size())
+    {
+        int bytes = kChunkBytes;
+        if (bytes > (int)(stream.size() - offset)) {
+            bytes = (int)(stream.size() - offset);
+        }
+        const int accepted = parser.Write(stream.data() + offset, bytes);
+        offset += accepted;
+
+        const int before = parser.RecvOffsetBytes;
+        parser.Parse(callback);
+
+        // Buffer is full and the parser made no progress: Drop the input like
+        // the UART would overflow, so the benchmark terminates
+        if (accepted == 0 && parser.RecvOffsetBytes == before) {
+            parser.RecvOffsetBytes = 0;
+            ++stalls;
+        }
+    }
+
+    ReportResult("Legacy memmove parser", stream, GetTimeUsec() - t0, found, expected, stalls);
+}
+
+// frame_ends is optional, and enables counting late frames
+static void RunRing(const char* name, const std::vector<uint8_t>& stream, int expected, const std::vector<size_t>* frame_ends = nullptr)
+{
+    FrameParser parser;
+    if (!parser.Initialize()) {
+        return;
+    }
+    int found = 0, late = 0;
+    size_t chunk_offset = 0, max_late_bytes = 0;
+    auto callback = [&](const uint8_t*, int, int, int) {
+        // Frames arrive in order, so this is the frame_ends entry for it
+        if (frame_ends && found < (int)frame_ends->size())
+        {
+            const size_t frame_end = (*frame_ends)[found];
+            if (frame_end <= chunk_offset)
+            {
+                ++late;
+                if (max_late_bytes < chunk_offset - frame_end) {
+                    max_late_bytes = chunk_offset - frame_end;
+                }
+            }
+        }
+        ++found;
+    };
+
+    const uint64_t t0 = GetTimeUsec();
+
+    size_t offset = 0;
+    while (offset < stream.size())
+    {
+        int bytes = kChunkBytes;
+        if (bytes > (int)(stream.size() - offset)) {
+            bytes = (int)(stream.size() - offset);
+        }
+        if (bytes > parser.GetWriteSpace()) {
+            bytes = parser.GetWriteSpace();
+        }
+        memcpy(parser.GetWritePtr(), stream.data() + offset, bytes);
+        parser.OnWrite(bytes);
+        chunk_offset = offset;
+        offset += bytes;
+
+        parser.Parse(callback);
+    }
+
+    ReportResult(name, stream, GetTimeUsec() - t0, found, expected, 0);
+    if (frame_ends) {
+        spdlog::info("    {} frames late, by up to {} bytes", late, max_late_bytes);
+    }
+}
+
+static void RunGarbage(float garbage_fraction)
+{
+    spdlog::info("Generated stream with {}% garbage:", (int)(garbage_fraction * 100.f));
+
+    int frame_count = 0;
+    std::vector<uint8_t> stream = GenerateStream(garbage_fraction, 0, frame_count);
+    RunLegacy(stream, frame_count);
+
+    stream = GenerateStream(garbage_fraction, kFrameVersion1, frame_count);
+    RunRing("Ring buffer parser, version 1 frames", stream, frame_count);
+
+    stream = GenerateStream(garbage_fraction, kFrameVersion2, frame_count);
+    RunRing("Ring buffer parser, version 2 frames", stream, frame_count);
+}
+
+static void RunLateFrames(float garbage_fraction, bool truncate)
+{
+    if (truncate) {
+        spdlog::info("Generated stream of {} byte packets with every {}th frame cut short:", kSmallPacketBytes + kFrameV1HeaderBytes, kTruncateInterval);
+    } else {
+        spdlog::info("Generated stream of {} byte packets with {}% garbage:", kSmallPacketBytes + kFrameV1HeaderBytes, (int)(garbage_fraction * 100.f));
+    }
+
+    int frame_count = 0;
+    std::vector<size_t> frame_ends;
+
+    std::vector<uint8_t> stream = GenerateStream(garbage_fraction, kFrameVersion1, frame_count, kSmallPacketBytes, &frame_ends, truncate);
+    RunRing("Ring buffer parser, version 1 frames", stream, frame_count, &frame_ends);
+
+    stream = GenerateStream(garbage_fraction, kFrameVersion2, frame_count, kSmallPacketBytes, &frame_ends, truncate);
+    RunRing("Ring buffer parser, version 2 frames", stream, frame_count, &frame_ends);
+}
+
+
+//------------------------------------------------------------------------------
+// Entrypoint
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 2)
+    {
+        MappedReadOnlySmallFile mmf;
+        if (!mmf.Read(argv[1])) {
+            spdlog::error("Failed to open file: {}", argv[1]);
+            return -1;
+        }
+        std::vector<uint8_t> stream(mmf.GetData(), mmf.GetData() + mmf.GetDataBytes());
+        spdlog::info("{} [{} bytes]:", argv[1], stream.size());
+        RunRing("Ring buffer parser", stream, -1);
+        return 0;
+    }
+
+    RunGarbage(0.f);
+    RunGarbage(0.1f);
+    RunGarbage(0.5f);
+    RunLateFrames(0.1f, false);
+    RunLateFrames(0.f, true);
+
+    return 0;
+}
@@ -0,0 +1,203 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Measures FileSender startup time and peak memory by file size.
+
+        ./sender_benchmark
+
+    Each file is written to a temporary directory and then sent over an
+    emulated link, first by reading the whole file into memory and calling
+    FileSender::Initialize(), and then with FileSender::InitializeFromFile(),
+    which compresses the file a piece at a time.  Startup time is from
+    opening the file until the sender is transmitting.
+
+    Each case runs in its own process, so the peak resident memory (VmHWM)
+    is for that case alone.  The file contents are log lines with random
+    values, which compress about as well as our telemetry files.
+*/
+
+#include "loraftp.hpp"
+#include "link_emulator.hpp"
+using namespace lora;
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <sys/wait.h> // waitpid
+#include <unistd.h> // fork, rmdir, unlink
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const uint64_t kFileSizes[] = {
+    1000 * 1000,
+    100 * 1000 * 1000,
+    1000 * 1000 * 1000
+};
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+// Returns the peak resident memory of this process in KB, or 0 on error
+static uint64_t GetPeakResidentKB()
+{
+    FILE* file = fopen("/proc/self/status", "r");
+    if (!file) {
+        return 0;
+    }
+
+    uint64_t kb = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        if (0 == strncmp(line, "VmHWM:", 6)) {
+            kb = strtoull(line + 6, nullptr, 10);
+            break;
+        }
+    }
+
+    fclose(file);
+    return kb;
+}
+
+static bool WriteTestFile(const std::string& path, uint64_t file_bytes)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        spdlog::error("Failed to create file: {}", path);
+        return false;
+    }
+
+    std::mt19937 prng((uint32_t)file_bytes);
+    char line[128];
+    uint64_t written = 0;
+
+    while (written < file_bytes)
+    {
+        int bytes = snprintf(line, sizeof(line),
+            "t=%u sensor=%u temp=%u.%u rssi=-%u status=ok\n",
+            (unsigned)(written / 64),
+            (unsigned)(prng() % 16),
+            (unsigned)(prng() % 40),
+            (unsigned)(prng() % 10),
+            (unsigned)(prng() % 120));
+        if ((uint64_t)bytes > file_bytes - written) {
+            bytes = (int)(file_bytes - written);
+        }
+
+        if (fwrite(line, 1, bytes, file) != (size_t)bytes) {
+            spdlog::error("Failed to write file: {}", path);
+            fclose(file);
+            return false;
+        }
+        written += bytes;
+    }
+
+    return 0 == fclose(file);
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmark
+
+// Runs in a child process
+static bool RunStartup(const char* file_path, bool from_file)
+{
+    auto emulator = std::make_shared<LinkEmulator>();
+    emulator->Initialize(LinkEmulatorSettings());
+    std::vector<std::shared_ptr<IRadioLink>> links;
+    links.push_back(emulator->CreateLink(0));
+
+    FileSender sender;
+
+    const uint64_t t0 = GetTimeUsec();
+
+    bool success;
+    if (from_file) {
+        success = sender.InitializeFromFile(file_path, links);
+    } else {
+        MappedReadOnlySmallFile mmf;
+        success = mmf.Read(file_path) &&
+            sender.Initialize(file_path, mmf.GetData(), mmf.GetDataBytes(), links);
+    }
+
+    const uint64_t t1 = GetTimeUsec();
+
+    sender.Shutdown();
+
+    if (!success) {
+        spdlog::error("Sender failed to start");
+        return false;
+    }
+
+    spdlog::info("{}: {} msec startup, {} MB peak memory",
+        from_file ? "InitializeFromFile" : "Initialize(in memory)",
+        (t1 - t0) / 1000.f,
+        GetPeakResidentKB() / 1024.f);
+    return true;
+}
+
+static bool RunCase(const char* file_path, bool from_file)
+{
+    fflush(stdout);
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        spdlog::error("fork failed");
+        return false;
+    }
+    if (pid == 0) {
+        _exit(RunStartup(file_path, from_file) ? 0 : 1);
+    }
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) != pid) {
+        spdlog::error("waitpid failed");
+        return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+
+//------------------------------------------------------------------------------
+// Entrypoint
+
+int main()
+{
+    bool success = true;
+
+    char output_dir[] = "/tmp/sender_benchmark.XXXXXX";
+    if (!mkdtemp(output_dir)) {
+        spdlog::error("mkdtemp failed");
+        return -1;
+    }
+    const std::string file_path = std::string(output_dir) + "/test.log";
+
+    for (uint64_t file_bytes : kFileSizes)
+    {
+        if (!WriteTestFile(file_path, file_bytes)) {
+            success = false;
+            break;
+        }
+
+        spdlog::info("File size {} bytes:", file_bytes);
+
+        for (bool from_file : { false, true }) {
+            if (!RunCase(file_path.c_str(), from_file)) {
+                success = false;
+            }
+        }
+
+        unlink(file_path.c_str());
+    }
+
+    rmdir(output_dir);
+
+    return success ? 0 : -1;
+}
@@ -0,0 +1,212 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Compares the old timer-polled receive loop against SerialReactor.
+
+    A pseudo-terminal stands in for the HAT UART so this runs on any Linux box:
+
+        ./serial_benchmark
+
+    For each mode it reports:
+    + Idle CPU time and wake-ups per second with no data on the line.
+    + Frame-to-callback latency: Time from the last byte of a frame being
+      written until the receive loop has read the whole frame.
+*/
+
+#include "linux_serial.hpp"
+#include "tools.hpp"
+using namespace lora;
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+using namespace std;
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const int kFrameBytes = 240;
+static const int kFrameCount = 200;
+static const int kIdleTestMsec = 2000;
+
+// This is what FileReceiver::Loop used to do between Receive() calls
+static const int kPollIntervalUsec = 4000;
+
+// Longest time to block in the reactor
+static const int kReactorWaitMsec = 100;
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+static uint64_t GetThreadCpuUsec()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec * 1000000ULL + usage.ru_utime.tv_usec +
+           usage.ru_stime.tv_sec * 1000000ULL + usage.ru_stime.tv_usec;
+}
+
+struct PtyPair
+{
+    int Master = -1;
+    RawSerialPort Slave;
+
+    bool Initialize()
+    {
+        Master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (Master < 0 || grantpt(Master) != 0 || unlockpt(Master) != 0) {
+            spdlog::error("posix_openpt failed");
+            return false;
+        }
+        return Slave.Initialize(ptsname(Master), 115200);
+    }
+
+    ~PtyPair()
+    {
+        Slave.Shutdown();
+        if (Master != -1) {
+            close(Master);
+        }
+    }
+};
+
+
+//------------------------------------------------------------------------------
+// Receive loops
+
+// Returns true when a full frame has been read.
+static bool ReadFrame(RawSerialPort& port, uint8_t* frame, int& offset)
+{
+    const int available = port.GetAvailable();
+    if (available <= 0) {
+        return false;
+    }
+    const int r = port.Read(frame + offset, std::min(available, kFrameBytes - offset));
+    if (r > 0) {
+        offset += r;
+    }
+    if (offset < kFrameBytes) {
+        return false;
+    }
+    offset = 0;
+    return true;
+}
+
+static void RunBenchmark(const char* name, bool use_reactor)
+{
+    PtyPair pty;
+    if (!pty.Initialize()) {
+        return;
+    }
+
+    SerialReactor reactor;
+    if (!reactor.Initialize()) {
+        return;
+    }
+
+    std::atomic<bool> terminated(false);
+    std::atomic<uint64_t> sent_usec(0);
+    std::vector<uint64_t> latencies;
+    std::atomic<uint64_t> wakeups(0);
+    uint64_t idle_cpu_usec = 0;
+
+    std::thread reader([&]()
+    {
+        uint8_t frame[kFrameBytes];
+        int offset = 0;
+
+        auto receive = [&]() -> bool {
+            ++wakeups;
+            if (use_reactor) {
+                if (pty.Slave.GetAvailable() == 0) {
+                    reactor.Wait(pty.Slave, kReactorWaitMsec);
+                }
+                return ReadFrame(pty.Slave, frame, offset);
+            }
+            const bool got = ReadFrame(pty.Slave, frame, offset);
+            usleep(kPollIntervalUsec);
+            return got;
+        };
+
+        // Idle phase
+        const uint64_t cpu0 = GetThreadCpuUsec();
+        const uint64_t t0 = GetTimeMsec();
+        while (GetTimeMsec() - t0 < (uint64_t)kIdleTestMsec) {
+            receive();
+        }
+        idle_cpu_usec = GetThreadCpuUsec() - cpu0;
+
+        // Latency phase
+        while (!terminated) {
+            if (receive()) {
+                latencies.push_back(GetTimeUsec() - sent_usec);
+            }
+        }
+    });
+
+    // Wait for idle phase to finish
+    std::this_thread::sleep_for(std::chrono::milliseconds(kIdleTestMsec + 200));
+    const uint64_t idle_wakeups = wakeups;
+
+    uint8_t frame[kFrameBytes] = {};
+    for (int i = 0; i < kFrameCount; ++i)
+    {
+        // Randomize the phase relative to the polling timer
+        usleep(10000 + rand() % 10000);
+
+        sent_usec = GetTimeUsec();
+        if (write(pty.Master, frame, kFrameBytes) != kFrameBytes) {
+            spdlog::error("write failed");
+            break;
+        }
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    terminated = true;
+    reactor.Wake();
+    reader.join();
+
+    if (latencies.empty()) {
+        spdlog::error("{}: No frames received", name);
+        return;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t sum = 0;
+    for (uint64_t t : latencies) {
+        sum += t;
+    }
+
+    spdlog::info("{}: Idle CPU = {} msec/sec, {} wakeups/sec",
+        name,
+        idle_cpu_usec / (float)kIdleTestMsec,
+        idle_wakeups * 1000.f / kIdleTestMsec);
+    spdlog::info("{}: Frame-to-callback latency avg = {} usec, p50 = {} usec, p99 = {} usec, max = {} usec",
+        name,
+        sum / (float)latencies.size(),
+        latencies[latencies.size() / 2],
+        latencies[latencies.size() * 99 / 100],
+        latencies.back());
+}
+
+
+//------------------------------------------------------------------------------
+// Entrypoint
+
+int main()
+{
+    spdlog::info("Serial receive benchmark: {} frames of {} bytes", kFrameCount, kFrameBytes);
+
+    RunBenchmark("Polling (usleep 4 msec)", false);
+    RunBenchmark("SerialReactor (poll + eventfd)", true);
+
+    return 0;
+}
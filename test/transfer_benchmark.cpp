@@ -0,0 +1,493 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Measures end-to-end time-to-file over the emulated radio link.
+
+    A FileSender and FileReceiver are connected through a LinkEmulator, so
+    this runs the whole protocol on any Linux box without the HATs:
+
+        ./transfer_benchmark
+
+    Each file size is sent over a clean channel, with independent loss, with
+    Gilbert-Elliott burst loss, and with byte corruption and truncation.
+    The file contents are random so that compression does not hide the cost
+    of sending the data.  Times are real time at the HAT air data rate.
+    The link quality measured by the receiver is shown next to the frame
+    counts from the emulator.
+    Below that are the sender's encode times and the gaps between the block
+    frames it handed to the radio.
+
+    Each case is also run striped across two radios on separate channels.
+
+    The clean channel is also run with version 1 frames, which send file
+    info in separate frames instead of in the block headers.
+
+    The 32 block generations case splits the larger files into several
+    generations that are decoded separately, as for files too large for one
+    Wirehair codec.
+
+    The written to disk case has the receiver decompress the file straight
+    to a temporary directory, and checks the file it writes.
+
+    The dictionary case compresses with a dictionary trained on generated
+    config files, which the receiver picks by the id in the zstd frame.
+
+    The delta case sends only the changes from an earlier version of the
+    file, which the receiver has in its output directory.  The missing base
+    cases send a delta to a receiver without the base file, which should
+    drop it once instead of decoding it again each time the file repeats.
+    With a late join the receiver misses block 0, which holds the delta
+    header, and only finds out after solving the first generation.
+
+    The late join cases start the receiver after the sender has been running
+    for a while.  Times are from when the receiver starts, and the time until
+    it decodes its first block is shown.
+
+    The noisy site cases are loud on most channels, including the one the
+    radios start on, and show the effect of automatic data channel selection.
+
+    The long link cases have a weak signal where faster air rates and longer
+    packets lose more frames.  The selected profile case picks its profile
+    with SelectRadioProfile() from the loss at full size packets, as a
+    receiver would report it.
+*/
+
+#include "loraftp.hpp"
+#include "link_emulator.hpp"
+using namespace lora;
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include <unistd.h> // rmdir, unlink
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const int kFileSizes[] = {
+    1000, 10000, 50000
+};
+
+// Number of radios (each on its own channel) to stripe blocks across
+static const int kLinkCounts[] = {
+    1, 2
+};
+
+// Give up on a transfer after this long
+static const uint64_t kTransferTimeoutUsec = 120 * 1000 * 1000;
+
+// Missing base cases watch the sender this long.  The deltas are a few
+// blocks long, so the sender repeats them many times meanwhile
+static const uint64_t kMissingBaseWaitUsec = 3 * 1000 * 1000;
+
+
+//------------------------------------------------------------------------------
+// Channel Settings
+
+struct ChannelCase
+{
+    const char* Name;
+    LinkEmulatorSettings Settings;
+    FileSenderSettings Sender;
+    FileReceiverSettings Receiver;
+
+    // Start the receiver this long after the sender
+    uint64_t JoinDelayUsec = 0;
+
+    // Send a delta from a version of the file with a few bytes changed,
+    // which is written to the receiver's output directory
+    bool Delta = false;
+
+    // Delete the base file before the receiver needs it
+    bool MissingBase = false;
+};
+
+// Bit errors fall off quickly at lower air rates, where the radio has more
+// processing gain.  This loses 60% of full size packets at the top rate
+static float GetLongLinkLossRate(const RadioProfile& profile)
+{
+    const float ber = 5e-4f * std::pow(profile.AirRateBps / 62500.f, 3.f);
+    return 1.f - std::pow(1.f - ber, profile.PacketBytes * 8.f);
+}
+
+// Trains a dictionary on small generated config files
+static std::shared_ptr<ZstdDictionary> MakeDictionary()
+{
+    std::mt19937 prng(1);
+    std::vector<std::vector<uint8_t>> samples(200);
+    for (auto& sample : samples) {
+        char text[256];
+        const int bytes = snprintf(text, sizeof(text),
+            "{ \"node\": \"gw-%03u\", \"channel\": %u, \"air_rate\": %u, \"sensors\": [%u, %u, %u] }\n",
+            (unsigned)(prng() % 40),
+            (unsigned)(prng() % 84),
+            (unsigned)(prng() % 2 ? 62500 : 2400),
+            (unsigned)(prng() % 16), (unsigned)(prng() % 16), (unsigned)(prng() % 16));
+        sample.assign(text, text + bytes);
+    }
+
+    std::vector<uint8_t> dict;
+    auto dictionary = std::make_shared<ZstdDictionary>();
+    if (!TrainDictionary(samples, 4096, dict) || !dictionary->Set(dict.data(), dict.size())) {
+        return nullptr;
+    }
+    return dictionary;
+}
+
+static std::vector<ChannelCase> GetChannelCases(const std::string& output_dir)
+{
+    std::vector<ChannelCase> cases;
+
+    ChannelCase clean;
+    clean.Name = "Clean";
+    cases.push_back(clean);
+
+    // For comparing the payload efficiency of the frame versions
+    ChannelCase clean_v1;
+    clean_v1.Name = "Clean, version 1 frames";
+    clean_v1.Sender.FrameVersion = kFrameVersion1;
+    cases.push_back(clean_v1);
+
+    ChannelCase late;
+    late.Name = "Late join";
+    late.JoinDelayUsec = 2 * 1000 * 1000;
+    cases.push_back(late);
+
+    late.Name = "Late join, version 1 frames";
+    late.Sender.FrameVersion = kFrameVersion1;
+    cases.push_back(late);
+
+    ChannelCase bernoulli;
+    bernoulli.Name = "10% loss";
+    bernoulli.Settings.LossRate = 0.1f;
+    cases.push_back(bernoulli);
+
+    bernoulli.Name = "10% loss, 32 block generations";
+    bernoulli.Sender.GenerationBlocks = 32;
+    cases.push_back(bernoulli);
+
+    ChannelCase disk;
+    disk.Name = "Written to disk, 32 block generations";
+    disk.Sender.GenerationBlocks = 32;
+    disk.Receiver.OutputDirectory = output_dir;
+    cases.push_back(disk);
+
+    ChannelCase delta;
+    delta.Name = "Delta from earlier version";
+    delta.Receiver.OutputDirectory = output_dir;
+    delta.Delta = true;
+    cases.push_back(delta);
+
+    delta.Name = "Delta with missing base file";
+    delta.MissingBase = true;
+    cases.push_back(delta);
+
+    delta.Name = "Delta with missing base file, late join";
+    delta.JoinDelayUsec = 2 * 1000 * 1000;
+    cases.push_back(delta);
+
+    ChannelCase dictionary;
+    dictionary.Name = "Dictionary";
+    dictionary.Sender.Dictionary = MakeDictionary();
+    dictionary.Receiver.Dictionaries.push_back(dictionary.Sender.Dictionary);
+    if (dictionary.Sender.Dictionary) {
+        cases.push_back(dictionary);
+    } else {
+        spdlog::error("Failed to train dictionary");
+    }
+
+    // Average burst of 5 lost frames, about 10% of frames lost overall
+    ChannelCase burst;
+    burst.Name = "Burst loss";
+    burst.Settings.GoodToBadRate = 0.02f;
+    burst.Settings.BadToGoodRate = 0.2f;
+    burst.Settings.GoodLossRate = 0.01f;
+    burst.Settings.BadLossRate = 1.f;
+    cases.push_back(burst);
+
+    ChannelCase corrupt;
+    corrupt.Name = "Corruption";
+    corrupt.Settings.ByteErrorRate = 0.0002f;
+    corrupt.Settings.TruncationRate = 0.05f;
+    cases.push_back(corrupt);
+
+    // Noise 20 dB over the floor (40% loss) except on a few quiet channels
+    ChannelCase noisy;
+    noisy.Settings.ChannelNoiseDbm.assign(noisy.Settings.ChannelCount, -80.f);
+    for (int channel : { 17, 45, 71 }) {
+        noisy.Settings.ChannelNoiseDbm[channel] = -105.f;
+    }
+    noisy.Settings.NoiseFloorDbm = -100.f;
+    noisy.Settings.LossPerNoiseDb = 0.02f;
+
+    noisy.Name = "Noisy site, fixed channel";
+    noisy.Sender.AutoChannel = false;
+    cases.push_back(noisy);
+
+    noisy.Name = "Noisy site, auto channel";
+    noisy.Sender.AutoChannel = true;
+    cases.push_back(noisy);
+
+    ChannelCase long_link;
+    long_link.Settings.ProfileLossRate = &GetLongLinkLossRate;
+
+    long_link.Name = "Long link, default profile";
+    cases.push_back(long_link);
+
+    std::vector<ProfileLoss> measurements;
+    for (int rate_bps : kAirRatesBps) {
+        ProfileLoss measurement;
+        measurement.Profile.AirRateBps = rate_bps;
+        measurement.LossRate = GetLongLinkLossRate(measurement.Profile);
+        measurements.push_back(measurement);
+    }
+
+    long_link.Name = "Long link, selected profile";
+    long_link.Sender.Profile = SelectRadioProfile(measurements, kBlockHeaderBytes);
+    cases.push_back(long_link);
+
+    return cases;
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmark
+
+static bool RunTransfer(const ChannelCase& channel, int file_bytes, int link_count)
+{
+    std::vector<uint8_t> file_data(file_bytes);
+    std::mt19937 prng(file_bytes);
+    for (auto& x : file_data) {
+        x = (uint8_t)prng();
+    }
+
+    // One emulator per pair of radios, starting on separate channels
+    std::vector<std::shared_ptr<LinkEmulator>> emulators;
+    std::vector<std::shared_ptr<IRadioLink>> sender_links, receiver_links;
+    for (int i = 0; i < link_count; ++i)
+    {
+        LinkEmulatorSettings settings = channel.Settings;
+        settings.Seed += i;
+
+        auto emulator = std::make_shared<LinkEmulator>();
+        emulator->Initialize(settings);
+        auto sender_link = emulator->CreateLink(i);
+        if (!sender_link) {
+            spdlog::error("CreateLink failed");
+            return false;
+        }
+
+        emulators.push_back(emulator);
+        sender_links.push_back(sender_link);
+    }
+
+    std::mutex lock;
+    std::condition_variable condition;
+    bool complete = false;
+    bool matched = false;
+    uint64_t first_decode_usec = 0;
+
+    // Times the receiver started receiving the file
+    int transfer_starts = 0;
+
+    FileSender sender;
+    FileReceiver receiver;
+
+    auto start_receiver = [&]() {
+        // Receivers only hear frames sent after their links exist
+        for (int i = 0; i < link_count; ++i) {
+            auto receiver_link = emulators[i]->CreateLink(i);
+            if (!receiver_link) {
+                spdlog::error("CreateLink failed");
+                return false;
+            }
+            receiver_links.push_back(receiver_link);
+        }
+
+        return receiver.Initialize([&](float progress, const char* file_name, const void* data, int bytes) {
+            std::lock_guard<std::mutex> locker(lock);
+            if (progress > 0.f && first_decode_usec == 0) {
+                first_decode_usec = GetTimeUsec();
+            }
+            if (progress == 0.f && !file_name) {
+                ++transfer_starts;
+            }
+            if (!file_name) {
+                return;
+            }
+
+            // Read back files written to disk
+            MappedReadOnlySmallFile written;
+            if (!data) {
+                const std::string path = channel.Receiver.OutputDirectory + "/" + file_name;
+                if (written.Read(path.c_str())) {
+                    data = written.GetData();
+                }
+                unlink(path.c_str());
+            }
+
+            matched = data && bytes == file_bytes && 0 == memcmp(data, file_data.data(), bytes);
+            complete = true;
+            condition.notify_all();
+        }, receiver_links, channel.Receiver);
+    };
+
+    if (channel.JoinDelayUsec == 0 && !start_receiver()) {
+        spdlog::error("receiver.Initialize failed");
+        return false;
+    }
+
+    FileSenderSettings sender_settings = channel.Sender;
+    if (channel.Delta)
+    {
+        std::vector<uint8_t> base_data = file_data;
+        for (int i = 0; i < 4; ++i) {
+            base_data[prng() % file_bytes] ^= 0x55;
+        }
+
+        sender_settings.BaseFile = channel.Receiver.OutputDirectory + "/test.bin";
+        if (!WriteBufferToFile(sender_settings.BaseFile.c_str(), base_data.data(), base_data.size())) {
+            spdlog::error("Failed to write base file");
+            return false;
+        }
+    }
+
+    uint64_t t0 = GetTimeUsec();
+
+    if (!sender.Initialize("test.bin", file_data.data(), file_bytes, sender_links, sender_settings)) {
+        spdlog::error("sender.Initialize failed");
+        return false;
+    }
+
+    // The sender has compressed the delta, and no longer needs the base file
+    if (channel.MissingBase) {
+        unlink(sender_settings.BaseFile.c_str());
+    }
+
+    if (channel.JoinDelayUsec > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(channel.JoinDelayUsec));
+
+        t0 = GetTimeUsec();
+
+        if (!start_receiver()) {
+            spdlog::error("receiver.Initialize failed");
+            return false;
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> locker(lock);
+        const uint64_t timeout_usec = channel.MissingBase ? kMissingBaseWaitUsec : kTransferTimeoutUsec;
+        condition.wait_for(locker, std::chrono::microseconds(timeout_usec), [&]() {
+            return complete;
+        });
+    }
+
+    const uint64_t t1 = GetTimeUsec();
+
+    sender.Shutdown();
+    receiver.Shutdown();
+
+    LinkEmulatorStats stats;
+    for (auto& emulator : emulators) {
+        const LinkEmulatorStats link_stats = emulator->GetStats();
+        stats.SentFrames += link_stats.SentFrames;
+        stats.LostFrames += link_stats.LostFrames;
+        stats.CorruptedFrames += link_stats.CorruptedFrames;
+        stats.TruncatedFrames += link_stats.TruncatedFrames;
+        stats.OverrunFrames += link_stats.OverrunFrames;
+    }
+
+    // What the receiver measured, to compare with the emulator's counts
+    LinkQualityStats quality;
+    for (auto& link : receiver_links) {
+        quality.Add(link->GetLinkQuality().GetStats());
+    }
+
+    if (channel.MissingBase)
+    {
+        // The file should be received once and then dropped
+        if (complete || transfer_starts != 1) {
+            spdlog::error("{} / {} links / {} bytes: Expected the file to be dropped after one try, but it was received {} times, complete = {}",
+                channel.Name, link_count, file_bytes, transfer_starts, complete);
+            return false;
+        }
+
+        spdlog::info("{} ({}) / {} links / {} bytes: Dropped after one try in {} seconds, frames sent = {}",
+            channel.Name,
+            channel.Sender.Profile.ToString(),
+            link_count,
+            file_bytes,
+            (t1 - t0) / 1000000.f,
+            stats.SentFrames);
+        spdlog::info("    Receiver timing: {}", receiver.GetTimingStats().ToString());
+        return true;
+    }
+
+    if (!complete) {
+        spdlog::error("{} / {} links / {} bytes: Timed out", channel.Name, link_count, file_bytes);
+        return false;
+    }
+    if (!matched) {
+        spdlog::error("{} / {} links / {} bytes: Received file does not match", channel.Name, link_count, file_bytes);
+        return false;
+    }
+
+    const float seconds = (t1 - t0) / 1000000.f;
+    spdlog::info("{} ({}) / {} links / {} bytes: {} seconds ({} bytes/sec), first block decoded after {} msec, frames sent = {}, lost = {}, corrupted = {}, truncated = {}, overrun = {}, receiver: {}",
+        channel.Name,
+        channel.Sender.Profile.ToString(),
+        link_count,
+        file_bytes,
+        seconds,
+        file_bytes / seconds,
+        (first_decode_usec - t0) / 1000.f,
+        stats.SentFrames,
+        stats.LostFrames,
+        stats.CorruptedFrames,
+        stats.TruncatedFrames,
+        stats.OverrunFrames,
+        quality.ToString());
+    spdlog::info("    Sender timing: {}", sender.GetTimingStats().ToString());
+    spdlog::info("    Receiver timing: {}", receiver.GetTimingStats().ToString());
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Entrypoint
+
+int main()
+{
+    bool success = true;
+
+    char output_dir[] = "/tmp/transfer_benchmark.XXXXXX";
+    if (!mkdtemp(output_dir)) {
+        spdlog::error("mkdtemp failed");
+        return -1;
+    }
+
+    for (const auto& channel : GetChannelCases(output_dir)) {
+        for (int link_count : kLinkCounts) {
+            for (int file_bytes : kFileSizes) {
+                if (!RunTransfer(channel, file_bytes, link_count)) {
+                    success = false;
+                }
+            }
+        }
+    }
+
+    rmdir(output_dir);
+
+    return success ? 0 : -1;
+}
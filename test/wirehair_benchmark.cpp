@@ -0,0 +1,295 @@
+// Copyright (c) 2020, Christopher A. Taylor.  All rights reserved.
+
+/*
+    Measures Wirehair repair block generation with wirehair_encode() one
+    block at a time, against wirehair_encode_batch(), for message sizes up
+    to the largest generation.  Batch output is checked against
+    wirehair_encode().
+
+    Then measures the matrix solve by thread count: The time to create the
+    encoder, and the time for the wirehair_decode() call that completes a
+    message missing one original block in ten.  Each decoded message is
+    checked against the original.
+
+        ./wirehair_benchmark
+
+    Blocks are the size loraftp sends at the default radio profile, and
+    the size a relay over UDP might use.
+*/
+
+#include "loraftp.hpp"
+using namespace lora;
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+using namespace std;
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const unsigned kBlockCounts[] = {
+    100, 1000, 10000, 64000
+};
+
+static const unsigned kThreadCounts[] = {
+    2, 4
+};
+
+// Repair blocks generated for each measurement
+static const unsigned kRepairBlocks = 20000;
+
+// Each measurement is the fastest of this many runs
+static const int kTrials = 20;
+
+// Each solve measurement is the fastest of this many runs
+static const int kSolveTrials = 5;
+
+// One original block in this many is lost before decoding
+static const unsigned kSolveLossInterval = 10;
+
+
+//------------------------------------------------------------------------------
+// Benchmark
+
+static bool RunEncode(unsigned block_count, uint32_t block_bytes)
+{
+    const uint64_t message_bytes = (uint64_t)block_count * block_bytes;
+
+    std::vector<uint8_t> message(message_bytes);
+    std::mt19937 prng(block_count);
+    for (auto& x : message) {
+        x = (uint8_t)prng();
+    }
+
+    const uint64_t t0 = GetTimeUsec();
+
+    WirehairCodec encoder = wirehair_encoder_create(nullptr, message.data(), message_bytes, block_bytes);
+    if (!encoder) {
+        spdlog::error("wirehair_encoder_create failed: N={}", block_count);
+        return false;
+    }
+    ScopedFunction encoder_scope([&]() {
+        wirehair_free(encoder);
+    });
+
+    const uint64_t t1 = GetTimeUsec();
+
+    spdlog::info("N = {}, {} byte blocks: Encoder created in {} msec", block_count, block_bytes, (t1 - t0) / 1000.f);
+
+    // Repair blocks, as a sender sends once the original blocks are out
+    const unsigned first_id = block_count;
+
+    std::vector<uint8_t> expected((size_t)kRepairBlocks * block_bytes);
+    std::vector<uint8_t> batch((size_t)kRepairBlocks * block_bytes);
+
+    // Runs take turns so that noise from other processes affects each alike
+    uint64_t call_usec = ~(uint64_t)0;
+    uint64_t batch_usec = ~(uint64_t)0;
+
+    for (int trial = 0; trial < kTrials; ++trial)
+    {
+        const uint64_t t2 = GetTimeUsec();
+
+        for (unsigned i = 0; i < kRepairBlocks; ++i)
+        {
+            uint32_t written = 0;
+            WirehairResult wr = wirehair_encode(encoder, first_id + i, expected.data() + (size_t)i * block_bytes, block_bytes, &written);
+            if (wr != Wirehair_Success) {
+                spdlog::error("wirehair_encode failed: {}", wirehair_result_string(wr));
+                return false;
+            }
+        }
+
+        const uint64_t t3 = GetTimeUsec();
+        call_usec = std::min(call_usec, t3 - t2);
+
+        memset(batch.data(), 0, batch.size());
+
+        const uint64_t t4 = GetTimeUsec();
+
+        WirehairResult wr = wirehair_encode_batch(encoder, first_id, kRepairBlocks, batch.data(), block_bytes);
+
+        const uint64_t t5 = GetTimeUsec();
+        batch_usec = std::min(batch_usec, t5 - t4);
+
+        if (wr != Wirehair_Success) {
+            spdlog::error("wirehair_encode_batch failed: {}", wirehair_result_string(wr));
+            return false;
+        }
+        if (batch != expected) {
+            spdlog::error("wirehair_encode_batch output does not match wirehair_encode: N={}", block_count);
+            return false;
+        }
+    }
+
+    const float call_rate = kRepairBlocks * 1000000.f / call_usec;
+    spdlog::info("    wirehair_encode:       {:>10.0f} blocks/sec", call_rate);
+
+    const float batch_rate = kRepairBlocks * 1000000.f / batch_usec;
+    spdlog::info("    wirehair_encode_batch: {:>10.0f} blocks/sec ({:.2f}x)", batch_rate, batch_rate / call_rate);
+
+    return true;
+}
+
+
+// Returns the usec taken by the wirehair_decode() call that completes the
+// message, or 0 on failure
+static uint64_t DecodeSolve(
+    const std::vector<uint8_t>& message,
+    uint32_t block_bytes,
+    WirehairCodec encoder,
+    unsigned threads)
+{
+    const unsigned block_count = (unsigned)((message.size() + block_bytes - 1) / block_bytes);
+
+    WirehairCodec decoder = wirehair_decoder_create_threads(nullptr, message.size(), block_bytes, threads);
+    if (!decoder) {
+        spdlog::error("wirehair_decoder_create_threads failed: N={}", block_count);
+        return 0;
+    }
+    ScopedFunction decoder_scope([&]() {
+        wirehair_free(decoder);
+    });
+
+    std::vector<uint8_t> block(block_bytes);
+    uint64_t solve_usec = 0;
+
+    for (unsigned block_id = 0;; ++block_id)
+    {
+        if (block_id < block_count && block_id % kSolveLossInterval == 0) {
+            continue;
+        }
+
+        uint32_t written = 0;
+        WirehairResult wr = wirehair_encode(encoder, block_id, block.data(), block_bytes, &written);
+        if (wr != Wirehair_Success) {
+            spdlog::error("wirehair_encode failed: {}", wirehair_result_string(wr));
+            return 0;
+        }
+
+        const uint64_t t0 = GetTimeUsec();
+        wr = wirehair_decode(decoder, block_id, block.data(), written);
+        const uint64_t t1 = GetTimeUsec();
+
+        if (wr == Wirehair_Success) {
+            solve_usec = t1 - t0;
+            break;
+        }
+        if (wr != Wirehair_NeedMore) {
+            spdlog::error("wirehair_decode failed: {}", wirehair_result_string(wr));
+            return 0;
+        }
+    }
+
+    std::vector<uint8_t> recovered(message.size());
+    WirehairResult wr = wirehair_recover(decoder, recovered.data(), recovered.size());
+    if (wr != Wirehair_Success) {
+        spdlog::error("wirehair_recover failed: {}", wirehair_result_string(wr));
+        return 0;
+    }
+    if (recovered != message) {
+        spdlog::error("Decoded message does not match: N={} threads={}", block_count, threads);
+        return 0;
+    }
+
+    return solve_usec > 0 ? solve_usec : 1;
+}
+
+static bool RunSolve(unsigned block_count, uint32_t block_bytes)
+{
+    const uint64_t message_bytes = (uint64_t)block_count * block_bytes;
+
+    std::vector<uint8_t> message(message_bytes);
+    std::mt19937 prng(block_count);
+    for (auto& x : message) {
+        x = (uint8_t)prng();
+    }
+
+    const unsigned thread_counts[] = { 1, kThreadCounts[0], kThreadCounts[1] };
+    const int run_count = sizeof(thread_counts) / sizeof(thread_counts[0]);
+
+    uint64_t encode_usec[run_count], decode_usec[run_count];
+    for (int j = 0; j < run_count; ++j) {
+        encode_usec[j] = decode_usec[j] = ~(uint64_t)0;
+    }
+
+    // Runs take turns so that noise from other processes affects each alike
+    for (int trial = 0; trial < kSolveTrials; ++trial)
+    {
+        for (int j = 0; j < run_count; ++j)
+        {
+            const unsigned threads = thread_counts[j];
+
+            const uint64_t t0 = GetTimeUsec();
+            WirehairCodec encoder = wirehair_encoder_create_threads(nullptr, message.data(), message_bytes, block_bytes, threads);
+            const uint64_t t1 = GetTimeUsec();
+
+            if (!encoder) {
+                spdlog::error("wirehair_encoder_create_threads failed: N={} threads={}", block_count, threads);
+                return false;
+            }
+            ScopedFunction encoder_scope([&]() {
+                wirehair_free(encoder);
+            });
+
+            encode_usec[j] = std::min(encode_usec[j], t1 - t0);
+
+            const uint64_t solve_usec = DecodeSolve(message, block_bytes, encoder, threads);
+            if (solve_usec == 0) {
+                return false;
+            }
+            decode_usec[j] = std::min(decode_usec[j], solve_usec);
+        }
+    }
+
+    spdlog::info("N = {}, {} byte blocks: Matrix solve", block_count, block_bytes);
+
+    for (int j = 0; j < run_count; ++j)
+    {
+        spdlog::info("    {} thread{}: Encoder created in {:>8.2f} msec ({:.2f}x), final decode in {:>8.2f} msec ({:.2f}x)",
+            thread_counts[j], thread_counts[j] == 1 ? " " : "s",
+            encode_usec[j] / 1000.f, encode_usec[0] / (float)encode_usec[j],
+            decode_usec[j] / 1000.f, decode_usec[0] / (float)decode_usec[j]);
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Entrypoint
+
+int main()
+{
+    if (wirehair_init() != Wirehair_Success) {
+        spdlog::error("wirehair_init failed");
+        return -1;
+    }
+
+    spdlog::info("{} hardware threads", std::thread::hardware_concurrency());
+
+    const uint32_t radio_block_bytes = RadioProfile().GetMaxSendBytes() - kBlockHeaderBytes;
+
+    bool success = true;
+
+    for (uint32_t block_bytes : { radio_block_bytes, 1200u }) {
+        for (unsigned block_count : kBlockCounts) {
+            if (!RunEncode(block_count, block_bytes)) {
+                success = false;
+            }
+        }
+    }
+
+    for (uint32_t block_bytes : { radio_block_bytes, 1200u }) {
+        for (unsigned block_count : kBlockCounts) {
+            if (!RunSolve(block_count, block_bytes)) {
+                success = false;
+            }
+        }
+    }
+
+    return success ? 0 : -1;
+}
@@ -29,6 +29,9 @@
 
 #include "WirehairCodec.h"
 
+#include <thread>
+#include <vector>
+
 
 //------------------------------------------------------------------------------
 // Precompiler-conditional console output
@@ -312,7 +315,7 @@ void Codec::SolveWithPeel(
     _peel_tail_rows = row;
 
     // Indicate that this row hasn't been copied yet
-    row->Marks.Result.IsCopied = 0;
+    row->Marks.Result.CopiedBy = LIST_TERM;
 
     // Attempt to avalanche and solve other columns
     PeelAvalancheOnSolve(column_i);
@@ -500,13 +503,13 @@ void Codec::PeelDiagonal()
     CAT_IF_DUMP(cout << endl << "---- PeelDiagonal ----" << endl << endl;)
 
     /*
-        This function optimizes the block value generation by combining the first
-        memcpy and memxor operations together into a three-way memxor if possible,
-        using the is_copied row member.
+        This function generates the Compression matrix rows.  The block values
+        are generated afterwards by PeelDiagonalValues(), which follows the
+        same order of operations.  It records the first row added to each
+        referencing row in CopiedBy, so that the first memcpy and memxor
+        operations can be combined into a three-way memxor.
     */
 
-    CAT_IF_ROWOP(unsigned rowops = 0;)
-
     PeelRow * GF256_RESTRICT row;
 
     // For each peeled row in forward solution order:
@@ -540,40 +543,89 @@ void Codec::PeelDiagonal()
         ge_row[ge_column_k >> 6] ^= (uint64_t)1 << (ge_column_k & 63);
         CAT_IF_DUMP(cout << " " << ge_column_k << endl;)
 
+        CAT_IF_DUMP(cout << "++ Adding to referencing rows:";)
+
+        const PeelRefs * GF256_RESTRICT refs = &_peel_col_refs[peel_column_i];
+        const uint16_t * GF256_RESTRICT referencingRows = refs->Rows;
+
+        // For each row that references this one:
+        for (unsigned i = 0, count = refs->RowCount; i < count; ++i)
+        {
+            const uint16_t ref_row_i = referencingRows[i];
+
+            // If it references the current row:
+            if (ref_row_i == peel_row_i) {
+                // Skip this row
+                continue;
+            }
+
+            CAT_IF_DUMP(cout << " " << ref_row_i;)
+
+            uint64_t * GF256_RESTRICT ge_ref_row = _compress_matrix + _ge_pitch * ref_row_i;
+
+            // Add GE row to referencing GE row
+            for (unsigned j = 0; j < _ge_pitch; ++j) {
+                ge_ref_row[j] ^= ge_row[j];
+            }
+
+            PeelRow * GF256_RESTRICT ref_row = &_peel_rows[ref_row_i];
+
+            // If row is peeled and this is the first row added to it:
+            if (ref_row->Marks.Result.PeelColumn != LIST_TERM &&
+                ref_row->Marks.Result.CopiedBy == LIST_TERM)
+            {
+                ref_row->Marks.Result.CopiedBy = peel_row_i;
+            }
+        } // next referencing row
+
+        CAT_IF_DUMP(cout << endl;)
+
+    } // next peeled row
+}
+
+void Codec::PeelDiagonalValues(const BlockSlice& slice)
+{
+    CAT_IF_ROWOP(unsigned rowops = 0;)
+
+    uint8_t * GF256_RESTRICT recovery_blocks = _recovery_blocks + slice.Offset;
+    const uint8_t * GF256_RESTRICT input_blocks = _input_blocks + slice.Offset;
+
+    const PeelRow * GF256_RESTRICT row;
+
+    // For each peeled row in forward solution order:
+    for (uint16_t peel_row_i = _peel_head_rows;
+        peel_row_i != LIST_TERM;
+        peel_row_i = row->NextRow)
+    {
+        row = &_peel_rows[peel_row_i];
+
+        const uint16_t peel_column_i = row->Marks.Result.PeelColumn;
+
         // Get pointer to output block
         CAT_DEBUG_ASSERT(peel_column_i < _recovery_rows);
-        uint8_t * GF256_RESTRICT temp_block_src = _recovery_blocks + _block_bytes * peel_column_i;
+        uint8_t * GF256_RESTRICT temp_block_src = recovery_blocks + _block_bytes * peel_column_i;
 
         // If row has not been copied yet:
-        if (!row->Marks.Result.IsCopied)
+        if (row->Marks.Result.CopiedBy == LIST_TERM)
         {
-            const uint8_t * GF256_RESTRICT block_src = _input_blocks + _block_bytes * peel_row_i;
+            const uint8_t * GF256_RESTRICT block_src = input_blocks + _block_bytes * peel_row_i;
 
             // If this is not the last block:
             if (peel_row_i != _block_count - 1) {
                 // Copy it directly to the output block
-                memcpy(temp_block_src, block_src, _block_bytes);
+                memcpy(temp_block_src, block_src, slice.Bytes);
             }
             else
             {
                 // Copy with zero padding
-                memcpy(temp_block_src, block_src, _input_final_bytes);
-                CAT_DEBUG_ASSERT(_block_bytes >= _input_final_bytes);
-                memset(temp_block_src + _input_final_bytes, 0, _block_bytes - _input_final_bytes);
+                memcpy(temp_block_src, block_src, slice.FinalBytes);
+                CAT_DEBUG_ASSERT(slice.Bytes >= slice.FinalBytes);
+                memset(temp_block_src + slice.FinalBytes, 0, slice.Bytes - slice.FinalBytes);
             }
             CAT_IF_ROWOP(++rowops;)
-
-            CAT_IF_DUMP(cout << "-- Copied from " << peel_row_i <<
-                " because has not been copied yet.  Output block = " <<
-                (unsigned)temp_block_src[0] << endl;)
-
-            // Note that we do not need to set is_copied here because no
-            // further rows reference this one
         }
 
-        CAT_IF_DUMP(cout << "++ Adding to referencing rows:";)
-
-        PeelRefs * GF256_RESTRICT refs = &_peel_col_refs[peel_column_i];
+        const PeelRefs * GF256_RESTRICT refs = &_peel_col_refs[peel_column_i];
         const uint16_t * GF256_RESTRICT referencingRows = refs->Rows;
 
         // For each row that references this one:
@@ -587,61 +639,47 @@ void Codec::PeelDiagonal()
                 continue;
             }
 
-            CAT_IF_DUMP(cout << " " << ref_row_i;)
-
-            uint64_t * GF256_RESTRICT ge_ref_row = _compress_matrix + _ge_pitch * ref_row_i;
+            const PeelRow * GF256_RESTRICT ref_row = &_peel_rows[ref_row_i];
+            const uint16_t ref_column_i = ref_row->Marks.Result.PeelColumn;
 
-            // Add GE row to referencing GE row
-            for (unsigned j = 0; j < _ge_pitch; ++j) {
-                ge_ref_row[j] ^= ge_row[j];
+            // If row is not peeled:
+            if (ref_column_i == LIST_TERM) {
+                continue;
             }
 
-            PeelRow * GF256_RESTRICT ref_row = &_peel_rows[ref_row_i];
-            const uint16_t ref_column_i = ref_row->Marks.Result.PeelColumn;
+            // Generate temporary row block value:
+            CAT_DEBUG_ASSERT(ref_column_i < _recovery_rows);
+            uint8_t * GF256_RESTRICT temp_block_dest = recovery_blocks + _block_bytes * ref_column_i;
 
-            // If row is peeled:
-            if (ref_column_i != LIST_TERM)
+            // If referencing row is already copied to the recovery blocks:
+            if (ref_row->Marks.Result.CopiedBy != peel_row_i) {
+                // Add this row block value to it
+                gf256_add_mem(temp_block_dest, temp_block_src, slice.Bytes);
+            }
+            else
             {
-                // Generate temporary row block value:
-                CAT_DEBUG_ASSERT(ref_column_i < _recovery_rows);
-                uint8_t * GF256_RESTRICT temp_block_dest = _recovery_blocks + _block_bytes * ref_column_i;
-
-                // If referencing row is already copied to the recovery blocks:
-                if (ref_row->Marks.Result.IsCopied) {
-                    // Add this row block value to it
-                    gf256_add_mem(temp_block_dest, temp_block_src, _block_bytes);
+                const uint8_t * GF256_RESTRICT block_src = input_blocks + _block_bytes * ref_row_i;
+
+                // If this is not the last block:
+                if (ref_row_i != _block_count - 1) {
+                    // Add this row block value with message block to it (optimization)
+                    gf256_addset_mem(temp_block_dest, temp_block_src, block_src, slice.Bytes);
                 }
                 else
                 {
-                    const uint8_t * GF256_RESTRICT block_src = _input_blocks + _block_bytes * ref_row_i;
-
-                    // If this is not the last block:
-                    if (ref_row_i != _block_count - 1) {
-                        // Add this row block value with message block to it (optimization)
-                        gf256_addset_mem(temp_block_dest, temp_block_src, block_src, _block_bytes);
-                    }
-                    else
-                    {
-                        // Add with zero padding
-                        gf256_addset_mem(temp_block_dest, temp_block_src, block_src, _input_final_bytes);
-
-                        CAT_DEBUG_ASSERT(_block_bytes >= _input_final_bytes);
-                        memcpy(
-                            temp_block_dest + _input_final_bytes,
-                            temp_block_src + _input_final_bytes,
-                            _block_bytes - _input_final_bytes);
-                    }
-
-                    ref_row->Marks.Result.IsCopied = 1;
+                    // Add with zero padding
+                    gf256_addset_mem(temp_block_dest, temp_block_src, block_src, slice.FinalBytes);
+
+                    CAT_DEBUG_ASSERT(slice.Bytes >= slice.FinalBytes);
+                    memcpy(
+                        temp_block_dest + slice.FinalBytes,
+                        temp_block_src + slice.FinalBytes,
+                        slice.Bytes - slice.FinalBytes);
                 }
+            }
 
-                CAT_IF_ROWOP(++rowops;)
-            } // end if referencing row is peeled
-
+            CAT_IF_ROWOP(++rowops;)
         } // next referencing row
-
-        CAT_IF_DUMP(cout << endl;)
-
     } // next peeled row
 
     CAT_IF_ROWOP(cout << "PeelDiagonal used " << rowops << " row ops = "
@@ -1453,11 +1491,9 @@ bool Codec::Triangle()
 //------------------------------------------------------------------------------
 // Stage (4) Substitution
 
-void Codec::InitializeColumnValues()
+void Codec::MapDenseRows()
 {
-    CAT_IF_DUMP(cout << endl << "---- InitializeColumnValues ----" << endl << endl;)
-
-    CAT_IF_ROWOP(uint32_t rowops = 0;)
+    CAT_IF_DUMP(cout << endl << "---- MapDenseRows ----" << endl << endl;)
 
     const uint16_t first_heavy_row = _defer_count + _dense_count;
     const uint16_t column_count = _defer_count + _mix_count;
@@ -1466,12 +1502,58 @@ void Codec::InitializeColumnValues()
 
     // For each pivot:
     for (pivot_i = 0; pivot_i < column_count; ++pivot_i)
+    {
+        const uint16_t ge_row_i = _pivots[pivot_i];
+
+        // If it is a dense/heavy(non-extra) row,
+        if (ge_row_i < _dense_count ||
+            ge_row_i >= (first_heavy_row + _extra_count))
+        {
+            // Store which column solves the dense row
+            _ge_row_map[ge_row_i] = _ge_col_map[pivot_i];
+        }
+    }
+
+    // For each remaining pivot:
+    for (; pivot_i < _pivot_count; ++pivot_i)
+    {
+        const uint16_t ge_row_i = _pivots[pivot_i];
+
+        // If row is a dense row,
+        if (ge_row_i < _dense_count ||
+            (ge_row_i >= first_heavy_row && ge_row_i < column_count))
+        {
+            // Mark it for skipping
+            _ge_row_map[ge_row_i] = LIST_TERM;
+
+            CAT_IF_DUMP(cout << "Did not use GE row " << ge_row_i << ", which is a dense row." << endl;)
+        }
+        else {
+            CAT_IF_DUMP(cout << "Did not use deferred row " << ge_row_i << ", which is not a dense row." << endl;)
+        }
+    }
+}
+
+void Codec::InitializeColumnValues(const BlockSlice& slice)
+{
+    CAT_IF_DUMP(cout << endl << "---- InitializeColumnValues ----" << endl << endl;)
+
+    uint8_t * GF256_RESTRICT recovery_blocks = _recovery_blocks + slice.Offset;
+    const uint8_t * GF256_RESTRICT input_blocks = _input_blocks + slice.Offset;
+
+    CAT_IF_ROWOP(uint32_t rowops = 0;)
+
+    const uint16_t first_heavy_row = _defer_count + _dense_count;
+    const uint16_t column_count = _defer_count + _mix_count;
+
+    // For each pivot:
+    for (uint16_t pivot_i = 0; pivot_i < column_count; ++pivot_i)
     {
         // Lookup pivot column, GE row, and destination buffer
         const uint16_t dest_column_i = _ge_col_map[pivot_i];
         const uint16_t ge_row_i = _pivots[pivot_i];
         CAT_DEBUG_ASSERT(dest_column_i < _recovery_rows);
-        uint8_t * GF256_RESTRICT buffer_dest = _recovery_blocks + _block_bytes * dest_column_i;
+        uint8_t * GF256_RESTRICT buffer_dest = recovery_blocks + _block_bytes * dest_column_i;
 
         CAT_IF_DUMP(cout << "Pivot " << pivot_i << " solving column " << dest_column_i << " with GE row " << ge_row_i << " : ";)
 
@@ -1480,10 +1562,7 @@ void Codec::InitializeColumnValues()
             ge_row_i >= (first_heavy_row + _extra_count))
         {
             // Dense/heavy rows sum to zero
-            memset(buffer_dest, 0, _block_bytes);
-
-            // Store which column solves the dense row
-            _ge_row_map[ge_row_i] = dest_column_i;
+            memset(buffer_dest, 0, slice.Bytes);
 
             CAT_IF_DUMP(cout << "[0]" << endl;)
             CAT_IF_ROWOP(++rowops;)
@@ -1493,7 +1572,7 @@ void Codec::InitializeColumnValues()
 
         // Look up row and input value for GE row
         const uint16_t row_i = _ge_row_map[ge_row_i];
-        const uint8_t * GF256_RESTRICT combo = _input_blocks + _block_bytes * row_i;
+        const uint8_t * GF256_RESTRICT combo = input_blocks + _block_bytes * row_i;
         PeelRow * GF256_RESTRICT row = &_peel_rows[row_i];
 
         CAT_IF_DUMP(cout << "[" << (unsigned)combo[0] << "]";)
@@ -1501,8 +1580,8 @@ void Codec::InitializeColumnValues()
         // If copying from final input block:
         if (row_i == _block_count - 1)
         {
-            memcpy(buffer_dest, combo, _input_final_bytes);
-            memset(buffer_dest + _input_final_bytes, 0, _block_bytes - _input_final_bytes);
+            memcpy(buffer_dest, combo, slice.FinalBytes);
+            memset(buffer_dest + slice.FinalBytes, 0, slice.Bytes - slice.FinalBytes);
 
             CAT_IF_ROWOP(++rowops;)
 
@@ -1522,16 +1601,16 @@ void Codec::InitializeColumnValues()
             if (column->Mark == MARK_PEEL)
             {
                 CAT_DEBUG_ASSERT(column_i < _recovery_rows);
-                const uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * column_i;
+                const uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * column_i;
 
                 // If combo unused:
                 if (!combo) {
-                    gf256_add_mem(buffer_dest, src, _block_bytes);
+                    gf256_add_mem(buffer_dest, src, slice.Bytes);
                 }
                 else
                 {
                     // Use combo
-                    gf256_addset_mem(buffer_dest, combo, src, _block_bytes);
+                    gf256_addset_mem(buffer_dest, combo, src, slice.Bytes);
 
                     combo = 0;
                 }
@@ -1541,38 +1620,21 @@ void Codec::InitializeColumnValues()
 
         // If combo still unused:
         if (combo) {
-            memcpy(buffer_dest, combo, _block_bytes);
+            memcpy(buffer_dest, combo, slice.Bytes);
         }
 
         CAT_IF_DUMP(cout << endl;)
     }
 
-    // For each remaining pivot:
-    for (; pivot_i < _pivot_count; ++pivot_i)
-    {
-        const uint16_t ge_row_i = _pivots[pivot_i];
-
-        // If row is a dense row,
-        if (ge_row_i < _dense_count ||
-            (ge_row_i >= first_heavy_row && ge_row_i < column_count))
-        {
-            // Mark it for skipping
-            _ge_row_map[ge_row_i] = LIST_TERM;
-
-            CAT_IF_DUMP(cout << "Did not use GE row " << ge_row_i << ", which is a dense row." << endl;)
-        }
-        else {
-            CAT_IF_DUMP(cout << "Did not use deferred row " << ge_row_i << ", which is not a dense row." << endl;)
-        }
-    }
-
     CAT_IF_ROWOP(cout << "InitializeColumnValues used " << rowops << " row ops = " << rowops / (double)_block_count << "*N" << endl;)
 }
 
-void Codec::MultiplyDenseValues()
+void Codec::MultiplyDenseValues(const BlockSlice& slice)
 {
     CAT_IF_DUMP(cout << endl << "---- MultiplyDenseValues ----" << endl << endl;)
 
+    uint8_t * GF256_RESTRICT recovery_blocks = _recovery_blocks + slice.Offset;
+
     CAT_IF_ROWOP(uint32_t rowops = 0;)
 
     // Initialize PRNG
@@ -1581,8 +1643,8 @@ void Codec::MultiplyDenseValues()
 
     const uint16_t dense_count = _dense_count;
     CAT_DEBUG_ASSERT((unsigned)(_block_count + _mix_count) < _recovery_rows);
-    uint8_t * GF256_RESTRICT temp_block = _recovery_blocks + _block_bytes * (_block_count + _mix_count);
-    const uint8_t * GF256_RESTRICT source_block = _recovery_blocks;
+    uint8_t * GF256_RESTRICT temp_block = recovery_blocks + _block_bytes * (_block_count + _mix_count);
+    const uint8_t * GF256_RESTRICT source_block = recovery_blocks;
     const PeelColumn * GF256_RESTRICT column = _peel_cols;
     uint16_t rows[CAT_MAX_DENSE_ROWS];
     uint16_t bits[CAT_MAX_DENSE_ROWS];
@@ -1636,14 +1698,14 @@ void Codec::MultiplyDenseValues()
                 else if (combo == temp_block)
                 {
                     // Else if combo has been used: XOR it in
-                    gf256_add_mem(temp_block, src, _block_bytes);
+                    gf256_add_mem(temp_block, src, slice.Bytes);
 
                     CAT_IF_ROWOP(++rowops;)
                 }
                 else
                 {
                     // Else if combo needs to be used: Combine into block
-                    gf256_addset_mem(temp_block, combo, src, _block_bytes);
+                    gf256_addset_mem(temp_block, combo, src, slice.Bytes);
 
                     CAT_IF_ROWOP(++rowops;)
 
@@ -1656,14 +1718,14 @@ void Codec::MultiplyDenseValues()
 
         // If no combo ever triggered:
         if (!combo) {
-            memset(temp_block, 0, _block_bytes);
+            memset(temp_block, 0, slice.Bytes);
         }
         else
         {
             // Else if never combined two: Just copy it
             if (combo != temp_block)
             {
-                memcpy(temp_block, combo, _block_bytes);
+                memcpy(temp_block, combo, slice.Bytes);
                 CAT_IF_ROWOP(++rowops;)
             }
 
@@ -1673,7 +1735,7 @@ void Codec::MultiplyDenseValues()
             if (dest_column_i != LIST_TERM)
             {
                 CAT_DEBUG_ASSERT(dest_column_i < _recovery_rows);
-                gf256_add_mem(_recovery_blocks + _block_bytes * dest_column_i, temp_block, _block_bytes);
+                gf256_add_mem(recovery_blocks + _block_bytes * dest_column_i, temp_block, slice.Bytes);
                 CAT_IF_ROWOP(++rowops;)
             }
         }
@@ -1706,7 +1768,7 @@ void Codec::MultiplyDenseValues()
                         temp_block,
                         source_block + _block_bytes * bit0,
                         source_block + _block_bytes * bit1,
-                        _block_bytes);
+                        slice.Bytes);
                 }
                 else
                 {
@@ -1715,7 +1777,7 @@ void Codec::MultiplyDenseValues()
                     gf256_add_mem(
                         temp_block,
                         source_block + _block_bytes * bit0,
-                        _block_bytes);
+                        slice.Bytes);
                 }
                 CAT_IF_ROWOP(++rowops;)
             }
@@ -1726,7 +1788,7 @@ void Codec::MultiplyDenseValues()
                 gf256_add_mem(
                     temp_block,
                     source_block + _block_bytes * bit1,
-                    _block_bytes);
+                    slice.Bytes);
 
                 CAT_IF_ROWOP(++rowops;)
             }
@@ -1741,9 +1803,9 @@ void Codec::MultiplyDenseValues()
                 CAT_DEBUG_ASSERT(dest_column_i < _recovery_rows);
 
                 gf256_add_mem(
-                    _recovery_blocks + _block_bytes * dest_column_i,
+                    recovery_blocks + _block_bytes * dest_column_i,
                     temp_block,
-                    _block_bytes);
+                    slice.Bytes);
 
                 CAT_IF_ROWOP(++rowops;)
             }
@@ -1778,7 +1840,7 @@ void Codec::MultiplyDenseValues()
                         temp_block,
                         source_block + _block_bytes * bit0,
                         source_block + _block_bytes * bit1,
-                        _block_bytes);
+                        slice.Bytes);
                 }
                 else
                 {
@@ -1789,7 +1851,7 @@ void Codec::MultiplyDenseValues()
                     gf256_add_mem(
                         temp_block,
                         source_block + _block_bytes * bit0,
-                        _block_bytes);
+                        slice.Bytes);
                 }
 
                 CAT_IF_ROWOP(++rowops;)
@@ -1803,7 +1865,7 @@ void Codec::MultiplyDenseValues()
                 gf256_add_mem(
                     temp_block,
                     source_block + _block_bytes * bit1,
-                    _block_bytes);
+                    slice.Bytes);
 
                 CAT_IF_ROWOP(++rowops;)
             }
@@ -1818,9 +1880,9 @@ void Codec::MultiplyDenseValues()
                 CAT_DEBUG_ASSERT(dest_column_i < _recovery_rows);
 
                 gf256_add_mem(
-                    _recovery_blocks + _block_bytes * dest_column_i,
+                    recovery_blocks + _block_bytes * dest_column_i,
                     temp_block,
-                    _block_bytes);
+                    slice.Bytes);
 
                 CAT_IF_ROWOP(++rowops;)
             }
@@ -1836,10 +1898,12 @@ void Codec::MultiplyDenseValues()
 #define CAT_UNDER_WIN_THRESH_6 (85 + 6)
 #define CAT_UNDER_WIN_THRESH_7 (138 + 7)
 
-void Codec::AddSubdiagonalValues()
+void Codec::AddSubdiagonalValues(const BlockSlice& slice)
 {
     CAT_IF_DUMP(cout << endl << "---- AddSubdiagonalValues ----" << endl << endl;)
 
+    uint8_t * GF256_RESTRICT recovery_blocks = _recovery_blocks + slice.Offset;
+
     CAT_IF_ROWOP(uint32_t rowops = 0; unsigned heavyops = 0;)
 
     const unsigned column_count = _defer_count + _mix_count;
@@ -1884,7 +1948,7 @@ void Codec::AddSubdiagonalValues()
         // but now they are unused, and so they can be reused for temporary space
         uint8_t * GF256_RESTRICT win_table[128];
         const PeelColumn * GF256_RESTRICT column = _peel_cols;
-        uint8_t * GF256_RESTRICT column_src = _recovery_blocks;
+        uint8_t * GF256_RESTRICT column_src = recovery_blocks;
         uint32_t jj = 1;
 
         for (uint32_t count = _block_count; count > 0; --count, ++column, column_src += _block_bytes)
@@ -1925,7 +1989,7 @@ void Codec::AddSubdiagonalValues()
             for (unsigned src_pivot_i = pivot_i; src_pivot_i < final_i; ++src_pivot_i)
             {
                 CAT_DEBUG_ASSERT(_ge_col_map[src_pivot_i] < _recovery_rows);
-                uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * _ge_col_map[src_pivot_i];
+                uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * _ge_col_map[src_pivot_i];
 
                 CAT_IF_DUMP(cout << "Back-substituting small triangle from pivot " << src_pivot_i << "[" << (unsigned)src[0] << "] :";)
 
@@ -1944,10 +2008,10 @@ void Codec::AddSubdiagonalValues()
                         CAT_DEBUG_ASSERT(dest_col_i < _block_count + _mix_count);
 
                         CAT_DEBUG_ASSERT(dest_col_i < _recovery_rows);
-                        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * dest_col_i;
+                        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * dest_col_i;
 
                         // Back-substitute
-                        gf256_add_mem(dest, src, _block_bytes);
+                        gf256_add_mem(dest, src, slice.Bytes);
 
                         CAT_IF_ROWOP(++rowops;)
 
@@ -1964,25 +2028,25 @@ void Codec::AddSubdiagonalValues()
 
             // Generate window table: 2 bits
             CAT_DEBUG_ASSERT(_ge_col_map[pivot_i] < _recovery_rows);
-            win_table[1] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i];
+            win_table[1] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i];
             CAT_DEBUG_ASSERT(_ge_col_map[pivot_i + 1] < _recovery_rows);
-            win_table[2] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 1];
-            gf256_addset_mem(win_table[3], win_table[1], win_table[2], _block_bytes);
+            win_table[2] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 1];
+            gf256_addset_mem(win_table[3], win_table[1], win_table[2], slice.Bytes);
             CAT_IF_ROWOP(++rowops;)
 
             // Generate window table: 3 bits
             CAT_DEBUG_ASSERT(_ge_col_map[pivot_i + 2] < _recovery_rows);
-            win_table[4] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 2];
-            gf256_addset_mem(win_table[5], win_table[1], win_table[4], _block_bytes);
-            gf256_addset_mem(win_table[6], win_table[2], win_table[4], _block_bytes);
-            gf256_addset_mem(win_table[7], win_table[1], win_table[6], _block_bytes);
+            win_table[4] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 2];
+            gf256_addset_mem(win_table[5], win_table[1], win_table[4], slice.Bytes);
+            gf256_addset_mem(win_table[6], win_table[2], win_table[4], slice.Bytes);
+            gf256_addset_mem(win_table[7], win_table[1], win_table[6], slice.Bytes);
             CAT_IF_ROWOP(rowops += 3;)
 
             // Generate window table: 4 bits
             CAT_DEBUG_ASSERT(_ge_col_map[pivot_i + 3] < _recovery_rows);
-            win_table[8] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 3];
+            win_table[8] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 3];
             for (unsigned ii = 1; ii < 8; ++ii) {
-                gf256_addset_mem(win_table[8 + ii], win_table[ii], win_table[8], _block_bytes);
+                gf256_addset_mem(win_table[8 + ii], win_table[ii], win_table[8], slice.Bytes);
             }
             CAT_IF_ROWOP(rowops += 7;)
 
@@ -1990,27 +2054,27 @@ void Codec::AddSubdiagonalValues()
             if (w >= 5)
             {
                 CAT_DEBUG_ASSERT(_ge_col_map[pivot_i + 4] < _recovery_rows);
-                win_table[16] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 4];
+                win_table[16] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 4];
                 for (unsigned ii = 1; ii < 16; ++ii) {
-                    gf256_addset_mem(win_table[16 + ii], win_table[ii], win_table[16], _block_bytes);
+                    gf256_addset_mem(win_table[16 + ii], win_table[ii], win_table[16], slice.Bytes);
                 }
                 CAT_IF_ROWOP(rowops += 15;)
 
                 if (w >= 6)
                 {
                     CAT_DEBUG_ASSERT(_ge_col_map[pivot_i + 5] < _recovery_rows);
-                    win_table[32] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 5];
+                    win_table[32] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 5];
                     for (unsigned ii = 1; ii < 32; ++ii) {
-                        gf256_addset_mem(win_table[32 + ii], win_table[ii], win_table[32], _block_bytes);
+                        gf256_addset_mem(win_table[32 + ii], win_table[ii], win_table[32], slice.Bytes);
                     }
                     CAT_IF_ROWOP(rowops += 31;)
 
                     if (w >= 7)
                     {
                         CAT_DEBUG_ASSERT(_ge_col_map[pivot_i + 6] < _recovery_rows);
-                        win_table[64] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 6];
+                        win_table[64] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 6];
                         for (unsigned ii = 1; ii < 64; ++ii) {
-                            gf256_addset_mem(win_table[64 + ii], win_table[ii], win_table[64], _block_bytes);
+                            gf256_addset_mem(win_table[64 + ii], win_table[ii], win_table[64], slice.Bytes);
                         }
                         CAT_IF_ROWOP(rowops += 63;)
                     }
@@ -2045,8 +2109,8 @@ void Codec::AddSubdiagonalValues()
                         CAT_IF_DUMP(cout << "Adding window table " << win_bits << " to pivot " << ge_below_i << endl;)
 
                         // Back-substitute
-                        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[ge_below_i];
-                        gf256_add_mem(dest, win_table[win_bits], _block_bytes);
+                        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[ge_below_i];
+                        gf256_add_mem(dest, win_table[win_bits], slice.Bytes);
                         CAT_IF_ROWOP(++rowops;)
                     }
                 }
@@ -2074,8 +2138,8 @@ void Codec::AddSubdiagonalValues()
                         CAT_IF_DUMP(cout << "Adding window table " << win_bits << " to pivot " << ge_below_i << endl;)
 
                         // Back-substitute
-                        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[ge_below_i];
-                        gf256_add_mem(dest, win_table[win_bits], _block_bytes);
+                        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[ge_below_i];
+                        gf256_add_mem(dest, win_table[win_bits], slice.Bytes);
                         CAT_IF_ROWOP(++rowops;)
                     }
                 }
@@ -2118,7 +2182,7 @@ void Codec::AddSubdiagonalValues()
         const unsigned column_i = _ge_col_map[ge_column_i];
         const uint16_t ge_row_i = _pivots[ge_column_i];
         CAT_DEBUG_ASSERT(column_i < _recovery_rows);
-        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * column_i;
+        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * column_i;
 
         CAT_IF_DUMP(cout << "Pivot " << ge_column_i << " solving column " << column_i << "[" << (unsigned)dest[0] << "] with GE row " << ge_row_i << " :";)
 
@@ -2141,9 +2205,9 @@ void Codec::AddSubdiagonalValues()
 
                 // Look up data source
                 CAT_DEBUG_ASSERT(_ge_col_map[sub_i] < _recovery_rows);
-                const uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * _ge_col_map[sub_i];
+                const uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * _ge_col_map[sub_i];
 
-                gf256_muladd_mem(dest, code_value, src, _block_bytes);
+                gf256_muladd_mem(dest, code_value, src, slice.Bytes);
 
                 CAT_IF_ROWOP(if (code_value == 1) ++rowops; else ++heavyops;)
                 CAT_IF_DUMP(cout << " h" << ge_column_i << "=[" << (unsigned)src[0] << "*" << (unsigned)code_value << "]";)
@@ -2174,10 +2238,10 @@ void Codec::AddSubdiagonalValues()
             {
                 const unsigned column_j = _ge_col_map[bit_j];
                 CAT_DEBUG_ASSERT(column_j < _recovery_rows);
-                const uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * column_j;
+                const uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * column_j;
 
                 // Add pivot for non-zero bit to destination row value
-                gf256_add_mem(dest, src, _block_bytes);
+                gf256_add_mem(dest, src, slice.Bytes);
                 CAT_IF_ROWOP(++rowops;)
 
                 CAT_IF_DUMP(cout << " " << bit_j << "=[" << (unsigned)src[0] << "]";)
@@ -2198,10 +2262,12 @@ void Codec::AddSubdiagonalValues()
 #define CAT_ABOVE_WIN_THRESH_6 (64 + 6)
 #define CAT_ABOVE_WIN_THRESH_7 (128 + 7)
 
-void Codec::BackSubstituteAboveDiagonal()
+void Codec::BackSubstituteAboveDiagonal(const BlockSlice& slice)
 {
     CAT_IF_DUMP(cout << endl << "---- BackSubstituteAboveDiagonal ----" << endl << endl;)
 
+    uint8_t * GF256_RESTRICT recovery_blocks = _recovery_blocks + slice.Offset;
+
     CAT_IF_ROWOP(unsigned rowops = 0; unsigned heavyops = 0;)
 
     const unsigned pivot_count = _defer_count + _mix_count;
@@ -2240,7 +2306,7 @@ void Codec::BackSubstituteAboveDiagonal()
         // but now they are unused, and so they can be reused for temporary space.
         uint8_t * GF256_RESTRICT win_table[128];
         const PeelColumn * GF256_RESTRICT column = _peel_cols;
-        uint8_t * GF256_RESTRICT column_src = _recovery_blocks;
+        uint8_t * GF256_RESTRICT column_src = recovery_blocks;
         uint32_t jj = 1;
 
         // For each original data column:
@@ -2281,7 +2347,7 @@ void Codec::BackSubstituteAboveDiagonal()
             for (unsigned src_pivot_i = pivot_i; src_pivot_i > backsub_i; --src_pivot_i)
             {
                 CAT_DEBUG_ASSERT(_ge_col_map[src_pivot_i] < _recovery_rows);
-                uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * _ge_col_map[src_pivot_i];
+                uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * _ge_col_map[src_pivot_i];
 
                 const uint16_t ge_row_i = _pivots[src_pivot_i];
 
@@ -2300,7 +2366,7 @@ void Codec::BackSubstituteAboveDiagonal()
 
                     // Normalize code value, setting it to 1 (implicitly nonzero)
                     if (code_value != 1) {
-                        gf256_div_mem(src, src, code_value, _block_bytes);
+                        gf256_div_mem(src, src, code_value, slice.Bytes);
                         CAT_IF_ROWOP(++heavyops;)
                     }
 
@@ -2331,10 +2397,10 @@ void Codec::BackSubstituteAboveDiagonal()
                         }
 
                         CAT_DEBUG_ASSERT(_ge_col_map[dest_pivot_i] < _recovery_rows);
-                        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[dest_pivot_i];
+                        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[dest_pivot_i];
 
                         // Back-substitute
-                        gf256_muladd_mem(dest, code_value, src, _block_bytes);
+                        gf256_muladd_mem(dest, code_value, src, slice.Bytes);
 
                         CAT_IF_ROWOP(if (code_value == 1) ++rowops; else ++heavyops;)
                         CAT_IF_DUMP(cout << " h" << dest_pivot_i;)
@@ -2345,10 +2411,10 @@ void Codec::BackSubstituteAboveDiagonal()
                         if (ge_row[_ge_pitch * dest_row_i] & ge_mask)
                         {
                             CAT_DEBUG_ASSERT(_ge_col_map[dest_pivot_i] < _recovery_rows);
-                            uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[dest_pivot_i];
+                            uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[dest_pivot_i];
 
                             // Back-substitute
-                            gf256_add_mem(dest, src, _block_bytes);
+                            gf256_add_mem(dest, src, slice.Bytes);
 
                             CAT_IF_ROWOP(++rowops;)
                             CAT_IF_DUMP(cout << " " << dest_pivot_i;)
@@ -2382,9 +2448,9 @@ void Codec::BackSubstituteAboveDiagonal()
                 if (code_value != 1)
                 {
                     CAT_DEBUG_ASSERT(_ge_col_map[backsub_i] < _recovery_rows);
-                    uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i];
+                    uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * _ge_col_map[backsub_i];
 
-                    gf256_div_mem(src, src, code_value, _block_bytes);
+                    gf256_div_mem(src, src, code_value, slice.Bytes);
                     CAT_IF_ROWOP(++heavyops;)
                 }
             }
@@ -2393,25 +2459,25 @@ void Codec::BackSubstituteAboveDiagonal()
 
             // Generate window table: 2 bits
             CAT_DEBUG_ASSERT(_ge_col_map[backsub_i] < _recovery_rows);
-            win_table[1] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i];
+            win_table[1] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i];
             CAT_DEBUG_ASSERT(_ge_col_map[backsub_i + 1] < _recovery_rows);
-            win_table[2] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 1];
-            gf256_addset_mem(win_table[3], win_table[1], win_table[2], _block_bytes);
+            win_table[2] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 1];
+            gf256_addset_mem(win_table[3], win_table[1], win_table[2], slice.Bytes);
             CAT_IF_ROWOP(++rowops;)
 
             // Generate window table: 3 bits
             CAT_DEBUG_ASSERT(_ge_col_map[backsub_i + 2] < _recovery_rows);
-            win_table[4] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 2];
-            gf256_addset_mem(win_table[5], win_table[1], win_table[4], _block_bytes);
-            gf256_addset_mem(win_table[6], win_table[2], win_table[4], _block_bytes);
-            gf256_addset_mem(win_table[7], win_table[1], win_table[6], _block_bytes);
+            win_table[4] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 2];
+            gf256_addset_mem(win_table[5], win_table[1], win_table[4], slice.Bytes);
+            gf256_addset_mem(win_table[6], win_table[2], win_table[4], slice.Bytes);
+            gf256_addset_mem(win_table[7], win_table[1], win_table[6], slice.Bytes);
             CAT_IF_ROWOP(rowops += 3;)
 
             // Generate window table: 4 bits
             CAT_DEBUG_ASSERT(_ge_col_map[backsub_i + 3] < _recovery_rows);
-            win_table[8] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 3];
+            win_table[8] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 3];
             for (unsigned ii = 1; ii < 8; ++ii) {
-                gf256_addset_mem(win_table[8 + ii], win_table[ii], win_table[8], _block_bytes);
+                gf256_addset_mem(win_table[8 + ii], win_table[ii], win_table[8], slice.Bytes);
             }
             CAT_IF_ROWOP(rowops += 7;)
 
@@ -2419,27 +2485,27 @@ void Codec::BackSubstituteAboveDiagonal()
             if (w >= 5)
             {
                 CAT_DEBUG_ASSERT(_ge_col_map[backsub_i + 4] < _recovery_rows);
-                win_table[16] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 4];
+                win_table[16] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 4];
                 for (unsigned ii = 1; ii < 16; ++ii) {
-                    gf256_addset_mem(win_table[16 + ii], win_table[ii], win_table[16], _block_bytes);
+                    gf256_addset_mem(win_table[16 + ii], win_table[ii], win_table[16], slice.Bytes);
                 }
                 CAT_IF_ROWOP(rowops += 15;)
 
                 if (w >= 6)
                 {
                     CAT_DEBUG_ASSERT(_ge_col_map[backsub_i + 5] < _recovery_rows);
-                    win_table[32] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 5];
+                    win_table[32] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 5];
                     for (unsigned ii = 1; ii < 32; ++ii) {
-                        gf256_addset_mem(win_table[32 + ii], win_table[ii], win_table[32], _block_bytes);
+                        gf256_addset_mem(win_table[32 + ii], win_table[ii], win_table[32], slice.Bytes);
                     }
                     CAT_IF_ROWOP(rowops += 31;)
 
                     if (w >= 7)
                     {
                         CAT_DEBUG_ASSERT(_ge_col_map[backsub_i + 6] < _recovery_rows);
-                        win_table[64] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 6];
+                        win_table[64] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 6];
                         for (unsigned ii = 1; ii < 64; ++ii) {
-                            gf256_addset_mem(win_table[64 + ii], win_table[ii], win_table[64], _block_bytes);
+                            gf256_addset_mem(win_table[64 + ii], win_table[ii], win_table[64], slice.Bytes);
                         }
                         CAT_IF_ROWOP(rowops += 63;)
                     }
@@ -2462,7 +2528,7 @@ void Codec::BackSubstituteAboveDiagonal()
                     }
 
                     CAT_DEBUG_ASSERT(_ge_col_map[ge_above_i] < _recovery_rows);
-                    uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[ge_above_i];
+                    uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[ge_above_i];
                     unsigned ge_column_j = backsub_i;
 
                     // If the first column of window is not heavy:
@@ -2481,9 +2547,9 @@ void Codec::BackSubstituteAboveDiagonal()
                             if (nonzero)
                             {
                                 CAT_DEBUG_ASSERT(_ge_col_map[ge_column_j] < _recovery_rows);
-                                const uint8_t *src = _recovery_blocks + _block_bytes * _ge_col_map[ge_column_j];
+                                const uint8_t *src = recovery_blocks + _block_bytes * _ge_col_map[ge_column_j];
 
-                                gf256_add_mem(dest, src, _block_bytes);
+                                gf256_add_mem(dest, src, slice.Bytes);
 
                                 CAT_IF_ROWOP(++rowops;)
                             }
@@ -2512,10 +2578,10 @@ void Codec::BackSubstituteAboveDiagonal()
                         }
 
                         CAT_DEBUG_ASSERT(_ge_col_map[ge_column_j] < _recovery_rows);
-                        const uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * _ge_col_map[ge_column_j];
+                        const uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * _ge_col_map[ge_column_j];
 
                         // Back-substitute
-                        gf256_muladd_mem(dest, code_value, src, _block_bytes);
+                        gf256_muladd_mem(dest, code_value, src, slice.Bytes);
 
                         CAT_IF_ROWOP(if (code_value == 1) ++rowops; else ++heavyops;)
                     } // next column in row
@@ -2553,10 +2619,10 @@ void Codec::BackSubstituteAboveDiagonal()
                         CAT_IF_DUMP(cout << "Adding window table " << win_bits << " to pivot " << above_pivot_i << endl;)
 
                         CAT_DEBUG_ASSERT(_ge_col_map[above_pivot_i] < _recovery_rows);
-                        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[above_pivot_i];
+                        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[above_pivot_i];
 
                         // Back-substitute
-                        gf256_add_mem(dest, win_table[win_bits], _block_bytes);
+                        gf256_add_mem(dest, win_table[win_bits], slice.Bytes);
 
                         CAT_IF_ROWOP(++rowops;)
                     }
@@ -2586,10 +2652,10 @@ void Codec::BackSubstituteAboveDiagonal()
                         CAT_IF_DUMP(cout << "Adding window table " << win_bits << " to pivot " << above_pivot_i << endl;)
 
                         CAT_DEBUG_ASSERT(_ge_col_map[above_pivot_i] < _recovery_rows);
-                        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[above_pivot_i];
+                        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[above_pivot_i];
 
                         // Back-substitute
-                        gf256_add_mem(dest, win_table[win_bits], _block_bytes);
+                        gf256_add_mem(dest, win_table[win_bits], slice.Bytes);
 
                         CAT_IF_ROWOP(++rowops;)
                     }
@@ -2630,7 +2696,7 @@ void Codec::BackSubstituteAboveDiagonal()
     {
         // Calculate source
         CAT_DEBUG_ASSERT(_ge_col_map[pivot_i] < _recovery_rows);
-        uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i];
+        uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * _ge_col_map[pivot_i];
 
         const uint16_t ge_row_i = _pivots[pivot_i];
 
@@ -2649,7 +2715,7 @@ void Codec::BackSubstituteAboveDiagonal()
 
             // Normalize code value, setting it to 1 (implicitly nonzero)
             if (code_value != 1) {
-                gf256_div_mem(src, src, code_value, _block_bytes);
+                gf256_div_mem(src, src, code_value, slice.Bytes);
                 CAT_IF_ROWOP(++heavyops;)
             }
 
@@ -2679,10 +2745,10 @@ void Codec::BackSubstituteAboveDiagonal()
                 }
 
                 CAT_DEBUG_ASSERT(_ge_col_map[ge_up_i] < _recovery_rows);
-                uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[ge_up_i];
+                uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[ge_up_i];
 
                 // Back-substitute
-                gf256_muladd_mem(dest, code_value, src, _block_bytes);
+                gf256_muladd_mem(dest, code_value, src, slice.Bytes);
 
                 CAT_IF_ROWOP(if (code_value == 1) {
                     ++rowops;
@@ -2698,10 +2764,10 @@ void Codec::BackSubstituteAboveDiagonal()
                 if (ge_row[_ge_pitch * up_row_i] & ge_mask)
                 {
                     CAT_DEBUG_ASSERT(_ge_col_map[ge_up_i] < _recovery_rows);
-                    uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[ge_up_i];
+                    uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[ge_up_i];
 
                     // Back-substitute
-                    gf256_add_mem(dest, src, _block_bytes);
+                    gf256_add_mem(dest, src, slice.Bytes);
 
                     CAT_IF_ROWOP(++rowops;)
                     CAT_IF_DUMP(cout << " " << up_row_i;)
@@ -2722,10 +2788,13 @@ void Codec::BackSubstituteAboveDiagonal()
     CAT_IF_ROWOP(cout << "BackSubstituteAboveDiagonal used " << rowops << " row ops = " << rowops / (double)_block_count << "*N and " << heavyops << " heavy ops" << endl;)
 }
 
-void Codec::Substitute()
+void Codec::Substitute(const BlockSlice& slice)
 {
     CAT_IF_DUMP(cout << endl << "---- Substitute ----" << endl << endl;)
 
+    uint8_t * GF256_RESTRICT recovery_blocks = _recovery_blocks + slice.Offset;
+    const uint8_t * GF256_RESTRICT input_blocks = _input_blocks + slice.Offset;
+
     CAT_IF_ROWOP(uint32_t rowops = 0;)
 
     PeelRow * GF256_RESTRICT row;
@@ -2737,40 +2806,40 @@ void Codec::Substitute()
 
         const uint16_t dest_column_i = row->Marks.Result.PeelColumn;
         CAT_DEBUG_ASSERT(dest_column_i < _recovery_rows);
-        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * dest_column_i;
+        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * dest_column_i;
 
         CAT_IF_DUMP(cout << "Generating column " << dest_column_i << ":";)
 
-        const uint8_t * GF256_RESTRICT input_src = _input_blocks + _block_bytes * row_i;
+        const uint8_t * GF256_RESTRICT input_src = input_blocks + _block_bytes * row_i;
         CAT_IF_DUMP(cout << " " << row_i << ":[" << (unsigned)input_src[0] << "]";)
 
         const RowMixIterator mix(row->Params, _mix_count, _mix_next_prime);
 
         // Set up mixing column generator
         CAT_DEBUG_ASSERT((unsigned)(_block_count + mix.Columns[0]) < _recovery_rows);
-        const uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * (_block_count + mix.Columns[0]);
+        const uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * (_block_count + mix.Columns[0]);
 
         // If copying from final block:
         if (row_i != _block_count - 1) {
-            gf256_addset_mem(dest, src, input_src, _block_bytes);
+            gf256_addset_mem(dest, src, input_src, slice.Bytes);
         }
         else
         {
-            gf256_addset_mem(dest, src, input_src, _input_final_bytes);
+            gf256_addset_mem(dest, src, input_src, slice.FinalBytes);
             memcpy(
-                dest + _input_final_bytes,
-                src + _input_final_bytes,
-                _block_bytes - _input_final_bytes);
+                dest + slice.FinalBytes,
+                src + slice.FinalBytes,
+                slice.Bytes - slice.FinalBytes);
         }
         CAT_IF_ROWOP(++rowops;)
 
         CAT_DEBUG_ASSERT((unsigned)(_block_count + mix.Columns[1]) < _recovery_rows);
-        const uint8_t * GF256_RESTRICT src0 = _recovery_blocks + _block_bytes * (_block_count + mix.Columns[1]);
+        const uint8_t * GF256_RESTRICT src0 = recovery_blocks + _block_bytes * (_block_count + mix.Columns[1]);
         CAT_DEBUG_ASSERT((unsigned)(_block_count + mix.Columns[2]) < _recovery_rows);
-        const uint8_t * GF256_RESTRICT src1 = _recovery_blocks + _block_bytes * (_block_count + mix.Columns[2]);
+        const uint8_t * GF256_RESTRICT src1 = recovery_blocks + _block_bytes * (_block_count + mix.Columns[2]);
 
         // Add next two mixing columns in
-        gf256_add2_mem(dest, src0, src1, _block_bytes);
+        gf256_add2_mem(dest, src0, src1, slice.Bytes);
 
         CAT_IF_ROWOP(++rowops;)
 
@@ -2787,20 +2856,20 @@ void Codec::Substitute()
             if (column_0 != dest_column_i)
             {
                 CAT_DEBUG_ASSERT(column_0 < _recovery_rows);
-                const uint8_t * GF256_RESTRICT peel0 = _recovery_blocks + _block_bytes * column_0;
+                const uint8_t * GF256_RESTRICT peel0 = recovery_blocks + _block_bytes * column_0;
 
                 // Common case:
                 if (column_1 != dest_column_i) {
                     CAT_DEBUG_ASSERT(column_1 < _recovery_rows);
-                    gf256_add2_mem(dest, peel0, _recovery_blocks + _block_bytes * column_1, _block_bytes);
+                    gf256_add2_mem(dest, peel0, recovery_blocks + _block_bytes * column_1, slice.Bytes);
                 }
                 else {
-                    gf256_add_mem(dest, peel0, _block_bytes);
+                    gf256_add_mem(dest, peel0, slice.Bytes);
                 }
             }
             else {
                 CAT_DEBUG_ASSERT(column_1 < _recovery_rows);
-                gf256_add_mem(dest, _recovery_blocks + _block_bytes * column_1, _block_bytes);
+                gf256_add_mem(dest, recovery_blocks + _block_bytes * column_1, slice.Bytes);
             }
             CAT_IF_ROWOP(++rowops;)
 
@@ -2809,14 +2878,14 @@ void Codec::Substitute()
             {
                 const uint16_t column_i = iter.GetColumn();
                 CAT_DEBUG_ASSERT(column_i < _recovery_rows);
-                const uint8_t * GF256_RESTRICT peel_src = _recovery_blocks + _block_bytes * column_i;
+                const uint8_t * GF256_RESTRICT peel_src = recovery_blocks + _block_bytes * column_i;
 
                 CAT_IF_DUMP(cout << " " << column_i;)
 
                 // If column is not the solved one:
                 if (column_i != dest_column_i)
                 {
-                    gf256_add_mem(dest, peel_src, _block_bytes);
+                    gf256_add_mem(dest, peel_src, slice.Bytes);
                     CAT_IF_ROWOP(++rowops;)
                     CAT_IF_DUMP(cout << "[" << (unsigned)peel_src[0] << "]";)
                 }
@@ -2916,6 +2985,7 @@ WirehairResult Codec::SolveMatrix()
     SetDeferredColumns();
     SetMixingColumnsForDeferredRows();
     PeelDiagonal();
+    RunBlockSlices(&Codec::PeelDiagonalValues);
     CopyDeferredRows();
     MultiplyDenseRows();
     SetHeavyRows();
@@ -2953,11 +3023,72 @@ WirehairResult Codec::SolveMatrix()
 
 void Codec::GenerateRecoveryBlocks()
 {
-    InitializeColumnValues();
-    MultiplyDenseValues();
-    AddSubdiagonalValues();
-    BackSubstituteAboveDiagonal();
-    Substitute();
+    MapDenseRows();
+
+    RunBlockSlices(&Codec::GenerateSliceValues);
+}
+
+void Codec::GenerateSliceValues(const BlockSlice& slice)
+{
+    InitializeColumnValues(slice);
+    MultiplyDenseValues(slice);
+    AddSubdiagonalValues(slice);
+    BackSubstituteAboveDiagonal(slice);
+    Substitute(slice);
+}
+
+/// Slices start on a cache line so that threads do not share lines
+static const unsigned kBlockSliceAlignBytes = 64;
+
+/// Recovery sets smaller than this are solved on the calling thread
+static const uint64_t kParallelSolveMinBytes = 1024 * 1024;
+
+void Codec::RunBlockSlices(void (Codec::*pass)(const BlockSlice& slice))
+{
+    unsigned thread_count = _solve_threads;
+    if ((uint64_t)_recovery_rows * _block_bytes < kParallelSolveMinBytes) {
+        thread_count = 1;
+    }
+
+    // Split the blocks into one aligned slice per thread
+    unsigned slice_bytes = (_block_bytes + thread_count - 1) / thread_count;
+    slice_bytes = (slice_bytes + kBlockSliceAlignBytes - 1) & ~(kBlockSliceAlignBytes - 1);
+    const unsigned slice_count = (_block_bytes + slice_bytes - 1) / slice_bytes;
+
+    const unsigned block_bytes = _block_bytes;
+    const unsigned final_bytes = _input_final_bytes;
+
+    auto runSlice = [this, pass, slice_bytes, block_bytes, final_bytes](unsigned slice_i)
+    {
+        BlockSlice slice;
+        slice.Offset = slice_i * slice_bytes;
+        slice.Bytes = block_bytes - slice.Offset;
+        if (slice.Bytes > slice_bytes) {
+            slice.Bytes = slice_bytes;
+        }
+        slice.FinalBytes = 0;
+        if (final_bytes > slice.Offset)
+        {
+            slice.FinalBytes = final_bytes - slice.Offset;
+            if (slice.FinalBytes > slice.Bytes) {
+                slice.FinalBytes = slice.Bytes;
+            }
+        }
+
+        (this->*pass)(slice);
+    };
+
+    std::vector<std::thread> threads;
+
+    // Run the first slice on this thread
+    for (unsigned slice_i = 1; slice_i < slice_count; ++slice_i) {
+        threads.emplace_back(runSlice, slice_i);
+    }
+    runSlice(0);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
 }
 
 WirehairResult Codec::ResumeSolveMatrix(
@@ -4163,6 +4294,146 @@ uint32_t Codec::Encode(
     return copyBytes;
 }
 
+/// Blocks ahead of the one being generated whose inputs are found early
+static const unsigned kEncodeBatchPrefetchBlocks = 4;
+
+/// Inputs are only prefetched from recovery sets too large to stay cached
+static const uint64_t kEncodeBatchPrefetchMinBytes = 2 * 1024 * 1024;
+
+/// Bytes prefetched from the start of each input.  The hardware prefetcher
+/// picks up the rest of a long block once it is being read
+static const unsigned kEncodeBatchPrefetchBytes = 256;
+
+/// Most recovery blocks summed into one block: PeelRowParameters::PeelCount
+/// is at most 64, plus the mixing columns
+static const unsigned kMaxEncodeColumns = 64 + RowMixIterator::kColumnCount;
+
+/// Hint that a block will be read soon
+static GF256_FORCE_INLINE void PrefetchBlock(const uint8_t * data, unsigned bytes)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    for (unsigned offset = 0; offset < bytes; offset += 64) {
+        __builtin_prefetch(data + offset);
+    }
+#else
+    (void)data;
+    (void)bytes;
+#endif
+}
+
+WirehairResult Codec::EncodeBatch(
+    const uint32_t first_id, ///< First block id to generate
+    const unsigned count, ///< Number of blocks to generate
+    uint8_t * GF256_RESTRICT blocks_out, ///< Output for the first block
+    const size_t stride ///< Bytes between output blocks
+)
+{
+    if (!blocks_out || stride < _block_bytes) {
+        return Wirehair_InvalidInput;
+    }
+
+    // Inputs of the next few blocks, found ahead of time so they can be
+    // prefetched while the current block is summed
+    struct BlockInputs
+    {
+        // Original block to copy, or nullptr to sum the rows
+        const uint8_t * Original;
+
+        unsigned RowCount;
+        const uint8_t * Rows[kMaxEncodeColumns];
+    };
+    BlockInputs ahead[kEncodeBatchPrefetchBlocks];
+
+    unsigned prefetch_bytes = 0;
+    if ((uint64_t)_recovery_rows * _block_bytes >= kEncodeBatchPrefetchMinBytes) {
+        prefetch_bytes = (_block_bytes < kEncodeBatchPrefetchBytes) ? _block_bytes : kEncodeBatchPrefetchBytes;
+    }
+
+    auto findInputs = [&](unsigned i)
+    {
+        const uint32_t block_id = first_id + i;
+        BlockInputs& inputs = ahead[i % kEncodeBatchPrefetchBlocks];
+        inputs.Original = nullptr;
+        inputs.RowCount = 0;
+
+#if defined(CAT_COPY_FIRST_N)
+        // For the original message blocks (id < N):
+        if (block_id < _block_count &&
+            !_original_out_of_order)
+        {
+            inputs.Original = _input_blocks + _block_bytes * block_id;
+            PrefetchBlock(inputs.Original, prefetch_bytes);
+            return;
+        }
+#endif // CAT_COPY_FIRST_N
+
+        PeelRowParameters params;
+        params.Initialize(block_id, _p_seed, _block_count, _mix_count);
+
+        PeelRowIterator iter(params, _block_count, _block_next_prime);
+        const RowMixIterator mix(params, _mix_count, _mix_next_prime);
+
+        do {
+            CAT_DEBUG_ASSERT(iter.GetColumn() < _recovery_rows);
+            CAT_DEBUG_ASSERT(inputs.RowCount < kMaxEncodeColumns - RowMixIterator::kColumnCount);
+            inputs.Rows[inputs.RowCount++] = _recovery_blocks + _block_bytes * iter.GetColumn();
+        } while (iter.Iterate());
+
+        for (unsigned j = 0; j < RowMixIterator::kColumnCount; ++j)
+        {
+            CAT_DEBUG_ASSERT((unsigned)(_block_count + mix.Columns[j]) < _recovery_rows);
+            inputs.Rows[inputs.RowCount++] = _recovery_blocks + _block_bytes * (_block_count + mix.Columns[j]);
+        }
+
+        for (unsigned j = 0; j < inputs.RowCount; ++j) {
+            PrefetchBlock(inputs.Rows[j], prefetch_bytes);
+        }
+    };
+
+    for (unsigned i = 0; i < count && i < kEncodeBatchPrefetchBlocks; ++i) {
+        findInputs(i);
+    }
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        const uint32_t block_id = first_id + i;
+        const BlockInputs& inputs = ahead[i % kEncodeBatchPrefetchBlocks];
+        uint8_t * GF256_RESTRICT data_out = blocks_out + stride * i;
+
+        // If this is the last block:
+        const unsigned copyBytes = ((uint16_t)block_id == _block_count - 1) ? _input_final_bytes : _block_bytes;
+
+        if (inputs.Original) {
+            memcpy(data_out, inputs.Original, copyBytes);
+        }
+        else
+        {
+            // There are always at least 4 rows: A peeling column and 3 mixing columns
+            const uint8_t * const * rows = inputs.Rows;
+            const unsigned row_count = inputs.RowCount;
+
+            gf256_addset_mem(data_out, rows[0], rows[1], copyBytes);
+
+            unsigned j = 2;
+            for (; j + 1 < row_count; j += 2) {
+                gf256_add2_mem(data_out, rows[j], rows[j + 1], copyBytes);
+            }
+            if (j < row_count) {
+                gf256_add_mem(data_out, rows[j], copyBytes);
+            }
+        }
+
+        if (copyBytes < _block_bytes) {
+            memset(data_out + copyBytes, 0, _block_bytes - copyBytes);
+        }
+
+        if (i + kEncodeBatchPrefetchBlocks < count) {
+            findInputs(i + kEncodeBatchPrefetchBlocks);
+        }
+    }
+
+    return Wirehair_Success;
+}
 
 //// Decoder Mode
 
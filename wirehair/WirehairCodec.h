@@ -222,8 +222,9 @@ struct PeelRowResult
     /// Set to LIST_TERM if it is deferred for Gaussian elimination
     uint16_t PeelColumn;
 
-    /// Row value is copied yet?
-    uint8_t IsCopied;
+    /// First peeled row whose value was added to this row's value,
+    /// or LIST_TERM if none was, so the row value starts as a copy
+    uint16_t CopiedBy;
 };
 
 union PeelOverlappingFields
@@ -298,6 +299,28 @@ struct PeelRefs
 };
 
 
+//------------------------------------------------------------------------------
+// Block Slices
+
+/**
+    The block values are solved by adding blocks together in an order set
+    by the matrix, and each byte of a block only ever meets the same byte
+    of other blocks.  So the value passes can run separately over slices
+    of the bytes in every block, one slice per thread.
+*/
+struct BlockSlice
+{
+    /// Offset of the slice within each block
+    unsigned Offset;
+
+    /// Number of bytes in the slice
+    unsigned Bytes;
+
+    /// Number of bytes of the final input block within the slice
+    unsigned FinalBytes;
+};
+
+
 //------------------------------------------------------------------------------
 // Codec
 
@@ -339,6 +362,9 @@ class Codec
     /// Next prime number at or above dense count
     uint16_t _mix_next_prime = 0;
 
+    /// Number of threads that solve the block values
+    unsigned _solve_threads = 1;
+
     /// Recovery blocks
     uint8_t * GF256_RESTRICT _recovery_blocks = nullptr;
 
@@ -715,13 +741,29 @@ class Codec
 
         For each peeled row in forward solution order,
             Set mixing column bits for the row in the Compression matrix.
-            Generate row block value.
             For each row that references this row in the peeling matrix,
                 Add Compression matrix row to referencing row.
+                If row is peeled and not added to yet,
+                    Remember that this row is added to it first.
+
+        The block values are generated after by PeelDiagonalValues().
+    */
+    void PeelDiagonal();
+
+    /**
+        PeelDiagonalValues()
+
+        This function generates the temporary block values for the peeled
+        rows within one slice of the blocks, in the same order as the
+        Compression matrix rows were generated by PeelDiagonal().
+
+        For each peeled row in forward solution order,
+            Generate row block value.
+            For each row that references this row in the peeling matrix,
                 If row is peeled,
                     Add row block value.
     */
-    void PeelDiagonal();
+    void PeelDiagonalValues(const BlockSlice& slice);
 
     /**
         CopyDeferredRows()
@@ -1004,6 +1046,15 @@ class Codec
     //--------------------------------------------------------------------------
     // Stage (4) Substitution
 
+    /**
+        MapDenseRows()
+
+        This function stores which column solves each dense/heavy GE row,
+        for MultiplyDenseValues().  Unused dense rows are set to LIST_TERM
+        so they can be ignored later (happens in the decoder for extra rows).
+    */
+    void MapDenseRows();
+
     /**
         InitializeColumnValues()
 
@@ -1019,12 +1070,8 @@ class Codec
             Else it is from a deferred row:
                 For each peeled column that it references:
                     Add in that peeled column's row value from Compression.
-
-        For each remaining unused row, (happens in the decoder for extra rows):
-            If the unused row is a dense row:
-                Set the GE row map entry to LIST_TERM so it can be ignored later.
     */
-    void InitializeColumnValues();
+    void InitializeColumnValues(const BlockSlice& slice);
 
     /**
         MultiplyDenseValues()
@@ -1037,7 +1084,7 @@ class Codec
         See MultiplyDenseRows() comments for justification of the
         design of the dense row structure.
     */
-    void MultiplyDenseValues();
+    void MultiplyDenseValues(const BlockSlice& slice);
 
     /**
         AddSubdiagonalValues()
@@ -1048,7 +1095,7 @@ class Codec
         It is aided by the already roughly upper-triangular form
         of the GE matrix, making this function very cheap to execute.
     */
-    void AddSubdiagonalValues();
+    void AddSubdiagonalValues(const BlockSlice& slice);
 
     /**
         Windowed Back-Substitution
@@ -1124,7 +1171,7 @@ class Codec
         to eliminate all of the bits in the upper triangular half,
         completing solving for these columns.
     */
-    void BackSubstituteAboveDiagonal();
+    void BackSubstituteAboveDiagonal(const BlockSlice& slice);
 
     /**
         Substitute()
@@ -1143,7 +1190,7 @@ class Codec
         are so dense, it is actually faster in every case to just regenerate
         the rows from scratch and throw away those results.
     */
-    void Substitute();
+    void Substitute(const BlockSlice& slice);
 
 
     //--------------------------------------------------------------------------
@@ -1178,6 +1225,7 @@ class Codec
             SetDeferredColumns()
             SetMixingColumnsForDeferredRows()
             PeelDiagonal()
+            PeelDiagonalValues()
 
         Produce the GE matrix:
 
@@ -1208,6 +1256,20 @@ class Codec
         const void * GF256_RESTRICT data ///< Block data
     );
 
+    /**
+        RunBlockSlices()
+
+        This function splits the blocks into cache line aligned slices
+        and runs the given value pass over each, with one thread per slice
+        up to the number of solve threads.  Small recovery sets are run
+        on the calling thread, where starting threads would cost more
+        than they save.
+    */
+    void RunBlockSlices(void (Codec::*pass)(const BlockSlice& slice));
+
+    /// Runs each value pass of GenerateRecoveryBlocks() over one slice
+    void GenerateSliceValues(const BlockSlice& slice);
+
 #if defined(CAT_ALL_ORIGINAL)
     /**
         IsAllOriginalData()
@@ -1245,6 +1307,17 @@ public:
     GF256_FORCE_INLINE uint32_t BlockCount() const { return _block_count; }
 
 
+    //--------------------------------------------------------------------------
+    // Setters
+
+    /// Set the number of threads that solve the block values.
+    /// Defaults to 1, which solves on the calling thread
+    GF256_FORCE_INLINE void SetSolveThreads(unsigned threads)
+    {
+        _solve_threads = threads < 1 ? 1 : threads;
+    }
+
+
     //--------------------------------------------------------------------------
     // Encoder API
 
@@ -1287,6 +1360,24 @@ public:
         uint32_t out_buffer_bytes ///< Output buffer bytes
     );
 
+    /**
+        EncodeBatch()
+
+        This function encodes count blocks with consecutive identifiers,
+        stride bytes apart in the output.  Each output block is a full
+        block: The final block of the message is padded with zeros.
+
+        The columns of each row are generated a few blocks ahead, and for
+        large recovery sets the recovery blocks they name are prefetched,
+        so the sums do not wait on cache misses.
+    */
+    WirehairResult EncodeBatch(
+        const uint32_t first_id, ///< First block id to generate
+        const unsigned count, ///< Number of blocks to generate
+        uint8_t * GF256_RESTRICT blocks_out, ///< Output for the first block
+        const size_t stride ///< Bytes between output blocks
+    );
+
 
     //--------------------------------------------------------------------------
     // Decoder API
@@ -1322,6 +1413,7 @@ public:
 
             Solves across GE matrix rows:
 
+                MapDenseRows()
                 InitializeColumnValues()
                 MultiplyDenseValues()
                 AddSubdiagonalValues()
@@ -1333,6 +1425,9 @@ public:
             Solves remaining columns:
 
                 Substitute()
+
+        All but MapDenseRows() run over slices of the blocks
+        with RunBlockSlices().
     */
     void GenerateRecoveryBlocks();
 
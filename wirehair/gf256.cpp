@@ -60,8 +60,8 @@ static GF256_FORCE_INLINE uint8x16_t vqtbl1q_u8(uint8x16_t a, uint8x16_t b)
 //
 // This is executed during initialization to make sure the library is working
 
-static const unsigned kTestBufferBytes = 32 + 16 + 8 + 4 + 2 + 1;
-static const unsigned kTestBufferAllocated = 64;
+static const unsigned kTestBufferBytes = 64 + 32 + 16 + 8 + 4 + 2 + 1;
+static const unsigned kTestBufferAllocated = 128;
 struct SelfTestBuffersT
 {
     GF256_ALIGNED uint8_t A[kTestBufferAllocated];
@@ -211,13 +211,28 @@ static bool CpuHasNeon64 = false;   // And we don't have ASIMD
     #pragma warning(disable: 4752) // found Intel(R) Advanced Vector Extensions; consider using /arch:AVX
 #endif
 
-#ifdef GF256_TRY_AVX2
-static bool CpuHasAVX2 = false;
-#endif
+// What the CPU and OS support
+static bool CpuSupportsSSSE3 = false;
+static bool CpuSupportsAVX2 = false;
+static bool CpuSupportsAVX512 = false;
+static bool CpuSupportsGFNI = false;
+
+// What the bulk memory operations use: Limited by gf256_set_isa()
 static bool CpuHasSSSE3 = false;
+static bool CpuHasAVX2 = false;
+static bool CpuHasAVX512 = false;
+static bool CpuHasGFNI = false;
+
+#define CPUID_ECX_SSSE3     0x00000200
+#define CPUID_ECX_OSXSAVE   0x08000000
+#define CPUID_EBX_AVX2      0x00000020
+#define CPUID_EBX_AVX512F   0x00010000
+#define CPUID_EBX_AVX512BW  0x40000000
+#define CPUID_ECX_GFNI      0x00000100
 
-#define CPUID_EBX_AVX2    0x00000020
-#define CPUID_ECX_SSSE3   0x00000200
+// Register state the OS saves on context switch
+#define XCR0_YMM            0x00000006
+#define XCR0_ZMM            0x000000e6
 
 static void _cpuid(unsigned int cpu_info[4U], const unsigned int cpu_info_type)
 {
@@ -256,6 +271,17 @@ static void _cpuid(unsigned int cpu_info[4U], const unsigned int cpu_info_type)
 #endif
 }
 
+static uint64_t _xgetbv0()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0U));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
 #else
 #if defined(LINUX_ARM)
 static void checkLinuxARMNeonCapabilities( bool& cpuHasNeon )
@@ -314,12 +340,34 @@ static void gf256_architecture_init()
     unsigned int cpu_info[4];
 
     _cpuid(cpu_info, 1);
-    CpuHasSSSE3 = ((cpu_info[2] & CPUID_ECX_SSSE3) != 0);
+    CpuSupportsSSSE3 = ((cpu_info[2] & CPUID_ECX_SSSE3) != 0);
 
-#if defined(GF256_TRY_AVX2)
-    _cpuid(cpu_info, 7);
-    CpuHasAVX2 = ((cpu_info[1] & CPUID_EBX_AVX2) != 0);
-#endif // GF256_TRY_AVX2
+    // The OS must save the wider registers too
+    uint64_t xcr0 = 0;
+    if ((cpu_info[2] & CPUID_ECX_OSXSAVE) != 0)
+        xcr0 = _xgetbv0();
+
+    _cpuid(cpu_info, 0);
+    if (cpu_info[0] >= 7)
+    {
+        _cpuid(cpu_info, 7);
+        CpuSupportsAVX2 = ((cpu_info[1] & CPUID_EBX_AVX2) != 0) &&
+            ((xcr0 & XCR0_YMM) == XCR0_YMM);
+#if defined(GF256_TRY_AVX512)
+        const unsigned avx512 = CPUID_EBX_AVX512F | CPUID_EBX_AVX512BW;
+        CpuSupportsAVX512 = CpuSupportsAVX2 && ((cpu_info[1] & avx512) == avx512) &&
+            ((xcr0 & XCR0_ZMM) == XCR0_ZMM);
+#endif // GF256_TRY_AVX512
+#if defined(GF256_TRY_GFNI)
+        // The GFNI code uses 256-bit registers at least
+        CpuSupportsGFNI = CpuSupportsAVX2 && ((cpu_info[2] & CPUID_ECX_GFNI) != 0);
+#endif // GF256_TRY_GFNI
+    }
+
+    CpuHasSSSE3 = CpuSupportsSSSE3;
+    CpuHasAVX2 = CpuSupportsAVX2;
+    CpuHasAVX512 = CpuSupportsAVX512;
+    CpuHasGFNI = CpuSupportsGFNI;
 
     // When AVX2 and SSSE3 are unavailable, Siamese takes 4x longer to decode
     // and 2.6x longer to encode.  Encoding requires a lot more simple XOR ops
@@ -572,16 +620,37 @@ static void gf256_mul_mem_init()
         _mm_storeu_si128(GF256Ctx.MM128.TABLE_LO_Y + y, table_lo);
         _mm_storeu_si128(GF256Ctx.MM128.TABLE_HI_Y + y, table_hi);
 # ifdef GF256_TRY_AVX2
-        if (CpuHasAVX2)
-        {
-            const GF256_M256 table_lo2 = _mm256_broadcastsi128_si256(table_lo);
-            const GF256_M256 table_hi2 = _mm256_broadcastsi128_si256(table_hi);
-            _mm256_storeu_si256(GF256Ctx.MM256.TABLE_LO_Y + y, table_lo2);
-            _mm256_storeu_si256(GF256Ctx.MM256.TABLE_HI_Y + y, table_hi2);
-        }
+        // Same table in both 128-bit lanes.  Filled in even without AVX2,
+        // since the instruction set can change after initialization
+        uint8_t* lo2 = reinterpret_cast<uint8_t*>(GF256Ctx.MM256.TABLE_LO_Y + y);
+        uint8_t* hi2 = reinterpret_cast<uint8_t*>(GF256Ctx.MM256.TABLE_HI_Y + y);
+        memcpy(lo2, lo, 16);
+        memcpy(lo2 + 16, lo, 16);
+        memcpy(hi2, hi, 16);
+        memcpy(hi2 + 16, hi, 16);
 # endif // GF256_TRY_AVX2
 #endif // GF256_TARGET_MOBILE
     }
+
+#ifdef GF256_TRY_GFNI
+    /*
+        GF2P8AFFINEQB computes bit i of each output byte as the parity of
+        the input byte AND matrix byte (7 - i).  Multiplying by y is linear
+        over GF(2), so bit j of that matrix byte is bit i of (1 << j) * y.
+    */
+    for (int y = 0; y < 256; ++y)
+    {
+        uint64_t matrix = 0;
+        for (unsigned i = 0; i < 8; ++i)
+        {
+            uint64_t row = 0;
+            for (unsigned j = 0; j < 8; ++j)
+                row |= (uint64_t)((gf256_mul(static_cast<uint8_t>(1 << j), static_cast<uint8_t>(y)) >> i) & 1) << j;
+            matrix |= row << (8 * (7 - i));
+        }
+        GF256Ctx.GF256_AFFINE_TABLE[y] = matrix;
+    }
+#endif // GF256_TRY_GFNI
 }
 
 
@@ -632,6 +701,585 @@ extern "C" int gf256_init_(int version)
 }
 
 
+//------------------------------------------------------------------------------
+// Instruction Sets
+
+extern "C" int gf256_get_isa(void)
+{
+#if defined(GF256_TARGET_MOBILE)
+# if defined(GF256_TRY_NEON)
+    if (CpuHasNeon)
+        return GF256_ISA_NEON;
+# endif // GF256_TRY_NEON
+    return GF256_ISA_SCALAR;
+#else // GF256_TARGET_MOBILE
+    if (CpuHasGFNI)
+        return GF256_ISA_GFNI;
+    if (CpuHasAVX512)
+        return GF256_ISA_AVX512;
+    if (CpuHasAVX2)
+        return GF256_ISA_AVX2;
+    if (CpuHasSSSE3)
+        return GF256_ISA_SSSE3;
+    return GF256_ISA_SCALAR;
+#endif // GF256_TARGET_MOBILE
+}
+
+extern "C" int gf256_set_isa(int isa)
+{
+#if !defined(GF256_TARGET_MOBILE)
+    CpuHasSSSE3 = CpuSupportsSSSE3 && isa >= GF256_ISA_SSSE3;
+    CpuHasAVX2 = CpuSupportsAVX2 && isa >= GF256_ISA_AVX2;
+    CpuHasAVX512 = CpuSupportsAVX512 && isa >= GF256_ISA_AVX512;
+    CpuHasGFNI = CpuSupportsGFNI && isa >= GF256_ISA_GFNI;
+#else // GF256_TARGET_MOBILE
+    (void)isa;
+#endif // GF256_TARGET_MOBILE
+    return gf256_get_isa();
+}
+
+extern "C" const char* gf256_isa_name(int isa)
+{
+    switch (isa)
+    {
+    case GF256_ISA_SCALAR: return "Scalar";
+    case GF256_ISA_SSSE3: return "SSSE3";
+    case GF256_ISA_AVX2: return "AVX2";
+    case GF256_ISA_AVX512: return "AVX-512BW";
+    case GF256_ISA_GFNI: return "GFNI";
+    case GF256_ISA_NEON: return "NEON";
+    default: break;
+    }
+    return "Unknown";
+}
+
+
+//------------------------------------------------------------------------------
+// Wide x86 Kernels
+//
+// Each is compiled for its instruction set whatever the compiler targets, and
+// is only called once gf256_architecture_init() finds the CPU supports it.
+// They return the number of bytes processed, a multiple of the register size,
+// and leave the rest to the narrower code in the operations below.
+
+#if !defined(GF256_TARGET_MOBILE)
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #define GF256_TARGET(isa) /* MSVC allows any intrinsic */
+#else
+    #define GF256_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#define GF256_TARGET_SSSE3   GF256_TARGET("ssse3")
+#define GF256_TARGET_AVX2    GF256_TARGET("avx2")
+#define GF256_TARGET_AVX512  GF256_TARGET("avx512f,avx512bw")
+#define GF256_TARGET_GFNI256 GF256_TARGET("avx2,gfni")
+#define GF256_TARGET_GFNI512 GF256_TARGET("avx512f,avx512bw,gfni")
+
+// z[] = x[] * y
+static GF256_TARGET_SSSE3 int gf256_mul_mem_ssse3(void * GF256_RESTRICT vz,
+                                                 const void * GF256_RESTRICT vx, uint8_t y, int bytes)
+{
+    GF256_M128 * GF256_RESTRICT z16 = reinterpret_cast<GF256_M128 *>(vz);
+    const GF256_M128 * GF256_RESTRICT x16 = reinterpret_cast<const GF256_M128 *>(vx);
+    const int original = bytes;
+
+    // Partial product tables; see above
+    const GF256_M128 table_lo_y = _mm_loadu_si128(GF256Ctx.MM128.TABLE_LO_Y + y);
+    const GF256_M128 table_hi_y = _mm_loadu_si128(GF256Ctx.MM128.TABLE_HI_Y + y);
+
+    // clr_mask = 0x0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f
+    const GF256_M128 clr_mask = _mm_set1_epi8(0x0f);
+
+    // Handle multiples of 16 bytes
+    do
+    {
+        // See above comments for details
+        GF256_M128 x0 = _mm_loadu_si128(x16);
+        GF256_M128 l0 = _mm_and_si128(x0, clr_mask);
+        x0 = _mm_srli_epi64(x0, 4);
+        GF256_M128 h0 = _mm_and_si128(x0, clr_mask);
+        l0 = _mm_shuffle_epi8(table_lo_y, l0);
+        h0 = _mm_shuffle_epi8(table_hi_y, h0);
+        _mm_storeu_si128(z16, _mm_xor_si128(l0, h0));
+
+        bytes -= 16, ++x16, ++z16;
+    } while (bytes >= 16);
+
+    return original - bytes;
+}
+
+// z[] += x[] * y
+static GF256_TARGET_SSSE3 int gf256_muladd_mem_ssse3(void * GF256_RESTRICT vz, uint8_t y,
+                                                    const void * GF256_RESTRICT vx, int bytes)
+{
+    GF256_M128 * GF256_RESTRICT z16 = reinterpret_cast<GF256_M128 *>(vz);
+    const GF256_M128 * GF256_RESTRICT x16 = reinterpret_cast<const GF256_M128 *>(vx);
+    const int original = bytes;
+
+    // Partial product tables; see above
+    const GF256_M128 table_lo_y = _mm_loadu_si128(GF256Ctx.MM128.TABLE_LO_Y + y);
+    const GF256_M128 table_hi_y = _mm_loadu_si128(GF256Ctx.MM128.TABLE_HI_Y + y);
+
+    // clr_mask = 0x0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f
+    const GF256_M128 clr_mask = _mm_set1_epi8(0x0f);
+
+    // This unroll seems to provide about 7% speed boost when AVX2 is disabled
+    while (bytes >= 32)
+    {
+        bytes -= 32;
+
+        GF256_M128 x1 = _mm_loadu_si128(x16 + 1);
+        GF256_M128 l1 = _mm_and_si128(x1, clr_mask);
+        x1 = _mm_srli_epi64(x1, 4);
+        GF256_M128 h1 = _mm_and_si128(x1, clr_mask);
+        l1 = _mm_shuffle_epi8(table_lo_y, l1);
+        h1 = _mm_shuffle_epi8(table_hi_y, h1);
+        const GF256_M128 z1 = _mm_loadu_si128(z16 + 1);
+
+        GF256_M128 x0 = _mm_loadu_si128(x16);
+        GF256_M128 l0 = _mm_and_si128(x0, clr_mask);
+        x0 = _mm_srli_epi64(x0, 4);
+        GF256_M128 h0 = _mm_and_si128(x0, clr_mask);
+        l0 = _mm_shuffle_epi8(table_lo_y, l0);
+        h0 = _mm_shuffle_epi8(table_hi_y, h0);
+        const GF256_M128 z0 = _mm_loadu_si128(z16);
+
+        const GF256_M128 p1 = _mm_xor_si128(l1, h1);
+        _mm_storeu_si128(z16 + 1, _mm_xor_si128(p1, z1));
+
+        const GF256_M128 p0 = _mm_xor_si128(l0, h0);
+        _mm_storeu_si128(z16, _mm_xor_si128(p0, z0));
+
+        x16 += 2, z16 += 2;
+    }
+
+    // Handle multiples of 16 bytes
+    while (bytes >= 16)
+    {
+        // See above comments for details
+        GF256_M128 x0 = _mm_loadu_si128(x16);
+        GF256_M128 l0 = _mm_and_si128(x0, clr_mask);
+        x0 = _mm_srli_epi64(x0, 4);
+        GF256_M128 h0 = _mm_and_si128(x0, clr_mask);
+        l0 = _mm_shuffle_epi8(table_lo_y, l0);
+        h0 = _mm_shuffle_epi8(table_hi_y, h0);
+        const GF256_M128 p0 = _mm_xor_si128(l0, h0);
+        const GF256_M128 z0 = _mm_loadu_si128(z16);
+        _mm_storeu_si128(z16, _mm_xor_si128(p0, z0));
+
+        bytes -= 16, ++x16, ++z16;
+    }
+
+    return original - bytes;
+}
+
+// x[] += y[]
+static GF256_TARGET_AVX2 int gf256_add_mem_avx2(void * GF256_RESTRICT vx,
+                                                const void * GF256_RESTRICT vy, int bytes)
+{
+    GF256_M256 * GF256_RESTRICT x32 = reinterpret_cast<GF256_M256 *>(vx);
+    const GF256_M256 * GF256_RESTRICT y32 = reinterpret_cast<const GF256_M256 *>(vy);
+    const int original = bytes;
+
+    while (bytes >= 128)
+    {
+        GF256_M256 x0 = _mm256_loadu_si256(x32);
+        GF256_M256 y0 = _mm256_loadu_si256(y32);
+        x0 = _mm256_xor_si256(x0, y0);
+        GF256_M256 x1 = _mm256_loadu_si256(x32 + 1);
+        GF256_M256 y1 = _mm256_loadu_si256(y32 + 1);
+        x1 = _mm256_xor_si256(x1, y1);
+        GF256_M256 x2 = _mm256_loadu_si256(x32 + 2);
+        GF256_M256 y2 = _mm256_loadu_si256(y32 + 2);
+        x2 = _mm256_xor_si256(x2, y2);
+        GF256_M256 x3 = _mm256_loadu_si256(x32 + 3);
+        GF256_M256 y3 = _mm256_loadu_si256(y32 + 3);
+        x3 = _mm256_xor_si256(x3, y3);
+
+        _mm256_storeu_si256(x32, x0);
+        _mm256_storeu_si256(x32 + 1, x1);
+        _mm256_storeu_si256(x32 + 2, x2);
+        _mm256_storeu_si256(x32 + 3, x3);
+
+        bytes -= 128, x32 += 4, y32 += 4;
+    }
+
+    // Handle multiples of 32 bytes
+    while (bytes >= 32)
+    {
+        // x[i] = x[i] xor y[i]
+        _mm256_storeu_si256(x32,
+            _mm256_xor_si256(
+                _mm256_loadu_si256(x32),
+                _mm256_loadu_si256(y32)));
+
+        bytes -= 32, ++x32, ++y32;
+    }
+
+    return original - bytes;
+}
+
+// z[] += x[] + y[]
+static GF256_TARGET_AVX2 int gf256_add2_mem_avx2(void * GF256_RESTRICT vz, const void * GF256_RESTRICT vx,
+                                                 const void * GF256_RESTRICT vy, int bytes)
+{
+    GF256_M256 * GF256_RESTRICT z32 = reinterpret_cast<GF256_M256 *>(vz);
+    const GF256_M256 * GF256_RESTRICT x32 = reinterpret_cast<const GF256_M256 *>(vx);
+    const GF256_M256 * GF256_RESTRICT y32 = reinterpret_cast<const GF256_M256 *>(vy);
+
+    const int count = bytes / 32;
+    for (int i = 0; i < count; ++i)
+    {
+        _mm256_storeu_si256(z32 + i,
+            _mm256_xor_si256(
+                _mm256_loadu_si256(z32 + i),
+                _mm256_xor_si256(
+                    _mm256_loadu_si256(x32 + i),
+                    _mm256_loadu_si256(y32 + i))));
+    }
+
+    return count * 32;
+}
+
+// z[] = x[] + y[]
+static GF256_TARGET_AVX2 int gf256_addset_mem_avx2(void * GF256_RESTRICT vz, const void * GF256_RESTRICT vx,
+                                                   const void * GF256_RESTRICT vy, int bytes)
+{
+    GF256_M256 * GF256_RESTRICT z32 = reinterpret_cast<GF256_M256 *>(vz);
+    const GF256_M256 * GF256_RESTRICT x32 = reinterpret_cast<const GF256_M256 *>(vx);
+    const GF256_M256 * GF256_RESTRICT y32 = reinterpret_cast<const GF256_M256 *>(vy);
+
+    const int count = bytes / 32;
+    for (int i = 0; i < count; ++i)
+    {
+        _mm256_storeu_si256(z32 + i,
+            _mm256_xor_si256(
+                _mm256_loadu_si256(x32 + i),
+                _mm256_loadu_si256(y32 + i)));
+    }
+
+    return count * 32;
+}
+
+// z[] = x[] * y
+static GF256_TARGET_AVX2 int gf256_mul_mem_avx2(void * GF256_RESTRICT vz,
+                                                const void * GF256_RESTRICT vx, uint8_t y, int bytes)
+{
+    // Partial product tables; see above
+    const GF256_M256 table_lo_y = _mm256_loadu_si256(GF256Ctx.MM256.TABLE_LO_Y + y);
+    const GF256_M256 table_hi_y = _mm256_loadu_si256(GF256Ctx.MM256.TABLE_HI_Y + y);
+
+    // clr_mask = 0x0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f
+    const GF256_M256 clr_mask = _mm256_set1_epi8(0x0f);
+
+    GF256_M256 * GF256_RESTRICT z32 = reinterpret_cast<GF256_M256 *>(vz);
+    const GF256_M256 * GF256_RESTRICT x32 = reinterpret_cast<const GF256_M256 *>(vx);
+
+    // Handle multiples of 32 bytes
+    const int count = bytes / 32;
+    for (int i = 0; i < count; ++i)
+    {
+        // See above comments for details
+        GF256_M256 x0 = _mm256_loadu_si256(x32 + i);
+        GF256_M256 l0 = _mm256_and_si256(x0, clr_mask);
+        x0 = _mm256_srli_epi64(x0, 4);
+        GF256_M256 h0 = _mm256_and_si256(x0, clr_mask);
+        l0 = _mm256_shuffle_epi8(table_lo_y, l0);
+        h0 = _mm256_shuffle_epi8(table_hi_y, h0);
+        _mm256_storeu_si256(z32 + i, _mm256_xor_si256(l0, h0));
+    }
+
+    return count * 32;
+}
+
+// z[] += x[] * y
+static GF256_TARGET_AVX2 int gf256_muladd_mem_avx2(void * GF256_RESTRICT vz, uint8_t y,
+                                                   const void * GF256_RESTRICT vx, int bytes)
+{
+    // Partial product tables; see above
+    const GF256_M256 table_lo_y = _mm256_loadu_si256(GF256Ctx.MM256.TABLE_LO_Y + y);
+    const GF256_M256 table_hi_y = _mm256_loadu_si256(GF256Ctx.MM256.TABLE_HI_Y + y);
+
+    // clr_mask = 0x0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f
+    const GF256_M256 clr_mask = _mm256_set1_epi8(0x0f);
+
+    GF256_M256 * GF256_RESTRICT z32 = reinterpret_cast<GF256_M256 *>(vz);
+    const GF256_M256 * GF256_RESTRICT x32 = reinterpret_cast<const GF256_M256 *>(vx);
+    const int original = bytes;
+
+    // On my Reed Solomon codec, the encoder unit test runs in 640 usec without and 550 usec with the optimization (86% of the original time)
+    const int count = bytes / 64;
+    for (int i = 0; i < count; ++i)
+    {
+        // See above comments for details
+        GF256_M256 x0 = _mm256_loadu_si256(x32 + i * 2);
+        GF256_M256 l0 = _mm256_and_si256(x0, clr_mask);
+        x0 = _mm256_srli_epi64(x0, 4);
+        const GF256_M256 z0 = _mm256_loadu_si256(z32 + i * 2);
+        GF256_M256 h0 = _mm256_and_si256(x0, clr_mask);
+        l0 = _mm256_shuffle_epi8(table_lo_y, l0);
+        h0 = _mm256_shuffle_epi8(table_hi_y, h0);
+        const GF256_M256 p0 = _mm256_xor_si256(l0, h0);
+        _mm256_storeu_si256(z32 + i * 2, _mm256_xor_si256(p0, z0));
+
+        GF256_M256 x1 = _mm256_loadu_si256(x32 + i * 2 + 1);
+        GF256_M256 l1 = _mm256_and_si256(x1, clr_mask);
+        x1 = _mm256_srli_epi64(x1, 4);
+        const GF256_M256 z1 = _mm256_loadu_si256(z32 + i * 2 + 1);
+        GF256_M256 h1 = _mm256_and_si256(x1, clr_mask);
+        l1 = _mm256_shuffle_epi8(table_lo_y, l1);
+        h1 = _mm256_shuffle_epi8(table_hi_y, h1);
+        const GF256_M256 p1 = _mm256_xor_si256(l1, h1);
+        _mm256_storeu_si256(z32 + i * 2 + 1, _mm256_xor_si256(p1, z1));
+    }
+    bytes -= count * 64;
+    z32 += count * 2;
+    x32 += count * 2;
+
+    if (bytes >= 32)
+    {
+        GF256_M256 x0 = _mm256_loadu_si256(x32);
+        GF256_M256 l0 = _mm256_and_si256(x0, clr_mask);
+        x0 = _mm256_srli_epi64(x0, 4);
+        GF256_M256 h0 = _mm256_and_si256(x0, clr_mask);
+        l0 = _mm256_shuffle_epi8(table_lo_y, l0);
+        h0 = _mm256_shuffle_epi8(table_hi_y, h0);
+        const GF256_M256 p0 = _mm256_xor_si256(l0, h0);
+        const GF256_M256 z0 = _mm256_loadu_si256(z32);
+        _mm256_storeu_si256(z32, _mm256_xor_si256(p0, z0));
+        bytes -= 32;
+    }
+
+    return original - bytes;
+}
+
+#if defined(GF256_TRY_AVX512)
+
+#if defined(__GNUC__) && !defined(__clang__)
+    // GCC 12 warns about _mm512_undefined_epi32() inside its own intrinsics
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    #pragma GCC diagnostic ignored "-Wuninitialized"
+#endif
+
+// x[] += y[]
+static GF256_TARGET_AVX512 int gf256_add_mem_avx512(void * GF256_RESTRICT vx,
+                                                    const void * GF256_RESTRICT vy, int bytes)
+{
+    GF256_M512 * GF256_RESTRICT x64 = reinterpret_cast<GF256_M512 *>(vx);
+    const GF256_M512 * GF256_RESTRICT y64 = reinterpret_cast<const GF256_M512 *>(vy);
+
+    const int count = bytes / 64;
+    for (int i = 0; i < count; ++i)
+    {
+        _mm512_storeu_si512(x64 + i,
+            _mm512_xor_si512(
+                _mm512_loadu_si512(x64 + i),
+                _mm512_loadu_si512(y64 + i)));
+    }
+
+    return count * 64;
+}
+
+// z[] += x[] + y[]
+static GF256_TARGET_AVX512 int gf256_add2_mem_avx512(void * GF256_RESTRICT vz, const void * GF256_RESTRICT vx,
+                                                     const void * GF256_RESTRICT vy, int bytes)
+{
+    GF256_M512 * GF256_RESTRICT z64 = reinterpret_cast<GF256_M512 *>(vz);
+    const GF256_M512 * GF256_RESTRICT x64 = reinterpret_cast<const GF256_M512 *>(vx);
+    const GF256_M512 * GF256_RESTRICT y64 = reinterpret_cast<const GF256_M512 *>(vy);
+
+    const int count = bytes / 64;
+    for (int i = 0; i < count; ++i)
+    {
+        // 0x96: Three-way XOR
+        _mm512_storeu_si512(z64 + i,
+            _mm512_ternarylogic_epi64(
+                _mm512_loadu_si512(z64 + i),
+                _mm512_loadu_si512(x64 + i),
+                _mm512_loadu_si512(y64 + i), 0x96));
+    }
+
+    return count * 64;
+}
+
+// z[] = x[] + y[]
+static GF256_TARGET_AVX512 int gf256_addset_mem_avx512(void * GF256_RESTRICT vz, const void * GF256_RESTRICT vx,
+                                                       const void * GF256_RESTRICT vy, int bytes)
+{
+    GF256_M512 * GF256_RESTRICT z64 = reinterpret_cast<GF256_M512 *>(vz);
+    const GF256_M512 * GF256_RESTRICT x64 = reinterpret_cast<const GF256_M512 *>(vx);
+    const GF256_M512 * GF256_RESTRICT y64 = reinterpret_cast<const GF256_M512 *>(vy);
+
+    const int count = bytes / 64;
+    for (int i = 0; i < count; ++i)
+    {
+        _mm512_storeu_si512(z64 + i,
+            _mm512_xor_si512(
+                _mm512_loadu_si512(x64 + i),
+                _mm512_loadu_si512(y64 + i)));
+    }
+
+    return count * 64;
+}
+
+// z[] = x[] * y
+static GF256_TARGET_AVX512 int gf256_mul_mem_avx512(void * GF256_RESTRICT vz,
+                                                    const void * GF256_RESTRICT vx, uint8_t y, int bytes)
+{
+    // Partial product tables in all four 128-bit lanes; see above
+    const GF256_M512 table_lo_y = _mm512_broadcast_i32x4(_mm_loadu_si128(GF256Ctx.MM128.TABLE_LO_Y + y));
+    const GF256_M512 table_hi_y = _mm512_broadcast_i32x4(_mm_loadu_si128(GF256Ctx.MM128.TABLE_HI_Y + y));
+
+    const GF256_M512 clr_mask = _mm512_set1_epi8(0x0f);
+
+    GF256_M512 * GF256_RESTRICT z64 = reinterpret_cast<GF256_M512 *>(vz);
+    const GF256_M512 * GF256_RESTRICT x64 = reinterpret_cast<const GF256_M512 *>(vx);
+
+    const int count = bytes / 64;
+    for (int i = 0; i < count; ++i)
+    {
+        // See above comments for details
+        GF256_M512 x0 = _mm512_loadu_si512(x64 + i);
+        GF256_M512 l0 = _mm512_and_si512(x0, clr_mask);
+        x0 = _mm512_srli_epi64(x0, 4);
+        GF256_M512 h0 = _mm512_and_si512(x0, clr_mask);
+        l0 = _mm512_shuffle_epi8(table_lo_y, l0);
+        h0 = _mm512_shuffle_epi8(table_hi_y, h0);
+        _mm512_storeu_si512(z64 + i, _mm512_xor_si512(l0, h0));
+    }
+
+    return count * 64;
+}
+
+// z[] += x[] * y
+static GF256_TARGET_AVX512 int gf256_muladd_mem_avx512(void * GF256_RESTRICT vz, uint8_t y,
+                                                       const void * GF256_RESTRICT vx, int bytes)
+{
+    // Partial product tables in all four 128-bit lanes; see above
+    const GF256_M512 table_lo_y = _mm512_broadcast_i32x4(_mm_loadu_si128(GF256Ctx.MM128.TABLE_LO_Y + y));
+    const GF256_M512 table_hi_y = _mm512_broadcast_i32x4(_mm_loadu_si128(GF256Ctx.MM128.TABLE_HI_Y + y));
+
+    const GF256_M512 clr_mask = _mm512_set1_epi8(0x0f);
+
+    GF256_M512 * GF256_RESTRICT z64 = reinterpret_cast<GF256_M512 *>(vz);
+    const GF256_M512 * GF256_RESTRICT x64 = reinterpret_cast<const GF256_M512 *>(vx);
+
+    const int count = bytes / 64;
+    for (int i = 0; i < count; ++i)
+    {
+        // See above comments for details
+        GF256_M512 x0 = _mm512_loadu_si512(x64 + i);
+        GF256_M512 l0 = _mm512_and_si512(x0, clr_mask);
+        x0 = _mm512_srli_epi64(x0, 4);
+        GF256_M512 h0 = _mm512_and_si512(x0, clr_mask);
+        l0 = _mm512_shuffle_epi8(table_lo_y, l0);
+        h0 = _mm512_shuffle_epi8(table_hi_y, h0);
+
+        // z[i] = z[i] xor lo xor hi
+        _mm512_storeu_si512(z64 + i,
+            _mm512_ternarylogic_epi64(_mm512_loadu_si512(z64 + i), l0, h0, 0x96));
+    }
+
+    return count * 64;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC diagnostic pop
+#endif
+
+#endif // GF256_TRY_AVX512
+
+#if defined(GF256_TRY_GFNI)
+
+/*
+    GF2P8AFFINEQB multiplies each byte by an 8x8 bit matrix, which does the
+    whole multiply by y in one instruction with no table lookups.
+    See gf256_mul_mem_init() for the matrices.
+*/
+
+// z[] = x[] * y
+static GF256_TARGET_GFNI256 int gf256_mul_mem_gfni256(void * GF256_RESTRICT vz,
+                                                      const void * GF256_RESTRICT vx, uint8_t y, int bytes)
+{
+    const GF256_M256 matrix = _mm256_set1_epi64x((long long)GF256Ctx.GF256_AFFINE_TABLE[y]);
+
+    GF256_M256 * GF256_RESTRICT z32 = reinterpret_cast<GF256_M256 *>(vz);
+    const GF256_M256 * GF256_RESTRICT x32 = reinterpret_cast<const GF256_M256 *>(vx);
+
+    const int count = bytes / 32;
+    for (int i = 0; i < count; ++i)
+    {
+        _mm256_storeu_si256(z32 + i,
+            _mm256_gf2p8affine_epi64_epi8(_mm256_loadu_si256(x32 + i), matrix, 0));
+    }
+
+    return count * 32;
+}
+
+// z[] += x[] * y
+static GF256_TARGET_GFNI256 int gf256_muladd_mem_gfni256(void * GF256_RESTRICT vz, uint8_t y,
+                                                         const void * GF256_RESTRICT vx, int bytes)
+{
+    const GF256_M256 matrix = _mm256_set1_epi64x((long long)GF256Ctx.GF256_AFFINE_TABLE[y]);
+
+    GF256_M256 * GF256_RESTRICT z32 = reinterpret_cast<GF256_M256 *>(vz);
+    const GF256_M256 * GF256_RESTRICT x32 = reinterpret_cast<const GF256_M256 *>(vx);
+
+    const int count = bytes / 32;
+    for (int i = 0; i < count; ++i)
+    {
+        const GF256_M256 p0 = _mm256_gf2p8affine_epi64_epi8(_mm256_loadu_si256(x32 + i), matrix, 0);
+        _mm256_storeu_si256(z32 + i, _mm256_xor_si256(_mm256_loadu_si256(z32 + i), p0));
+    }
+
+    return count * 32;
+}
+
+// z[] = x[] * y
+static GF256_TARGET_GFNI512 int gf256_mul_mem_gfni512(void * GF256_RESTRICT vz,
+                                                      const void * GF256_RESTRICT vx, uint8_t y, int bytes)
+{
+    const GF256_M512 matrix = _mm512_set1_epi64((long long)GF256Ctx.GF256_AFFINE_TABLE[y]);
+
+    GF256_M512 * GF256_RESTRICT z64 = reinterpret_cast<GF256_M512 *>(vz);
+    const GF256_M512 * GF256_RESTRICT x64 = reinterpret_cast<const GF256_M512 *>(vx);
+
+    const int count = bytes / 64;
+    for (int i = 0; i < count; ++i)
+    {
+        _mm512_storeu_si512(z64 + i,
+            _mm512_gf2p8affine_epi64_epi8(_mm512_loadu_si512(x64 + i), matrix, 0));
+    }
+
+    return count * 64;
+}
+
+// z[] += x[] * y
+static GF256_TARGET_GFNI512 int gf256_muladd_mem_gfni512(void * GF256_RESTRICT vz, uint8_t y,
+                                                         const void * GF256_RESTRICT vx, int bytes)
+{
+    const GF256_M512 matrix = _mm512_set1_epi64((long long)GF256Ctx.GF256_AFFINE_TABLE[y]);
+
+    GF256_M512 * GF256_RESTRICT z64 = reinterpret_cast<GF256_M512 *>(vz);
+    const GF256_M512 * GF256_RESTRICT x64 = reinterpret_cast<const GF256_M512 *>(vx);
+
+    const int count = bytes / 64;
+    for (int i = 0; i < count; ++i)
+    {
+        const GF256_M512 p0 = _mm512_gf2p8affine_epi64_epi8(_mm512_loadu_si512(x64 + i), matrix, 0);
+        _mm512_storeu_si512(z64 + i, _mm512_xor_si512(_mm512_loadu_si512(z64 + i), p0));
+    }
+
+    return count * 64;
+}
+
+#endif // GF256_TRY_GFNI
+
+#endif // GF256_TARGET_MOBILE
+
+
 //------------------------------------------------------------------------------
 // Operations
 
@@ -692,52 +1340,19 @@ extern "C" void gf256_add_mem(void * GF256_RESTRICT vx,
         bytes -= (count * 8);
     }
 #else // GF256_TARGET_MOBILE
-# if defined(GF256_TRY_AVX2)
     if (CpuHasAVX2)
     {
-        GF256_M256 * GF256_RESTRICT x32 = reinterpret_cast<GF256_M256 *>(x16);
-        const GF256_M256 * GF256_RESTRICT y32 = reinterpret_cast<const GF256_M256 *>(y16);
-
-        while (bytes >= 128)
-        {
-            GF256_M256 x0 = _mm256_loadu_si256(x32);
-            GF256_M256 y0 = _mm256_loadu_si256(y32);
-            x0 = _mm256_xor_si256(x0, y0);
-            GF256_M256 x1 = _mm256_loadu_si256(x32 + 1);
-            GF256_M256 y1 = _mm256_loadu_si256(y32 + 1);
-            x1 = _mm256_xor_si256(x1, y1);
-            GF256_M256 x2 = _mm256_loadu_si256(x32 + 2);
-            GF256_M256 y2 = _mm256_loadu_si256(y32 + 2);
-            x2 = _mm256_xor_si256(x2, y2);
-            GF256_M256 x3 = _mm256_loadu_si256(x32 + 3);
-            GF256_M256 y3 = _mm256_loadu_si256(y32 + 3);
-            x3 = _mm256_xor_si256(x3, y3);
-
-            _mm256_storeu_si256(x32, x0);
-            _mm256_storeu_si256(x32 + 1, x1);
-            _mm256_storeu_si256(x32 + 2, x2);
-            _mm256_storeu_si256(x32 + 3, x3);
-
-            bytes -= 128, x32 += 4, y32 += 4;
-        }
-
-        // Handle multiples of 32 bytes
-        while (bytes >= 32)
-        {
-            // x[i] = x[i] xor y[i]
-            _mm256_storeu_si256(x32,
-                _mm256_xor_si256(
-                    _mm256_loadu_si256(x32),
-                    _mm256_loadu_si256(y32)));
-
-            bytes -= 32, ++x32, ++y32;
-        }
-
-        x16 = reinterpret_cast<GF256_M128 *>(x32);
-        y16 = reinterpret_cast<const GF256_M128 *>(y32);
+        int done = 0;
+# if defined(GF256_TRY_AVX512)
+        if (CpuHasAVX512)
+            done = gf256_add_mem_avx512(x16, y16, bytes);
+# endif // GF256_TRY_AVX512
+        done += gf256_add_mem_avx2(x16 + done / 16, y16 + done / 16, bytes - done);
+
+        bytes -= done, x16 += done / 16, y16 += done / 16;
     }
-    else
-# endif // GF256_TRY_AVX2
+
+    if (CpuHasSSSE3)
     {
         while (bytes >= 64)
         {
@@ -761,22 +1376,34 @@ extern "C" void gf256_add_mem(void * GF256_RESTRICT vx,
 
             bytes -= 64, x16 += 4, y16 += 4;
         }
-    }
-#endif // GF256_TARGET_MOBILE
 
-#if !defined(GF256_TARGET_MOBILE)
-    // Handle multiples of 16 bytes
-    while (bytes >= 16)
+        // Handle multiples of 16 bytes
+        while (bytes >= 16)
+        {
+            // x[i] = x[i] xor y[i]
+            _mm_storeu_si128(x16,
+                _mm_xor_si128(
+                    _mm_loadu_si128(x16),
+                    _mm_loadu_si128(y16)));
+
+            bytes -= 16, ++x16, ++y16;
+        }
+    }
+    else
     {
-        // x[i] = x[i] xor y[i]
-        _mm_storeu_si128(x16,
-            _mm_xor_si128(
-                _mm_loadu_si128(x16),
-                _mm_loadu_si128(y16)));
+        uint64_t * GF256_RESTRICT x8 = reinterpret_cast<uint64_t *>(x16);
+        const uint64_t * GF256_RESTRICT y8 = reinterpret_cast<const uint64_t *>(y16);
 
-        bytes -= 16, ++x16, ++y16;
+        const unsigned count = (unsigned)bytes / 8;
+        for (unsigned ii = 0; ii < count; ++ii)
+            x8[ii] ^= y8[ii];
+
+        x16 = reinterpret_cast<GF256_M128 *>(x8 + count);
+        y16 = reinterpret_cast<const GF256_M128 *>(y8 + count);
+
+        bytes -= (count * 8);
     }
-#endif
+#endif // GF256_TARGET_MOBILE
 
     uint8_t * GF256_RESTRICT x1 = reinterpret_cast<uint8_t *>(x16);
     const uint8_t * GF256_RESTRICT y1 = reinterpret_cast<const uint8_t *>(y16);
@@ -855,43 +1482,49 @@ extern "C" void gf256_add2_mem(void * GF256_RESTRICT vz, const void * GF256_REST
         bytes -= (count * 8);
     }
 #else // GF256_TARGET_MOBILE
-# if defined(GF256_TRY_AVX2)
     if (CpuHasAVX2)
     {
-        GF256_M256 * GF256_RESTRICT z32 = reinterpret_cast<GF256_M256 *>(z16);
-        const GF256_M256 * GF256_RESTRICT x32 = reinterpret_cast<const GF256_M256 *>(x16);
-        const GF256_M256 * GF256_RESTRICT y32 = reinterpret_cast<const GF256_M256 *>(y16);
+        int done = 0;
+# if defined(GF256_TRY_AVX512)
+        if (CpuHasAVX512)
+            done = gf256_add2_mem_avx512(z16, x16, y16, bytes);
+# endif // GF256_TRY_AVX512
+        done += gf256_add2_mem_avx2(z16 + done / 16, x16 + done / 16, y16 + done / 16, bytes - done);
+
+        bytes -= done, z16 += done / 16, x16 += done / 16, y16 += done / 16;
+    }
 
-        const unsigned count = bytes / 32;
-        for (unsigned i = 0; i < count; ++i)
+    if (CpuHasSSSE3)
+    {
+        // Handle multiples of 16 bytes
+        while (bytes >= 16)
         {
-            _mm256_storeu_si256(z32 + i,
-                _mm256_xor_si256(
-                    _mm256_loadu_si256(z32 + i),
-                    _mm256_xor_si256(
-                        _mm256_loadu_si256(x32 + i),
-                        _mm256_loadu_si256(y32 + i))));
-        }
+            // z[i] = z[i] xor x[i] xor y[i]
+            _mm_storeu_si128(z16,
+                _mm_xor_si128(
+                    _mm_loadu_si128(z16),
+                    _mm_xor_si128(
+                        _mm_loadu_si128(x16),
+                        _mm_loadu_si128(y16))));
 
-        bytes -= count * 32;
-        z16 = reinterpret_cast<GF256_M128 *>(z32 + count);
-        x16 = reinterpret_cast<const GF256_M128 *>(x32 + count);
-        y16 = reinterpret_cast<const GF256_M128 *>(y32 + count);
+            bytes -= 16, ++x16, ++y16, ++z16;
+        }
     }
-# endif // GF256_TRY_AVX2
-
-    // Handle multiples of 16 bytes
-    while (bytes >= 16)
+    else
     {
-        // z[i] = z[i] xor x[i] xor y[i]
-        _mm_storeu_si128(z16,
-            _mm_xor_si128(
-                _mm_loadu_si128(z16),
-                _mm_xor_si128(
-                    _mm_loadu_si128(x16),
-                    _mm_loadu_si128(y16))));
+        uint64_t * GF256_RESTRICT z8 = reinterpret_cast<uint64_t *>(z16);
+        const uint64_t * GF256_RESTRICT x8 = reinterpret_cast<const uint64_t *>(x16);
+        const uint64_t * GF256_RESTRICT y8 = reinterpret_cast<const uint64_t *>(y16);
 
-        bytes -= 16, ++x16, ++y16, ++z16;
+        const unsigned count = (unsigned)bytes / 8;
+        for (unsigned ii = 0; ii < count; ++ii)
+            z8[ii] ^= x8[ii] ^ y8[ii];
+
+        z16 = reinterpret_cast<GF256_M128 *>(z8 + count);
+        x16 = reinterpret_cast<const GF256_M128 *>(x8 + count);
+        y16 = reinterpret_cast<const GF256_M128 *>(y8 + count);
+
+        bytes -= (count * 8);
     }
 #endif // GF256_TARGET_MOBILE
 
@@ -992,29 +1625,18 @@ extern "C" void gf256_addset_mem(void * GF256_RESTRICT vz, const void * GF256_RE
         bytes -= (count * 8);
     }
 #else // GF256_TARGET_MOBILE
-# if defined(GF256_TRY_AVX2)
     if (CpuHasAVX2)
     {
-        GF256_M256 * GF256_RESTRICT z32 = reinterpret_cast<GF256_M256 *>(z16);
-        const GF256_M256 * GF256_RESTRICT x32 = reinterpret_cast<const GF256_M256 *>(x16);
-        const GF256_M256 * GF256_RESTRICT y32 = reinterpret_cast<const GF256_M256 *>(y16);
-
-        const unsigned count = bytes / 32;
-        for (unsigned i = 0; i < count; ++i)
-        {
-            _mm256_storeu_si256(z32 + i,
-                _mm256_xor_si256(
-                    _mm256_loadu_si256(x32 + i),
-                    _mm256_loadu_si256(y32 + i)));
-        }
-
-        bytes -= count * 32;
-        z16 = reinterpret_cast<GF256_M128 *>(z32 + count);
-        x16 = reinterpret_cast<const GF256_M128 *>(x32 + count);
-        y16 = reinterpret_cast<const GF256_M128 *>(y32 + count);
+        int done = 0;
+# if defined(GF256_TRY_AVX512)
+        if (CpuHasAVX512)
+            done = gf256_addset_mem_avx512(z16, x16, y16, bytes);
+# endif // GF256_TRY_AVX512
+        done += gf256_addset_mem_avx2(z16 + done / 16, x16 + done / 16, y16 + done / 16, bytes - done);
+
+        bytes -= done, z16 += done / 16, x16 += done / 16, y16 += done / 16;
     }
     else
-# endif // GF256_TRY_AVX2
     {
         // Handle multiples of 64 bytes
         while (bytes >= 64)
@@ -1129,61 +1751,32 @@ extern "C" void gf256_mul_mem(void * GF256_RESTRICT vz, const void * GF256_RESTR
     }
 #endif
 #else
-# if defined(GF256_TRY_AVX2)
     if (bytes >= 32 && CpuHasAVX2)
     {
-        // Partial product tables; see above
-        const GF256_M256 table_lo_y = _mm256_loadu_si256(GF256Ctx.MM256.TABLE_LO_Y + y);
-        const GF256_M256 table_hi_y = _mm256_loadu_si256(GF256Ctx.MM256.TABLE_HI_Y + y);
-
-        // clr_mask = 0x0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f
-        const GF256_M256 clr_mask = _mm256_set1_epi8(0x0f);
-
-        GF256_M256 * GF256_RESTRICT z32 = reinterpret_cast<GF256_M256 *>(vz);
-        const GF256_M256 * GF256_RESTRICT x32 = reinterpret_cast<const GF256_M256 *>(vx);
-
-        // Handle multiples of 32 bytes
-        do
+        int done = 0;
+# if defined(GF256_TRY_GFNI)
+        if (CpuHasGFNI)
         {
-            // See above comments for details
-            GF256_M256 x0 = _mm256_loadu_si256(x32);
-            GF256_M256 l0 = _mm256_and_si256(x0, clr_mask);
-            x0 = _mm256_srli_epi64(x0, 4);
-            GF256_M256 h0 = _mm256_and_si256(x0, clr_mask);
-            l0 = _mm256_shuffle_epi8(table_lo_y, l0);
-            h0 = _mm256_shuffle_epi8(table_hi_y, h0);
-            _mm256_storeu_si256(z32, _mm256_xor_si256(l0, h0));
-
-            bytes -= 32, ++x32, ++z32;
-        } while (bytes >= 32);
+            if (CpuHasAVX512)
+                done = gf256_mul_mem_gfni512(z16, x16, y, bytes);
+            done += gf256_mul_mem_gfni256(z16 + done / 16, x16 + done / 16, y, bytes - done);
+        }
+        else
+# endif // GF256_TRY_GFNI
+        {
+# if defined(GF256_TRY_AVX512)
+            if (CpuHasAVX512)
+                done = gf256_mul_mem_avx512(z16, x16, y, bytes);
+# endif // GF256_TRY_AVX512
+            done += gf256_mul_mem_avx2(z16 + done / 16, x16 + done / 16, y, bytes - done);
+        }
 
-        z16 = reinterpret_cast<GF256_M128 *>(z32);
-        x16 = reinterpret_cast<const GF256_M128 *>(x32);
+        bytes -= done, z16 += done / 16, x16 += done / 16;
     }
-# endif // GF256_TRY_AVX2
     if (bytes >= 16 && CpuHasSSSE3)
     {
-        // Partial product tables; see above
-        const GF256_M128 table_lo_y = _mm_loadu_si128(GF256Ctx.MM128.TABLE_LO_Y + y);
-        const GF256_M128 table_hi_y = _mm_loadu_si128(GF256Ctx.MM128.TABLE_HI_Y + y);
-
-        // clr_mask = 0x0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f
-        const GF256_M128 clr_mask = _mm_set1_epi8(0x0f);
-
-        // Handle multiples of 16 bytes
-        do
-        {
-            // See above comments for details
-            GF256_M128 x0 = _mm_loadu_si128(x16);
-            GF256_M128 l0 = _mm_and_si128(x0, clr_mask);
-            x0 = _mm_srli_epi64(x0, 4);
-            GF256_M128 h0 = _mm_and_si128(x0, clr_mask);
-            l0 = _mm_shuffle_epi8(table_lo_y, l0);
-            h0 = _mm_shuffle_epi8(table_hi_y, h0);
-            _mm_storeu_si128(z16, _mm_xor_si128(l0, h0));
-
-            bytes -= 16, ++x16, ++z16;
-        } while (bytes >= 16);
+        const int done = gf256_mul_mem_ssse3(z16, x16, y, bytes);
+        bytes -= done, z16 += done / 16, x16 += done / 16;
     }
 #endif
 
@@ -1277,124 +1870,32 @@ extern "C" void gf256_muladd_mem(void * GF256_RESTRICT vz, uint8_t y,
     }
 #endif
 #else // GF256_TARGET_MOBILE
-# if defined(GF256_TRY_AVX2)
     if (bytes >= 32 && CpuHasAVX2)
     {
-        // Partial product tables; see above
-        const GF256_M256 table_lo_y = _mm256_loadu_si256(GF256Ctx.MM256.TABLE_LO_Y + y);
-        const GF256_M256 table_hi_y = _mm256_loadu_si256(GF256Ctx.MM256.TABLE_HI_Y + y);
-
-        // clr_mask = 0x0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f
-        const GF256_M256 clr_mask = _mm256_set1_epi8(0x0f);
-
-        GF256_M256 * GF256_RESTRICT z32 = reinterpret_cast<GF256_M256 *>(z16);
-        const GF256_M256 * GF256_RESTRICT x32 = reinterpret_cast<const GF256_M256 *>(x16);
-
-        // On my Reed Solomon codec, the encoder unit test runs in 640 usec without and 550 usec with the optimization (86% of the original time)
-        const unsigned count = bytes / 64;
-        for (unsigned i = 0; i < count; ++i)
+        int done = 0;
+# if defined(GF256_TRY_GFNI)
+        if (CpuHasGFNI)
         {
-            // See above comments for details
-            GF256_M256 x0 = _mm256_loadu_si256(x32 + i * 2);
-            GF256_M256 l0 = _mm256_and_si256(x0, clr_mask);
-            x0 = _mm256_srli_epi64(x0, 4);
-            const GF256_M256 z0 = _mm256_loadu_si256(z32 + i * 2);
-            GF256_M256 h0 = _mm256_and_si256(x0, clr_mask);
-            l0 = _mm256_shuffle_epi8(table_lo_y, l0);
-            h0 = _mm256_shuffle_epi8(table_hi_y, h0);
-            const GF256_M256 p0 = _mm256_xor_si256(l0, h0);
-            _mm256_storeu_si256(z32 + i * 2, _mm256_xor_si256(p0, z0));
-
-            GF256_M256 x1 = _mm256_loadu_si256(x32 + i * 2 + 1);
-            GF256_M256 l1 = _mm256_and_si256(x1, clr_mask);
-            x1 = _mm256_srli_epi64(x1, 4);
-            const GF256_M256 z1 = _mm256_loadu_si256(z32 + i * 2 + 1);
-            GF256_M256 h1 = _mm256_and_si256(x1, clr_mask);
-            l1 = _mm256_shuffle_epi8(table_lo_y, l1);
-            h1 = _mm256_shuffle_epi8(table_hi_y, h1);
-            const GF256_M256 p1 = _mm256_xor_si256(l1, h1);
-            _mm256_storeu_si256(z32 + i * 2 + 1, _mm256_xor_si256(p1, z1));
+            if (CpuHasAVX512)
+                done = gf256_muladd_mem_gfni512(z16, y, x16, bytes);
+            done += gf256_muladd_mem_gfni256(z16 + done / 16, y, x16 + done / 16, bytes - done);
         }
-        bytes -= count * 64;
-        z32 += count * 2;
-        x32 += count * 2;
-
-        if (bytes >= 32)
+        else
+# endif // GF256_TRY_GFNI
         {
-            GF256_M256 x0 = _mm256_loadu_si256(x32);
-            GF256_M256 l0 = _mm256_and_si256(x0, clr_mask);
-            x0 = _mm256_srli_epi64(x0, 4);
-            GF256_M256 h0 = _mm256_and_si256(x0, clr_mask);
-            l0 = _mm256_shuffle_epi8(table_lo_y, l0);
-            h0 = _mm256_shuffle_epi8(table_hi_y, h0);
-            const GF256_M256 p0 = _mm256_xor_si256(l0, h0);
-            const GF256_M256 z0 = _mm256_loadu_si256(z32);
-            _mm256_storeu_si256(z32, _mm256_xor_si256(p0, z0));
-
-            bytes -= 32;
-            z32++;
-            x32++;
+# if defined(GF256_TRY_AVX512)
+            if (CpuHasAVX512)
+                done = gf256_muladd_mem_avx512(z16, y, x16, bytes);
+# endif // GF256_TRY_AVX512
+            done += gf256_muladd_mem_avx2(z16 + done / 16, y, x16 + done / 16, bytes - done);
         }
 
-        z16 = reinterpret_cast<GF256_M128 *>(z32);
-        x16 = reinterpret_cast<const GF256_M128 *>(x32);
+        bytes -= done, z16 += done / 16, x16 += done / 16;
     }
-# endif // GF256_TRY_AVX2
     if (bytes >= 16 && CpuHasSSSE3)
     {
-        // Partial product tables; see above
-        const GF256_M128 table_lo_y = _mm_loadu_si128(GF256Ctx.MM128.TABLE_LO_Y + y);
-        const GF256_M128 table_hi_y = _mm_loadu_si128(GF256Ctx.MM128.TABLE_HI_Y + y);
-
-        // clr_mask = 0x0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f0f
-        const GF256_M128 clr_mask = _mm_set1_epi8(0x0f);
-
-        // This unroll seems to provide about 7% speed boost when AVX2 is disabled
-        while (bytes >= 32)
-        {
-            bytes -= 32;
-
-            GF256_M128 x1 = _mm_loadu_si128(x16 + 1);
-            GF256_M128 l1 = _mm_and_si128(x1, clr_mask);
-            x1 = _mm_srli_epi64(x1, 4);
-            GF256_M128 h1 = _mm_and_si128(x1, clr_mask);
-            l1 = _mm_shuffle_epi8(table_lo_y, l1);
-            h1 = _mm_shuffle_epi8(table_hi_y, h1);
-            const GF256_M128 z1 = _mm_loadu_si128(z16 + 1);
-
-            GF256_M128 x0 = _mm_loadu_si128(x16);
-            GF256_M128 l0 = _mm_and_si128(x0, clr_mask);
-            x0 = _mm_srli_epi64(x0, 4);
-            GF256_M128 h0 = _mm_and_si128(x0, clr_mask);
-            l0 = _mm_shuffle_epi8(table_lo_y, l0);
-            h0 = _mm_shuffle_epi8(table_hi_y, h0);
-            const GF256_M128 z0 = _mm_loadu_si128(z16);
-
-            const GF256_M128 p1 = _mm_xor_si128(l1, h1);
-            _mm_storeu_si128(z16 + 1, _mm_xor_si128(p1, z1));
-
-            const GF256_M128 p0 = _mm_xor_si128(l0, h0);
-            _mm_storeu_si128(z16, _mm_xor_si128(p0, z0));
-
-            x16 += 2, z16 += 2;
-        }
-
-        // Handle multiples of 16 bytes
-        while (bytes >= 16)
-        {
-            // See above comments for details
-            GF256_M128 x0 = _mm_loadu_si128(x16);
-            GF256_M128 l0 = _mm_and_si128(x0, clr_mask);
-            x0 = _mm_srli_epi64(x0, 4);
-            GF256_M128 h0 = _mm_and_si128(x0, clr_mask);
-            l0 = _mm_shuffle_epi8(table_lo_y, l0);
-            h0 = _mm_shuffle_epi8(table_hi_y, h0);
-            const GF256_M128 p0 = _mm_xor_si128(l0, h0);
-            const GF256_M128 z0 = _mm_loadu_si128(z16);
-            _mm_storeu_si128(z16, _mm_xor_si128(p0, z0));
-
-            bytes -= 16, ++x16, ++z16;
-        }
+        const int done = gf256_muladd_mem_ssse3(z16, y, x16, bytes);
+        bytes -= done, z16 += done / 16, x16 += done / 16;
     }
 #endif // GF256_TARGET_MOBILE
 
@@ -57,13 +57,22 @@
     #define GF256_TARGET_MOBILE
 #endif // ANDROID
 
-#if defined(__AVX2__) || (defined (_MSC_VER) && _MSC_VER >= 1900)
+#if !defined(GF256_TARGET_MOBILE)
+    // Wider instruction sets are picked at runtime, whatever the compiler targets
     #define GF256_TRY_AVX2 /* 256-bit */
     #include <immintrin.h>
     #define GF256_ALIGN_BYTES 32
-#else // __AVX2__
+
+    // Compilers that know the AVX-512 and GFNI intrinsics
+    #if (defined(__clang__) && __clang_major__ >= 7) || \
+        (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 8) || \
+        (defined(_MSC_VER) && _MSC_VER >= 1920)
+        #define GF256_TRY_AVX512 /* 512-bit */
+        #define GF256_TRY_GFNI
+    #endif
+#else // GF256_TARGET_MOBILE
     #define GF256_ALIGN_BYTES 16
-#endif // __AVX2__
+#endif // GF256_TARGET_MOBILE
 
 #if !defined(GF256_TARGET_MOBILE)
     // Note: MSVC currently only supports SSSE3 but not AVX2
@@ -99,6 +108,11 @@
     #define GF256_M256 __m256i
 #endif
 
+#ifdef GF256_TRY_AVX512
+    // Compiler-specific 512-bit SIMD register keyword
+    #define GF256_M512 __m512i
+#endif
+
 // Compiler-specific C++11 restrict keyword
 #define GF256_RESTRICT __restrict
 
@@ -154,6 +168,11 @@ struct gf256_ctx
         GF256_ALIGNED GF256_M256 TABLE_HI_Y[256];
     } MM256;
 #endif // GF256_TRY_AVX2
+#ifdef GF256_TRY_GFNI
+    /// Bit matrix for GF2P8AFFINEQB that multiplies by y.  GF2P8MULB cannot
+    /// be used because it is fixed to a different polynomial
+    uint64_t GF256_AFFINE_TABLE[256];
+#endif // GF256_TRY_GFNI
 
     /// Mul/Div/Inv/Sqr tables
     uint8_t GF256_MUL_TABLE[256 * 256];
@@ -201,6 +220,37 @@ extern int gf256_init_(int version);
 #define gf256_init() gf256_init_(GF256_VERSION)
 
 
+//------------------------------------------------------------------------------
+// Instruction Sets
+
+/// Instruction sets used by the bulk memory operations, slowest first
+enum gf256_isa_t
+{
+    GF256_ISA_SCALAR = 0, ///< 64-bit words and table lookups
+    GF256_ISA_SSSE3  = 1, ///< 128-bit pshufb table lookups
+    GF256_ISA_AVX2   = 2, ///< 256-bit vpshufb table lookups
+    GF256_ISA_AVX512 = 3, ///< 512-bit vpshufb table lookups (AVX-512BW)
+    GF256_ISA_GFNI   = 4, ///< vgf2p8affineqb, 512-bit with AVX-512BW or else 256-bit
+    GF256_ISA_NEON   = 5  ///< 128-bit vtbl table lookups on ARM
+};
+
+/**
+    On x86 the fastest instruction set the CPU supports is picked during
+    gf256_init(), whatever the compiler was told to target.
+
+    gf256_set_isa() uses at most the given instruction set from then on.
+    This is for benchmarks, and for CPUs that slow their clock down to run
+    512-bit instructions.  It returns the instruction set now in use.
+    It must not be called while other threads are using the library.
+    On ARM it has no effect.
+*/
+extern int gf256_get_isa(void);
+extern int gf256_set_isa(int isa);
+
+/// Returns a name like "AVX2" for logging
+extern const char* gf256_isa_name(int isa);
+
+
 //------------------------------------------------------------------------------
 // Math Operations
 
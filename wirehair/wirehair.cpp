@@ -88,6 +88,17 @@ WIREHAIR_EXPORT WirehairCodec wirehair_encoder_create(
     uint64_t  messageBytes, ///< Bytes in the message
     uint32_t    blockBytes  ///< Bytes in an output block
 )
+{
+    return wirehair_encoder_create_threads(reuseOpt, message, messageBytes, blockBytes, 1);
+}
+
+WIREHAIR_EXPORT WirehairCodec wirehair_encoder_create_threads(
+    WirehairCodec reuseOpt, ///< [Optional] Pointer to prior codec object
+    const void*    message, ///< Pointer to message
+    uint64_t  messageBytes, ///< Bytes in the message
+    uint32_t    blockBytes, ///< Bytes in an output block
+    unsigned   threadCount  ///< Number of threads to solve with
+)
 {
     // If input is invalid:
     if (!m_init || !message || messageBytes < 1 || blockBytes < 1) {
@@ -101,6 +112,8 @@ WIREHAIR_EXPORT WirehairCodec wirehair_encoder_create(
         codec = new (std::nothrow) wirehair::Codec;
     }
 
+    codec->SetSolveThreads(threadCount);
+
     // Initialize codec
     WirehairResult result = codec->InitializeEncoder(messageBytes, blockBytes);
 
@@ -145,11 +158,38 @@ WIREHAIR_EXPORT WirehairResult wirehair_encode(
     return Wirehair_Success;
 }
 
+WIREHAIR_EXPORT WirehairResult wirehair_encode_batch(
+    WirehairCodec    codec, ///< Pointer to codec from wirehair_encoder_init()
+    unsigned       firstId, ///< Identifier of the first block to generate
+    unsigned         count, ///< Number of blocks to generate
+    void*        blocksOut, ///< Pointer to output for the first block
+    size_t          stride  ///< Bytes between output blocks
+)
+{
+    if (!codec || !blocksOut) {
+        return Wirehair_InvalidInput;
+    }
+
+    wirehair::Codec* session = reinterpret_cast<wirehair::Codec*>(codec);
+
+    return session->EncodeBatch(firstId, count, reinterpret_cast<uint8_t*>(blocksOut), stride);
+}
+
 WIREHAIR_EXPORT WirehairCodec wirehair_decoder_create(
     WirehairCodec reuseOpt, ///< Codec object to reuse
     uint64_t  messageBytes, ///< Bytes in the message to decode
     uint32_t    blockBytes  ///< Bytes in each encoded block
 )
+{
+    return wirehair_decoder_create_threads(reuseOpt, messageBytes, blockBytes, 1);
+}
+
+WIREHAIR_EXPORT WirehairCodec wirehair_decoder_create_threads(
+    WirehairCodec reuseOpt, ///< Codec object to reuse
+    uint64_t  messageBytes, ///< Bytes in the message to decode
+    uint32_t    blockBytes, ///< Bytes in each encoded block
+    unsigned   threadCount  ///< Number of threads to solve with
+)
 {
     // If input is invalid:
     if (messageBytes < 1 || blockBytes < 1) {
@@ -163,6 +203,8 @@ WIREHAIR_EXPORT WirehairCodec wirehair_decoder_create(
         codec = new (std::nothrow) wirehair::Codec;
     }
 
+    codec->SetSolveThreads(threadCount);
+
     // Allocate memory for decoding
     WirehairResult result = codec->InitializeDecoder(messageBytes, blockBytes);
 
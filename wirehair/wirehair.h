@@ -65,6 +65,7 @@
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
 
 
 #ifdef __cplusplus
@@ -178,6 +179,26 @@ WIREHAIR_EXPORT WirehairCodec wirehair_encoder_create(
     uint32_t    blockBytes  ///< Bytes in an output block
 );
 
+/**
+    wirehair_encoder_create_threads()
+
+    Same as wirehair_encoder_create(), but solves the block values with
+    up to `threadCount` threads.  Each thread works on its own slice of
+    the bytes in every block, so blocks of at least 64 bytes per thread
+    are needed to use them all.  Small messages are solved on the calling
+    thread, where starting threads would cost more than they save.
+
+    Returns a non-zero object pointer on success.
+    Returns nullptr(0) on failure.
+*/
+WIREHAIR_EXPORT WirehairCodec wirehair_encoder_create_threads(
+    WirehairCodec reuseOpt, ///< [Optional] Pointer to prior codec object
+    const void*    message, ///< Pointer to message
+    uint64_t  messageBytes, ///< Bytes in the message
+    uint32_t    blockBytes, ///< Bytes in an output block
+    unsigned   threadCount  ///< Number of threads to solve with
+);
+
 /**
     wirehair_encode()
 
@@ -202,6 +223,31 @@ WIREHAIR_EXPORT WirehairResult wirehair_encode(
     uint32_t* dataBytesOut  ///< Number of bytes written <= blockBytes
 );
 
+/**
+    wirehair_encode_batch()
+
+    Write `count` error correction blocks with consecutive identifiers
+    starting at `firstId`, as if wirehair_encode() were called for each.
+    Block i is written to blocksOut + i * stride.  Every block is
+    `blockBytes` long: The last block of the message is padded with zeros.
+
+    This is faster than calling wirehair_encode() for each block when
+    generating many blocks at once, for example to fill a carousel.
+
+    Preconditions:
+       `stride` >= `blockBytes`
+
+    Returns Wirehair_Success on success.
+    Returns other codes on error.
+*/
+WIREHAIR_EXPORT WirehairResult wirehair_encode_batch(
+    WirehairCodec    codec, ///< Pointer to codec from wirehair_encoder_init()
+    unsigned       firstId, ///< Identifier of the first block to generate
+    unsigned         count, ///< Number of blocks to generate
+    void*        blocksOut, ///< Pointer to output for the first block
+    size_t          stride  ///< Bytes between output blocks
+);
+
 /**
     wirehair_decoder_create()
 
@@ -220,6 +266,23 @@ WIREHAIR_EXPORT WirehairCodec wirehair_decoder_create(
     uint32_t    blockBytes  ///< Bytes in each encoded block
 );
 
+/**
+    wirehair_decoder_create_threads()
+
+    Same as wirehair_decoder_create(), but the wirehair_decode() call
+    that completes the message solves the block values with up to
+    `threadCount` threads, as in wirehair_encoder_create_threads().
+
+    Returns a non-zero object pointer on success.
+    Returns nullptr(0) on failure.
+*/
+WIREHAIR_EXPORT WirehairCodec wirehair_decoder_create_threads(
+    WirehairCodec reuseOpt, ///< Codec object to reuse
+    uint64_t  messageBytes, ///< Bytes in the message to decode
+    uint32_t    blockBytes, ///< Bytes in each encoded block
+    unsigned   threadCount  ///< Number of threads to solve with
+);
+
 /**
     wirehair_decode()
 